@@ -20,7 +20,7 @@
 #include <asoundlib.h>
 #include "../general.h"
 #include "../thread.h"
-#include "../fifo_buffer.h"
+#include "../spsc_buffer.h"
 
 #define TRY_ALSA(x) if (x < 0) { \
                   goto error; \
@@ -37,11 +37,14 @@ typedef struct alsa
    size_t period_size;
    snd_pcm_uframes_t period_frames;
 
-   fifo_buffer_t *buffer;
+   // The main thread writes, the worker thread reads, so this needs no lock.
+   // cond is only used to wake up a blocking writer when the buffer was full.
+   // The writer sets writer_waiting before it blocks, and the worker only takes cond_lock when it is set.
+   spsc_buffer_t *buffer;
    sthread_t *worker_thread;
-   slock_t *fifo_lock;
    scond_t *cond;
    slock_t *cond_lock;
+   volatile bool writer_waiting;
 } alsa_t;
 
 static void alsa_worker_thread(void *data)
@@ -57,12 +60,20 @@ static void alsa_worker_thread(void *data)
 
    while (!alsa->thread_dead)
    {
-      slock_lock(alsa->fifo_lock);
-      size_t avail = fifo_read_avail(alsa->buffer);
+      size_t avail = spsc_read_avail(alsa->buffer);
       size_t fifo_size = min(alsa->period_size, avail);
-      fifo_read(alsa->buffer, buf, fifo_size);
-      scond_signal(alsa->cond);
-      slock_unlock(alsa->fifo_lock);
+      spsc_read(alsa->buffer, buf, fifo_size);
+
+      // Pairs with the barrier in alsa_write(). Either the writer sees the space we just freed,
+      // or we see its flag. Holding cond_lock, it can only be between the flag and its wait,
+      // so taking the lock makes sure it is already waiting when we signal.
+      __sync_synchronize();
+      if (alsa->writer_waiting)
+      {
+         slock_lock(alsa->cond_lock);
+         scond_signal(alsa->cond);
+         slock_unlock(alsa->cond_lock);
+      }
 
       // If underrun, fill rest with silence.
       memset(buf + fifo_size, 0, alsa->period_size - fifo_size);
@@ -124,11 +135,9 @@ static void alsa_free(void *data)
          sthread_join(alsa->worker_thread);
       }
       if (alsa->buffer)
-         fifo_free(alsa->buffer);
+         spsc_free(alsa->buffer);
       if (alsa->cond)
          scond_free(alsa->cond);
-      if (alsa->fifo_lock)
-         slock_free(alsa->fifo_lock);
       if (alsa->cond_lock)
          slock_free(alsa->cond_lock);
       if (alsa->pcm)
@@ -192,11 +201,10 @@ static void *alsa_init(const char *device, unsigned rate, unsigned latency)
    snd_pcm_hw_params_free(params);
    snd_pcm_sw_params_free(sw_params);
 
-   alsa->fifo_lock = slock_new();
    alsa->cond_lock = slock_new();
    alsa->cond = scond_new();
-   alsa->buffer = fifo_new(alsa->buffer_size);
-   if (!alsa->fifo_lock || !alsa->cond_lock || !alsa->cond || !alsa->buffer)
+   alsa->buffer = spsc_new(alsa->buffer_size);
+   if (!alsa->cond_lock || !alsa->cond || !alsa->buffer)
       goto error;
 
    alsa->worker_thread = sthread_create(alsa_worker_thread, alsa);
@@ -230,11 +238,9 @@ static ssize_t alsa_write(void *data, const void *buf, size_t size)
 
    if (alsa->nonblock)
    {
-      slock_lock(alsa->fifo_lock);
-      size_t avail = fifo_write_avail(alsa->buffer);
+      size_t avail = spsc_write_avail(alsa->buffer);
       size_t write_amt = min(avail, size);
-      fifo_write(alsa->buffer, buf, write_amt);
-      slock_unlock(alsa->fifo_lock);
+      spsc_write(alsa->buffer, buf, write_amt);
       return write_amt;
    }
    else
@@ -242,22 +248,22 @@ static ssize_t alsa_write(void *data, const void *buf, size_t size)
       size_t written = 0;
       while (written < size && !alsa->thread_dead)
       {
-         slock_lock(alsa->fifo_lock);
-         size_t avail = fifo_write_avail(alsa->buffer);
+         size_t avail = spsc_write_avail(alsa->buffer);
 
          if (avail == 0)
          {
-            slock_unlock(alsa->fifo_lock);
             slock_lock(alsa->cond_lock);
-            if (!alsa->thread_dead)
+            alsa->writer_waiting = true;
+            __sync_synchronize(); // The worker has to see the flag, or we have to see the space it freed.
+            if (!alsa->thread_dead && spsc_write_avail(alsa->buffer) == 0)
                scond_wait(alsa->cond, alsa->cond_lock);
+            alsa->writer_waiting = false;
             slock_unlock(alsa->cond_lock);
          }
          else
          {
             size_t write_amt = min(size - written, avail);
-            fifo_write(alsa->buffer, (const char*)buf + written, write_amt);
-            slock_unlock(alsa->fifo_lock);
+            spsc_write(alsa->buffer, (const char*)buf + written, write_amt);
             written += write_amt;
          }
       }
@@ -289,10 +295,7 @@ static size_t alsa_write_avail(void *data)
 
    if (alsa->thread_dead)
       return 0;
-   slock_lock(alsa->fifo_lock);
-   size_t val = fifo_write_avail(alsa->buffer);
-   slock_unlock(alsa->fifo_lock);
-   return val;
+   return spsc_write_avail(alsa->buffer);
 }
 
 static size_t alsa_buffer_size(void *data)
@@ -0,0 +1,190 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Audio callbacks for the core, and pushing what they collect through DSP, resampling and out to the driver.
+
+#include "flush.h"
+#include "utils.h"
+#include "../general.h"
+#include "../driver.h"
+#include "../performance.h"
+#ifdef HAVE_FFMPEG
+#include "../record/ffemu.h"
+#endif
+
+static void readjust_audio_input_rate(void)
+{
+   int avail = audio_write_avail_func();
+   //RARCH_LOG_OUTPUT("Audio buffer is %u%% full\n",
+   //      (unsigned)(100 - (avail * 100) / g_extern.audio_data.driver_buffer_size));
+
+   unsigned write_index = g_extern.measure_data.buffer_free_samples_count++ & (AUDIO_BUFFER_FREE_SAMPLES_COUNT - 1);
+   g_extern.measure_data.buffer_free_samples[write_index] = avail;
+
+   double adjust = rate_control_update(g_extern.audio_data.rate_controller, avail, g_settings.audio.rate_control_delta);
+
+   g_extern.audio_data.src_ratio = g_extern.audio_data.orig_src_ratio * adjust;
+
+   //RARCH_LOG_OUTPUT("New rate: %lf, Orig rate: %lf\n",
+   //      g_extern.audio_data.src_ratio, g_extern.audio_data.orig_src_ratio);
+}
+
+bool audio_flush(const int16_t *data, size_t samples)
+{
+#ifdef HAVE_FFMPEG
+   if (g_extern.recording)
+   {
+      struct ffemu_audio_data ffemu_data = {0};
+      ffemu_data.data                    = data;
+      ffemu_data.frames                  = samples / 2;
+
+      ffemu_push_audio(g_extern.rec, &ffemu_data);
+   }
+#endif
+
+   if (g_extern.is_paused || g_extern.audio_data.mute)
+      return true;
+   if (!g_extern.audio_active)
+      return false;
+
+   if (g_extern.audio_data.rate_control)
+      readjust_audio_input_rate();
+
+   double ratio = g_extern.audio_data.src_ratio;
+   if (g_extern.is_slowmotion)
+      ratio *= g_settings.slowmotion_ratio;
+
+   RARCH_PERFORMANCE_INIT(audio_flush);
+   RARCH_PERFORMANCE_START(audio_flush);
+
+   // Run the chunk through conversion, DSP, resampling and conversion back to s16 one tile at a time.
+   // Every stage then works on data the previous one just left in cache,
+   // instead of streaming the whole chunk through memory once per stage.
+   // In float mode, the resampler writes straight into outsamples.
+   // Otherwise, each tile is resampled to the head of outsamples, which stays hot, and converted behind the previous tile.
+   bool use_float         = g_extern.audio_data.use_float;
+   size_t output_frames   = 0;
+
+   for (size_t offset = 0; offset < samples; offset += AUDIO_TILE_FRAMES * 2)
+   {
+      size_t tile_samples = samples - offset;
+      if (tile_samples > AUDIO_TILE_FRAMES * 2)
+         tile_samples = AUDIO_TILE_FRAMES * 2;
+
+      struct resampler_data src_data = {0};
+      RARCH_PERFORMANCE_INIT(audio_convert_s16);
+      RARCH_PERFORMANCE_START(audio_convert_s16);
+      audio_convert_s16_to_float(g_extern.audio_data.data, data + offset, tile_samples,
+            g_extern.audio_data.volume_gain);
+      RARCH_PERFORMANCE_STOP(audio_convert_s16);
+
+#if defined(HAVE_DYLIB)
+      rarch_dsp_output_t dsp_output = {0};
+      rarch_dsp_input_t dsp_input   = {0};
+      dsp_input.samples             = g_extern.audio_data.data;
+      dsp_input.frames              = tile_samples >> 1;
+
+      if (g_extern.audio_data.dsp_plugin)
+         g_extern.audio_data.dsp_plugin->process(g_extern.audio_data.dsp_handle, &dsp_output, &dsp_input);
+
+      src_data.data_in      = dsp_output.samples ? dsp_output.samples : g_extern.audio_data.data;
+      src_data.input_frames = dsp_output.samples ? dsp_output.frames : (tile_samples >> 1);
+#else
+      src_data.data_in      = g_extern.audio_data.data;
+      src_data.input_frames = tile_samples >> 1;
+#endif
+
+      src_data.data_out = g_extern.audio_data.outsamples;
+      if (use_float)
+         src_data.data_out += output_frames * 2;
+      src_data.ratio    = ratio;
+
+      RARCH_PERFORMANCE_INIT(resampler_proc);
+      RARCH_PERFORMANCE_START(resampler_proc);
+      rarch_resampler_process(g_extern.audio_data.resampler,
+            g_extern.audio_data.resampler_data, &src_data);
+      RARCH_PERFORMANCE_STOP(resampler_proc);
+
+      if (!use_float)
+      {
+         RARCH_PERFORMANCE_INIT(audio_convert_float);
+         RARCH_PERFORMANCE_START(audio_convert_float);
+         audio_convert_float_to_s16(g_extern.audio_data.conv_outsamples + output_frames * 2,
+               g_extern.audio_data.outsamples, src_data.output_frames * 2);
+         RARCH_PERFORMANCE_STOP(audio_convert_float);
+      }
+
+      output_frames += src_data.output_frames;
+   }
+
+   RARCH_PERFORMANCE_STOP(audio_flush);
+
+   if (use_float)
+   {
+      if (audio_write_func(g_extern.audio_data.outsamples, output_frames * sizeof(float) * 2) < 0)
+      {
+         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
+         return false;
+      }
+   }
+   else
+   {
+      if (audio_write_func(g_extern.audio_data.conv_outsamples, output_frames * sizeof(int16_t) * 2) < 0)
+      {
+         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
+         return false;
+      }
+   }
+
+   return true;
+}
+
+void audio_sample_rewind(int16_t left, int16_t right)
+{
+   g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] = right;
+   g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] = left;
+}
+
+size_t audio_sample_batch_rewind(const int16_t *data, size_t frames)
+{
+   size_t samples = frames << 1;
+   for (size_t i = 0; i < samples; i++)
+      g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] = data[i];
+
+   return frames;
+}
+
+void audio_sample(int16_t left, int16_t right)
+{
+   g_extern.audio_data.sample_buf[g_extern.audio_data.data_ptr++] = left;
+   g_extern.audio_data.sample_buf[g_extern.audio_data.data_ptr++] = right;
+
+   if (g_extern.audio_data.data_ptr < g_extern.audio_data.chunk_size)
+      return;
+
+   g_extern.audio_active = audio_flush(g_extern.audio_data.sample_buf,
+         g_extern.audio_data.data_ptr) && g_extern.audio_active;
+
+   g_extern.audio_data.data_ptr = 0;
+}
+
+size_t audio_sample_batch(const int16_t *data, size_t frames)
+{
+   if (frames > (AUDIO_CHUNK_SIZE_NONBLOCKING >> 1))
+      frames = AUDIO_CHUNK_SIZE_NONBLOCKING >> 1;
+
+   g_extern.audio_active = audio_flush(data, frames << 1) && g_extern.audio_active;
+   return frames;
+}
@@ -0,0 +1,35 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_AUDIO_FLUSH_H
+#define __RARCH_AUDIO_FLUSH_H
+
+#include "../boolean.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Converts, resamples and writes interleaved stereo samples to the audio driver.
+// Also records them if recording. Returns false if the driver failed, and audio should be disabled.
+bool audio_flush(const int16_t *data, size_t samples);
+
+// libretro audio callbacks. The single sample one collects a chunk in audio_data.sample_buf before flushing.
+void audio_sample(int16_t left, int16_t right);
+size_t audio_sample_batch(const int16_t *data, size_t frames);
+
+// Used while rewinding. Samples are collected backwards in audio_data.rewind_buf, to be flushed in one go.
+void audio_sample_rewind(int16_t left, int16_t right);
+size_t audio_sample_batch_rewind(const int16_t *data, size_t frames);
+
+#endif
@@ -0,0 +1,175 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rate_control.h"
+#include "../boolean.h"
+#include <stdlib.h>
+#include <math.h>
+
+// All control math works on the normalized error: (write_avail - half) / half, in [-1, 1].
+// Positive means the buffer is emptier than we want.
+
+// How fast the fill level itself is expected to drift between updates. Lower trusts the filtered estimate more.
+#define RATE_CONTROL_PROCESS_NOISE 0.0005
+
+// Smoothing factor for the running estimate of measurement noise.
+#define RATE_CONTROL_NOISE_ALPHA 0.02
+
+// Floor for the measurement noise estimate, so a driver reporting the exact same value for a while
+// doesn't make the filter follow the next report blindly.
+#define RATE_CONTROL_MIN_NOISE 0.0001
+
+// Reports coarser than this fraction of the buffer are treated as quantized.
+#define RATE_CONTROL_COARSE_FRACTION 64
+
+// Number of updates the integral term takes to reach full effect on a constant error.
+#define RATE_CONTROL_INTEGRAL_TIME 512.0
+
+struct rate_control
+{
+   size_t buffer_size;
+   double bytes_per_sec;
+
+   // Kalman filter state.
+   double estimate;
+   double estimate_var;
+   double noise_var;
+
+   double integral;
+
+   // Greatest common divisor of every report so far. For drivers which only report whole periods,
+   // this converges on the period size.
+   size_t granularity;
+
+   bool was_empty;
+
+   uint64_t updates;
+   uint64_t underruns;
+   double fill_accum;
+   double fill_sqr_accum;
+};
+
+rate_control_t *rate_control_new(size_t buffer_size, double bytes_per_sec)
+{
+   if (!buffer_size)
+      return NULL;
+
+   rate_control_t *rc = (rate_control_t*)calloc(1, sizeof(*rc));
+   if (!rc)
+      return NULL;
+
+   rc->buffer_size   = buffer_size;
+   rc->bytes_per_sec = bytes_per_sec;
+   rc->estimate_var  = 1.0;
+   rc->noise_var     = RATE_CONTROL_MIN_NOISE;
+   return rc;
+}
+
+void rate_control_free(rate_control_t *rc)
+{
+   free(rc);
+}
+
+static size_t gcd(size_t a, size_t b)
+{
+   while (b)
+   {
+      size_t tmp = a % b;
+      a = b;
+      b = tmp;
+   }
+   return a;
+}
+
+double rate_control_update(rate_control_t *rc, size_t write_avail, double max_delta)
+{
+   if (write_avail > rc->buffer_size)
+      write_avail = rc->buffer_size;
+
+   bool empty = write_avail == rc->buffer_size;
+   if (empty && !rc->was_empty)
+      rc->underruns++;
+   rc->was_empty = empty;
+
+   // A driver reporting in whole periods rounds down free space, which would bias the controller towards
+   // an emptier buffer. Assume the real value is in the middle of the period instead.
+   double avail = write_avail;
+   if (write_avail)
+      rc->granularity = gcd(rc->granularity, write_avail);
+   if (rc->granularity * RATE_CONTROL_COARSE_FRACTION > rc->buffer_size)
+   {
+      avail += rc->granularity / 2.0;
+      if (avail > rc->buffer_size)
+         avail = rc->buffer_size;
+   }
+
+   // Telemetry, on the corrected value so mean fill and latency aren't off by half a period on coarse drivers.
+   double fill = 1.0 - avail / rc->buffer_size;
+   rc->updates++;
+   rc->fill_accum += fill;
+   rc->fill_sqr_accum += fill * fill;
+
+   double half = rc->buffer_size / 2.0;
+   double error = (avail - half) / half;
+
+   // Predict. The fill level is assumed to stay put, but gets less certain.
+   rc->estimate_var += RATE_CONTROL_PROCESS_NOISE;
+
+   // Update, and learn how noisy the reports are from how far off our prediction was.
+   double innovation = error - rc->estimate;
+   double innovation_var = innovation * innovation - rc->estimate_var;
+   rc->noise_var += RATE_CONTROL_NOISE_ALPHA * (innovation_var - rc->noise_var);
+   if (rc->noise_var < RATE_CONTROL_MIN_NOISE)
+      rc->noise_var = RATE_CONTROL_MIN_NOISE;
+
+   double gain = rc->estimate_var / (rc->estimate_var + rc->noise_var);
+   rc->estimate += gain * innovation;
+   rc->estimate_var *= 1.0 - gain;
+
+   // PI control, with the integral clamped so it can't wind up past what max_delta allows anyway.
+   rc->integral += rc->estimate / RATE_CONTROL_INTEGRAL_TIME;
+   if (rc->integral > 1.0)
+      rc->integral = 1.0;
+   else if (rc->integral < -1.0)
+      rc->integral = -1.0;
+
+   double control = rc->estimate + rc->integral;
+   if (control > 1.0)
+      control = 1.0;
+   else if (control < -1.0)
+      control = -1.0;
+
+   return 1.0 + max_delta * control;
+}
+
+void rate_control_get_stats(const rate_control_t *rc, struct rate_control_stats *stats)
+{
+   stats->updates = rc->updates;
+   stats->underruns = rc->underruns;
+   stats->mean_fill = 0.0;
+   stats->fill_deviation = 0.0;
+   stats->mean_latency_ms = 0.0;
+
+   if (!rc->updates)
+      return;
+
+   stats->mean_fill = rc->fill_accum / rc->updates;
+   double var = rc->fill_sqr_accum / rc->updates - stats->mean_fill * stats->mean_fill;
+   stats->fill_deviation = var > 0.0 ? sqrt(var) : 0.0;
+
+   if (rc->bytes_per_sec > 0.0)
+      stats->mean_latency_ms = 1000.0 * stats->mean_fill * rc->buffer_size / rc->bytes_per_sec;
+}
+
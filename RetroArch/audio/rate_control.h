@@ -0,0 +1,51 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_RATE_CONTROL_H
+#define __RARCH_RATE_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Dynamic rate control.
+// Keeps the audio driver buffer half full by nudging the resampling ratio.
+// Buffer fill reports are run through a scalar Kalman filter which estimates the measurement noise as it goes,
+// so drivers which only report in whole periods get smoothed harder than precise ones.
+// A PI controller on top of the filtered fill removes the steady-state offset a pure proportional controller has
+// when the real input and output rates differ.
+
+typedef struct rate_control rate_control_t;
+
+struct rate_control_stats
+{
+   uint64_t updates;
+   uint64_t underruns; // Times the buffer was observed to run dry.
+   double mean_fill; // 0.0 (empty) to 1.0 (full).
+   double fill_deviation; // Standard deviation of fill.
+   double mean_latency_ms; // Estimated from the fill level.
+};
+
+// buffer_size and write_avail are in bytes. bytes_per_sec is the output rate of the audio driver.
+rate_control_t *rate_control_new(size_t buffer_size, double bytes_per_sec);
+void rate_control_free(rate_control_t *rc);
+
+// Feeds in a new write_avail from the driver. Returns the factor to apply to the resampling ratio,
+// which is within 1.0 +/- max_delta.
+double rate_control_update(rate_control_t *rc, size_t write_avail, double max_delta);
+
+void rate_control_get_stats(const rate_control_t *rc, struct rate_control_stats *stats);
+
+#endif
+
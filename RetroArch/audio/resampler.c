@@ -22,13 +22,14 @@
 
 #include "../general.h"
 
-bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident, double bw_ratio)
+bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident,
+      enum resampler_quality quality, double bw_ratio)
 {
    if (*re && *backend)
       (*backend)->free(*re);
 
    *backend = &sinc_resampler;
-   *re = (*backend)->init(bw_ratio);
+   *re = (*backend)->init(bw_ratio, quality);
 
    if (!*re)
    {
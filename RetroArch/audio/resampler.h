@@ -42,9 +42,21 @@ struct resampler_data
    double ratio;
 };
 
+// Backends which have no notion of quality ignore it.
+// DONTCARE lets the backend pick its compile-time default.
+enum resampler_quality
+{
+   RESAMPLER_QUALITY_DONTCARE = 0,
+   RESAMPLER_QUALITY_LOWEST,
+   RESAMPLER_QUALITY_LOWER,
+   RESAMPLER_QUALITY_NORMAL,
+   RESAMPLER_QUALITY_HIGHER,
+   RESAMPLER_QUALITY_HIGHEST
+};
+
 typedef struct rarch_resampler
 {
-   void *(*init)(double bandwidth_mod); // Bandwidth factor. Will be < 1.0 for downsampling, > 1.0 for upsamling. Corresponds to expected resampling ratio.
+   void *(*init)(double bandwidth_mod, enum resampler_quality quality); // Bandwidth factor. Will be < 1.0 for downsampling, > 1.0 for upsamling. Corresponds to expected resampling ratio.
    void (*process)(void *re, struct resampler_data *data);
    void (*free)(void *re);
    const char *ident;
@@ -54,7 +66,9 @@ extern const rarch_resampler_t sinc_resampler;
 
 // Reallocs resampler. Will free previous handle before allocating a new one.
 // If ident is NULL, first resampler will be used.
-bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident, double bw_ratio);
+// Re-creating a resampler with the same quality and ratio is cheap, as backends cache their filter tables.
+bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident,
+      enum resampler_quality quality, double bw_ratio);
 
 // Convenience macros.
 // freep makes sure to set handles to NULL to avoid double-free in rarch_resampler_realloc.
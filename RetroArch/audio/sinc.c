@@ -42,50 +42,17 @@
 // HIGHER: 110 dB
 // HIGHEST: 140 dB
 
-// TODO, make all this more configurable.
+// The SINC_*_QUALITY defines only select which quality is used when the caller does not care.
 #if defined(SINC_LOWEST_QUALITY)
-#define SINC_WINDOW_LANCZOS
-#define CUTOFF 0.98
-#define PHASE_BITS 12
-#define SINC_COEFF_LERP 0
-#define SUBPHASE_BITS 10
-#define SIDELOBES 2
-#define ENABLE_AVX 0
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_LOWEST
 #elif defined(SINC_LOWER_QUALITY)
-#define SINC_WINDOW_LANCZOS
-#define CUTOFF 0.98
-#define PHASE_BITS 12
-#define SUBPHASE_BITS 10
-#define SINC_COEFF_LERP 0
-#define SIDELOBES 4
-#define ENABLE_AVX 0
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_LOWER
 #elif defined(SINC_HIGHER_QUALITY)
-#define SINC_WINDOW_KAISER
-#define SINC_WINDOW_KAISER_BETA 10.5
-#define CUTOFF 0.90
-#define PHASE_BITS 10
-#define SUBPHASE_BITS 14
-#define SINC_COEFF_LERP 1
-#define SIDELOBES 32
-#define ENABLE_AVX 1
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_HIGHER
 #elif defined(SINC_HIGHEST_QUALITY)
-#define SINC_WINDOW_KAISER
-#define SINC_WINDOW_KAISER_BETA 14.5
-#define CUTOFF 0.962
-#define PHASE_BITS 10
-#define SUBPHASE_BITS 14
-#define SINC_COEFF_LERP 1
-#define SIDELOBES 128
-#define ENABLE_AVX 1
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_HIGHEST
 #else
-#define SINC_WINDOW_KAISER
-#define SINC_WINDOW_KAISER_BETA 5.5
-#define CUTOFF 0.825
-#define PHASE_BITS 8
-#define SUBPHASE_BITS 16
-#define SINC_COEFF_LERP 1
-#define SIDELOBES 8
-#define ENABLE_AVX 0
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_NORMAL
 #endif
 
 // For the little amount of taps we're using,
@@ -93,31 +60,108 @@
 // AVX code is kept here though as by increasing number
 // of sinc taps, the AVX code is clearly faster than SSE1.
 
-#if defined(__AVX__) && ENABLE_AVX
+// With GCC and clang, the AVX and AVX2 kernels are built with per-function targets
+// and selected at runtime, so generic x86 builds can use them as well.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+   (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
 #include <immintrin.h>
+#define SINC_HAVE_AVX
+#define SINC_HAVE_AVX2
+#define SINC_TARGET_AVX __attribute__((target("avx")))
+#define SINC_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define SINC_HAVE_AVX
+#define SINC_TARGET_AVX
+#if defined(__AVX2__) && defined(__FMA__)
+#define SINC_HAVE_AVX2
+#define SINC_TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
 #endif
 
-#define PHASES (1 << (PHASE_BITS + SUBPHASE_BITS))
+enum sinc_window
+{
+   SINC_WINDOW_LANCZOS = 0,
+   SINC_WINDOW_KAISER
+};
+
+struct sinc_params
+{
+   enum sinc_window window;
+   double kaiser_beta;
+   double cutoff;
+   unsigned phase_bits;
+   unsigned subphase_bits;
+   bool coeff_lerp;
+   unsigned sidelobes;
+   bool enable_avx;
+};
+
+// Indexed by enum resampler_quality.
+static const struct sinc_params sinc_quality_params[] = {
+   // DONTCARE is resolved to SINC_DEFAULT_QUALITY, this entry is never used.
+   { SINC_WINDOW_KAISER,  5.5,  0.825, 8,  16, true,  8,   false },
+   // LOWEST
+   { SINC_WINDOW_LANCZOS, 0.0,  0.98,  12, 10, false, 2,   false },
+   // LOWER
+   { SINC_WINDOW_LANCZOS, 0.0,  0.98,  12, 10, false, 4,   false },
+   // NORMAL
+   { SINC_WINDOW_KAISER,  5.5,  0.825, 8,  16, true,  8,   false },
+   // HIGHER
+   { SINC_WINDOW_KAISER,  10.5, 0.90,  10, 14, true,  32,  true  },
+   // HIGHEST
+   { SINC_WINDOW_KAISER,  14.5, 0.962, 10, 14, true,  128, true  },
+};
+
+// Phase tables only depend on the quality and on the cutoff and taps derived from the bandwidth,
+// so they are shared between resamplers, and kept around for a while after the last user is gone.
+// That way, re-creating a resampler on core change or for ffemu does not recompute the table.
+// Resamplers are only created and freed from the main thread, so this needs no locking.
+struct sinc_table
+{
+   struct sinc_table *next;
+   enum resampler_quality quality;
+   unsigned taps;
+   double cutoff;
+
+   float *data;
+   unsigned refcount;
+   unsigned last_use;
+};
+
+#define SINC_MAX_UNUSED_TABLES 4
 
-#define TAPS (SIDELOBES * 2)
-#define SUBPHASE_MASK ((1 << SUBPHASE_BITS) - 1)
-#define SUBPHASE_MOD (1.0f / (1 << SUBPHASE_BITS))
+static struct sinc_table *sinc_tables;
+static unsigned sinc_table_clock;
 
-typedef struct rarch_sinc_resampler
+typedef struct rarch_sinc_resampler rarch_sinc_resampler_t;
+
+struct rarch_sinc_resampler
 {
-   float *phase_table;
+   const float *phase_table;
+   struct sinc_table *table;
    float *buffer_l;
    float *buffer_r;
 
    unsigned taps;
+   unsigned subphase_bits;
+   uint32_t subphase_mask;
+   float subphase_mod;
+   uint32_t phases;
+   bool coeff_lerp;
 
    unsigned ptr;
    uint32_t time;
 
-   // A buffer for phase_table, buffer_l and buffer_r are created in a single calloc().
-   // Ensure that we get as good cache locality as we can hope for.
+   void (*process)(rarch_sinc_resampler_t *resamp, float *out_buffer);
+
+   // buffer_l and buffer_r are created in a single allocation.
    float *main_buffer;
-} rarch_sinc_resampler_t;
+};
 
 static inline double sinc(double val)
 {
@@ -127,12 +171,6 @@ static inline double sinc(double val)
       return sin(val) / val;
 }
 
-#if defined(SINC_WINDOW_LANCZOS)
-static inline double window_function(double index)
-{
-   return sinc(M_PI * index);
-}
-#elif defined(SINC_WINDOW_KAISER)
 // Modified Bessel function of first order.
 // Check Wiki for mathematical definition ...
 static inline double besseli0(double x)
@@ -160,18 +198,23 @@ static inline double besseli0(double x)
    return sum;
 }
 
-static inline double window_function(double index)
+static inline double window_function(const struct sinc_params *params, double index)
 {
-   return besseli0(SINC_WINDOW_KAISER_BETA * sqrt(1 - index * index));
+   switch (params->window)
+   {
+      case SINC_WINDOW_LANCZOS:
+         return sinc(M_PI * index);
+      case SINC_WINDOW_KAISER:
+         return besseli0(params->kaiser_beta * sqrt(1 - index * index));
+      default:
+         return 1.0;
+   }
 }
-#else
-#error "No SINC window function defined."
-#endif
 
-static void init_sinc_table(rarch_sinc_resampler_t *resamp, double cutoff,
+static void init_sinc_table(const struct sinc_params *params, double cutoff,
       float *phase_table, int phases, int taps, bool calculate_delta)
 {
-   double window_mod = window_function(0.0); // Need to normalize w(0) to 1.0.
+   double window_mod = window_function(params, 0.0); // Need to normalize w(0) to 1.0.
    int stride = calculate_delta ? 2 : 1;
 
    double sidelobes = taps / 2.0;
@@ -184,7 +227,7 @@ static void init_sinc_table(rarch_sinc_resampler_t *resamp, double cutoff,
          window_phase = 2.0 * window_phase - 1.0; // [-1, 1)
          double sinc_phase = sidelobes * window_phase;
 
-         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(window_phase) / window_mod;
+         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(params, window_phase) / window_mod;
          phase_table[i * stride * taps + j] = val;
       }
    }
@@ -208,7 +251,7 @@ static void init_sinc_table(rarch_sinc_resampler_t *resamp, double cutoff,
          window_phase = 2.0 * window_phase - 1.0; // (-1, 1]
          double sinc_phase = sidelobes * window_phase;
 
-         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(window_phase) / window_mod;
+         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(params, window_phase) / window_mod;
          float delta = (val - phase_table[phase * stride * taps + j]);
          phase_table[(phase * stride + 1) * taps + j] = delta;
       }
@@ -235,7 +278,89 @@ static void aligned_free__(void *ptr)
    free(p[-1]);
 }
 
-static inline void process_sinc_C(rarch_sinc_resampler_t *resamp, float *out_buffer)
+static void sinc_table_free(struct sinc_table *table)
+{
+   aligned_free__(table->data);
+   free(table);
+}
+
+// Frees the least recently used tables nobody refers to, until at most SINC_MAX_UNUSED_TABLES are left.
+static void sinc_table_prune(void)
+{
+   for (;;)
+   {
+      unsigned unused = 0;
+      struct sinc_table **oldest = NULL;
+
+      for (struct sinc_table **table = &sinc_tables; *table; table = &(*table)->next)
+      {
+         if ((*table)->refcount)
+            continue;
+
+         unused++;
+         if (!oldest || (*table)->last_use < (*oldest)->last_use)
+            oldest = table;
+      }
+
+      if (unused <= SINC_MAX_UNUSED_TABLES)
+         break;
+
+      struct sinc_table *victim = *oldest;
+      *oldest = victim->next;
+      sinc_table_free(victim);
+   }
+}
+
+static struct sinc_table *sinc_table_acquire(enum resampler_quality quality, unsigned taps, double cutoff)
+{
+   struct sinc_table *table;
+   for (table = sinc_tables; table; table = table->next)
+   {
+      if (table->quality == quality && table->taps == taps && table->cutoff == cutoff)
+      {
+         table->refcount++;
+         table->last_use = ++sinc_table_clock;
+         return table;
+      }
+   }
+
+   const struct sinc_params *params = &sinc_quality_params[quality];
+   size_t elems = (1 << params->phase_bits) * taps;
+   if (params->coeff_lerp)
+      elems *= 2;
+
+   table = (struct sinc_table*)calloc(1, sizeof(*table));
+   if (!table)
+      return NULL;
+
+   table->data = (float*)aligned_alloc__(128, sizeof(float) * elems);
+   if (!table->data)
+   {
+      free(table);
+      return NULL;
+   }
+
+   init_sinc_table(params, cutoff, table->data, 1 << params->phase_bits, taps, params->coeff_lerp);
+
+   table->quality = quality;
+   table->taps = taps;
+   table->cutoff = cutoff;
+   table->refcount = 1;
+   table->last_use = ++sinc_table_clock;
+   table->next = sinc_tables;
+   sinc_tables = table;
+
+   sinc_table_prune();
+   return table;
+}
+
+static void sinc_table_release(struct sinc_table *table)
+{
+   table->refcount--;
+   sinc_table_prune();
+}
+
+static void process_sinc_C(rarch_sinc_resampler_t *resamp, float *out_buffer)
 {
    float sum_l = 0.0f;
    float sum_r = 0.0f;
@@ -243,33 +368,39 @@ static inline void process_sinc_C(rarch_sinc_resampler_t *resamp, float *out_buf
    const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
    unsigned taps  = resamp->taps;
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
-#if SINC_COEFF_LERP
-   const float *phase_table = resamp->phase_table + phase * taps * 2;
-   const float *delta_table = phase_table + taps;
-   float delta = (float)(resamp->time & SUBPHASE_MASK) * SUBPHASE_MOD;
-#else
-   const float *phase_table = resamp->phase_table + phase * taps;
-#endif
+   unsigned phase = resamp->time >> resamp->subphase_bits;
 
-   for (unsigned i = 0; i < taps; i++)
+   if (resamp->coeff_lerp)
    {
-#if SINC_COEFF_LERP
-      float sinc_val = phase_table[i] + delta_table[i] * delta;
-#else
-      float sinc_val = phase_table[i];
-#endif
-      sum_l         += buffer_l[i] * sinc_val;
-      sum_r         += buffer_r[i] * sinc_val;
+      const float *phase_table = resamp->phase_table + phase * taps * 2;
+      const float *delta_table = phase_table + taps;
+      float delta = (float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod;
+
+      for (unsigned i = 0; i < taps; i++)
+      {
+         float sinc_val = phase_table[i] + delta_table[i] * delta;
+         sum_l         += buffer_l[i] * sinc_val;
+         sum_r         += buffer_r[i] * sinc_val;
+      }
+   }
+   else
+   {
+      const float *phase_table = resamp->phase_table + phase * taps;
+
+      for (unsigned i = 0; i < taps; i++)
+      {
+         float sinc_val = phase_table[i];
+         sum_l         += buffer_l[i] * sinc_val;
+         sum_r         += buffer_r[i] * sinc_val;
+      }
    }
 
    out_buffer[0] = sum_l;
    out_buffer[1] = sum_r;
 }
 
-#if defined(__AVX__) && ENABLE_AVX
-#define process_sinc_func process_sinc
-static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
+#if defined(SINC_HAVE_AVX)
+SINC_TARGET_AVX static void process_sinc_AVX(rarch_sinc_resampler_t *resamp, float *out_buffer)
 {
    __m256 sum_l = _mm256_setzero_ps();
    __m256 sum_r = _mm256_setzero_ps();
@@ -278,28 +409,38 @@ static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
    const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
    unsigned taps = resamp->taps;
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
-#if SINC_COEFF_LERP
-   const float *phase_table = resamp->phase_table + phase * taps * 2;
-   const float *delta_table = phase_table + taps;
-   __m256 delta = _mm256_set1_ps((float)(resamp->time & SUBPHASE_MASK) * SUBPHASE_MOD);
-#else
-   const float *phase_table = resamp->phase_table + phase * taps;
-#endif
+   unsigned phase = resamp->time >> resamp->subphase_bits;
 
-   for (unsigned i = 0; i < taps; i += 8)
+   if (resamp->coeff_lerp)
    {
-      __m256 buf_l = _mm256_loadu_ps(buffer_l + i);
-      __m256 buf_r = _mm256_loadu_ps(buffer_r + i);
+      const float *phase_table = resamp->phase_table + phase * taps * 2;
+      const float *delta_table = phase_table + taps;
+      __m256 delta = _mm256_set1_ps((float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
 
-#if SINC_COEFF_LERP
-      __m256 deltas = _mm256_load_ps(delta_table + i);
-      __m256 sinc = _mm256_add_ps(_mm256_load_ps(phase_table + i), _mm256_mul_ps(deltas, delta));
-#else
-      __m256 sinc = _mm256_load_ps(phase_table + i);
-#endif
-      sum_l       = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
-      sum_r       = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
+      for (unsigned i = 0; i < taps; i += 8)
+      {
+         __m256 buf_l = _mm256_loadu_ps(buffer_l + i);
+         __m256 buf_r = _mm256_loadu_ps(buffer_r + i);
+
+         __m256 deltas = _mm256_load_ps(delta_table + i);
+         __m256 sinc = _mm256_add_ps(_mm256_load_ps(phase_table + i), _mm256_mul_ps(deltas, delta));
+         sum_l       = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
+         sum_r       = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
+      }
+   }
+   else
+   {
+      const float *phase_table = resamp->phase_table + phase * taps;
+
+      for (unsigned i = 0; i < taps; i += 8)
+      {
+         __m256 buf_l = _mm256_loadu_ps(buffer_l + i);
+         __m256 buf_r = _mm256_loadu_ps(buffer_r + i);
+
+         __m256 sinc = _mm256_load_ps(phase_table + i);
+         sum_l       = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
+         sum_r       = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
+      }
    }
 
    // hadd on AVX is weird, and acts on low-lanes and high-lanes separately.
@@ -315,9 +456,60 @@ static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
    _mm_store_ss(out_buffer + 0, _mm256_extractf128_ps(res_l, 0));
    _mm_store_ss(out_buffer + 1, _mm256_extractf128_ps(res_r, 0));
 }
-#elif defined(__SSE__)
-#define process_sinc_func process_sinc
-static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
+#endif
+
+#if defined(SINC_HAVE_AVX2)
+SINC_TARGET_AVX2 static void process_sinc_AVX2(rarch_sinc_resampler_t *resamp, float *out_buffer)
+{
+   __m256 sum_l = _mm256_setzero_ps();
+   __m256 sum_r = _mm256_setzero_ps();
+
+   const float *buffer_l = resamp->buffer_l + resamp->ptr;
+   const float *buffer_r = resamp->buffer_r + resamp->ptr;
+
+   unsigned taps = resamp->taps;
+   unsigned phase = resamp->time >> resamp->subphase_bits;
+
+   if (resamp->coeff_lerp)
+   {
+      const float *phase_table = resamp->phase_table + phase * taps * 2;
+      const float *delta_table = phase_table + taps;
+      __m256 delta = _mm256_set1_ps((float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
+
+      for (unsigned i = 0; i < taps; i += 8)
+      {
+         __m256 sinc = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i), delta, _mm256_load_ps(phase_table + i));
+         sum_l       = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i), sinc, sum_l);
+         sum_r       = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i), sinc, sum_r);
+      }
+   }
+   else
+   {
+      const float *phase_table = resamp->phase_table + phase * taps;
+
+      for (unsigned i = 0; i < taps; i += 8)
+      {
+         __m256 sinc = _mm256_load_ps(phase_table + i);
+         sum_l       = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i), sinc, sum_l);
+         sum_r       = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i), sinc, sum_r);
+      }
+   }
+
+   // Fold the high lanes onto the low lanes, then finish like the SSE kernel.
+   __m128 l = _mm_add_ps(_mm256_castps256_ps128(sum_l), _mm256_extractf128_ps(sum_l, 1));
+   __m128 r = _mm_add_ps(_mm256_castps256_ps128(sum_r), _mm256_extractf128_ps(sum_r, 1));
+
+   __m128 sum = _mm_add_ps(_mm_shuffle_ps(l, r, _MM_SHUFFLE(1, 0, 1, 0)),
+         _mm_shuffle_ps(l, r, _MM_SHUFFLE(3, 2, 3, 2)));
+   sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), sum);
+
+   _mm_store_ss(out_buffer + 0, sum);
+   _mm_store_ss(out_buffer + 1, _mm_movehl_ps(sum, sum));
+}
+#endif
+
+#if defined(__SSE__)
+static void process_sinc_SSE(rarch_sinc_resampler_t *resamp, float *out_buffer)
 {
    __m128 sum_l = _mm_setzero_ps();
    __m128 sum_r = _mm_setzero_ps();
@@ -326,28 +518,38 @@ static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
    const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
    unsigned taps = resamp->taps;
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
-#if SINC_COEFF_LERP
-   const float *phase_table = resamp->phase_table + phase * taps * 2;
-   const float *delta_table = phase_table + taps;
-   __m128 delta = _mm_set1_ps((float)(resamp->time & SUBPHASE_MASK) * SUBPHASE_MOD);
-#else
-   const float *phase_table = resamp->phase_table + phase * taps;
-#endif
+   unsigned phase = resamp->time >> resamp->subphase_bits;
 
-   for (unsigned i = 0; i < taps; i += 4)
+   if (resamp->coeff_lerp)
    {
-      __m128 buf_l = _mm_loadu_ps(buffer_l + i);
-      __m128 buf_r = _mm_loadu_ps(buffer_r + i);
+      const float *phase_table = resamp->phase_table + phase * taps * 2;
+      const float *delta_table = phase_table + taps;
+      __m128 delta = _mm_set1_ps((float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
 
-#if SINC_COEFF_LERP
-      __m128 deltas = _mm_load_ps(delta_table + i);
-      __m128 sinc = _mm_add_ps(_mm_load_ps(phase_table + i), _mm_mul_ps(deltas, delta));
-#else
-      __m128 sinc = _mm_load_ps(phase_table + i);
-#endif
-      sum_l       = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, sinc));
-      sum_r       = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, sinc));
+      for (unsigned i = 0; i < taps; i += 4)
+      {
+         __m128 buf_l = _mm_loadu_ps(buffer_l + i);
+         __m128 buf_r = _mm_loadu_ps(buffer_r + i);
+
+         __m128 deltas = _mm_load_ps(delta_table + i);
+         __m128 sinc = _mm_add_ps(_mm_load_ps(phase_table + i), _mm_mul_ps(deltas, delta));
+         sum_l       = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, sinc));
+         sum_r       = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, sinc));
+      }
+   }
+   else
+   {
+      const float *phase_table = resamp->phase_table + phase * taps;
+
+      for (unsigned i = 0; i < taps; i += 4)
+      {
+         __m128 buf_l = _mm_loadu_ps(buffer_l + i);
+         __m128 buf_r = _mm_loadu_ps(buffer_r + i);
+
+         __m128 sinc = _mm_load_ps(phase_table + i);
+         sum_l       = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, sinc));
+         sum_r       = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, sinc));
+      }
    }
 
    // Them annoying shuffles :V
@@ -371,17 +573,11 @@ static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
    // movehl { X, R, X, L } == { X, R, X, R }
    _mm_store_ss(out_buffer + 1, _mm_movehl_ps(sum, sum));
 }
-#elif defined(HAVE_NEON)
-
-#if SINC_COEFF_LERP
-#error "NEON asm does not support SINC lerp."
 #endif
 
-// Need to make this function pointer as Android doesn't have built-in targets
-// for NEON and plain ARMv7a.
-static void (*process_sinc_func)(rarch_sinc_resampler_t *resamp, float *out_buffer);
-
+#if defined(HAVE_NEON)
 // Assumes that taps >= 8, and that taps is a multiple of 8.
+// Does not support coefficient lerp.
 void process_sinc_neon_asm(float *out, const float *left, const float *right, const float *coeff, unsigned taps);
 
 static void process_sinc_neon(rarch_sinc_resampler_t *resamp, float *out_buffer)
@@ -389,21 +585,145 @@ static void process_sinc_neon(rarch_sinc_resampler_t *resamp, float *out_buffer)
    const float *buffer_l = resamp->buffer_l + resamp->ptr;
    const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
+   unsigned phase = resamp->time >> resamp->subphase_bits;
    unsigned taps = resamp->taps;
    const float *phase_table = resamp->phase_table + phase * taps;
 
    process_sinc_neon_asm(out_buffer, buffer_l, buffer_r, phase_table, taps);
 }
-#else // Plain ol' C99
-#define process_sinc_func process_sinc_C
 #endif
 
+#if defined(__ARM_NEON__)
+static void process_sinc_neon_intrinsics(rarch_sinc_resampler_t *resamp, float *out_buffer)
+{
+   float32x4_t sum_l = vdupq_n_f32(0.0f);
+   float32x4_t sum_r = vdupq_n_f32(0.0f);
+
+   const float *buffer_l = resamp->buffer_l + resamp->ptr;
+   const float *buffer_r = resamp->buffer_r + resamp->ptr;
+
+   unsigned taps = resamp->taps;
+   unsigned phase = resamp->time >> resamp->subphase_bits;
+
+   if (resamp->coeff_lerp)
+   {
+      const float *phase_table = resamp->phase_table + phase * taps * 2;
+      const float *delta_table = phase_table + taps;
+      float32x4_t delta = vdupq_n_f32((float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
+
+      for (unsigned i = 0; i < taps; i += 4)
+      {
+         float32x4_t sinc = vmlaq_f32(vld1q_f32(phase_table + i), vld1q_f32(delta_table + i), delta);
+         sum_l            = vmlaq_f32(sum_l, vld1q_f32(buffer_l + i), sinc);
+         sum_r            = vmlaq_f32(sum_r, vld1q_f32(buffer_r + i), sinc);
+      }
+   }
+   else
+   {
+      const float *phase_table = resamp->phase_table + phase * taps;
+
+      for (unsigned i = 0; i < taps; i += 4)
+      {
+         float32x4_t sinc = vld1q_f32(phase_table + i);
+         sum_l            = vmlaq_f32(sum_l, vld1q_f32(buffer_l + i), sinc);
+         sum_r            = vmlaq_f32(sum_r, vld1q_f32(buffer_r + i), sinc);
+      }
+   }
+
+   float32x2_t l = vadd_f32(vget_low_f32(sum_l), vget_high_f32(sum_l));
+   float32x2_t r = vadd_f32(vget_low_f32(sum_r), vget_high_f32(sum_r));
+   vst1_f32(out_buffer, vpadd_f32(l, r));
+}
+#endif
+
+struct sinc_kernel
+{
+   const char *ident;
+   void (*process)(rarch_sinc_resampler_t *resamp, float *out_buffer);
+   unsigned simd; // RARCH_SIMD_* flags the kernel needs at runtime.
+   unsigned tap_align;
+   bool wide; // Only worth it for the qualities with many taps.
+   bool coeff_lerp; // Can handle phase tables with deltas.
+};
+
+// In order of preference.
+static const struct sinc_kernel sinc_kernels[] = {
+#if defined(SINC_HAVE_AVX2)
+   { "AVX2", process_sinc_AVX2, RARCH_SIMD_AVX2 | RARCH_SIMD_FMA3, 8, true, true },
+#endif
+#if defined(SINC_HAVE_AVX)
+   { "AVX", process_sinc_AVX, RARCH_SIMD_AVX, 8, true, true },
+#endif
+#if defined(__SSE__)
+   { "SSE", process_sinc_SSE, 0, 4, false, true },
+#endif
+#if defined(HAVE_NEON)
+   { "NEON", process_sinc_neon, RARCH_SIMD_NEON, 8, false, false },
+#endif
+#if defined(__ARM_NEON__)
+   { "NEON intrinsics", process_sinc_neon_intrinsics, RARCH_SIMD_NEON, 4, false, true },
+#endif
+   { "C", process_sinc_C, 0, 4, false, true },
+};
+
+#ifdef RESAMPLER_TEST
+// Lets audio/test force a particular kernel by ident. Creating a resampler fails if it is not usable.
+const char *resampler_sinc_force_kernel;
+#endif
+
+// CPU features only need to be queried once, and rarch_get_cpu_features() is rather chatty.
+static unsigned get_simd_features(void)
+{
+   static bool queried;
+   static unsigned simd;
+
+   if (!queried)
+   {
+      struct rarch_cpu_features cpu;
+      rarch_get_cpu_features(&cpu);
+      simd = cpu.simd;
+      queried = true;
+   }
+
+   return simd;
+}
+
+static const struct sinc_kernel *sinc_select_kernel(const struct sinc_params *params)
+{
+   unsigned simd = get_simd_features();
+
+   for (unsigned i = 0; i < sizeof(sinc_kernels) / sizeof(sinc_kernels[0]); i++)
+   {
+      const struct sinc_kernel *kernel = &sinc_kernels[i];
+      if ((simd & kernel->simd) != kernel->simd)
+         continue;
+      if (params->coeff_lerp && !kernel->coeff_lerp)
+         continue;
+
+#ifdef RESAMPLER_TEST
+      if (resampler_sinc_force_kernel)
+      {
+         if (!strcmp(kernel->ident, resampler_sinc_force_kernel))
+            return kernel;
+         continue;
+      }
+#endif
+
+      if (kernel->wide && !params->enable_avx)
+         continue;
+
+      return kernel;
+   }
+
+   return NULL;
+}
+
 static void resampler_sinc_process(void *re_, struct resampler_data *data)
 {
    rarch_sinc_resampler_t *re = (rarch_sinc_resampler_t*)re_;
 
-   uint32_t ratio = PHASES / data->ratio;
+   uint32_t phases = re->phases;
+   uint32_t ratio = phases / data->ratio;
 
    const float *input = data->data_in;
    float *output      = data->data_out;
@@ -412,7 +732,7 @@ static void resampler_sinc_process(void *re_, struct resampler_data *data)
 
    while (frames)
    {
-      while (frames && re->time >= PHASES)
+      while (frames && re->time >= phases)
       {
          // Push in reverse to make filter more obvious.
          if (!re->ptr)
@@ -422,13 +742,13 @@ static void resampler_sinc_process(void *re_, struct resampler_data *data)
          re->buffer_l[re->ptr + re->taps] = re->buffer_l[re->ptr] = *input++;
          re->buffer_r[re->ptr + re->taps] = re->buffer_r[re->ptr] = *input++;
 
-         re->time -= PHASES;
+         re->time -= phases;
          frames--;
       }
 
-      while (re->time < PHASES)
+      while (re->time < phases)
       {
-         process_sinc_func(re, output);
+         re->process(re, output);
          output += 2;
          out_frames++;
          re->time += ratio;
@@ -442,20 +762,27 @@ static void resampler_sinc_free(void *re)
 {
    rarch_sinc_resampler_t *resampler = (rarch_sinc_resampler_t*)re;
    if (resampler)
-      aligned_free__(resampler->main_buffer);
+   {
+      if (resampler->table)
+         sinc_table_release(resampler->table);
+      if (resampler->main_buffer)
+         aligned_free__(resampler->main_buffer);
+   }
    free(resampler);
 }
 
-static void *resampler_sinc_new(double bandwidth_mod)
+static void *resampler_sinc_new(double bandwidth_mod, enum resampler_quality quality)
 {
    rarch_sinc_resampler_t *re = (rarch_sinc_resampler_t*)calloc(1, sizeof(*re));
    if (!re)
       return NULL;
 
-   memset(re, 0, sizeof(*re));
+   if (quality == RESAMPLER_QUALITY_DONTCARE || quality > RESAMPLER_QUALITY_HIGHEST)
+      quality = SINC_DEFAULT_QUALITY;
+   const struct sinc_params *params = &sinc_quality_params[quality];
 
-   re->taps = TAPS;
-   double cutoff = CUTOFF;
+   re->taps = params->sidelobes * 2;
+   double cutoff = params->cutoff;
 
    // Downsampling, must lower cutoff, and extend number of taps accordingly to keep same stopband attenuation.
    if (bandwidth_mod < 1.0)
@@ -464,43 +791,35 @@ static void *resampler_sinc_new(double bandwidth_mod)
       re->taps = (unsigned)ceil(re->taps / bandwidth_mod);
    }
 
+   const struct sinc_kernel *kernel = sinc_select_kernel(params);
+   if (!kernel)
+      goto error;
+   re->process = kernel->process;
+
    // Be SIMD-friendly.
-#if (defined(__AVX__) && ENABLE_AVX) || defined(HAVE_NEON)
-   re->taps = (re->taps + 7) & ~7;
-#else
-   re->taps = (re->taps + 3) & ~3;
-#endif
+   re->taps = (re->taps + kernel->tap_align - 1) & ~(kernel->tap_align - 1);
 
-   size_t phase_elems = (1 << PHASE_BITS) * re->taps;
-#if SINC_COEFF_LERP
-   phase_elems *= 2;
-#endif
-   size_t elems = phase_elems + 4 * re->taps;
+   re->subphase_bits = params->subphase_bits;
+   re->subphase_mask = (1 << params->subphase_bits) - 1;
+   re->subphase_mod  = 1.0f / (1 << params->subphase_bits);
+   re->phases        = 1 << (params->phase_bits + params->subphase_bits);
+   re->coeff_lerp    = params->coeff_lerp;
+
+   re->table = sinc_table_acquire(quality, re->taps, cutoff);
+   if (!re->table)
+      goto error;
+   re->phase_table = re->table->data;
 
-   re->main_buffer = (float*)aligned_alloc__(128, sizeof(float) * elems);
+   re->main_buffer = (float*)aligned_alloc__(128, sizeof(float) * 4 * re->taps);
    if (!re->main_buffer)
       goto error;
+   memset(re->main_buffer, 0, sizeof(float) * 4 * re->taps);
 
-   re->phase_table = re->main_buffer;
-   re->buffer_l = re->main_buffer + phase_elems;
+   re->buffer_l = re->main_buffer;
    re->buffer_r = re->buffer_l + 2 * re->taps;
 
-   init_sinc_table(re, cutoff, re->phase_table, 1 << PHASE_BITS, re->taps, SINC_COEFF_LERP);
-
-#if defined(__AVX__) && ENABLE_AVX
-   RARCH_LOG("Sinc resampler [AVX]\n");
-#elif defined(__SSE__)
-   RARCH_LOG("Sinc resampler [SSE]\n");
-#elif defined(HAVE_NEON)
-   struct rarch_cpu_features cpu;
-   rarch_get_cpu_features(&cpu);
-   process_sinc_func = cpu.simd & RARCH_SIMD_NEON ? process_sinc_neon : process_sinc_C;
-   RARCH_LOG("Sinc resampler [%s]\n", cpu.simd & RARCH_SIMD_NEON ? "NEON" : "C");
-#else
-   RARCH_LOG("Sinc resampler [C]\n");
-#endif
-
-   RARCH_LOG("SINC params (%u phase bits, %u taps).\n", PHASE_BITS, re->taps);
+   RARCH_LOG("Sinc resampler [%s]\n", kernel->ident);
+   RARCH_LOG("SINC params (quality %u, %u phase bits, %u taps).\n", (unsigned)quality, params->phase_bits, re->taps);
    return re;
 
 error:
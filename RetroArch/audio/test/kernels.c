@@ -0,0 +1,144 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs every sinc kernel this CPU supports on identical input,
+// and compares throughput and output against the plain C kernel.
+
+#include "../resampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+extern const char *resampler_sinc_force_kernel;
+
+#define IN_FRAMES (32000 / 4)
+#define RUNS 64
+
+static const char *kernels[] = {
+   "C", "SSE", "AVX", "AVX2", "NEON", "NEON intrinsics",
+};
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+// Returns output frames, or 0 if the kernel is not usable here.
+static size_t run_kernel(const char *kernel, enum resampler_quality quality, double ratio,
+      const float *input, float *output, double *frames_per_sec)
+{
+   void *re = NULL;
+   const rarch_resampler_t *resampler = NULL;
+
+   resampler_sinc_force_kernel = kernel;
+   bool ok = rarch_resampler_realloc(&re, &resampler, NULL, quality, ratio);
+   resampler_sinc_force_kernel = NULL;
+   if (!ok)
+      return 0;
+
+   struct resampler_data data = {
+      .data_in = input,
+      .data_out = output,
+      .input_frames = IN_FRAMES,
+      .ratio = ratio,
+   };
+
+   // First run is the one we compare. It starts from a cleared history, like every other kernel.
+   rarch_resampler_process(resampler, re, &data);
+   size_t out_frames = data.output_frames;
+
+   float *scratch = (float*)malloc(out_frames * 2 * sizeof(float) + 64 * sizeof(float));
+   data.data_out = scratch;
+
+   double start = get_time();
+   for (unsigned i = 0; i < RUNS; i++)
+      rarch_resampler_process(resampler, re, &data);
+   *frames_per_sec = RUNS * IN_FRAMES / (get_time() - start);
+
+   free(scratch);
+   rarch_resampler_freep(&resampler, &re);
+   return out_frames;
+}
+
+int main(int argc, char *argv[])
+{
+   (void)argc;
+   (void)argv;
+
+   // LOWEST only has 4 taps, which the 8-wide kernels pad out to a different filter, so it is not compared.
+   static const enum resampler_quality qualities[] = {
+      RESAMPLER_QUALITY_LOWER, RESAMPLER_QUALITY_NORMAL, RESAMPLER_QUALITY_HIGHER, RESAMPLER_QUALITY_HIGHEST,
+   };
+   static const double ratios[] = { 48000.0 / 32000.0, 0.5 };
+
+   float *input = (float*)malloc(IN_FRAMES * 2 * sizeof(float));
+   float *reference = (float*)malloc(IN_FRAMES * 2 * 8 * sizeof(float));
+   float *output = (float*)malloc(IN_FRAMES * 2 * 8 * sizeof(float));
+   if (!input || !reference || !output)
+      return 1;
+
+   srand(0);
+   for (unsigned i = 0; i < IN_FRAMES * 2; i++)
+      input[i] = (2.0f * rand()) / RAND_MAX - 1.0f;
+
+   int ret = 0;
+   for (unsigned q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++)
+   {
+      for (unsigned r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++)
+      {
+         double c_speed = 0.0;
+         size_t ref_frames = run_kernel("C", qualities[q], ratios[r], input, reference, &c_speed);
+         if (!ref_frames)
+         {
+            fprintf(stderr, "Failed to create C kernel.\n");
+            return 1;
+         }
+
+         for (unsigned k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+         {
+            double speed = 0.0;
+            size_t frames = run_kernel(kernels[k], qualities[q], ratios[r], input, output, &speed);
+            if (!frames)
+               continue;
+
+            float max_diff = 0.0f;
+            for (size_t i = 0; i < frames * 2 && frames == ref_frames; i++)
+            {
+               float diff = fabsf(output[i] - reference[i]);
+               if (diff > max_diff)
+                  max_diff = diff;
+            }
+
+            // Different summation order and FMA only account for rounding noise.
+            bool match = frames == ref_frames && max_diff < 1e-4f;
+            if (!match)
+               ret = 1;
+
+            printf("Quality %u | ratio %.3f | %-15s | %8.2f Mframes/s | %5.2fx C | max diff %.2e%s\n",
+                  (unsigned)qualities[q], ratios[r], kernels[k], speed / 1000000.0, speed / c_speed,
+                  max_diff, match ? "" : " MISMATCH");
+         }
+      }
+   }
+
+   free(input);
+   free(reference);
+   free(output);
+   return ret;
+}
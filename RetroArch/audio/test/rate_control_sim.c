@@ -0,0 +1,212 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Deterministic simulation of dynamic rate control against a fake audio sink.
+// A core runs at its own rate, synced to a monitor which doesn't quite match the refresh rate we were configured for,
+// feeding a sink whose clock may drift and which may only report its fill level in whole periods.
+// The old proportional controller and the Kalman-filtered PI controller from rate_control.c are run on the same
+// scenario, and compared on underruns, blocking writes, and how steady the buffer fill is.
+// The controller's own telemetry is checked against what the sink really went through.
+
+#include "../rate_control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#define OUT_RATE 48000.0
+#define FRAME_BYTES 4 // Stereo s16.
+#define CORE_RATE 32040.5
+#define CORE_FPS 60.0988
+#define CONFIGURED_REFRESH 59.95
+#define MAX_DELTA 0.005
+#define SIM_SECONDS 600
+#define MAX_TELEMETRY_FILL_ERROR 0.05
+
+struct scenario
+{
+   const char *name;
+   double monitor_refresh; // What vsync really runs at.
+   double sink_drift; // Relative error of the sink clock.
+   double frame_jitter; // Max deviation of frame time in seconds.
+   unsigned periods; // Sink reports fill in multiples of buffer / periods. 0 for exact reports.
+   unsigned latency_ms;
+};
+
+struct result
+{
+   uint64_t underruns;
+   uint64_t blocks;
+   double fill_mean;
+   double fill_dev;
+   double adjust_dev_ppm;
+
+   // What the controller itself saw, only filled in for pi-kalman.
+   bool has_stats;
+   struct rate_control_stats stats;
+};
+
+// Tiny LCG, so every run and every platform sees the same jitter.
+static uint32_t rng_state;
+
+static double rng_uniform(void)
+{
+   rng_state = rng_state * 1664525u + 1013904223u;
+   return (rng_state >> 8) / (double)(1 << 24) * 2.0 - 1.0;
+}
+
+static double proportional_update(size_t buffer_size, size_t avail)
+{
+   int half_size = buffer_size / 2;
+   int delta_mid = (int)avail - half_size;
+   double direction = (double)delta_mid / half_size;
+   return 1.0 + MAX_DELTA * direction;
+}
+
+static void simulate(const struct scenario *sc, bool use_pi, struct result *res)
+{
+   memset(res, 0, sizeof(*res));
+   rng_state = 1;
+
+   double sink_rate = OUT_RATE * (1.0 + sc->sink_drift);
+   size_t buffer_frames = (size_t)(OUT_RATE * sc->latency_ms / 1000.0);
+   size_t buffer_size = buffer_frames * FRAME_BYTES;
+   size_t period = sc->periods ? buffer_size / sc->periods : FRAME_BYTES;
+
+   // Same ratio setup as RetroArch, which assumes the configured refresh rate.
+   double in_rate = CORE_RATE * CONFIGURED_REFRESH / CORE_FPS;
+   double orig_ratio = OUT_RATE / in_rate;
+
+   rate_control_t *rc = rate_control_new(buffer_size, OUT_RATE * FRAME_BYTES);
+
+   double fill = buffer_frames / 2.0; // In frames, fractional.
+   double in_accum = 0.0;
+   double out_accum = 0.0;
+
+   double fill_accum = 0.0, fill_sqr_accum = 0.0;
+   double adjust_accum = 0.0, adjust_sqr_accum = 0.0;
+   uint64_t frames = (uint64_t)(SIM_SECONDS * sc->monitor_refresh);
+   bool was_empty = false;
+
+   for (uint64_t i = 0; i < frames; i++)
+   {
+      double dt = 1.0 / sc->monitor_refresh + sc->frame_jitter * rng_uniform();
+
+      // Sink drains while the frame is emulated.
+      double consumed = sink_rate * dt;
+      if (consumed > fill)
+      {
+         if (!was_empty)
+            res->underruns++;
+         was_empty = true;
+         fill = 0.0;
+      }
+      else
+      {
+         was_empty = false;
+         fill -= consumed;
+      }
+
+      double f = fill / buffer_frames;
+      fill_accum += f;
+      fill_sqr_accum += f * f;
+
+      size_t avail = (size_t)((buffer_frames - fill) * FRAME_BYTES);
+      avail -= avail % period;
+
+      double adjust = use_pi ? rate_control_update(rc, avail, MAX_DELTA) : proportional_update(buffer_size, avail);
+      adjust_accum += adjust;
+      adjust_sqr_accum += adjust * adjust;
+
+      in_accum += CORE_RATE / CORE_FPS;
+      double in_frames = floor(in_accum);
+      in_accum -= in_frames;
+
+      out_accum += in_frames * orig_ratio * adjust;
+      double out_frames = floor(out_accum);
+      out_accum -= out_frames;
+
+      // Blocking write. Whatever doesn't fit waits for the sink, which delays the next frame,
+      // but in this model simply means the sink drained that much in the meantime.
+      fill += out_frames;
+      if (fill > buffer_frames)
+      {
+         res->blocks++;
+         fill = buffer_frames;
+      }
+   }
+
+   res->fill_mean = fill_accum / frames;
+   res->fill_dev = sqrt(fill_sqr_accum / frames - res->fill_mean * res->fill_mean);
+   double adjust_mean = adjust_accum / frames;
+   double adjust_var = adjust_sqr_accum / frames - adjust_mean * adjust_mean;
+   res->adjust_dev_ppm = 1000000.0 * (adjust_var > 0.0 ? sqrt(adjust_var) : 0.0);
+
+   if (use_pi)
+   {
+      res->has_stats = true;
+      rate_control_get_stats(rc, &res->stats);
+   }
+
+   rate_control_free(rc);
+}
+
+int main(void)
+{
+   static const struct scenario scenarios[] = {
+      { "exact reports",          59.94, 0.0,    0.0,   0, 64 },
+      { "4 periods",              59.94, 0.0,    0.0,   4, 64 },
+      { "4 periods, drift",       60.02, 0.002,  0.0,   4, 64 },
+      { "2 periods, drift, jitter", 60.02, -0.002, 0.002, 2, 64 },
+      { "low latency, jitter",    59.94, 0.001,  0.002, 4, 32 },
+   };
+
+   bool ok = true;
+
+   printf("%-26s | %-12s | %9s | %8s | %10s | %9s | %12s\n",
+         "Scenario", "Controller", "Underruns", "Blocks", "Mean fill", "Fill dev", "Ratio dev");
+
+   for (unsigned i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+   {
+      for (unsigned pi = 0; pi < 2; pi++)
+      {
+         struct result res;
+         simulate(&scenarios[i], pi, &res);
+         bool ok = true;
+
+   printf("%-26s | %-12s | %9llu | %8llu | %8.1f %% | %7.2f %% | %8.0f ppm\n",
+               scenarios[i].name, pi ? "pi-kalman" : "proportional",
+               (unsigned long long)res.underruns, (unsigned long long)res.blocks,
+               res.fill_mean * 100.0, res.fill_dev * 100.0, res.adjust_dev_ppm);
+
+         if (res.has_stats)
+         {
+            // Telemetry only sees what the sink reports, so allow for the period it can't resolve.
+            bool telemetry_ok = res.stats.underruns == res.underruns &&
+               fabs(res.stats.mean_fill - res.fill_mean) <= MAX_TELEMETRY_FILL_ERROR;
+
+            printf("%-26s | telemetry: %llu updates, %llu underruns seen, mean fill %.1f %%, latency %.1f ms | %s\n", "",
+                  (unsigned long long)res.stats.updates, (unsigned long long)res.stats.underruns,
+                  res.stats.mean_fill * 100.0, res.stats.mean_latency_ms, telemetry_ok ? "OK" : "FAILED");
+
+            ok = telemetry_ok && ok;
+         }
+      }
+   }
+
+   return ok ? 0 : 1;
+}
@@ -22,10 +22,18 @@
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <time.h>
 
 #undef min
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
 static void gen_signal(float *out, double omega, double bias_samples, size_t samples)
 {
    for (size_t i = 0; i < samples; i += 2)
@@ -237,13 +245,14 @@ static void calculate_snr(struct snr_result *res,
 
 int main(int argc, char *argv[])
 {
-   if (argc != 2)
+   if (argc < 2 || argc > 3)
    {
-      fprintf(stderr, "Usage: %s <ratio> (out-rate is fixed for FFT).\n", argv[0]);
+      fprintf(stderr, "Usage: %s <ratio> [quality 1-5] (out-rate is fixed for FFT).\n", argv[0]);
       return 1;
    }
 
    double ratio = strtod(argv[1], NULL);
+   enum resampler_quality quality = argc == 3 ? (enum resampler_quality)strtoul(argv[2], NULL, 0) : RESAMPLER_QUALITY_DONTCARE;
 
    const unsigned fft_samples = 1024 * 128;
    unsigned out_rate = fft_samples / 2;
@@ -269,7 +278,7 @@ int main(int argc, char *argv[])
 
    void *re = NULL;
    const rarch_resampler_t *resampler = NULL;
-   if (!rarch_resampler_realloc(&re, &resampler, NULL, ratio))
+   if (!rarch_resampler_realloc(&re, &resampler, NULL, quality, ratio))
       return 1;
 
    test_fft();
@@ -287,7 +296,9 @@ int main(int argc, char *argv[])
          .ratio = ratio,
       };
 
+      double start = get_time();
       rarch_resampler_process(resampler, re, &data);
+      double process_time = get_time() - start;
 
       // We generate 2 seconds worth of audio, however, only the last second is considered so phase has stabilized.
       struct snr_result res = {0};
@@ -297,8 +308,8 @@ int main(int argc, char *argv[])
 
       calculate_snr(&res, freq, max_freq, output + fft_samples - 2048, butterfly_buf, fft_samples);
 
-      printf("SNR @ w = %5.3f : %6.2lf dB, Gain: %6.1lf dB\n",
-            freq_list[i], res.snr, res.gain);
+      printf("SNR @ w = %5.3f : %6.2lf dB, Gain: %6.1lf dB, Throughput: %7.2f Mframes/s\n",
+            freq_list[i], res.snr, res.gain, data.input_frames / (process_time * 1000000.0));
 
       printf("\tAliases: #1 (w = %5.3f, %6.2lf dB), #2 (w = %5.3f, %6.2lf dB), #3 (w = %5.3f, %6.2lf dB)\n",
             res.alias_freq[0] / (float)in_rate, res.alias_power[0],
@@ -306,6 +317,12 @@ int main(int argc, char *argv[])
             res.alias_freq[2] / (float)in_rate, res.alias_power[2]);
    }
 
+   // Re-creating the resampler with the same parameters should hit the cached phase table.
+   double start = get_time();
+   if (!rarch_resampler_realloc(&re, &resampler, NULL, quality, ratio))
+      return 1;
+   printf("Reinit: %.1f us\n", (get_time() - start) * 1000000.0);
+
    rarch_resampler_freep(&resampler, &re);
    free(input);
    free(output);
@@ -1,3 +1,13 @@
 #!/bin/sh
 
+# With no arguments, runs the deterministic rate control simulation against a fake audio sink,
+# and fails if the controller's telemetry doesn't match what the sink went through.
+# With arguments, resamples a file: test-rate-control.sh <input> <output> <ratio>.
+
+if [ $# -eq 0 ]; then
+   cd "$(dirname "$0")" || exit 1
+   make -s test-rate-control-sim || exit 1
+   exec ./test-rate-control-sim
+fi
+
 ffmpeg -i "$1" -f s16le - | ./test-sinc-highest 44100 48000 $3 | ffmpeg -y -ar 48000 -f s16le -ac 2 -i - "$2"
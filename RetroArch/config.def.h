@@ -231,6 +231,10 @@ static const bool hard_sync = false;
 // 2: Etc ...
 static const unsigned hard_sync_frames = 0;
 
+// Streams software frames to the GPU through a ring of PBOs (persistently mapped if ARB_buffer_storage is supported),
+// instead of letting the driver copy them synchronously in glTexSubImage2D().
+static const bool pbo_upload = false;
+
 // Threaded video. Will possibly increase performance significantly at cost of worse synchronization and latency.
 static const bool video_threaded = false;
 
@@ -358,6 +362,9 @@ static const float rate_control_delta = 0.005;
 // Default audio volume in dB. (0.0 dB == unity gain).
 static const float audio_volume = 0.0;
 
+// Resampler quality. 0 lets the resampler pick its built-in default, 1 (lowest) to 5 (highest) overrides it.
+static const unsigned audio_resampler_quality = RESAMPLER_QUALITY_DONTCARE;
+
 //////////////
 // Misc
 //////////////
@@ -371,6 +378,18 @@ static const unsigned rewind_buffer_size = 20 << 20; // 20MiB
 // How many frames to rewind at a time.
 static const unsigned rewind_granularity = 1;
 
+// How each rewind delta is compressed. "none", "rle" or "deflate" (needs zlib).
+// Deflate holds the most rewind per MiB, but costs noticeably more CPU per frame.
+static const char *rewind_compression = "rle";
+
+// Generates and compresses rewind deltas on a separate thread.
+// The main loop then only has to serialize the state.
+static const bool rewind_threaded = false;
+
+// Store a full state every this many rewind states, so the rewind buffer can be seeked
+// without replaying every delta on the way. 0 disables keyframes.
+static const unsigned rewind_keyframe_interval = 0;
+
 // Pause gameplay when gameplay loses focus.
 static const bool pause_nonactive = false;
 
@@ -380,6 +399,11 @@ static const unsigned autosave_interval = 0;
 // When being client over netplay, use keybinds for player 1 rather than player 2.
 static const bool netplay_client_swap_input = true;
 
+// How netplay guesses the other player's input until it arrives. "last", "hold" or "idle".
+// "last" repeats their last input. "hold" also learns how long they tend to hold each button,
+// and predicts releases when that is a safe bet. "idle" is "hold", leaning further towards releases.
+static const char *netplay_predictor = "hold";
+
 // On save state load, block SRAM from being overwritten.
 // This could potentially lead to buggy games.
 static const bool block_sram_overwrite = false;
@@ -23,6 +23,7 @@
 #include "compat/posix_string.h"
 #include "audio/utils.h"
 #include "audio/resampler.h"
+#include "audio/rate_control.h"
 #include "gfx/thread_wrapper.h"
 #include "gfx/gfx_common.h"
 
@@ -303,6 +304,56 @@ uintptr_t driver_get_current_framebuffer(void)
       return 0;
 }
 
+bool driver_get_current_software_framebuffer(struct retro_framebuffer *framebuffer)
+{
+   // Filters read the core's frame again when the cached frame is redrawn,
+   // so it can't live in memory the driver reuses.
+   if (g_extern.filter.active || g_extern.system.hw_render_callback.context_type)
+      return false;
+
+#ifdef HAVE_NETPLAY
+   // Frames replayed by netplay are never shown, no point in handing out the driver's memory for them.
+   if (g_extern.netplay && netplay_should_skip(g_extern.netplay))
+      return false;
+#endif
+
+   if (driver.video_poke && driver.video_poke->get_current_software_framebuffer &&
+         driver.video_poke->get_current_software_framebuffer(driver.video_data, framebuffer))
+   {
+      driver.software_framebuffer = framebuffer->data;
+      return true;
+   }
+
+   return false;
+}
+
+// A frame the core rendered into the driver's memory goes away with the driver,
+// but it may still have to be redrawn, e.g. when toggling fullscreen while paused.
+void driver_detach_frame_cache(void)
+{
+   if (!g_extern.frame_cache.from_driver)
+      return;
+
+   g_extern.frame_cache.from_driver = false;
+
+   size_t size = g_extern.frame_cache.height * g_extern.frame_cache.pitch;
+   if (size > g_extern.frame_cache.copy_size)
+   {
+      void *copy = realloc(g_extern.frame_cache.copy, size);
+      if (!copy)
+      {
+         g_extern.frame_cache.data = NULL;
+         return;
+      }
+
+      g_extern.frame_cache.copy = copy;
+      g_extern.frame_cache.copy_size = size;
+   }
+
+   memcpy(g_extern.frame_cache.copy, g_extern.frame_cache.data, size);
+   g_extern.frame_cache.data = g_extern.frame_cache.copy;
+}
+
 retro_proc_address_t driver_get_proc_address(const char *sym)
 {
 #ifdef HAVE_FBO
@@ -472,6 +523,8 @@ void init_audio(void)
 
    // Used for recording even if audio isn't enabled.
    rarch_assert(g_extern.audio_data.conv_outsamples = (int16_t*)malloc(outsamples_max * sizeof(int16_t)));
+   // Kept apart from conv_outsamples, which audio_flush() starts writing to before it is done reading the chunk.
+   rarch_assert(g_extern.audio_data.sample_buf = (int16_t*)malloc(AUDIO_CHUNK_SIZE_NONBLOCKING * sizeof(int16_t)));
 
    g_extern.audio_data.block_chunk_size    = AUDIO_CHUNK_SIZE_BLOCKING;
    g_extern.audio_data.nonblock_chunk_size = AUDIO_CHUNK_SIZE_NONBLOCKING;
@@ -511,7 +564,8 @@ void init_audio(void)
 
    const char *resampler = *g_settings.audio.resampler ? g_settings.audio.resampler : NULL;
    if (!rarch_resampler_realloc(&g_extern.audio_data.resampler_data, &g_extern.audio_data.resampler,
-         resampler, g_extern.audio_data.orig_src_ratio))
+         resampler, (enum resampler_quality)g_settings.audio.resampler_quality,
+         g_extern.audio_data.orig_src_ratio))
    {
       RARCH_ERR("Failed to initialize resampler \"%s\".\n", resampler ? resampler : "(default)");
       g_extern.audio_active = false;
@@ -529,7 +583,11 @@ void init_audio(void)
       if (driver.audio->buffer_size && driver.audio->write_avail)
       {
          g_extern.audio_data.driver_buffer_size = audio_buffer_size_func();
-         g_extern.audio_data.rate_control = true;
+
+         unsigned frame_size = (g_extern.audio_data.use_float ? sizeof(float) : sizeof(int16_t)) * 2;
+         g_extern.audio_data.rate_controller = rate_control_new(g_extern.audio_data.driver_buffer_size,
+               (double)g_settings.audio.out_rate * frame_size);
+         g_extern.audio_data.rate_control = g_extern.audio_data.rate_controller != NULL;
       }
       else
          RARCH_WARN("Audio rate control was desired, but driver does not support needed features.\n");
@@ -638,6 +696,8 @@ void uninit_audio(void)
 {
    free(g_extern.audio_data.conv_outsamples);
    g_extern.audio_data.conv_outsamples = NULL;
+   free(g_extern.audio_data.sample_buf);
+   g_extern.audio_data.sample_buf      = NULL;
    g_extern.audio_data.data_ptr        = 0;
 
    free(g_extern.audio_data.rewind_buf);
@@ -664,6 +724,19 @@ void uninit_audio(void)
    deinit_dsp_plugin();
 #endif
 
+   if (g_extern.audio_data.rate_controller)
+   {
+      struct rate_control_stats stats;
+      rate_control_get_stats(g_extern.audio_data.rate_controller, &stats);
+      RARCH_LOG("Rate control: %llu underruns over %llu updates. Average saturation %.2f %% (deviation %.2f %%), latency %.1f ms.\n",
+            (unsigned long long)stats.underruns, (unsigned long long)stats.updates,
+            stats.mean_fill * 100.0, stats.fill_deviation * 100.0, stats.mean_latency_ms);
+
+      rate_control_free(g_extern.audio_data.rate_controller);
+      g_extern.audio_data.rate_controller = NULL;
+   }
+   g_extern.audio_data.rate_control = false;
+
    compute_audio_buffer_statistics();
 }
 
@@ -913,14 +986,18 @@ void init_video_input(void)
    video.rgb32 = g_extern.filter.active || (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888);
 
    const input_driver_t *tmp = driver.input;
+   driver.scaler_threaded = false;
 #ifdef HAVE_THREADS
    if (g_settings.video.threaded && !g_extern.system.hw_render_callback.context_type) // Can't do hardware rendering with threaded driver currently.
    {
+      // Filters take RGB565, so they still need the conversion on the main thread.
+      driver.scaler_threaded = g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && !video.rgb32;
+
       find_video_driver(); // Need to grab the "real" video driver interface on a reinit.
       RARCH_LOG("Starting threaded video driver ...\n");
       if (!rarch_threaded_video_init(&driver.video, &driver.video_data,
                &driver.input, &driver.input_data,
-               driver.video, &video))
+               driver.video, &video, driver.scaler_threaded))
       {
          RARCH_ERR("Cannot open threaded video driver ... Exiting ...\n");
          rarch_fail(1, "init_video_input()");
@@ -1008,6 +1085,9 @@ void uninit_video_input(void)
    if (driver.input_data != driver.video_data && driver.input)
       input_free_func();
 
+   driver_detach_frame_cache();
+   driver.software_framebuffer = NULL;
+
    if (driver.video_data && driver.video)
       video_free_func();
 
@@ -41,6 +41,7 @@ extern "C" {
 #define AUDIO_CHUNK_SIZE_BLOCKING 512
 #define AUDIO_CHUNK_SIZE_NONBLOCKING 2048 // So we don't get complete line-noise when fast-forwarding audio.
 #define AUDIO_MAX_RATIO 16
+#define AUDIO_TILE_FRAMES 256 // audio_flush() runs this many frames through all stages at a time, so they stay in cache.
 
 // Specialized _POINTER that targets the full screen regardless of viewport.
 // Should not be used by a libretro implementation as coordinates returned make no sense.
@@ -358,6 +359,10 @@ typedef struct video_poke_interface
 
    void (*show_mouse)(void *data, bool state);
    void (*grab_mouse_toggle)(void *data);
+
+   // Memory the core can render its next frame into, saving a copy in video_frame().
+   // Valid until that frame is passed to the driver.
+   bool (*get_current_software_framebuffer)(void *data, struct retro_framebuffer *framebuffer);
 } video_poke_interface_t;
 
 typedef struct video_driver
@@ -439,6 +444,11 @@ typedef struct driver
    // Used for 15-bit -> 16-bit conversions that take place before being passed to video driver.
    struct scaler_ctx scaler;
    void *scaler_out;
+   // The threaded video driver does the conversion itself. Frames are only converted here for recording.
+   bool scaler_threaded;
+
+   // Last memory handed out to the core through RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER.
+   const void *software_framebuffer;
 
    // Graphics driver requires RGBA byte order data (ABGR on little-endian) for 32-bit.
    // This takes effect for overlay and shader cores that wants to load data into graphics driver.
@@ -475,6 +485,9 @@ void driver_set_nonblock_state(bool nonblock);
 
 // Used by RETRO_ENVIRONMENT_SET_HW_RENDER.
 uintptr_t driver_get_current_framebuffer(void);
+bool driver_get_current_software_framebuffer(struct retro_framebuffer *framebuffer);
+// Copies the cached frame out of memory handed out by the video driver.
+void driver_detach_frame_cache(void);
 retro_proc_address_t driver_get_proc_address(const char *sym);
 
 extern driver_t driver;
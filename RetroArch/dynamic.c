@@ -697,6 +697,21 @@ static bool environment_cb(unsigned cmd, void *data)
          break;
       }
 
+      // Called every frame, so don't log.
+      case RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER:
+         return driver_get_current_software_framebuffer((struct retro_framebuffer*)data);
+
+      case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+      {
+         int enable = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+#ifdef HAVE_NETPLAY
+         if (g_extern.netplay && netplay_should_skip(g_extern.netplay))
+            enable = 0;
+#endif
+         *(int*)data = enable;
+         break;
+      }
+
       default:
          RARCH_LOG("Environ UNSUPPORTED (#%u).\n", cmd);
          return false;
@@ -28,6 +28,7 @@
 #include "movie.h"
 #include "autosave.h"
 #include "dynamic.h"
+#include "audio/rate_control.h"
 #include "cheats.h"
 #include "audio/ext/rarch_dsp.h"
 #include "compat/strl.h"
@@ -156,6 +157,7 @@ struct settings
       bool vsync;
       bool hard_sync;
       unsigned hard_sync_frames;
+      bool pbo_upload;
       bool smooth;
       bool force_aspect;
       bool crop_overscan;
@@ -208,6 +210,7 @@ struct settings
       float rate_control_delta;
       float volume; // dB scale
       char resampler[32];
+      unsigned resampler_quality;
    } audio;
 
    struct
@@ -233,6 +236,7 @@ struct settings
       unsigned icade_count;
 #endif
       bool netplay_client_swap_input;
+      char netplay_predictor[32];
 
       unsigned turbo_period;
       unsigned turbo_duty_cycle;
@@ -256,6 +260,9 @@ struct settings
    bool rewind_enable;
    size_t rewind_buffer_size;
    unsigned rewind_granularity;
+   char rewind_compression[32];
+   bool rewind_threaded;
+   unsigned rewind_keyframe_interval;
 
    float slowmotion_ratio;
 
@@ -394,6 +401,7 @@ struct global
 
       float *data;
 
+      int16_t *sample_buf; // Collects samples from the single sample callback, up to a chunk.
       size_t data_ptr;
       size_t chunk_size;
       size_t nonblock_chunk_size;
@@ -416,6 +424,7 @@ struct global
       void *dsp_handle;
 
       bool rate_control; 
+      rate_control_t *rate_controller;
       double orig_src_ratio;
       size_t driver_buffer_size;
 
@@ -526,6 +535,12 @@ struct global
       unsigned width;
       unsigned height;
       size_t pitch;
+
+      // data is memory handed out by the video driver, see driver_get_current_software_framebuffer().
+      bool from_driver;
+      // Where such a frame is kept once the driver goes away.
+      void *copy;
+      size_t copy_size;
    } frame_cache;
 
    unsigned frame_count;
@@ -675,6 +690,7 @@ void rarch_input_poll(void);
 void rarch_check_overlay(void);
 void rarch_init_rewind(void);
 void rarch_deinit_rewind(void);
+void rarch_log_rewind_stats(void);
 void rarch_set_fullscreen(bool fullscreen);
 void rarch_disk_control_set_eject(bool state, bool log);
 void rarch_disk_control_set_index(unsigned index);
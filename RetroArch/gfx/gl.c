@@ -140,6 +140,23 @@ static bool load_sync_proc(gl_t *gl)
 
    return pglFenceSync && pglDeleteSync && pglClientWaitSync;
 }
+
+#if !defined(HAVE_OPENGLES) && !defined(HAVE_PSGL) && defined(GL_MAP_PERSISTENT_BIT)
+#define HAVE_GL_BUFFER_STORAGE
+static PFNGLBUFFERSTORAGEPROC pglBufferStorage;
+static PFNGLMAPBUFFERRANGEPROC pglMapBufferRange;
+
+static bool load_buffer_storage_proc(gl_t *gl)
+{
+   if (!gl_query_extension("ARB_buffer_storage"))
+      return false;
+
+   LOAD_GL_SYM(BufferStorage);
+   LOAD_GL_SYM(MapBufferRange);
+
+   return pglBufferStorage && pglMapBufferRange;
+}
+#endif
 #endif
 
 #ifdef HAVE_FBO
@@ -1198,6 +1215,179 @@ static void gl_init_textures(void *data, const video_info_t *video)
    glBindTexture(GL_TEXTURE_2D, gl->texture[gl->tex_index]);
 }
 
+#if !defined(HAVE_OPENGLES) && !defined(HAVE_PSGL)
+static void gl_deinit_pbo_upload(void *data)
+{
+   gl_t *gl = (gl_t*)data;
+   if (!gl->pbo_upload_enable)
+      return;
+
+   // The last frame may have been rendered into one of the mappings, and it may still be redrawn.
+   if (gl->pbo_upload_shared)
+      driver_detach_frame_cache();
+   gl->pbo_upload_shared = false;
+
+   for (unsigned i = 0; i < PBO_UPLOAD_BUFFERS; i++)
+   {
+#ifdef HAVE_GL_SYNC
+      if (gl->pbo_upload_fence[i])
+      {
+         pglClientWaitSync(gl->pbo_upload_fence[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+         pglDeleteSync(gl->pbo_upload_fence[i]);
+         gl->pbo_upload_fence[i] = 0;
+      }
+#endif
+
+      if (gl->pbo_upload_ptr[i])
+      {
+         pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload[i]);
+         pglUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+         gl->pbo_upload_ptr[i] = NULL;
+      }
+   }
+
+   pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+   pglDeleteBuffers(PBO_UPLOAD_BUFFERS, gl->pbo_upload);
+   memset(gl->pbo_upload, 0, sizeof(gl->pbo_upload));
+
+   gl->pbo_upload_enable = false;
+   gl->pbo_upload_persistent = false;
+}
+
+#ifdef HAVE_GL_BUFFER_STORAGE
+static bool gl_init_pbo_upload_persistent(void *data)
+{
+   gl_t *gl = (gl_t*)data;
+   if (!gl->have_sync || !load_buffer_storage_proc(gl))
+      return false;
+
+   const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+   for (unsigned i = 0; i < PBO_UPLOAD_BUFFERS; i++)
+   {
+      pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload[i]);
+      pglBufferStorage(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload_size, NULL, flags);
+      gl->pbo_upload_ptr[i] = (uint8_t*)pglMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, gl->pbo_upload_size, flags);
+      if (!gl->pbo_upload_ptr[i])
+         return false;
+   }
+
+   pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+   return true;
+}
+#endif
+
+static void gl_init_pbo_upload(void *data)
+{
+   gl_t *gl = (gl_t*)data;
+   // Frames rendered by the core on the GPU never go through gl_copy_frame().
+   gl->pbo_upload_enable = g_settings.video.pbo_upload && !gl->hw_render_use;
+   if (!gl->pbo_upload_enable)
+      return;
+
+   // Always use 32-bit textures on desktop GL.
+   gl->pbo_upload_size  = gl->tex_w * gl->tex_h * sizeof(uint32_t);
+   gl->pbo_upload_index = 0;
+   pglGenBuffers(PBO_UPLOAD_BUFFERS, gl->pbo_upload);
+
+#ifdef HAVE_GL_BUFFER_STORAGE
+   gl->pbo_upload_persistent = gl_init_pbo_upload_persistent(gl);
+   if (gl->pbo_upload_persistent)
+   {
+      RARCH_LOG("[GL]: Using persistently mapped PBOs for frame upload.\n");
+      return;
+   }
+
+   // Buffer storage is immutable, so start over with fresh buffers.
+   gl_deinit_pbo_upload(gl);
+   gl->pbo_upload_enable = true;
+   pglGenBuffers(PBO_UPLOAD_BUFFERS, gl->pbo_upload);
+#endif
+
+   for (unsigned i = 0; i < PBO_UPLOAD_BUFFERS; i++)
+   {
+      pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload[i]);
+      pglBufferData(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload_size, NULL, GL_STREAM_DRAW);
+   }
+   pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+   RARCH_LOG("[GL]: Using PBOs for frame upload.\n");
+}
+
+// Blocks until GPU is done sourcing the buffer from last time around the ring. Should normally be a no-op.
+static void gl_pbo_upload_wait(void *data, unsigned index)
+{
+#ifdef HAVE_GL_SYNC
+   gl_t *gl = (gl_t*)data;
+   if (gl->pbo_upload_fence[index])
+   {
+      RARCH_PERFORMANCE_INIT(pbo_upload_wait);
+      RARCH_PERFORMANCE_START(pbo_upload_wait);
+      pglClientWaitSync(gl->pbo_upload_fence[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      pglDeleteSync(gl->pbo_upload_fence[index]);
+      gl->pbo_upload_fence[index] = 0;
+      RARCH_PERFORMANCE_STOP(pbo_upload_wait);
+   }
+#else
+   (void)data;
+   (void)index;
+#endif
+}
+
+static void gl_pbo_upload_frame(void *data, const void *frame, unsigned width, unsigned height, unsigned pitch)
+{
+   gl_t *gl = (gl_t*)data;
+   unsigned index = gl->pbo_upload_index;
+   gl->pbo_upload_index = (gl->pbo_upload_index + 1) % PBO_UPLOAD_BUFFERS;
+
+   pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload[index]);
+
+   uint8_t *dst;
+   if (gl->pbo_upload_persistent)
+   {
+      gl_pbo_upload_wait(gl, index);
+      dst = gl->pbo_upload_ptr[index];
+   }
+   else
+   {
+      // Orphan the old storage, so the driver doesn't make us wait for the GPU to source it.
+      pglBufferData(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload_size, NULL, GL_STREAM_DRAW);
+      dst = (uint8_t*)pglMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+      if (!dst)
+      {
+         RARCH_ERR("[GL]: Failed to map PBO for frame upload.\n");
+         pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+         return;
+      }
+   }
+
+   const unsigned line_bytes = width * sizeof(uint32_t);
+   if (gl->base_size == 2)
+      gl_convert_frame_rgb16_32(gl, dst, frame, width, height, pitch);
+   else if (frame != dst) // Core might have rendered straight into the PBO.
+   {
+      const uint8_t *src = (const uint8_t*)frame;
+      uint8_t *out = dst;
+      for (unsigned h = 0; h < height; h++, src += pitch, out += line_bytes)
+         memcpy(out, src, line_bytes);
+   }
+
+   if (!gl->pbo_upload_persistent)
+      pglUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+   glPixelStorei(GL_UNPACK_ALIGNMENT, get_alignment(line_bytes));
+   glTexSubImage2D(GL_TEXTURE_2D,
+         0, 0, 0, width, height, gl->texture_type,
+         gl->texture_fmt, NULL);
+
+#ifdef HAVE_GL_SYNC
+   if (gl->pbo_upload_persistent)
+      gl->pbo_upload_fence[index] = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
+   pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+#endif
+
 static inline void gl_copy_frame(void *data, const void *frame, unsigned width, unsigned height, unsigned pitch)
 {
    gl_t *gl = (gl_t*)data;
@@ -1268,6 +1458,12 @@ static inline void gl_copy_frame(void *data, const void *frame, unsigned width,
 
    glUnmapBuffer(GL_TEXTURE_REFERENCE_BUFFER_SCE);
 #else
+   if (gl->pbo_upload_enable)
+   {
+      gl_pbo_upload_frame(gl, frame, width, height, pitch);
+      return;
+   }
+
    glPixelStorei(GL_UNPACK_ALIGNMENT, get_alignment(pitch));
    if (gl->base_size == 2)
    {
@@ -1612,6 +1808,10 @@ static void gl_free(void *data)
 
    scaler_ctx_gen_reset(&gl->scaler);
 
+#if !defined(HAVE_OPENGLES) && !defined(HAVE_PSGL)
+   gl_deinit_pbo_upload(gl);
+#endif
+
 #if !defined(HAVE_OPENGLES) && defined(HAVE_FFMPEG)
    if (gl->pbo_readback_enable)
    {
@@ -1739,6 +1939,11 @@ static inline void gl_reinit_textures(void *data, const video_info_t *video)
       gl_init_textures(gl, video);
       gl_init_textures_data(gl);
 
+#if !defined(HAVE_OPENGLES) && !defined(HAVE_PSGL)
+      gl_deinit_pbo_upload(gl);
+      gl_init_pbo_upload(gl);
+#endif
+
 #ifdef HAVE_FBO
       if (gl->tex_w > old_width || gl->tex_h > old_height)
       {
@@ -2001,6 +2206,10 @@ static void *gl_init(const video_info_t *video, const input_driver_t **input, vo
    gl_init_pbo_readback(gl);
 #endif
 
+#if !defined(HAVE_OPENGLES) && !defined(HAVE_PSGL)
+   gl_init_pbo_upload(gl);
+#endif
+
    if (!gl_check_error())
    {
       context_destroy_func();
@@ -2487,6 +2696,32 @@ static void gl_show_mouse(void *data, bool state)
       gl->ctx_driver->show_mouse(state);
 }
 
+#ifdef HAVE_GL_BUFFER_STORAGE
+// Lets the core render straight into the next upload PBO.
+// Only for XRGB8888, since RGB565 frames have to be converted to 32-bit on desktop GL anyways.
+// The mapping is write-combined, so it is only handed out to cores which never read from it.
+static bool gl_get_current_software_framebuffer(void *data, struct retro_framebuffer *framebuffer)
+{
+   gl_t *gl = (gl_t*)data;
+   if (!gl->pbo_upload_persistent || gl->base_size != sizeof(uint32_t))
+      return false;
+   if (framebuffer->access_flags != RETRO_MEMORY_ACCESS_WRITE)
+      return false;
+   if (framebuffer->width > gl->tex_w || framebuffer->height > gl->tex_h)
+      return false;
+
+   unsigned index = gl->pbo_upload_index;
+   gl_pbo_upload_wait(gl, index);
+
+   framebuffer->data   = gl->pbo_upload_ptr[index];
+   framebuffer->pitch  = framebuffer->width * sizeof(uint32_t);
+   framebuffer->format = RETRO_PIXEL_FORMAT_XRGB8888;
+   framebuffer->memory_flags = 0;
+   gl->pbo_upload_shared = true;
+   return true;
+}
+#endif
+
 static const video_poke_interface_t gl_poke_interface = {
    NULL,
 #ifdef HAVE_FBO
@@ -2502,6 +2737,12 @@ static const video_poke_interface_t gl_poke_interface = {
    gl_set_osd_msg,
 
    gl_show_mouse,
+   NULL,
+#ifdef HAVE_GL_BUFFER_STORAGE
+   gl_get_current_software_framebuffer,
+#else
+   NULL,
+#endif
 };
 
 static void gl_get_poke_interface(void *data, const video_poke_interface_t **iface)
@@ -276,6 +276,21 @@ typedef struct gl
    struct scaler_ctx pbo_readback_scaler;
 #endif
 
+#if !defined(HAVE_OPENGLES) && !defined(HAVE_PSGL)
+   // PBOs used for streaming frames to the GPU.
+#define PBO_UPLOAD_BUFFERS 3
+   GLuint pbo_upload[PBO_UPLOAD_BUFFERS];
+   uint8_t *pbo_upload_ptr[PBO_UPLOAD_BUFFERS]; // Persistently mapped.
+#ifdef HAVE_GL_SYNC
+   GLsync pbo_upload_fence[PBO_UPLOAD_BUFFERS]; // Signalled when GPU is done sourcing the buffer.
+#endif
+   size_t pbo_upload_size;
+   unsigned pbo_upload_index;
+   bool pbo_upload_enable;
+   bool pbo_upload_persistent;
+   bool pbo_upload_shared; // Mapping was handed out to the core.
+#endif
+
 #if defined(HAVE_RGUI) || defined(HAVE_RMENU)
    GLuint rgui_texture;
    bool rgui_texture_enable;
@@ -15,6 +15,7 @@
 
 #include "../general.h"
 #include "../driver.h"
+#include <string.h>
 
 static void *null_gfx_init(const video_info_t *video,
       const input_driver_t **input, void **input_data)
@@ -62,11 +63,17 @@ static void null_gfx_free(void *data)
    (void)data;
 }
 
-#ifdef RARCH_CONSOLE
+#if defined(HAVE_RMENU) || defined(HAVE_RGUI)
 static void null_gfx_start(void) {}
 static void null_gfx_restart(void) {}
 #endif
 
+static void null_gfx_viewport_info(void *data, struct rarch_viewport *vp)
+{
+   (void)data;
+   memset(vp, 0, sizeof(*vp));
+}
+
 const video_driver_t video_null = {
    null_gfx_init,
    null_gfx_frame,
@@ -77,9 +84,12 @@ const video_driver_t video_null = {
    null_gfx_free,
    "null",
 
-#ifdef RARCH_CONSOLE
+#if defined(HAVE_RMENU) || defined(HAVE_RGUI)
    null_gfx_start,
    null_gfx_restart,
 #endif
+
+   NULL, // set_rotation
+   null_gfx_viewport_info,
 };
 
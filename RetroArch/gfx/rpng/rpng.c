@@ -26,6 +26,16 @@
 #include <string.h>
 #include "../../hash.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#endif
+
 // Decodes a subset of PNG standard.
 // Does not handle much outside 24/32-bit RGB(A) images.
 //
@@ -98,12 +108,6 @@ struct
    { "IEND", PNG_CHUNK_IEND },
 };
 
-struct idat_buffer
-{
-   uint8_t *data;
-   size_t size;
-};
-
 static enum png_chunk_type png_chunk_type(const struct png_chunk *chunk)
 {
    for (unsigned i = 0; i < sizeof(chunk_map) / sizeof(chunk_map[0]); i++)
@@ -215,96 +219,394 @@ static inline void copy_line_rgba(uint32_t *data, const uint8_t *decoded, unsign
    }
 }
 
-static bool png_reverse_filter(uint32_t *data, const struct png_ihdr *ihdr,
-      const uint8_t *inflate_buf, size_t inflate_buf_size)
+// Reverse filters work in place on the filtered line, prev is the previous decoded line (zero for the first).
+// Sub, average and Paeth depend on the pixel to the left, so SIMD versions work on one pixel at a time,
+// but do all channels at once.
+#if defined(__SSE2__)
+static inline __m128i png_load4(const uint8_t *p)
 {
-   bool ret = true;
-   unsigned bpp = ihdr->color_type == 2 ? 3 : 4;
-   if (inflate_buf_size < (ihdr->width * bpp + 1) * ihdr->height)
-      return false;
+   int tmp;
+   memcpy(&tmp, p, sizeof(tmp));
+   return _mm_cvtsi32_si128(tmp);
+}
 
-   unsigned pitch = ihdr->width * bpp;
-   uint8_t *prev_scanline    = (uint8_t*)calloc(1, pitch);
-   uint8_t *decoded_scanline = (uint8_t*)calloc(1, pitch);
+static inline void png_store4(uint8_t *p, __m128i v)
+{
+   int tmp = _mm_cvtsi128_si32(v);
+   memcpy(p, &tmp, sizeof(tmp));
+}
 
-   if (!decoded_scanline || !decoded_scanline)
-      GOTO_END_ERROR();
+static inline __m128i png_load3(const uint8_t *p)
+{
+   int tmp = 0;
+   memcpy(&tmp, p, 3);
+   return _mm_cvtsi32_si128(tmp);
+}
 
-   for (unsigned h = 0; h < ihdr->height;
-         h++, inflate_buf += pitch, data += ihdr->width)
-   {
-      unsigned filter = *inflate_buf++;
-      switch (filter)
-      {
-         case 0: // None
-            memcpy(decoded_scanline, inflate_buf, pitch);
-            break;
+static inline void png_store3(uint8_t *p, __m128i v)
+{
+   int tmp = _mm_cvtsi128_si32(v);
+   memcpy(p, &tmp, 3);
+}
 
-         case 1: // Sub
-            for (unsigned i = 0; i < bpp; i++)
-               decoded_scanline[i] = inflate_buf[i];
-            for (unsigned i = bpp; i < pitch; i++)
-               decoded_scanline[i] = decoded_scanline[i - bpp] + inflate_buf[i];
-            break;
+// Pixels are loaded as 4 bytes even with bpp 3 as long as the line has room for it.
+// The extra byte is never stored, and is overwritten before it is used.
+#define PNG_SIMD_LOOP(bpp, body) do { \
+   __m128i (*load)(const uint8_t*) = bpp == 4 ? png_load4 : png_load3; \
+   for (; pitch >= 4; row += bpp, prev += bpp, pitch -= bpp) \
+      body(png_load4, png_store, bpp); \
+   if (pitch) \
+      body(load, png_store, bpp); \
+} while (0)
+
+static inline void png_store(uint8_t *p, __m128i v, unsigned bpp)
+{
+   if (bpp == 4)
+      png_store4(p, v);
+   else
+      png_store3(p, v);
+}
 
-         case 2: // Up
-            for (unsigned i = 0; i < pitch; i++)
-               decoded_scanline[i] = prev_scanline[i] + inflate_buf[i];
-            break;
+static void png_unfilter_sub_simd(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   __m128i d = _mm_setzero_si128();
+#define PNG_SUB(LOAD, STORE, bpp) do { \
+   d = _mm_add_epi8(LOAD(row), d); \
+   STORE(row, d, bpp); \
+} while (0)
+   PNG_SIMD_LOOP(bpp, PNG_SUB);
+#undef PNG_SUB
+}
 
-         case 3: // Average
-            for (unsigned i = 0; i < bpp; i++)
-            {
-               uint8_t avg = prev_scanline[i] >> 1;
-               decoded_scanline[i] = avg + inflate_buf[i];
-            }
-            for (unsigned i = bpp; i < pitch; i++)
-            {
-               uint8_t avg = (decoded_scanline[i - bpp] + prev_scanline[i]) >> 1;
-               decoded_scanline[i] = avg + inflate_buf[i];
-            }
-            break;
+static void png_unfilter_avg_simd(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i d = _mm_setzero_si128();
+   // _mm_avg_epu8() rounds up, PNG truncates. Subtract the rounding back out.
+#define PNG_AVG(LOAD, STORE, bpp) do { \
+   __m128i b = LOAD(prev); \
+   __m128i avg = _mm_avg_epu8(d, b); \
+   avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(d, b), one)); \
+   d = _mm_add_epi8(LOAD(row), avg); \
+   STORE(row, d, bpp); \
+} while (0)
+   PNG_SIMD_LOOP(bpp, PNG_AVG);
+#undef PNG_AVG
+}
 
-         case 4: // Paeth
-            for (unsigned i = 0; i < bpp; i++)
-               decoded_scanline[i] = paeth(0, prev_scanline[i], 0) + inflate_buf[i];
-            for (unsigned i = bpp; i < pitch; i++)
-               decoded_scanline[i] = paeth(decoded_scanline[i - bpp], prev_scanline[i], prev_scanline[i - bpp]) + inflate_buf[i];
-            break;
+static inline __m128i png_abs_i16(__m128i x)
+{
+   __m128i neg = _mm_cmplt_epi16(x, _mm_setzero_si128());
+   return _mm_sub_epi16(_mm_xor_si128(x, neg), neg);
+}
 
-         default:
-            GOTO_END_ERROR();
-      }
+static inline __m128i png_select(__m128i cond, __m128i t, __m128i e)
+{
+   return _mm_or_si128(_mm_and_si128(cond, t), _mm_andnot_si128(cond, e));
+}
 
-      if (bpp == 3)
-         copy_line_rgb(data, decoded_scanline, ihdr->width);
-      else
-         copy_line_rgba(data, decoded_scanline, ihdr->width);
+static void png_unfilter_paeth_simd(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, b = zero, c = zero, d = zero;
+   // Works on 16-bit lanes. p - a = b - c, p - b = a - c, p - c = (a - c) + (b - c).
+#define PNG_PAETH(LOAD, STORE, bpp) do { \
+   c = b; \
+   b = _mm_unpacklo_epi8(LOAD(prev), zero); \
+   a = d; \
+   __m128i pa = _mm_sub_epi16(b, c); \
+   __m128i pb = _mm_sub_epi16(a, c); \
+   __m128i pc = _mm_add_epi16(pa, pb); \
+   pa = png_abs_i16(pa); \
+   pb = png_abs_i16(pb); \
+   pc = png_abs_i16(pc); \
+   __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb)); \
+   __m128i pred = png_select(_mm_cmpeq_epi16(smallest, pa), a, \
+         png_select(_mm_cmpeq_epi16(smallest, pb), b, c)); \
+   d = _mm_add_epi8(_mm_unpacklo_epi8(LOAD(row), zero), pred); \
+   STORE(row, _mm_packus_epi16(d, d), bpp); \
+} while (0)
+   PNG_SIMD_LOOP(bpp, PNG_PAETH);
+#undef PNG_PAETH
+}
+#define PNG_HAVE_SIMD
+#elif defined(__ARM_NEON__)
+static inline uint8x8_t png_load4(const uint8_t *p)
+{
+   uint32_t tmp;
+   memcpy(&tmp, p, sizeof(tmp));
+   return vreinterpret_u8_u32(vdup_n_u32(tmp));
+}
+
+static inline uint8x8_t png_load3(const uint8_t *p)
+{
+   uint32_t tmp = 0;
+   memcpy(&tmp, p, 3);
+   return vreinterpret_u8_u32(vdup_n_u32(tmp));
+}
+
+static inline void png_store(uint8_t *p, uint8x8_t v, unsigned bpp)
+{
+   uint32_t tmp = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+   memcpy(p, &tmp, bpp);
+}
+
+// Pixels are loaded as 4 bytes even with bpp 3 as long as the line has room for it.
+// The extra byte is never stored, and is overwritten before it is used.
+#define PNG_SIMD_LOOP(bpp, body) do { \
+   uint8x8_t (*load)(const uint8_t*) = bpp == 4 ? png_load4 : png_load3; \
+   for (; pitch >= 4; row += bpp, prev += bpp, pitch -= bpp) \
+      body(png_load4, png_store, bpp); \
+   if (pitch) \
+      body(load, png_store, bpp); \
+} while (0)
+
+static void png_unfilter_sub_simd(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   uint8x8_t d = vdup_n_u8(0);
+#define PNG_SUB(LOAD, STORE, bpp) do { \
+   d = vadd_u8(LOAD(row), d); \
+   STORE(row, d, bpp); \
+} while (0)
+   PNG_SIMD_LOOP(bpp, PNG_SUB);
+#undef PNG_SUB
+}
+
+static void png_unfilter_avg_simd(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   uint8x8_t d = vdup_n_u8(0);
+   // Halving add truncates, just like PNG wants.
+#define PNG_AVG(LOAD, STORE, bpp) do { \
+   d = vadd_u8(LOAD(row), vhadd_u8(d, LOAD(prev))); \
+   STORE(row, d, bpp); \
+} while (0)
+   PNG_SIMD_LOOP(bpp, PNG_AVG);
+#undef PNG_AVG
+}
+
+static void png_unfilter_paeth_simd(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   uint8x8_t a = vdup_n_u8(0), b = a, c = a, d = a;
+#define PNG_PAETH(LOAD, STORE, bpp) do { \
+   c = b; \
+   b = LOAD(prev); \
+   a = d; \
+   uint16x8_t pa = vabdl_u8(b, c); \
+   uint16x8_t pb = vabdl_u8(a, c); \
+   uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c)); \
+   uint8x8_t use_a = vmovn_u16(vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc))); \
+   uint8x8_t use_b = vmovn_u16(vcleq_u16(pb, pc)); \
+   uint8x8_t pred = vbsl_u8(use_a, a, vbsl_u8(use_b, b, c)); \
+   d = vadd_u8(LOAD(row), pred); \
+   STORE(row, d, bpp); \
+} while (0)
+   PNG_SIMD_LOOP(bpp, PNG_PAETH);
+#undef PNG_PAETH
+}
+#define PNG_HAVE_SIMD
+#endif
 
-      memcpy(prev_scanline, decoded_scanline, pitch);
+static void png_unfilter_sub(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+#ifdef PNG_HAVE_SIMD
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_sub_simd(row, prev, pitch, bpp);
+      return;
    }
+#endif
 
-end:
-   free(decoded_scanline);
-   free(prev_scanline);
-   return ret;
+   for (unsigned i = bpp; i < pitch; i++)
+      row[i] += row[i - bpp];
 }
 
-static bool png_append_idat(FILE *file, const struct png_chunk *chunk, struct idat_buffer *buf)
+static void png_unfilter_up(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
 {
-   uint8_t *new_buffer = (uint8_t*)realloc(buf->data, buf->size + chunk->size);
-   if (!new_buffer)
-      return false;
+   (void)bpp;
+   for (unsigned i = 0; i < pitch; i++)
+      row[i] += prev[i];
+}
 
-   buf->data  = new_buffer;
-   if (fread(buf->data + buf->size, 1, chunk->size, file) != chunk->size)
-      return false;
-   if (fseek(file, sizeof(uint32_t), SEEK_CUR) < 0)
+static void png_unfilter_avg(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+#ifdef PNG_HAVE_SIMD
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_avg_simd(row, prev, pitch, bpp);
+      return;
+   }
+#endif
+
+   for (unsigned i = 0; i < bpp; i++)
+      row[i] += prev[i] >> 1;
+   for (unsigned i = bpp; i < pitch; i++)
+      row[i] += (row[i - bpp] + prev[i]) >> 1;
+}
+
+static void png_unfilter_paeth(uint8_t *row, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+#ifdef PNG_HAVE_SIMD
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_paeth_simd(row, prev, pitch, bpp);
+      return;
+   }
+#endif
+
+   for (unsigned i = 0; i < bpp; i++)
+      row[i] += paeth(0, prev[i], 0);
+   for (unsigned i = bpp; i < pitch; i++)
+      row[i] += paeth(row[i - bpp], prev[i], prev[i - bpp]);
+}
+
+// Inflates IDAT data as it is read, and reverse filters every line as soon as it is complete,
+// so neither the compressed nor the filtered image ever has to be in memory at once.
+#define PNG_IDAT_READ_SIZE (64 * 1024)
+
+struct png_decoder
+{
+   z_stream stream;
+   bool stream_init;
+   bool stream_end;
+
+   const struct png_ihdr *ihdr;
+   unsigned bpp;
+   unsigned pitch;
+
+   // Filter type byte, followed by the line. Current line and previous one.
+   uint8_t *scanline[2];
+   unsigned scanline_pos;
+   unsigned cur;
+   unsigned line;
+
+   uint32_t *data;
+   uint8_t *read_buf;
+};
+
+static bool png_decoder_init(struct png_decoder *dec, const struct png_ihdr *ihdr, uint32_t *data)
+{
+   memset(dec, 0, sizeof(*dec));
+   dec->ihdr  = ihdr;
+   dec->bpp   = ihdr->color_type == 2 ? 3 : 4;
+   dec->pitch = ihdr->width * dec->bpp;
+   dec->data  = data;
+
+   if (inflateInit(&dec->stream) != Z_OK)
       return false;
-   buf->size += chunk->size;
+   dec->stream_init = true;
+
+   dec->scanline[0] = (uint8_t*)calloc(1, dec->pitch + 1);
+   dec->scanline[1] = (uint8_t*)calloc(1, dec->pitch + 1);
+   dec->read_buf    = (uint8_t*)malloc(PNG_IDAT_READ_SIZE);
+   return dec->scanline[0] && dec->scanline[1] && dec->read_buf;
+}
+
+static void png_decoder_free(struct png_decoder *dec)
+{
+   if (dec->stream_init)
+      inflateEnd(&dec->stream);
+   free(dec->scanline[0]);
+   free(dec->scanline[1]);
+   free(dec->read_buf);
+   memset(dec, 0, sizeof(*dec));
+}
+
+static bool png_decode_line(struct png_decoder *dec)
+{
+   uint8_t *row = dec->scanline[dec->cur] + 1;
+   const uint8_t *prev = dec->scanline[dec->cur ^ 1] + 1;
+
+   switch (row[-1])
+   {
+      case 0: // None
+         break;
+      case 1:
+         png_unfilter_sub(row, prev, dec->pitch, dec->bpp);
+         break;
+      case 2:
+         png_unfilter_up(row, prev, dec->pitch, dec->bpp);
+         break;
+      case 3:
+         png_unfilter_avg(row, prev, dec->pitch, dec->bpp);
+         break;
+      case 4:
+         png_unfilter_paeth(row, prev, dec->pitch, dec->bpp);
+         break;
+      default:
+         return false;
+   }
+
+   uint32_t *out = dec->data + dec->line * dec->ihdr->width;
+   if (dec->bpp == 3)
+      copy_line_rgb(out, row, dec->ihdr->width);
+   else
+      copy_line_rgba(out, row, dec->ihdr->width);
+
+   dec->line++;
+   dec->cur ^= 1;
    return true;
 }
 
+static bool png_decode_idat(FILE *file, const struct png_chunk *chunk, struct png_decoder *dec)
+{
+   z_stream *stream = &dec->stream;
+   const unsigned line_size = dec->pitch + 1;
+
+   for (uint32_t remaining = chunk->size; remaining; )
+   {
+      uint32_t read_size = remaining < PNG_IDAT_READ_SIZE ? remaining : PNG_IDAT_READ_SIZE;
+      if (fread(dec->read_buf, 1, read_size, file) != read_size)
+         return false;
+      remaining -= read_size;
+
+      stream->next_in  = dec->read_buf;
+      stream->avail_in = read_size;
+
+      // Output can still be pending after all input is consumed, if the last call filled up the line.
+      bool pending = false;
+      while ((stream->avail_in || pending) && !dec->stream_end)
+      {
+         uint8_t trailing[64];
+         bool done = dec->line >= dec->ihdr->height;
+
+         // Once every line is in, only the end of the stream is left. Anything else is ignored.
+         if (done)
+         {
+            stream->next_out  = trailing;
+            stream->avail_out = sizeof(trailing);
+         }
+         else
+         {
+            stream->next_out  = dec->scanline[dec->cur] + dec->scanline_pos;
+            stream->avail_out = line_size - dec->scanline_pos;
+         }
+
+         int err = inflate(stream, Z_NO_FLUSH);
+         pending = stream->avail_out == 0;
+         if (err == Z_STREAM_END)
+            dec->stream_end = true;
+         else if (err == Z_BUF_ERROR && !stream->avail_in)
+            break; // Needs more input.
+         else if (err != Z_OK)
+            return false;
+
+         if (!done)
+         {
+            dec->scanline_pos = line_size - stream->avail_out;
+            if (dec->scanline_pos == line_size)
+            {
+               dec->scanline_pos = 0;
+               if (!png_decode_line(dec))
+                  return false;
+            }
+         }
+      }
+   }
+
+   // Ignore CRC.
+   return fseek(file, sizeof(uint32_t), SEEK_CUR) == 0;
+}
+
 bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, unsigned *height)
 {
    *data   = NULL;
@@ -323,11 +625,8 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
    bool has_ihdr = false;
    bool has_idat = false;
    bool has_iend = false;
-   uint8_t *inflate_buf = NULL;
-   size_t inflate_buf_size = 0;
-   z_stream stream = {0};
 
-   struct idat_buffer idat_buf = {0};
+   struct png_decoder dec = {0};
    struct png_ihdr ihdr = {0};
 
    char header[8];
@@ -362,6 +661,13 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
             if (!png_parse_ihdr(file, &chunk, &ihdr))
                GOTO_END_ERROR();
 
+            *data = (uint32_t*)malloc(ihdr.width * ihdr.height * sizeof(uint32_t));
+            if (!*data)
+               GOTO_END_ERROR();
+
+            if (!png_decoder_init(&dec, &ihdr, *data))
+               GOTO_END_ERROR();
+
             has_ihdr = true;
             break;
 
@@ -369,7 +675,7 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
             if (!has_ihdr || has_iend)
                GOTO_END_ERROR();
 
-            if (!png_append_idat(file, &chunk, &idat_buf))
+            if (!png_decode_idat(file, &chunk, &dec))
                GOTO_END_ERROR();
 
             has_idat = true;
@@ -390,42 +696,21 @@ bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, un
    if (!has_ihdr || !has_idat || !has_iend)
       GOTO_END_ERROR();
 
-   if (inflateInit(&stream) != Z_OK)
-      GOTO_END_ERROR();
-
-   inflate_buf_size = (ihdr.width + 1) * ihdr.height * sizeof(uint32_t);
-   inflate_buf = (uint8_t*)malloc(inflate_buf_size);
-   if (!inflate_buf)
+   if (dec.line != ihdr.height || !dec.stream_end)
       GOTO_END_ERROR();
 
-   stream.next_in   = idat_buf.data;
-   stream.avail_in  = idat_buf.size;
-   stream.avail_out = inflate_buf_size;
-   stream.next_out  = inflate_buf;
-
-   if (inflate(&stream, Z_FINISH) != Z_STREAM_END)
-   {
-      inflateEnd(&stream);
-      GOTO_END_ERROR();
-   }
-   inflateEnd(&stream);
-
    *width  = ihdr.width;
    *height = ihdr.height;
-   *data = (uint32_t*)malloc(ihdr.width * ihdr.height * sizeof(uint32_t));
-   if (!*data)
-      GOTO_END_ERROR();
-
-   if (!png_reverse_filter(*data, &ihdr, inflate_buf, stream.total_out))
-      GOTO_END_ERROR();
 
 end:
    if (file)
       fclose(file);
    if (!ret)
+   {
       free(*data);
-   free(idat_buf.data);
-   free(inflate_buf);
+      *data = NULL;
+   }
+   png_decoder_free(&dec);
    return ret;
 }
 
@@ -577,24 +862,354 @@ static unsigned filter_paeth(uint8_t *target, const uint8_t *line, const uint8_t
    return count_sad(target, width);
 }
 
+struct png_filter_scratch
+{
+   uint8_t *rgba_line;
+   uint8_t *prev_encoded;
+   uint8_t *up_filtered;
+   uint8_t *sub_filtered;
+   uint8_t *avg_filtered;
+   uint8_t *paeth_filtered;
+};
+
+static void png_filter_scratch_free(struct png_filter_scratch *scratch)
+{
+   free(scratch->rgba_line);
+   free(scratch->prev_encoded);
+   free(scratch->up_filtered);
+   free(scratch->sub_filtered);
+   free(scratch->avg_filtered);
+   free(scratch->paeth_filtered);
+   memset(scratch, 0, sizeof(*scratch));
+}
+
+static bool png_filter_scratch_init(struct png_filter_scratch *scratch, size_t line_size)
+{
+   memset(scratch, 0, sizeof(*scratch));
+   scratch->rgba_line      = (uint8_t*)malloc(line_size);
+   scratch->prev_encoded   = (uint8_t*)calloc(1, line_size);
+   scratch->up_filtered    = (uint8_t*)malloc(line_size);
+   scratch->sub_filtered   = (uint8_t*)malloc(line_size);
+   scratch->avg_filtered   = (uint8_t*)malloc(line_size);
+   scratch->paeth_filtered = (uint8_t*)malloc(line_size);
+
+   if (!scratch->rgba_line || !scratch->prev_encoded || !scratch->up_filtered ||
+         !scratch->sub_filtered || !scratch->avg_filtered || !scratch->paeth_filtered)
+   {
+      png_filter_scratch_free(scratch);
+      return false;
+   }
+
+   return true;
+}
+
+static inline void png_copy_line(uint8_t *dst, const uint8_t *src, unsigned width, unsigned bpp)
+{
+   if (bpp == sizeof(uint32_t))
+      copy_argb_line(dst, (const uint32_t*)src, width);
+   else
+      copy_bgr24_line(dst, src, width);
+}
+
+// Filters height lines starting at data into encode_target, each prefixed with its filter type.
+// If first_line is false, the line before data is used as the previous line, so bands of an image
+// can be filtered independently and still come out the same as the whole image.
+static void png_filter_lines(uint8_t *encode_target, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch, unsigned bpp,
+      bool first_line, enum rpng_compression compression, struct png_filter_scratch *scratch)
+{
+   uint8_t *rgba_line    = scratch->rgba_line;
+   uint8_t *prev_encoded = scratch->prev_encoded;
+
+   if (first_line)
+      memset(prev_encoded, 0, width * bpp);
+   else
+      png_copy_line(prev_encoded, data - pitch, width, bpp);
+
+   for (unsigned h = 0; h < height;
+         h++, encode_target += width * bpp, data += pitch)
+   {
+      png_copy_line(rgba_line, data, width, bpp);
+
+      uint8_t filter = 0;
+      const uint8_t *chosen_filtered = rgba_line;
+
+      if (compression == RPNG_COMPRESSION_FAST)
+      {
+         // Up is cheap and does well on the flat areas and repeated lines typical of game footage.
+         filter_up(scratch->up_filtered, rgba_line, prev_encoded, width, bpp);
+         filter = 2;
+         chosen_filtered = scratch->up_filtered;
+      }
+      else
+      {
+         // Try every filtering method, and choose the method
+         // which has most entries as zero.
+         // This is probably not very optimal, but it's very simple to implement.
+         unsigned none_score  = count_sad(rgba_line, width * bpp);
+         unsigned up_score    = filter_up(scratch->up_filtered, rgba_line, prev_encoded, width, bpp);
+         unsigned sub_score   = filter_sub(scratch->sub_filtered, rgba_line, width, bpp);
+         unsigned avg_score   = filter_avg(scratch->avg_filtered, rgba_line, prev_encoded, width, bpp);
+         unsigned paeth_score = filter_paeth(scratch->paeth_filtered, rgba_line, prev_encoded, width, bpp);
+
+         unsigned min_sad = none_score;
+
+         if (sub_score < min_sad)
+         {
+            filter = 1;
+            chosen_filtered = scratch->sub_filtered;
+            min_sad = sub_score;
+         }
+
+         if (up_score < min_sad)
+         {
+            filter = 2;
+            chosen_filtered = scratch->up_filtered;
+            min_sad = up_score;
+         }
+
+         if (avg_score < min_sad)
+         {
+            filter = 3;
+            chosen_filtered = scratch->avg_filtered;
+            min_sad = avg_score;
+         }
+
+         if (paeth_score < min_sad)
+         {
+            filter = 4;
+            chosen_filtered = scratch->paeth_filtered;
+            min_sad = paeth_score;
+         }
+      }
+
+      *encode_target++ = filter;
+      memcpy(encode_target, chosen_filtered, width * bpp);
+
+      memcpy(prev_encoded, rgba_line, width * bpp);
+   }
+}
+
+static inline int png_deflate_level(enum rpng_compression compression)
+{
+   return compression == RPNG_COMPRESSION_FAST ? 1 : 9;
+}
+
+// Deflates the whole image as one zlib stream into deflate_buf.
+static bool png_deflate_image(uint8_t *deflate_buf, size_t deflate_buf_size, size_t *deflate_size,
+      const uint8_t *encode_buf, size_t encode_buf_size, enum rpng_compression compression)
+{
+   z_stream stream = {0};
+   stream.next_in   = (uint8_t*)encode_buf;
+   stream.avail_in  = encode_buf_size;
+   stream.next_out  = deflate_buf;
+   stream.avail_out = deflate_buf_size;
+
+   deflateInit(&stream, png_deflate_level(compression));
+   bool ret = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+   deflateEnd(&stream);
+
+   *deflate_size = stream.total_out;
+   return ret;
+}
+
+#ifdef HAVE_THREADS
+// Band encoding, pigz style.
+// Every band is filtered and then deflated by its own thread, as raw deflate streams.
+// All but the last band end with a sync flush, so they can simply be concatenated behind one zlib header.
+// The last 32K of the band before is used as dictionary, so compression barely suffers from the split.
+#define PNG_BAND_DICT_SIZE 32768
+#define PNG_BAND_MIN_LINES 16
+
+struct png_band
+{
+   // Filter input.
+   const uint8_t *data;
+   unsigned width;
+   unsigned height;
+   unsigned pitch;
+   unsigned bpp;
+   bool first_line;
+   enum rpng_compression compression;
+
+   // Filtered lines, slice of the full encode buffer.
+   uint8_t *encoded;
+   size_t encoded_size;
+   const uint8_t *dict;
+   size_t dict_size;
+   bool last;
+
+   uint8_t *out;
+   size_t out_size;
+   size_t out_cap;
+
+   bool ok;
+};
+
+static void png_band_filter(void *data)
+{
+   struct png_band *band = (struct png_band*)data;
+   struct png_filter_scratch scratch;
+
+   band->ok = png_filter_scratch_init(&scratch, band->width * band->bpp);
+   if (!band->ok)
+      return;
+
+   png_filter_lines(band->encoded, band->data, band->width, band->height, band->pitch, band->bpp,
+         band->first_line, band->compression, &scratch);
+   png_filter_scratch_free(&scratch);
+}
+
+static void png_band_deflate(void *data)
+{
+   struct png_band *band = (struct png_band*)data;
+   z_stream stream = {0};
+
+   band->ok = false;
+   if (deflateInit2(&stream, png_deflate_level(band->compression),
+            Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return;
+
+#ifndef WANT_MINIZ
+   if (band->dict_size)
+      deflateSetDictionary(&stream, band->dict, band->dict_size);
+#endif
+
+   // Sync flush might add a few bytes on top of the bound.
+   band->out_cap = deflateBound(&stream, band->encoded_size) + 64;
+   band->out = (uint8_t*)malloc(band->out_cap);
+   if (!band->out)
+   {
+      deflateEnd(&stream);
+      return;
+   }
+
+   stream.next_in   = band->encoded;
+   stream.avail_in  = band->encoded_size;
+   stream.next_out  = band->out;
+   stream.avail_out = band->out_cap;
+
+   int err = deflate(&stream, band->last ? Z_FINISH : Z_SYNC_FLUSH);
+   if (band->last)
+      band->ok = err == Z_STREAM_END;
+   else
+      band->ok = err == Z_OK && stream.avail_in == 0 && stream.avail_out != 0;
+
+   band->out_size = stream.total_out;
+   deflateEnd(&stream);
+}
+
+// Runs func for every band, the first one on the calling thread.
+static void png_run_bands(void (*func)(void*), struct png_band *bands, unsigned num_bands)
+{
+   sthread_t *threads[RPNG_MAX_THREADS] = {NULL};
+
+   for (unsigned i = 1; i < num_bands; i++)
+   {
+      threads[i] = sthread_create(func, &bands[i]);
+      if (!threads[i])
+         func(&bands[i]);
+   }
+
+   func(&bands[0]);
+
+   for (unsigned i = 1; i < num_bands; i++)
+      if (threads[i])
+         sthread_join(threads[i]);
+}
+
+// Builds the full zlib stream (header, bands, adler32) into deflate_buf.
+static bool png_deflate_bands(uint8_t *deflate_buf, size_t deflate_buf_size, size_t *deflate_size,
+      uint8_t *encode_buf, const uint8_t *data, unsigned width, unsigned height, unsigned pitch,
+      unsigned bpp, enum rpng_compression compression, unsigned num_bands)
+{
+   bool ret = true;
+   struct png_band bands[RPNG_MAX_THREADS];
+   memset(bands, 0, sizeof(bands));
+
+   size_t line_size = width * bpp + 1;
+   unsigned line = 0;
+   for (unsigned i = 0; i < num_bands; i++)
+   {
+      unsigned lines = (height - line) / (num_bands - i);
+      struct png_band *band = &bands[i];
+
+      band->data        = data + line * pitch;
+      band->width       = width;
+      band->height      = lines;
+      band->pitch       = pitch;
+      band->bpp         = bpp;
+      band->first_line  = line == 0;
+      band->compression = compression;
+
+      band->encoded      = encode_buf + line * line_size;
+      band->encoded_size = lines * line_size;
+      band->last         = i == num_bands - 1;
+
+      if (line)
+      {
+         band->dict_size = line * line_size;
+         if (band->dict_size > PNG_BAND_DICT_SIZE)
+            band->dict_size = PNG_BAND_DICT_SIZE;
+         band->dict = band->encoded - band->dict_size;
+      }
+
+      line += lines;
+   }
+
+   png_run_bands(png_band_filter, bands, num_bands);
+   for (unsigned i = 0; i < num_bands; i++)
+      if (!bands[i].ok)
+         GOTO_END_ERROR();
+
+   // Dictionaries refer to the filtered lines of the band before, so these all have to be done first.
+   png_run_bands(png_band_deflate, bands, num_bands);
+
+   size_t total = 2;
+   for (unsigned i = 0; i < num_bands; i++)
+   {
+      if (!bands[i].ok)
+         GOTO_END_ERROR();
+      total += bands[i].out_size;
+   }
+   total += 4;
+
+   if (total > deflate_buf_size)
+      GOTO_END_ERROR();
+
+   uint8_t *out = deflate_buf;
+   // Same header as deflateInit(): 32K window, with the level hint.
+   *out++ = 0x78;
+   *out++ = compression == RPNG_COMPRESSION_FAST ? 0x01 : 0xda;
+
+   for (unsigned i = 0; i < num_bands; i++)
+   {
+      memcpy(out, bands[i].out, bands[i].out_size);
+      out += bands[i].out_size;
+   }
+
+   dword_write_be(out, adler32(adler32(0, NULL, 0), encode_buf, line_size * height));
+   *deflate_size = total;
+
+end:
+   for (unsigned i = 0; i < num_bands; i++)
+      free(bands[i].out);
+   return ret;
+}
+#endif
+
 static bool rpng_save_image(const char *path, const uint8_t *data,
-      unsigned width, unsigned height, unsigned pitch, unsigned bpp)
+      unsigned width, unsigned height, unsigned pitch, unsigned bpp,
+      enum rpng_compression compression, unsigned threads)
 {
    bool ret = true;
    struct png_ihdr ihdr = {0};
+   struct png_filter_scratch scratch = {0};
 
    size_t encode_buf_size  = 0;
+   size_t deflate_size     = 0;
    uint8_t *encode_buf     = NULL;
    uint8_t *deflate_buf    = NULL;
-   uint8_t *rgba_line      = NULL;
-   uint8_t *up_filtered    = NULL;
-   uint8_t *sub_filtered   = NULL;
-   uint8_t *avg_filtered   = NULL;
-   uint8_t *paeth_filtered = NULL;
-   uint8_t *prev_encoded   = NULL;
-   uint8_t *encode_target  = NULL;
-
-   z_stream stream = {0};
 
    FILE *file = fopen(path, "wb");
    if (!file)
@@ -615,94 +1230,38 @@ static bool rpng_save_image(const char *path, const uint8_t *data,
    if (!encode_buf)
       GOTO_END_ERROR();
 
-   prev_encoded = (uint8_t*)calloc(1, width * bpp);
-   if (!prev_encoded)
+   deflate_buf = (uint8_t*)malloc(encode_buf_size * 2); // Just to be sure.
+   if (!deflate_buf)
       GOTO_END_ERROR();
 
-   rgba_line      = (uint8_t*)malloc(width * bpp);
-   up_filtered    = (uint8_t*)malloc(width * bpp);
-   sub_filtered   = (uint8_t*)malloc(width * bpp);
-   avg_filtered   = (uint8_t*)malloc(width * bpp);
-   paeth_filtered = (uint8_t*)malloc(width * bpp);
-   if (!rgba_line || !up_filtered || !sub_filtered || !avg_filtered || !paeth_filtered)
-      GOTO_END_ERROR();
+#ifdef HAVE_THREADS
+   if (threads > RPNG_MAX_THREADS)
+      threads = RPNG_MAX_THREADS;
+   if (threads > height / PNG_BAND_MIN_LINES)
+      threads = height / PNG_BAND_MIN_LINES;
 
-   encode_target = encode_buf;
-   for (unsigned h = 0; h < height;
-         h++, encode_target += width * bpp, data += pitch)
+   if (threads > 1)
    {
-      if (bpp == sizeof(uint32_t))
-         copy_argb_line(rgba_line, (const uint32_t*)data, width);
-      else
-         copy_bgr24_line(rgba_line, data, width);
-
-      // Try every filtering method, and choose the method
-      // which has most entries as zero.
-      // This is probably not very optimal, but it's very simple to implement.
-      unsigned none_score  = count_sad(rgba_line, width * bpp);
-      unsigned up_score    = filter_up(up_filtered, rgba_line, prev_encoded, width, bpp);
-      unsigned sub_score   = filter_sub(sub_filtered, rgba_line, width, bpp);
-      unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, width, bpp);
-      unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, width, bpp);
-
-      uint8_t filter = 0;
-      unsigned min_sad = none_score;
-      const uint8_t *chosen_filtered = rgba_line;
-
-      if (sub_score < min_sad)
-      {
-         filter = 1;
-         chosen_filtered = sub_filtered;
-         min_sad = sub_score;
-      }
-
-      if (up_score < min_sad)
-      {
-         filter = 2;
-         chosen_filtered = up_filtered;
-         min_sad = up_score;
-      }
-
-      if (avg_score < min_sad)
-      {
-         filter = 3;
-         chosen_filtered = avg_filtered;
-         min_sad = avg_score;
-      }
-
-      if (paeth_score < min_sad)
-      {
-         filter = 4;
-         chosen_filtered = paeth_filtered;
-         min_sad = paeth_score;
-      }
-
-      *encode_target++ = filter;
-      memcpy(encode_target, chosen_filtered, width * bpp);
-
-      memcpy(prev_encoded, rgba_line, width * bpp);
+      if (!png_deflate_bands(deflate_buf + 8, encode_buf_size * 2 - 8, &deflate_size,
+               encode_buf, data, width, height, pitch, bpp, compression, threads))
+         GOTO_END_ERROR();
    }
+   else
+#endif
+   {
+      if (!png_filter_scratch_init(&scratch, width * bpp))
+         GOTO_END_ERROR();
 
-   deflate_buf = (uint8_t*)malloc(encode_buf_size * 2); // Just to be sure.
-   if (!deflate_buf)
-      GOTO_END_ERROR();
-
-   stream.next_in   = encode_buf;
-   stream.avail_in  = encode_buf_size;
-   stream.next_out  = deflate_buf + 8;
-   stream.avail_out = encode_buf_size * 2;
+      png_filter_lines(encode_buf, data, width, height, pitch, bpp, true, compression, &scratch);
 
-   deflateInit(&stream, 9);
-   if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
-   {
-      deflateEnd(&stream);
-      GOTO_END_ERROR();
+      if (!png_deflate_image(deflate_buf + 8, encode_buf_size * 2 - 8, &deflate_size,
+               encode_buf, encode_buf_size, compression))
+         GOTO_END_ERROR();
    }
-   deflateEnd(&stream);
 
    memcpy(deflate_buf + 4, "IDAT", 4);
-   dword_write_be(deflate_buf + 0, stream.total_out);
-   if (!png_write_idat(file, deflate_buf, stream.total_out + 8))
+   dword_write_be(deflate_buf + 0, deflate_size);
+   if (!png_write_idat(file, deflate_buf, deflate_size + 8))
       GOTO_END_ERROR();
 
    if (!png_write_iend(file))
@@ -713,24 +1272,37 @@ end:
       fclose(file);
    free(encode_buf);
    free(deflate_buf);
-   free(rgba_line);
-   free(prev_encoded);
-   free(up_filtered);
-   free(avg_filtered);
-   free(paeth_filtered);
+   png_filter_scratch_free(&scratch);
    return ret;
 }
 
 bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch)
 {
-   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, sizeof(uint32_t));
+   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, sizeof(uint32_t),
+         RPNG_COMPRESSION_BEST, 1);
 }
 
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
       unsigned width, unsigned height, unsigned pitch)
 {
-   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, 3);
+   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, 3,
+         RPNG_COMPRESSION_BEST, 1);
+}
+
+bool rpng_save_image_argb_ex(const char *path, const uint32_t *data,
+      unsigned width, unsigned height, unsigned pitch,
+      enum rpng_compression compression, unsigned threads)
+{
+   return rpng_save_image(path, (const uint8_t*)data, width, height, pitch, sizeof(uint32_t),
+         compression, threads);
+}
+
+bool rpng_save_image_bgr24_ex(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch,
+      enum rpng_compression compression, unsigned threads)
+{
+   return rpng_save_image(path, data, width, height, pitch, 3, compression, threads);
 }
 
 #endif
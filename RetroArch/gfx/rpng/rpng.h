@@ -30,10 +30,27 @@ extern "C" {
 bool rpng_load_image_argb(const char *path, uint32_t **data, unsigned *width, unsigned *height);
 
 #ifdef HAVE_ZLIB_DEFLATE
+#define RPNG_MAX_THREADS 16
+
+enum rpng_compression
+{
+   RPNG_COMPRESSION_BEST = 0, // Tries every filter on every line, deflate level 9.
+   RPNG_COMPRESSION_FAST // Up filter on every line, deflate level 1.
+};
+
 bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch);
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
       unsigned width, unsigned height, unsigned pitch);
+
+// With threads > 1, the image is split in bands which are filtered and deflated in parallel.
+// Output is a regular PNG, slightly bigger than what a single thread would produce.
+bool rpng_save_image_argb_ex(const char *path, const uint32_t *data,
+      unsigned width, unsigned height, unsigned pitch,
+      enum rpng_compression compression, unsigned threads);
+bool rpng_save_image_bgr24_ex(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch,
+      enum rpng_compression compression, unsigned threads);
 #endif
 
 #ifdef __cplusplus
@@ -18,13 +18,114 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/time.h>
+
+#ifdef HAVE_IMLIB2
 #include <Imlib2.h>
+#endif
+
+static double time_ms(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// Something like a menu wallpaper: smooth gradients, a soft noise texture and some hard edged shapes,
+// so the encoder ends up using every filter type.
+static void gen_wallpaper(uint32_t *data, unsigned width, unsigned height)
+{
+   srand(1);
+   for (unsigned y = 0; y < height; y++)
+   {
+      for (unsigned x = 0; x < width; x++)
+      {
+         unsigned r = (x * 255) / width;
+         unsigned g = (y * 255) / height;
+         unsigned b = ((x + y) >> 2) & 0xff;
+
+         if (((x >> 6) ^ (y >> 6)) & 1)
+            b = (b + (rand() & 15)) & 0xff;
+         if ((x / 96 + y / 64) % 7 == 0)
+            r = g = 0xf0;
+
+         data[y * width + x] = (0xffu << 24) | (r << 16) | (g << 8) | b;
+      }
+   }
+}
+
+// Saves, then decodes a width x height image iterations times. Checks the result against the input.
+static bool bench(unsigned width, unsigned height, bool rgb, unsigned iterations)
+{
+   const char *path = "/tmp/rpng_bench.png";
+   uint32_t *src = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+   uint8_t *bgr = (uint8_t*)malloc(width * height * 3);
+   if (!src || !bgr)
+      return false;
+
+   gen_wallpaper(src, width, height);
+
+   bool ret;
+   if (rgb)
+   {
+      for (unsigned i = 0; i < width * height; i++)
+      {
+         bgr[i * 3 + 0] = (uint8_t)(src[i] >>  0);
+         bgr[i * 3 + 1] = (uint8_t)(src[i] >>  8);
+         bgr[i * 3 + 2] = (uint8_t)(src[i] >> 16);
+      }
+      ret = rpng_save_image_bgr24(path, bgr, width, height, width * 3);
+   }
+   else
+      ret = rpng_save_image_argb(path, src, width, height, width * sizeof(uint32_t));
+
+   double total = 0.0;
+   for (unsigned i = 0; ret && i < iterations; i++)
+   {
+      uint32_t *data = NULL;
+      unsigned out_width = 0, out_height = 0;
+
+      double start = time_ms();
+      ret = rpng_load_image_argb(path, &data, &out_width, &out_height);
+      total += time_ms() - start;
+
+      if (ret)
+         ret = out_width == width && out_height == height &&
+            memcmp(data, src, width * height * sizeof(uint32_t)) == 0;
+      free(data);
+   }
+
+   fprintf(stderr, "%4u x %4u %s: %8.2f ms per load, %7.1f Mpixels/s, %s\n",
+         width, height, rgb ? "RGB " : "RGBA",
+         total / iterations, (width * height * iterations) / (total * 1000.0),
+         ret ? "OK" : "FAILED");
+
+   remove(path);
+   free(src);
+   free(bgr);
+   return ret;
+}
 
 int main(int argc, char *argv[])
 {
+   if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+   {
+      unsigned iterations = argc >= 3 ? strtoul(argv[2], NULL, 0) : 20;
+      if (!iterations)
+         iterations = 1;
+
+      bool ok = true;
+      ok = bench(1920, 1080, false, iterations) && ok;
+      ok = bench(1920, 1080, true, iterations) && ok;
+      ok = bench(1024, 1024, false, iterations) && ok;
+      ok = bench(333, 77, true, iterations) && ok; // Odd sizes.
+      return ok ? 0 : 1;
+   }
+
    if (argc > 2)
    {
       fprintf(stderr, "Usage: %s <png file>\n", argv[0]);
+      fprintf(stderr, "       %s --bench [iterations]\n", argv[0]);
       return 1;
    }
 
@@ -60,6 +161,7 @@ int main(int argc, char *argv[])
    if (width != 4 || height != 4)
       return 3;
 
+#ifdef HAVE_IMLIB2
    // Validate with imlib2 as well.
    Imlib_Image img = imlib_load_image(in_path);
    if (!img)
@@ -78,6 +180,7 @@ int main(int argc, char *argv[])
       fprintf(stderr, "\n");
    }
    imlib_free_image();
+#endif
 
    if (memcmp(test_data, data, sizeof(test_data)) != 0)
       return 5;
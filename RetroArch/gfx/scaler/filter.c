@@ -18,18 +18,23 @@
 #include "scaler_int.h"
 #include "../../general.h"
 #include <math.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-static bool allocate_filters(struct scaler_ctx *ctx)
-{
-   ctx->horiz.filter     = (int16_t*)scaler_alloc(sizeof(int16_t), ctx->horiz.filter_stride * ctx->out_width);
-   ctx->horiz.filter_pos = (int*)scaler_alloc(sizeof(int), ctx->out_width);
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#endif
+
+// Filters are separable, so each axis is generated on its own from (in length, out length, type).
 
-   ctx->vert.filter      = (int16_t*)scaler_alloc(sizeof(int16_t), ctx->vert.filter_stride * ctx->out_height);
-   ctx->vert.filter_pos  = (int*)scaler_alloc(sizeof(int), ctx->out_height);
+static bool allocate_filter(struct scaler_filter *filter, int out_len)
+{
+   filter->filter     = (int16_t*)scaler_alloc(sizeof(int16_t), filter->filter_stride * out_len);
+   filter->filter_pos = (int*)scaler_alloc(sizeof(int), out_len);
 
-   return ctx->horiz.filter && ctx->vert.filter;
+   return filter->filter && filter->filter_pos;
 }
 
 static void gen_filter_point_sub(struct scaler_filter *filter, int len, int pos, int step)
@@ -41,26 +46,18 @@ static void gen_filter_point_sub(struct scaler_filter *filter, int len, int pos,
    }
 }
 
-static bool gen_filter_point(struct scaler_ctx *ctx)
+static bool gen_filter_point(struct scaler_filter *filter, int in_len, int out_len)
 {
-   ctx->horiz.filter_len    = 1;
-   ctx->horiz.filter_stride = 1;
-   ctx->vert.filter_len     = 1;
-   ctx->vert.filter_stride  = 1;
+   filter->filter_len    = 1;
+   filter->filter_stride = 1;
 
-   if (!allocate_filters(ctx))
+   if (!allocate_filter(filter, out_len))
       return false;
 
-   int x_pos  = (1 << 15) * ctx->in_width / ctx->out_width - (1 << 15);
-   int x_step = (1 << 16) * ctx->in_width / ctx->out_width;
-   int y_pos  = (1 << 15) * ctx->in_height / ctx->out_height - (1 << 15);
-   int y_step = (1 << 16) * ctx->in_height / ctx->out_height;
-
-   gen_filter_point_sub(&ctx->horiz, ctx->out_width, x_pos, x_step);
-   gen_filter_point_sub(&ctx->vert, ctx->out_height, y_pos, y_step);
-
-   ctx->scaler_special = scaler_argb8888_point_special;
+   int pos  = (1 << 15) * in_len / out_len - (1 << 15);
+   int step = (1 << 16) * in_len / out_len;
 
+   gen_filter_point_sub(filter, out_len, pos, step);
    return true;
 }
 
@@ -74,24 +71,18 @@ static void gen_filter_bilinear_sub(struct scaler_filter *filter, int len, int p
    }
 }
 
-static bool gen_filter_bilinear(struct scaler_ctx *ctx)
+static bool gen_filter_bilinear(struct scaler_filter *filter, int in_len, int out_len)
 {
-   ctx->horiz.filter_len    = 2;
-   ctx->horiz.filter_stride = 2;
-   ctx->vert.filter_len     = 2;
-   ctx->vert.filter_stride  = 2;
+   filter->filter_len    = 2;
+   filter->filter_stride = 2;
 
-   if (!allocate_filters(ctx))
+   if (!allocate_filter(filter, out_len))
       return false;
 
-   int x_pos  = (1 << 15) * ctx->in_width / ctx->out_width - (1 << 15);
-   int x_step = (1 << 16) * ctx->in_width / ctx->out_width;
-   int y_pos  = (1 << 15) * ctx->in_height / ctx->out_height - (1 << 15);
-   int y_step = (1 << 16) * ctx->in_height / ctx->out_height;
-
-   gen_filter_bilinear_sub(&ctx->horiz, ctx->out_width, x_pos, x_step);
-   gen_filter_bilinear_sub(&ctx->vert, ctx->out_height, y_pos, y_step);
+   int pos  = (1 << 15) * in_len / out_len - (1 << 15);
+   int step = (1 << 16) * in_len / out_len;
 
+   gen_filter_bilinear_sub(filter, out_len, pos, step);
    return true;
 }
 
@@ -125,58 +116,132 @@ static void gen_filter_sinc_sub(struct scaler_filter *filter, int len, int pos,
    }
 }
 
-static bool gen_filter_sinc(struct scaler_ctx *ctx)
+static bool gen_filter_sinc(struct scaler_filter *filter, int in_len, int out_len)
 {
    // Need to expand the filter when downsampling to get a proper low-pass effect.
-   const int sinc_size      = 8 * (ctx->in_width > ctx->out_width ? next_pow2(ctx->in_width / ctx->out_width) : 1);
-   ctx->horiz.filter_len    = sinc_size;
-   ctx->horiz.filter_stride = sinc_size;
-   ctx->vert.filter_len     = sinc_size;
-   ctx->vert.filter_stride  = sinc_size;
+   const int sinc_size   = 8 * (in_len > out_len ? next_pow2(in_len / out_len) : 1);
+   filter->filter_len    = sinc_size;
+   filter->filter_stride = sinc_size;
 
-   if (!allocate_filters(ctx))
+   if (!allocate_filter(filter, out_len))
       return false;
 
-   int x_pos  = (1 << 15) * ctx->in_width / ctx->out_width - (1 << 15) - (sinc_size << 15);
-   int x_step = (1 << 16) * ctx->in_width / ctx->out_width;
-   int y_pos  = (1 << 15) * ctx->in_height / ctx->out_height - (1 << 15) - (sinc_size << 15);
-   int y_step = (1 << 16) * ctx->in_height / ctx->out_height;
+   int pos  = (1 << 15) * in_len / out_len - (1 << 15) - (sinc_size << 15);
+   int step = (1 << 16) * in_len / out_len;
 
-   double phase_mul_horiz = ctx->in_width  > ctx->out_width  ? (double)ctx->out_width  / ctx->in_width  : 1.0;
-   double phase_mul_vert  = ctx->in_height > ctx->out_height ? (double)ctx->out_height / ctx->in_height : 1.0;
-
-   gen_filter_sinc_sub(&ctx->horiz, ctx->out_width, x_pos, x_step, phase_mul_horiz);
-   gen_filter_sinc_sub(&ctx->vert, ctx->out_height, y_pos, y_step, phase_mul_vert);
+   double phase_mul = in_len > out_len ? (double)out_len / in_len : 1.0;
 
+   gen_filter_sinc_sub(filter, out_len, pos, step, phase_mul);
    return true;
 }
 
+// Generic windowed filter, for kernels which are easier to express in floating point.
+// weight() gets the distance from the output pixel center in input pixels, scaled down when downsampling,
+// and must return 0 beyond support, which is in input pixels. Taps falling outside the input are clamped to the edge,
+// and every output pixel is normalized to exactly FILTER_UNITY so flat areas stay flat.
+typedef double (*filter_weight_t)(double x, double scale);
 
-static bool validate_filter(struct scaler_ctx *ctx)
+static bool gen_filter_window(struct scaler_filter *filter, int in_len, int out_len,
+      double support, filter_weight_t weight)
 {
-   int max_w_pos = ctx->in_width - ctx->horiz.filter_len;
-   for (int i = 0; i < ctx->out_width; i++)
+   double scale = (double)in_len / out_len;
+
+   int len = (int)ceil(2.0 * support);
+   if (len > in_len)
+      len = in_len;
+   if (len < 1)
+      len = 1;
+
+   filter->filter_len    = len;
+   filter->filter_stride = len;
+
+   if (!allocate_filter(filter, out_len))
+      return false;
+
+   double *weights = (double*)calloc(len, sizeof(double));
+   if (!weights)
+      return false;
+
+   for (int i = 0; i < out_len; i++)
    {
-      if (ctx->horiz.filter_pos[i] > max_w_pos || ctx->horiz.filter_pos[i] < 0)
+      double center = (i + 0.5) * scale - 0.5;
+
+      int first = (int)floor(center - support) + 1;
+      int start = first;
+      if (start > in_len - len)
+         start = in_len - len;
+      if (start < 0)
+         start = 0;
+
+      memset(weights, 0, len * sizeof(double));
+      double sum = 0.0;
+      for (int x = first; x < center + support; x++)
       {
-         fprintf(stderr, "Out X = %d => In X = %d\n", i, ctx->horiz.filter_pos[i]); 
-         return false;
+         double w = weight(x - center, scale);
+         if (w == 0.0)
+            continue;
+
+         int tap = x < 0 ? 0 : (x >= in_len ? in_len - 1 : x);
+         if (tap < start || tap >= start + len)
+            continue;
+         weights[tap - start] += w;
+         sum += w;
       }
-   }
 
-   int max_h_pos = ctx->in_height - ctx->vert.filter_len;
-   for (int i = 0; i < ctx->out_height; i++)
-   {
-      if (ctx->vert.filter_pos[i] > max_h_pos || ctx->vert.filter_pos[i] < 0)
+      filter->filter_pos[i] = start;
+      int16_t *coeffs = filter->filter + i * filter->filter_stride;
+
+      int total = 0;
+      int largest = 0;
+      for (int j = 0; j < len; j++)
       {
-         fprintf(stderr, "Out Y = %d => In Y = %d\n", i, ctx->vert.filter_pos[i]); 
-         return false;
+         coeffs[j] = (int16_t)floor(FILTER_UNITY * weights[j] / sum + 0.5);
+         total += coeffs[j];
+         if (coeffs[j] > coeffs[largest])
+            largest = j;
       }
+
+      // Rounding error goes into the center tap.
+      coeffs[largest] += FILTER_UNITY - total;
    }
 
+   free(weights);
    return true;
 }
 
+static double weight_lanczos(double x, double scale, double a)
+{
+   if (scale > 1.0)
+      x /= scale;
+   if (fabs(x) >= a)
+      return 0.0;
+   return filter_sinc(M_PI * x) * filter_sinc(M_PI * x / a);
+}
+
+static double weight_lanczos2(double x, double scale)
+{
+   return weight_lanczos(x, scale, 2.0);
+}
+
+static double weight_lanczos3(double x, double scale)
+{
+   return weight_lanczos(x, scale, 3.0);
+}
+
+// Box filter covering exactly one output pixel. Each input pixel is weighted by how much of it falls inside.
+// When upscaling, this blends at most two input pixels on boundaries, which makes for sharp, even pixels.
+static double weight_area(double x, double scale)
+{
+   double half_out = 0.5 * scale;
+   double lo = x - 0.5;
+   double hi = x + 0.5;
+   if (lo < -half_out)
+      lo = -half_out;
+   if (hi > half_out)
+      hi = half_out;
+   return hi > lo ? hi - lo : 0.0;
+}
+
 static void fixup_filter_sub(struct scaler_filter *filter, int out_len, int in_len)
 {
    int max_pos = in_len - filter->filter_len;
@@ -217,41 +282,264 @@ static void fixup_filter_sub(struct scaler_filter *filter, int out_len, int in_l
    }
 }
 
-// Makes sure that we never sample outside our rectangle.
-static void fixup_filter(struct scaler_ctx *ctx)
+static bool validate_filter(const struct scaler_filter *filter, int out_len, int in_len)
 {
-   fixup_filter_sub(&ctx->horiz, ctx->out_width, ctx->in_width);
-   fixup_filter_sub(&ctx->vert, ctx->out_height, ctx->in_height);
+   int max_pos = in_len - filter->filter_len;
+   for (int i = 0; i < out_len; i++)
+   {
+      if (filter->filter_pos[i] > max_pos || filter->filter_pos[i] < 0)
+      {
+         fprintf(stderr, "Out %d => In %d\n", i, filter->filter_pos[i]);
+         return false;
+      }
+   }
+
+   return true;
 }
 
+static void free_filter(struct scaler_filter *filter)
+{
+   scaler_free(filter->filter);
+   scaler_free(filter->filter_pos);
+   memset(filter, 0, sizeof(*filter));
+}
 
-bool scaler_gen_filter(struct scaler_ctx *ctx)
+static bool gen_filter(struct scaler_filter *filter, enum scaler_type type, int in_len, int out_len)
 {
-   bool ret = true;
+   bool ret = false;
+   // Windowed filters are stretched when downscaling, so they act as a low-pass filter.
+   double downscale = in_len > out_len ? (double)in_len / out_len : 1.0;
 
-   switch (ctx->scaler_type)
+   switch (type)
    {
       case SCALER_TYPE_POINT:
-         ret = gen_filter_point(ctx);
+         ret = gen_filter_point(filter, in_len, out_len);
          break;
 
       case SCALER_TYPE_BILINEAR:
-         ret = gen_filter_bilinear(ctx);
+         ret = gen_filter_bilinear(filter, in_len, out_len);
          break;
 
       case SCALER_TYPE_SINC:
-         ret = gen_filter_sinc(ctx);
+         ret = gen_filter_sinc(filter, in_len, out_len);
+         break;
+
+      case SCALER_TYPE_LANCZOS2:
+         ret = gen_filter_window(filter, in_len, out_len, 2.0 * downscale, weight_lanczos2);
+         break;
+
+      case SCALER_TYPE_LANCZOS3:
+         ret = gen_filter_window(filter, in_len, out_len, 3.0 * downscale, weight_lanczos3);
+         break;
+
+      case SCALER_TYPE_AREA:
+         ret = gen_filter_window(filter, in_len, out_len, 0.5 * in_len / out_len + 0.5, weight_area);
          break;
 
       default:
-         return false;
+         break;
+   }
+
+   if (ret)
+   {
+      // Makes sure that we never sample outside our rectangle.
+      fixup_filter_sub(filter, out_len, in_len);
+      ret = validate_filter(filter, out_len, in_len);
    }
 
    if (!ret)
+      free_filter(filter);
+   return ret;
+}
+
+// Generated filters are kept in a small LRU cache, so contexts which are regenerated a lot
+// (cores switching resolution while recording, window resizes, screenshots) don't recompute them every time.
+// Contexts get their own copies, so they never have to care about the cache.
+// The cache is shared between threads, and only used between scaler_filter_cache_init() and scaler_filter_cache_deinit().
+// Filters are generated without holding the lock, so other threads can keep using the cache meanwhile.
+static bool filter_cache_active;
+#ifdef HAVE_THREADS
+static slock_t *filter_cache_lock;
+#endif
+
+static bool filter_cache_acquire(void)
+{
+   if (!filter_cache_active)
       return false;
 
-   fixup_filter(ctx);
+#ifdef HAVE_THREADS
+   slock_lock(filter_cache_lock);
+#endif
+   return true;
+}
 
-   return validate_filter(ctx);
+static void filter_cache_release(void)
+{
+#ifdef HAVE_THREADS
+   slock_unlock(filter_cache_lock);
+#endif
 }
 
+static bool copy_filter(struct scaler_filter *dst, const struct scaler_filter *src, int out_len)
+{
+   dst->filter_len    = src->filter_len;
+   dst->filter_stride = src->filter_stride;
+
+   if (!allocate_filter(dst, out_len))
+   {
+      free_filter(dst);
+      return false;
+   }
+
+   memcpy(dst->filter, src->filter, src->filter_stride * out_len * sizeof(int16_t));
+   memcpy(dst->filter_pos, src->filter_pos, out_len * sizeof(int));
+   return true;
+}
+
+struct filter_cache_entry
+{
+   enum scaler_type type;
+   int in_len;
+   int out_len;
+   unsigned last_used;
+   struct scaler_filter filter;
+};
+
+static struct filter_cache_entry filter_cache[SCALER_FILTER_CACHE_SIZE];
+static unsigned filter_cache_clock;
+static struct scaler_filter_cache_stats filter_cache_stats;
+
+// Cache must be locked.
+static struct filter_cache_entry *filter_cache_find(enum scaler_type type, int in_len, int out_len)
+{
+   for (unsigned i = 0; i < SCALER_FILTER_CACHE_SIZE; i++)
+   {
+      struct filter_cache_entry *entry = &filter_cache[i];
+      if (entry->filter.filter && entry->type == type && entry->in_len == in_len && entry->out_len == out_len)
+         return entry;
+   }
+
+   return NULL;
+}
+
+// Cache must be locked. Returns an empty entry, or the least recently used one after evicting it.
+static struct filter_cache_entry *filter_cache_evict(void)
+{
+   struct filter_cache_entry *oldest = &filter_cache[0];
+   for (unsigned i = 0; i < SCALER_FILTER_CACHE_SIZE; i++)
+   {
+      struct filter_cache_entry *entry = &filter_cache[i];
+      if (!entry->filter.filter)
+         return entry;
+      if (entry->last_used - oldest->last_used > (unsigned)INT_MAX) // Wraps around.
+         oldest = entry;
+   }
+
+   free_filter(&oldest->filter);
+   return oldest;
+}
+
+static bool get_filter(struct scaler_filter *filter, enum scaler_type type, int in_len, int out_len)
+{
+   memset(filter, 0, sizeof(*filter));
+
+   if (!filter_cache_acquire())
+      return gen_filter(filter, type, in_len, out_len);
+
+   struct filter_cache_entry *entry = filter_cache_find(type, in_len, out_len);
+   if (entry)
+   {
+      entry->last_used = ++filter_cache_clock;
+      filter_cache_stats.hits++;
+      bool ret = copy_filter(filter, &entry->filter, out_len);
+      filter_cache_release();
+      return ret;
+   }
+
+   filter_cache_stats.misses++;
+   filter_cache_release();
+
+   // Don't hold the cache while generating, other threads can still use it.
+   if (!gen_filter(filter, type, in_len, out_len))
+      return false;
+
+   if (!filter_cache_acquire())
+      return true;
+
+   // Someone else might have put it in already.
+   if (!filter_cache_find(type, in_len, out_len))
+   {
+      entry = filter_cache_evict();
+      if (copy_filter(&entry->filter, filter, out_len))
+      {
+         entry->type      = type;
+         entry->in_len    = in_len;
+         entry->out_len   = out_len;
+         entry->last_used = ++filter_cache_clock;
+      }
+   }
+
+   filter_cache_release();
+   return true;
+}
+
+void scaler_filter_cache_init(void)
+{
+   if (filter_cache_active)
+      return;
+
+#ifdef HAVE_THREADS
+   filter_cache_lock = slock_new();
+   if (!filter_cache_lock)
+      return;
+#endif
+
+   filter_cache_active = true;
+}
+
+void scaler_filter_cache_deinit(void)
+{
+   if (!filter_cache_active)
+      return;
+
+   scaler_filter_cache_clear();
+   filter_cache_active = false;
+
+#ifdef HAVE_THREADS
+   slock_free(filter_cache_lock);
+   filter_cache_lock = NULL;
+#endif
+}
+
+void scaler_filter_cache_clear(void)
+{
+   if (!filter_cache_acquire())
+      return;
+
+   for (unsigned i = 0; i < SCALER_FILTER_CACHE_SIZE; i++)
+      free_filter(&filter_cache[i].filter);
+   memset(&filter_cache_stats, 0, sizeof(filter_cache_stats));
+
+   filter_cache_release();
+}
+
+void scaler_filter_cache_get_stats(struct scaler_filter_cache_stats *stats)
+{
+   if (!filter_cache_acquire())
+   {
+      memset(stats, 0, sizeof(*stats));
+      return;
+   }
+
+   *stats = filter_cache_stats;
+   filter_cache_release();
+}
+
+bool scaler_gen_filter(struct scaler_ctx *ctx)
+{
+   if (ctx->scaler_type == SCALER_TYPE_POINT)
+      ctx->scaler_special = scaler_argb8888_point_special;
+
+   return get_filter(&ctx->horiz, ctx->scaler_type, ctx->in_width, ctx->out_width) &&
+      get_filter(&ctx->vert, ctx->scaler_type, ctx->in_height, ctx->out_height);
+}
@@ -1,6 +1,6 @@
 /*  RetroArch - A frontend for libretro.
  *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
- * 
+ *
  *  RetroArch is free software: you can redistribute it and/or modify it under the terms
  *  of the GNU General Public License as published by the Free Software Found-
  *  ation, either version 3 of the License, or (at your option) any later version.
@@ -14,53 +14,46 @@
  */
 
 #include "pixconv.h"
+#include "../../performance.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+// Every converter has a plain C version, which defines the expected output.
+// SSE2, AVX2 and NEON versions must match it bit for bit, and are picked at runtime with pixconv_find().
+
 #ifdef SCALER_NO_SIMD
 #undef __SSE2__
+#undef __ARM_NEON__
 #endif
 
 #if defined(__SSE2__)
 #include <emmintrin.h>
 #endif
 
-#if defined(__SSE2_)
-void conv_rgb565_0rgb1555(void *output_, const void *input_,
-      int width, int height,
-      int out_stride, int in_stride)
-{
-   const uint16_t *input = (const uint16_t*)input_;
-   uint16_t *output = (uint16_t*)output_;
-
-   int max_width = width - 7;
-
-   const __m128i hi_mask   = _mm_set1_epi16(0x7fe0);
-   const __m128i lo_mask   = _mm_set1_epi16(0x1f);
+// With GCC and clang, the AVX2 converters are built with per-function targets,
+// so generic x86 builds can use them as well.
+#if !defined(SCALER_NO_SIMD) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && \
+   (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#include <immintrin.h>
+#define PIXCONV_HAVE_AVX2
+#define PIXCONV_TARGET_AVX2 __attribute__((target("avx2")))
+#elif !defined(SCALER_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define PIXCONV_HAVE_AVX2
+#define PIXCONV_TARGET_AVX2
+#endif
 
-   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
-   {
-      int w;
-      for (w = 0; w < max_width; w += 8)
-      {
-         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
-         __m128i hi = _mm_and_si128(_mm_slli_epi16(in, 1), hi_mask);
-         __m128i lo = _mm_and_si128(in, lo_mask);
-         _mm_storeu_si128((__m128i*)(output + w), _mm_or_si128(hi, lo));
-      }
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
-      for (; w < width; w++)
-      {
-         uint16_t col = input[w];
-         uint16_t hi = (col >> 1) & 0x7fe0;
-         uint16_t lo = col & 0x1f;
-         output[w] = hi | lo;
-      }
-   }
+static inline uint32_t load_bgr24(const uint8_t *in)
+{
+   return (0xffu << 24) | ((uint32_t)in[2] << 16) | ((uint32_t)in[1] << 8) | ((uint32_t)in[0] << 0);
 }
-#else
+
 void conv_rgb565_0rgb1555(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -80,45 +73,6 @@ void conv_rgb565_0rgb1555(void *output_, const void *input_,
    }
 }
 
-#endif
-
-#if defined(__SSE2__)
-void conv_0rgb1555_rgb565(void *output_, const void *input_,
-      int width, int height,
-      int out_stride, int in_stride)
-{
-   const uint16_t *input = (const uint16_t*)input_;
-   uint16_t *output = (uint16_t*)output_;
-
-   int max_width = width - 7;
-
-   const __m128i hi_mask   = _mm_set1_epi16((int16_t)((0x1f << 11) | (0x1f << 6)));
-   const __m128i lo_mask   = _mm_set1_epi16(0x1f);
-   const __m128i glow_mask = _mm_set1_epi16(1 << 5);
-
-   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
-   {
-      int w;
-      for (w = 0; w < max_width; w += 8)
-      {
-         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
-         __m128i rg   = _mm_and_si128(_mm_slli_epi16(in, 1), hi_mask);
-         __m128i b    = _mm_and_si128(in, lo_mask);
-         __m128i glow = _mm_and_si128(_mm_srli_epi16(in, 4), glow_mask);
-         _mm_storeu_si128((__m128i*)(output + w), _mm_or_si128(rg, _mm_or_si128(b, glow)));
-      }
-
-      for (; w < width; w++)
-      {
-         uint16_t col = input[w];
-         uint16_t rg = (col << 1) & ((0x1f << 11) | (0x1f << 6));
-         uint16_t b = col & 0x1f;
-         uint16_t glow = (col >> 4) & (1 << 5);
-         output[w] = rg | b | glow;
-      }
-   }
-}
-#else
 void conv_0rgb1555_rgb565(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -138,9 +92,7 @@ void conv_0rgb1555_rgb565(void *output_, const void *input_,
       }
    }
 }
-#endif
 
-#if defined(__SSE2__)
 void conv_0rgb1555_argb8888(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
@@ -148,41 +100,9 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
    const uint16_t *input = (const uint16_t*)input_;
    uint32_t *output      = (uint32_t*)output_;
 
-   const __m128i pix_mask_r  = _mm_set1_epi16(0x1f << 10);
-   const __m128i pix_mask_gb = _mm_set1_epi16(0x1f <<  5);
-   const __m128i mul15_mid   = _mm_set1_epi16(0x4200);
-   const __m128i mul15_hi    = _mm_set1_epi16(0x0210);
-   const __m128i a           = _mm_set1_epi16(0x00ff);
-
-   int max_width = width - 7;
-
    for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
    {
-      int w;
-      for (w = 0; w < max_width; w += 8)
-      {
-         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
-         __m128i r = _mm_and_si128(in, pix_mask_r);
-         __m128i g = _mm_and_si128(in, pix_mask_gb);
-         __m128i b = _mm_and_si128(_mm_slli_epi16(in, 5), pix_mask_gb);
-
-         r = _mm_mulhi_epi16(r, mul15_hi);
-         g = _mm_mulhi_epi16(g, mul15_mid);
-         b = _mm_mulhi_epi16(b, mul15_mid);
-
-         __m128i res_lo_bg = _mm_unpacklo_epi8(b, g);
-         __m128i res_hi_bg = _mm_unpackhi_epi8(b, g);
-         __m128i res_lo_ra = _mm_unpacklo_epi8(r, a);
-         __m128i res_hi_ra = _mm_unpackhi_epi8(r, a);
-
-         __m128i res_lo = _mm_or_si128(res_lo_bg, _mm_slli_si128(res_lo_ra, 2));
-         __m128i res_hi = _mm_or_si128(res_hi_bg, _mm_slli_si128(res_hi_ra, 2));
-
-         _mm_storeu_si128((__m128i*)(output + w + 0), res_lo);
-         _mm_storeu_si128((__m128i*)(output + w + 4), res_hi);
-      }
-
-      for (; w < width; w++)
+      for (int w = 0; w < width; w++)
       {
          uint32_t col = input[w];
          uint32_t r = (col >> 10) & 0x1f;
@@ -192,12 +112,12 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
          g = (g << 3) | (g >> 2);
          b = (b << 3) | (b >> 2);
 
-         output[w] = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
       }
    }
 }
-#else
-void conv_0rgb1555_argb8888(void *output_, const void *input_,
+
+void conv_rgb565_argb8888(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
@@ -209,471 +129,1523 @@ void conv_0rgb1555_argb8888(void *output_, const void *input_,
       for (int w = 0; w < width; w++)
       {
          uint32_t col = input[w];
-         uint32_t r = (col >> 10) & 0x1f;
-         uint32_t g = (col >>  5) & 0x1f;
+         uint32_t r = (col >> 11) & 0x1f;
+         uint32_t g = (col >>  5) & 0x3f;
          uint32_t b = (col >>  0) & 0x1f;
          r = (r << 3) | (r >> 2);
-         g = (g << 3) | (g >> 2);
+         g = (g << 2) | (g >> 4);
          b = (b << 3) | (b >> 2);
 
          output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
       }
    }
 }
-#endif
 
-#if defined(__SSE2__)
-void conv_rgb565_argb8888(void *output_, const void *input_,
+void conv_0rgb1555_bgr24(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint16_t *input = (const uint16_t*)input_;
-   uint32_t *output      = (uint32_t*)output_;
-
-   const __m128i pix_mask_r = _mm_set1_epi16(0x1f << 10);
-   const __m128i pix_mask_g = _mm_set1_epi16(0x3f <<  5);
-   const __m128i pix_mask_b = _mm_set1_epi16(0x1f <<  5);
-   const __m128i mul16_r    = _mm_set1_epi16(0x0210);
-   const __m128i mul16_g    = _mm_set1_epi16(0x2080);
-   const __m128i mul16_b    = _mm_set1_epi16(0x4200);
-   const __m128i a          = _mm_set1_epi16(0x00ff);
-
-   int max_width = width - 7;
+   uint8_t *output       = (uint8_t*)output_;
 
-   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
    {
-      int w;
-      for (w = 0; w < max_width; w += 8)
-      {
-         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
-         __m128i r = _mm_and_si128(_mm_srli_epi16(in, 1), pix_mask_r);
-         __m128i g = _mm_and_si128(in, pix_mask_g);
-         __m128i b = _mm_and_si128(_mm_slli_epi16(in, 5), pix_mask_b);
-
-         r = _mm_mulhi_epi16(r, mul16_r);
-         g = _mm_mulhi_epi16(g, mul16_g);
-         b = _mm_mulhi_epi16(b, mul16_b);
-
-         __m128i res_lo_bg = _mm_unpacklo_epi8(b, g);
-         __m128i res_hi_bg = _mm_unpackhi_epi8(b, g);
-         __m128i res_lo_ra = _mm_unpacklo_epi8(r, a);
-         __m128i res_hi_ra = _mm_unpackhi_epi8(r, a);
-
-         __m128i res_lo = _mm_or_si128(res_lo_bg, _mm_slli_si128(res_lo_ra, 2));
-         __m128i res_hi = _mm_or_si128(res_hi_bg, _mm_slli_si128(res_hi_ra, 2));
-
-         _mm_storeu_si128((__m128i*)(output + w + 0), res_lo);
-         _mm_storeu_si128((__m128i*)(output + w + 4), res_hi);
-      }
-
-      for (; w < width; w++)
+      uint8_t *out = output;
+      for (int w = 0; w < width; w++)
       {
          uint32_t col = input[w];
-         uint32_t r = (col >> 11) & 0x1f;
-         uint32_t g = (col >>  5) & 0x3f;
          uint32_t b = (col >>  0) & 0x1f;
-         r = (r << 3) | (r >> 2);
-         g = (g << 2) | (g >> 4);
+         uint32_t g = (col >>  5) & 0x1f;
+         uint32_t r = (col >> 10) & 0x1f;
          b = (b << 3) | (b >> 2);
+         g = (g << 3) | (g >> 2);
+         r = (r << 3) | (r >> 2);
 
-         output[w] = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+         *out++ = b;
+         *out++ = g;
+         *out++ = r;
       }
    }
 }
-#else
-void conv_rgb565_argb8888(void *output_, const void *input_,
+
+void conv_rgb565_bgr24(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint16_t *input = (const uint16_t*)input_;
-   uint32_t *output      = (uint32_t*)output_;
+   uint8_t *output       = (uint8_t*)output_;
 
-   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
    {
+      uint8_t *out = output;
       for (int w = 0; w < width; w++)
       {
          uint32_t col = input[w];
-         uint32_t r = (col >> 11) & 0x1f;
-         uint32_t g = (col >>  5) & 0x3f;
          uint32_t b = (col >>  0) & 0x1f;
-         r = (r << 3) | (r >> 2);
-         g = (g << 2) | (g >> 4);
+         uint32_t g = (col >>  5) & 0x3f;
+         uint32_t r = (col >> 11) & 0x1f;
          b = (b << 3) | (b >> 2);
+         g = (g << 2) | (g >> 4);
+         r = (r << 3) | (r >> 2);
 
-         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+         *out++ = b;
+         *out++ = g;
+         *out++ = r;
       }
    }
 }
-#endif
 
-#if defined(__SSE2__)
-// :( TODO: Make this saner.
-static inline void store_bgr24_sse2(void *output, __m128i a, __m128i b, __m128i c, __m128i d)
+void conv_bgr24_argb8888(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
 {
-   const __m128i mask_0 = _mm_set_epi32(0, 0, 0, 0x00ffffff);
-   const __m128i mask_1 = _mm_set_epi32(0, 0, 0x00ffffff, 0);
-   const __m128i mask_2 = _mm_set_epi32(0, 0x00ffffff, 0, 0);
-   const __m128i mask_3 = _mm_set_epi32(0x00ffffff, 0, 0, 0);
-
-   __m128i a0 = _mm_and_si128(a, mask_0);
-   __m128i a1 = _mm_srli_si128(_mm_and_si128(a, mask_1),  1);
-   __m128i a2 = _mm_srli_si128(_mm_and_si128(a, mask_2),  2);
-   __m128i a3 = _mm_srli_si128(_mm_and_si128(a, mask_3),  3);
-   __m128i a4 = _mm_slli_si128(_mm_and_si128(b, mask_0), 12);
-   __m128i a5 = _mm_slli_si128(_mm_and_si128(b, mask_1), 11);
-
-   __m128i b0 = _mm_srli_si128(_mm_and_si128(b, mask_1), 5);
-   __m128i b1 = _mm_srli_si128(_mm_and_si128(b, mask_2), 6);
-   __m128i b2 = _mm_srli_si128(_mm_and_si128(b, mask_3), 7);
-   __m128i b3 = _mm_slli_si128(_mm_and_si128(c, mask_0), 8);
-   __m128i b4 = _mm_slli_si128(_mm_and_si128(c, mask_1), 7);
-   __m128i b5 = _mm_slli_si128(_mm_and_si128(c, mask_2), 6);
-
-   __m128i c0 = _mm_srli_si128(_mm_and_si128(c, mask_2), 10);
-   __m128i c1 = _mm_srli_si128(_mm_and_si128(c, mask_3), 11);
-   __m128i c2 = _mm_slli_si128(_mm_and_si128(d, mask_0),  4);
-   __m128i c3 = _mm_slli_si128(_mm_and_si128(d, mask_1),  3);
-   __m128i c4 = _mm_slli_si128(_mm_and_si128(d, mask_2),  2);
-   __m128i c5 = _mm_slli_si128(_mm_and_si128(d, mask_3),  1);
-
-   __m128i *out = (__m128i*)output;
-
-   _mm_storeu_si128(out + 0,
-         _mm_or_si128(a0, _mm_or_si128(a1, _mm_or_si128(a2, _mm_or_si128(a3, _mm_or_si128(a4, a5))))));
-
-   _mm_storeu_si128(out + 1,
-         _mm_or_si128(b0, _mm_or_si128(b1, _mm_or_si128(b2, _mm_or_si128(b3, _mm_or_si128(b4, b5))))));
+   const uint8_t *input = (const uint8_t*)input_;
+   uint32_t *output     = (uint32_t*)output_;
 
-   _mm_storeu_si128(out + 2,
-         _mm_or_si128(c0, _mm_or_si128(c1, _mm_or_si128(c2, _mm_or_si128(c3, _mm_or_si128(c4, c5))))));
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride)
+   {
+      const uint8_t *inp = input;
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t b = *inp++;
+         uint32_t g = *inp++;
+         uint32_t r = *inp++;
+         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+      }
+   }
 }
 
-void conv_0rgb1555_bgr24(void *output_, const void *input_,
+void conv_argb8888_0rgb1555(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   const uint16_t *input = (const uint16_t*)input_;
-   uint8_t *output       = (uint8_t*)output_;
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
 
-   const __m128i pix_mask_r  = _mm_set1_epi16(0x1f << 10);
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint16_t r = (col >> 19) & 0x1f;
+         uint16_t g = (col >> 11) & 0x1f;
+         uint16_t b = (col >>  3) & 0x1f;
+         output[w] = (r << 10) | (g << 5) | (b << 0);
+      }
+   }
+}
+
+void conv_argb8888_rgb565(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint16_t r = (col >> 19) & 0x1f;
+         uint16_t g = (col >> 10) & 0x3f;
+         uint16_t b = (col >>  3) & 0x1f;
+         output[w] = (r << 11) | (g << 5) | (b << 0);
+      }
+   }
+}
+
+void conv_argb8888_bgr24(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint8_t *output       = (uint8_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 2)
+   {
+      uint8_t *out = output;
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t col = input[w];
+         *out++ = (uint8_t)(col >>  0);
+         *out++ = (uint8_t)(col >>  8);
+         *out++ = (uint8_t)(col >> 16);
+      }
+   }
+}
+
+void conv_argb8888_abgr8888(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 2)
+   {
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t col = input[w];
+         output[w] = ((col << 16) & 0xff0000) | ((col >> 16) & 0xff) | (col & 0xff00ff00);
+      }
+   }
+}
+
+void conv_copy(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   int copy_len = abs(out_stride);
+   if (abs(in_stride) < copy_len)
+      copy_len = abs(in_stride);
+
+   const uint8_t *input = (const uint8_t*)input_;
+   uint8_t *output      = (uint8_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride)
+      memcpy(output, input, copy_len);
+}
+
+#if defined(__SSE2__)
+static void conv_rgb565_0rgb1555_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint16_t *output = (uint16_t*)output_;
+
+   int max_width = width - 7;
+
+   const __m128i hi_mask   = _mm_set1_epi16(0x7fe0);
+   const __m128i lo_mask   = _mm_set1_epi16(0x1f);
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 1), hi_mask);
+         __m128i lo = _mm_and_si128(in, lo_mask);
+         _mm_storeu_si128((__m128i*)(output + w), _mm_or_si128(hi, lo));
+      }
+
+      for (; w < width; w++)
+      {
+         uint16_t col = input[w];
+         uint16_t hi = (col >> 1) & 0x7fe0;
+         uint16_t lo = col & 0x1f;
+         output[w] = hi | lo;
+      }
+   }
+}
+
+static void conv_0rgb1555_rgb565_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint16_t *output = (uint16_t*)output_;
+
+   int max_width = width - 7;
+
+   const __m128i hi_mask   = _mm_set1_epi16((int16_t)((0x1f << 11) | (0x1f << 6)));
+   const __m128i lo_mask   = _mm_set1_epi16(0x1f);
+   const __m128i glow_mask = _mm_set1_epi16(1 << 5);
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i rg   = _mm_and_si128(_mm_slli_epi16(in, 1), hi_mask);
+         __m128i b    = _mm_and_si128(in, lo_mask);
+         __m128i glow = _mm_and_si128(_mm_srli_epi16(in, 4), glow_mask);
+         _mm_storeu_si128((__m128i*)(output + w), _mm_or_si128(rg, _mm_or_si128(b, glow)));
+      }
+
+      for (; w < width; w++)
+      {
+         uint16_t col = input[w];
+         uint16_t rg = (col << 1) & ((0x1f << 11) | (0x1f << 6));
+         uint16_t b = col & 0x1f;
+         uint16_t glow = (col >> 4) & (1 << 5);
+         output[w] = rg | b | glow;
+      }
+   }
+}
+
+static void conv_0rgb1555_argb8888_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const __m128i pix_mask_r  = _mm_set1_epi16(0x1f << 10);
    const __m128i pix_mask_gb = _mm_set1_epi16(0x1f <<  5);
    const __m128i mul15_mid   = _mm_set1_epi16(0x4200);
    const __m128i mul15_hi    = _mm_set1_epi16(0x0210);
    const __m128i a           = _mm_set1_epi16(0x00ff);
 
-   int max_width = width - 15;
+   int max_width = width - 7;
 
-   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
    {
-      uint8_t *out = output;
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i r = _mm_and_si128(in, pix_mask_r);
+         __m128i g = _mm_and_si128(in, pix_mask_gb);
+         __m128i b = _mm_and_si128(_mm_slli_epi16(in, 5), pix_mask_gb);
+
+         r = _mm_mulhi_epi16(r, mul15_hi);
+         g = _mm_mulhi_epi16(g, mul15_mid);
+         b = _mm_mulhi_epi16(b, mul15_mid);
+
+         __m128i res_lo_bg = _mm_unpacklo_epi8(b, g);
+         __m128i res_hi_bg = _mm_unpackhi_epi8(b, g);
+         __m128i res_lo_ra = _mm_unpacklo_epi8(r, a);
+         __m128i res_hi_ra = _mm_unpackhi_epi8(r, a);
+
+         __m128i res_lo = _mm_or_si128(res_lo_bg, _mm_slli_si128(res_lo_ra, 2));
+         __m128i res_hi = _mm_or_si128(res_hi_bg, _mm_slli_si128(res_hi_ra, 2));
+
+         _mm_storeu_si128((__m128i*)(output + w + 0), res_lo);
+         _mm_storeu_si128((__m128i*)(output + w + 4), res_hi);
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint32_t r = (col >> 10) & 0x1f;
+         uint32_t g = (col >>  5) & 0x1f;
+         uint32_t b = (col >>  0) & 0x1f;
+         r = (r << 3) | (r >> 2);
+         g = (g << 3) | (g >> 2);
+         b = (b << 3) | (b >> 2);
+
+         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+      }
+   }
+}
+
+static void conv_rgb565_argb8888_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const __m128i pix_mask_r = _mm_set1_epi16(0x1f << 10);
+   const __m128i pix_mask_g = _mm_set1_epi16(0x3f <<  5);
+   const __m128i pix_mask_b = _mm_set1_epi16(0x1f <<  5);
+   const __m128i mul16_r    = _mm_set1_epi16(0x0210);
+   const __m128i mul16_g    = _mm_set1_epi16(0x2080);
+   const __m128i mul16_b    = _mm_set1_epi16(0x4200);
+   const __m128i a          = _mm_set1_epi16(0x00ff);
+
+   int max_width = width - 7;
 
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
       int w;
-      for (w = 0; w < max_width; w += 16, out += 48)
+      for (w = 0; w < max_width; w += 8)
       {
-         const __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
-         const __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 8));
-         __m128i r0 = _mm_and_si128(in0, pix_mask_r);
-         __m128i r1 = _mm_and_si128(in1, pix_mask_r);
-         __m128i g0 = _mm_and_si128(in0, pix_mask_gb);
-         __m128i g1 = _mm_and_si128(in1, pix_mask_gb);
-         __m128i b0 = _mm_and_si128(_mm_slli_epi16(in0, 5), pix_mask_gb);
-         __m128i b1 = _mm_and_si128(_mm_slli_epi16(in1, 5), pix_mask_gb);
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i r = _mm_and_si128(_mm_srli_epi16(in, 1), pix_mask_r);
+         __m128i g = _mm_and_si128(in, pix_mask_g);
+         __m128i b = _mm_and_si128(_mm_slli_epi16(in, 5), pix_mask_b);
 
-         r0 = _mm_mulhi_epi16(r0, mul15_hi);
-         r1 = _mm_mulhi_epi16(r1, mul15_hi);
-         g0 = _mm_mulhi_epi16(g0, mul15_mid);
-         g1 = _mm_mulhi_epi16(g1, mul15_mid);
-         b0 = _mm_mulhi_epi16(b0, mul15_mid);
-         b1 = _mm_mulhi_epi16(b1, mul15_mid);
+         r = _mm_mulhi_epi16(r, mul16_r);
+         g = _mm_mulhi_epi16(g, mul16_g);
+         b = _mm_mulhi_epi16(b, mul16_b);
 
-         __m128i res_lo_bg0 = _mm_unpacklo_epi8(b0, g0);
-         __m128i res_lo_bg1 = _mm_unpacklo_epi8(b1, g1);
-         __m128i res_hi_bg0 = _mm_unpackhi_epi8(b0, g0);
-         __m128i res_hi_bg1 = _mm_unpackhi_epi8(b1, g1);
-         __m128i res_lo_ra0 = _mm_unpacklo_epi8(r0, a);
-         __m128i res_lo_ra1 = _mm_unpacklo_epi8(r1, a);
-         __m128i res_hi_ra0 = _mm_unpackhi_epi8(r0, a);
-         __m128i res_hi_ra1 = _mm_unpackhi_epi8(r1, a);
+         __m128i res_lo_bg = _mm_unpacklo_epi8(b, g);
+         __m128i res_hi_bg = _mm_unpackhi_epi8(b, g);
+         __m128i res_lo_ra = _mm_unpacklo_epi8(r, a);
+         __m128i res_hi_ra = _mm_unpackhi_epi8(r, a);
 
-         __m128i res_lo0 = _mm_or_si128(res_lo_bg0, _mm_slli_si128(res_lo_ra0, 2));
-         __m128i res_lo1 = _mm_or_si128(res_lo_bg1, _mm_slli_si128(res_lo_ra1, 2));
-         __m128i res_hi0 = _mm_or_si128(res_hi_bg0, _mm_slli_si128(res_hi_ra0, 2));
-         __m128i res_hi1 = _mm_or_si128(res_hi_bg1, _mm_slli_si128(res_hi_ra1, 2));
+         __m128i res_lo = _mm_or_si128(res_lo_bg, _mm_slli_si128(res_lo_ra, 2));
+         __m128i res_hi = _mm_or_si128(res_hi_bg, _mm_slli_si128(res_hi_ra, 2));
+
+         _mm_storeu_si128((__m128i*)(output + w + 0), res_lo);
+         _mm_storeu_si128((__m128i*)(output + w + 4), res_hi);
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint32_t r = (col >> 11) & 0x1f;
+         uint32_t g = (col >>  5) & 0x3f;
+         uint32_t b = (col >>  0) & 0x1f;
+         r = (r << 3) | (r >> 2);
+         g = (g << 2) | (g >> 4);
+         b = (b << 3) | (b >> 2);
+
+         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+      }
+   }
+}
+
+// :( TODO: Make this saner.
+static inline void store_bgr24_sse2(void *output, __m128i a, __m128i b, __m128i c, __m128i d)
+{
+   const __m128i mask_0 = _mm_set_epi32(0, 0, 0, 0x00ffffff);
+   const __m128i mask_1 = _mm_set_epi32(0, 0, 0x00ffffff, 0);
+   const __m128i mask_2 = _mm_set_epi32(0, 0x00ffffff, 0, 0);
+   const __m128i mask_3 = _mm_set_epi32(0x00ffffff, 0, 0, 0);
+
+   __m128i a0 = _mm_and_si128(a, mask_0);
+   __m128i a1 = _mm_srli_si128(_mm_and_si128(a, mask_1),  1);
+   __m128i a2 = _mm_srli_si128(_mm_and_si128(a, mask_2),  2);
+   __m128i a3 = _mm_srli_si128(_mm_and_si128(a, mask_3),  3);
+   __m128i a4 = _mm_slli_si128(_mm_and_si128(b, mask_0), 12);
+   __m128i a5 = _mm_slli_si128(_mm_and_si128(b, mask_1), 11);
+
+   __m128i b0 = _mm_srli_si128(_mm_and_si128(b, mask_1), 5);
+   __m128i b1 = _mm_srli_si128(_mm_and_si128(b, mask_2), 6);
+   __m128i b2 = _mm_srli_si128(_mm_and_si128(b, mask_3), 7);
+   __m128i b3 = _mm_slli_si128(_mm_and_si128(c, mask_0), 8);
+   __m128i b4 = _mm_slli_si128(_mm_and_si128(c, mask_1), 7);
+   __m128i b5 = _mm_slli_si128(_mm_and_si128(c, mask_2), 6);
+
+   __m128i c0 = _mm_srli_si128(_mm_and_si128(c, mask_2), 10);
+   __m128i c1 = _mm_srli_si128(_mm_and_si128(c, mask_3), 11);
+   __m128i c2 = _mm_slli_si128(_mm_and_si128(d, mask_0),  4);
+   __m128i c3 = _mm_slli_si128(_mm_and_si128(d, mask_1),  3);
+   __m128i c4 = _mm_slli_si128(_mm_and_si128(d, mask_2),  2);
+   __m128i c5 = _mm_slli_si128(_mm_and_si128(d, mask_3),  1);
+
+   __m128i *out = (__m128i*)output;
+
+   _mm_storeu_si128(out + 0,
+         _mm_or_si128(a0, _mm_or_si128(a1, _mm_or_si128(a2, _mm_or_si128(a3, _mm_or_si128(a4, a5))))));
+
+   _mm_storeu_si128(out + 1,
+         _mm_or_si128(b0, _mm_or_si128(b1, _mm_or_si128(b2, _mm_or_si128(b3, _mm_or_si128(b4, b5))))));
+
+   _mm_storeu_si128(out + 2,
+         _mm_or_si128(c0, _mm_or_si128(c1, _mm_or_si128(c2, _mm_or_si128(c3, _mm_or_si128(c4, c5))))));
+}
+
+static void conv_0rgb1555_bgr24_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint8_t *output       = (uint8_t*)output_;
+
+   const __m128i pix_mask_r  = _mm_set1_epi16(0x1f << 10);
+   const __m128i pix_mask_gb = _mm_set1_epi16(0x1f <<  5);
+   const __m128i mul15_mid   = _mm_set1_epi16(0x4200);
+   const __m128i mul15_hi    = _mm_set1_epi16(0x0210);
+   const __m128i a           = _mm_set1_epi16(0x00ff);
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
+   {
+      uint8_t *out = output;
+
+      int w;
+      for (w = 0; w < max_width; w += 16, out += 48)
+      {
+         const __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+         const __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 8));
+         __m128i r0 = _mm_and_si128(in0, pix_mask_r);
+         __m128i r1 = _mm_and_si128(in1, pix_mask_r);
+         __m128i g0 = _mm_and_si128(in0, pix_mask_gb);
+         __m128i g1 = _mm_and_si128(in1, pix_mask_gb);
+         __m128i b0 = _mm_and_si128(_mm_slli_epi16(in0, 5), pix_mask_gb);
+         __m128i b1 = _mm_and_si128(_mm_slli_epi16(in1, 5), pix_mask_gb);
+
+         r0 = _mm_mulhi_epi16(r0, mul15_hi);
+         r1 = _mm_mulhi_epi16(r1, mul15_hi);
+         g0 = _mm_mulhi_epi16(g0, mul15_mid);
+         g1 = _mm_mulhi_epi16(g1, mul15_mid);
+         b0 = _mm_mulhi_epi16(b0, mul15_mid);
+         b1 = _mm_mulhi_epi16(b1, mul15_mid);
+
+         __m128i res_lo_bg0 = _mm_unpacklo_epi8(b0, g0);
+         __m128i res_lo_bg1 = _mm_unpacklo_epi8(b1, g1);
+         __m128i res_hi_bg0 = _mm_unpackhi_epi8(b0, g0);
+         __m128i res_hi_bg1 = _mm_unpackhi_epi8(b1, g1);
+         __m128i res_lo_ra0 = _mm_unpacklo_epi8(r0, a);
+         __m128i res_lo_ra1 = _mm_unpacklo_epi8(r1, a);
+         __m128i res_hi_ra0 = _mm_unpackhi_epi8(r0, a);
+         __m128i res_hi_ra1 = _mm_unpackhi_epi8(r1, a);
+
+         __m128i res_lo0 = _mm_or_si128(res_lo_bg0, _mm_slli_si128(res_lo_ra0, 2));
+         __m128i res_lo1 = _mm_or_si128(res_lo_bg1, _mm_slli_si128(res_lo_ra1, 2));
+         __m128i res_hi0 = _mm_or_si128(res_hi_bg0, _mm_slli_si128(res_hi_ra0, 2));
+         __m128i res_hi1 = _mm_or_si128(res_hi_bg1, _mm_slli_si128(res_hi_ra1, 2));
+
+         // Non-POT pixel sizes ftl :(
+         store_bgr24_sse2(out, res_lo0, res_hi0, res_lo1, res_hi1);
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint32_t b = (col >>  0) & 0x1f;
+         uint32_t g = (col >>  5) & 0x1f;
+         uint32_t r = (col >> 10) & 0x1f;
+         b = (b << 3) | (b >> 2);
+         g = (g << 3) | (g >> 2);
+         r = (r << 3) | (r >> 2);
+
+         *out++ = b;
+         *out++ = g;
+         *out++ = r;
+      }
+   }
+}
+
+static void conv_rgb565_bgr24_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint8_t *output      = (uint8_t*)output_;
+
+   const __m128i pix_mask_r = _mm_set1_epi16(0x1f << 10);
+   const __m128i pix_mask_g = _mm_set1_epi16(0x3f <<  5);
+   const __m128i pix_mask_b = _mm_set1_epi16(0x1f <<  5);
+   const __m128i mul16_r    = _mm_set1_epi16(0x0210);
+   const __m128i mul16_g    = _mm_set1_epi16(0x2080);
+   const __m128i mul16_b    = _mm_set1_epi16(0x4200);
+   const __m128i a          = _mm_set1_epi16(0x00ff);
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
+   {
+      uint8_t *out = output;
+
+      int w;
+      for (w = 0; w < max_width; w += 16, out += 48)
+      {
+         const __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w));
+         const __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 8));
+         __m128i r0 = _mm_and_si128(_mm_srli_epi16(in0, 1), pix_mask_r);
+         __m128i g0 = _mm_and_si128(in0, pix_mask_g);
+         __m128i b0 = _mm_and_si128(_mm_slli_epi16(in0, 5), pix_mask_b);
+         __m128i r1 = _mm_and_si128(_mm_srli_epi16(in1, 1), pix_mask_r);
+         __m128i g1 = _mm_and_si128(in1, pix_mask_g);
+         __m128i b1 = _mm_and_si128(_mm_slli_epi16(in1, 5), pix_mask_b);
+
+         r0 = _mm_mulhi_epi16(r0, mul16_r);
+         g0 = _mm_mulhi_epi16(g0, mul16_g);
+         b0 = _mm_mulhi_epi16(b0, mul16_b);
+         r1 = _mm_mulhi_epi16(r1, mul16_r);
+         g1 = _mm_mulhi_epi16(g1, mul16_g);
+         b1 = _mm_mulhi_epi16(b1, mul16_b);
+
+         __m128i res_lo_bg0 = _mm_unpacklo_epi8(b0, g0);
+         __m128i res_hi_bg0 = _mm_unpackhi_epi8(b0, g0);
+         __m128i res_lo_ra0 = _mm_unpacklo_epi8(r0, a);
+         __m128i res_hi_ra0 = _mm_unpackhi_epi8(r0, a);
+         __m128i res_lo_bg1 = _mm_unpacklo_epi8(b1, g1);
+         __m128i res_hi_bg1 = _mm_unpackhi_epi8(b1, g1);
+         __m128i res_lo_ra1 = _mm_unpacklo_epi8(r1, a);
+         __m128i res_hi_ra1 = _mm_unpackhi_epi8(r1, a);
+
+         __m128i res_lo0 = _mm_or_si128(res_lo_bg0, _mm_slli_si128(res_lo_ra0, 2));
+         __m128i res_hi0 = _mm_or_si128(res_hi_bg0, _mm_slli_si128(res_hi_ra0, 2));
+         __m128i res_lo1 = _mm_or_si128(res_lo_bg1, _mm_slli_si128(res_lo_ra1, 2));
+         __m128i res_hi1 = _mm_or_si128(res_hi_bg1, _mm_slli_si128(res_hi_ra1, 2));
+
+         store_bgr24_sse2(out, res_lo0, res_hi0, res_lo1, res_hi1);
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint32_t r = (col >> 11) & 0x1f;
+         uint32_t g = (col >>  5) & 0x3f;
+         uint32_t b = (col >>  0) & 0x1f;
+         r = (r << 3) | (r >> 2);
+         g = (g << 2) | (g >> 4);
+         b = (b << 3) | (b >> 2);
+
+         *out++ = b;
+         *out++ = g;
+         *out++ = r;
+      }
+   }
+}
+
+static void conv_argb8888_bgr24_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint8_t *output       = (uint8_t*)output_;
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 2)
+   {
+      uint8_t *out = output;
+      int w;
+
+      for (w = 0; w < max_width; w += 16, out += 48)
+      {
+         store_bgr24_sse2(out,
+               _mm_loadu_si128((const __m128i*)(input + w +  0)),
+               _mm_loadu_si128((const __m128i*)(input + w +  4)),
+               _mm_loadu_si128((const __m128i*)(input + w +  8)),
+               _mm_loadu_si128((const __m128i*)(input + w + 12)));
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         *out++ = (uint8_t)(col >>  0);
+         *out++ = (uint8_t)(col >>  8);
+         *out++ = (uint8_t)(col >> 16);
+      }
+   }
+}
+
+// SSE2 has no byte shuffle, so gather pixels with (unaligned) 32-bit loads.
+// Each load takes one byte from the next pixel, which is why the last pixel of a row is left to the scalar loop.
+static void conv_bgr24_argb8888_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint8_t *input = (const uint8_t*)input_;
+   uint32_t *output     = (uint32_t*)output_;
+
+   const __m128i a = _mm_set1_epi32(0xff000000);
+
+   int max_width = width - 4;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride)
+   {
+      const uint8_t *inp = input;
+
+      int w;
+      for (w = 0; w < max_width; w += 4, inp += 12)
+      {
+         int32_t p0, p1, p2, p3;
+         memcpy(&p0, inp + 0, sizeof(p0));
+         memcpy(&p1, inp + 3, sizeof(p1));
+         memcpy(&p2, inp + 6, sizeof(p2));
+         memcpy(&p3, inp + 9, sizeof(p3));
+
+         // The stray byte lands in the alpha channel, which is overwritten anyway.
+         __m128i res = _mm_or_si128(_mm_set_epi32(p3, p2, p1, p0), a);
+         _mm_storeu_si128((__m128i*)(output + w), res);
+      }
+
+      for (; w < width; w++, inp += 3)
+         output[w] = load_bgr24(inp);
+   }
+}
+
+static void conv_argb8888_0rgb1555_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+
+   const __m128i mask_r = _mm_set1_epi32(0x1f << 10);
+   const __m128i mask_g = _mm_set1_epi32(0x1f <<  5);
+   const __m128i mask_b = _mm_set1_epi32(0x1f <<  0);
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+         const __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 4));
+
+         __m128i res0 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in0, 9), mask_r),
+               _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in0, 6), mask_g), _mm_and_si128(_mm_srli_epi32(in0, 3), mask_b)));
+         __m128i res1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in1, 9), mask_r),
+               _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in1, 6), mask_g), _mm_and_si128(_mm_srli_epi32(in1, 3), mask_b)));
+
+         // Everything fits in 15 bits, so signed saturation never kicks in.
+         _mm_storeu_si128((__m128i*)(output + w), _mm_packs_epi32(res0, res1));
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint16_t r = (col >> 19) & 0x1f;
+         uint16_t g = (col >> 11) & 0x1f;
+         uint16_t b = (col >>  3) & 0x1f;
+         output[w] = (r << 10) | (g << 5) | (b << 0);
+      }
+   }
+}
+
+static void conv_argb8888_rgb565_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+
+   const __m128i mask_r = _mm_set1_epi32(0x1f << 11);
+   const __m128i mask_g = _mm_set1_epi32(0x3f <<  5);
+   const __m128i mask_b = _mm_set1_epi32(0x1f <<  0);
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+         const __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 4));
+
+         __m128i res0 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in0, 8), mask_r),
+               _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in0, 5), mask_g), _mm_and_si128(_mm_srli_epi32(in0, 3), mask_b)));
+         __m128i res1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in1, 8), mask_r),
+               _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in1, 5), mask_g), _mm_and_si128(_mm_srli_epi32(in1, 3), mask_b)));
+
+         // Sign extend, so the signed saturating pack keeps the top bit.
+         res0 = _mm_srai_epi32(_mm_slli_epi32(res0, 16), 16);
+         res1 = _mm_srai_epi32(_mm_slli_epi32(res1, 16), 16);
+         _mm_storeu_si128((__m128i*)(output + w), _mm_packs_epi32(res0, res1));
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint16_t r = (col >> 19) & 0x1f;
+         uint16_t g = (col >> 10) & 0x3f;
+         uint16_t b = (col >>  3) & 0x1f;
+         output[w] = (r << 11) | (g << 5) | (b << 0);
+      }
+   }
+}
+
+static void conv_argb8888_abgr8888_sse2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const __m128i mask_r  = _mm_set1_epi32(0x00ff0000);
+   const __m128i mask_b  = _mm_set1_epi32(0x000000ff);
+   const __m128i mask_ag = _mm_set1_epi32(0xff00ff00);
+
+   int max_width = width - 3;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 4)
+      {
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i res = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(in, 16), mask_r),
+               _mm_or_si128(_mm_and_si128(_mm_srli_epi32(in, 16), mask_b), _mm_and_si128(in, mask_ag)));
+         _mm_storeu_si128((__m128i*)(output + w), res);
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         output[w] = ((col << 16) & 0xff0000) | ((col >> 16) & 0xff) | (col & 0xff00ff00);
+      }
+   }
+}
+#endif
+
+#if defined(PIXCONV_HAVE_AVX2)
+// AVX2 unpacks and packs work within each 128-bit lane.
+// 16-bit input is loaded with its 64-bit blocks shuffled to (0, 2, 1, 3),
+// so that unpacking to 32-bit pixels comes out in order again.
+static inline PIXCONV_TARGET_AVX2 __m256i load_rgb16_avx2(const uint16_t *input)
+{
+   return _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)input), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// r, g and b hold 16 pixels of 0 - 255 in 16-bit lanes, as laid out by load_rgb16_avx2().
+static inline PIXCONV_TARGET_AVX2 void pack_argb8888_avx2(__m256i *lo, __m256i *hi,
+      __m256i r, __m256i g, __m256i b)
+{
+   __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+   __m256i ra = _mm256_or_si256(r, _mm256_set1_epi16((int16_t)0xff00));
+
+   *lo = _mm256_unpacklo_epi16(bg, ra);
+   *hi = _mm256_unpackhi_epi16(bg, ra);
+}
+
+static inline PIXCONV_TARGET_AVX2 void expand_0rgb1555_avx2(__m256i *lo, __m256i *hi, __m256i in)
+{
+   const __m256i pix_mask_r  = _mm256_set1_epi16(0x1f << 10);
+   const __m256i pix_mask_gb = _mm256_set1_epi16(0x1f <<  5);
+   const __m256i mul15_mid   = _mm256_set1_epi16(0x4200);
+   const __m256i mul15_hi    = _mm256_set1_epi16(0x0210);
+
+   __m256i r = _mm256_mulhi_epi16(_mm256_and_si256(in, pix_mask_r), mul15_hi);
+   __m256i g = _mm256_mulhi_epi16(_mm256_and_si256(in, pix_mask_gb), mul15_mid);
+   __m256i b = _mm256_mulhi_epi16(_mm256_and_si256(_mm256_slli_epi16(in, 5), pix_mask_gb), mul15_mid);
+
+   pack_argb8888_avx2(lo, hi, r, g, b);
+}
+
+static inline PIXCONV_TARGET_AVX2 void expand_rgb565_avx2(__m256i *lo, __m256i *hi, __m256i in)
+{
+   const __m256i pix_mask_r = _mm256_set1_epi16(0x1f << 10);
+   const __m256i pix_mask_g = _mm256_set1_epi16(0x3f <<  5);
+   const __m256i pix_mask_b = _mm256_set1_epi16(0x1f <<  5);
+   const __m256i mul16_r    = _mm256_set1_epi16(0x0210);
+   const __m256i mul16_g    = _mm256_set1_epi16(0x2080);
+   const __m256i mul16_b    = _mm256_set1_epi16(0x4200);
+
+   __m256i r = _mm256_mulhi_epi16(_mm256_and_si256(_mm256_srli_epi16(in, 1), pix_mask_r), mul16_r);
+   __m256i g = _mm256_mulhi_epi16(_mm256_and_si256(in, pix_mask_g), mul16_g);
+   __m256i b = _mm256_mulhi_epi16(_mm256_and_si256(_mm256_slli_epi16(in, 5), pix_mask_b), mul16_b);
+
+   pack_argb8888_avx2(lo, hi, r, g, b);
+}
+
+// Writes 16 ARGB8888 pixels as 48 bytes of BGR24.
+// Each 128-bit lane is shuffled down to 12 bytes and stored with a 16-byte store,
+// so this writes 4 bytes of garbage past the end, which the caller must overwrite later.
+static inline PIXCONV_TARGET_AVX2 void store_bgr24_avx2(uint8_t *out, __m256i lo, __m256i hi)
+{
+   const __m256i shuf = _mm256_setr_epi8(
+         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+         0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+   lo = _mm256_shuffle_epi8(lo, shuf);
+   hi = _mm256_shuffle_epi8(hi, shuf);
+
+   _mm_storeu_si128((__m128i*)(out +  0), _mm256_castsi256_si128(lo));
+   _mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(lo, 1));
+   _mm_storeu_si128((__m128i*)(out + 24), _mm256_castsi256_si128(hi));
+   _mm_storeu_si128((__m128i*)(out + 36), _mm256_extracti128_si256(hi, 1));
+}
+
+static PIXCONV_TARGET_AVX2 void conv_rgb565_0rgb1555_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint16_t *output = (uint16_t*)output_;
+
+   const __m256i hi_mask = _mm256_set1_epi16(0x7fe0);
+   const __m256i lo_mask = _mm256_set1_epi16(0x1f);
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+         __m256i hi = _mm256_and_si256(_mm256_srli_epi16(in, 1), hi_mask);
+         __m256i lo = _mm256_and_si256(in, lo_mask);
+         _mm256_storeu_si256((__m256i*)(output + w), _mm256_or_si256(hi, lo));
+      }
+
+      for (; w < width; w++)
+      {
+         uint16_t col = input[w];
+         output[w] = ((col >> 1) & 0x7fe0) | (col & 0x1f);
+      }
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_0rgb1555_rgb565_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint16_t *output = (uint16_t*)output_;
+
+   const __m256i hi_mask   = _mm256_set1_epi16((int16_t)((0x1f << 11) | (0x1f << 6)));
+   const __m256i lo_mask   = _mm256_set1_epi16(0x1f);
+   const __m256i glow_mask = _mm256_set1_epi16(1 << 5);
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+         __m256i rg   = _mm256_and_si256(_mm256_slli_epi16(in, 1), hi_mask);
+         __m256i b    = _mm256_and_si256(in, lo_mask);
+         __m256i glow = _mm256_and_si256(_mm256_srli_epi16(in, 4), glow_mask);
+         _mm256_storeu_si256((__m256i*)(output + w), _mm256_or_si256(rg, _mm256_or_si256(b, glow)));
+      }
+
+      for (; w < width; w++)
+      {
+         uint16_t col = input[w];
+         output[w] = ((col << 1) & ((0x1f << 11) | (0x1f << 6))) | (col & 0x1f) | ((col >> 4) & (1 << 5));
+      }
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_0rgb1555_argb8888_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         __m256i lo, hi;
+         expand_0rgb1555_avx2(&lo, &hi, load_rgb16_avx2(input + w));
+         _mm256_storeu_si256((__m256i*)(output + w + 0), lo);
+         _mm256_storeu_si256((__m256i*)(output + w + 8), hi);
+      }
+
+      if (w < width)
+         conv_0rgb1555_argb8888(output + w, input + w, width - w, 1, 0, 0);
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_rgb565_argb8888_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         __m256i lo, hi;
+         expand_rgb565_avx2(&lo, &hi, load_rgb16_avx2(input + w));
+         _mm256_storeu_si256((__m256i*)(output + w + 0), lo);
+         _mm256_storeu_si256((__m256i*)(output + w + 8), hi);
+      }
+
+      if (w < width)
+         conv_rgb565_argb8888(output + w, input + w, width - w, 1, 0, 0);
+   }
+}
+
+// BGR24 stores spill 4 bytes, so keep two pixels in reserve for the scalar loop to write over.
+static PIXCONV_TARGET_AVX2 void conv_0rgb1555_bgr24_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint8_t *output       = (uint8_t*)output_;
+
+   int max_width = width - 17;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         __m256i lo, hi;
+         expand_0rgb1555_avx2(&lo, &hi, load_rgb16_avx2(input + w));
+         store_bgr24_avx2(output + 3 * w, lo, hi);
+      }
+
+      if (w < width)
+         conv_0rgb1555_bgr24(output + 3 * w, input + w, width - w, 1, 0, 0);
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_rgb565_bgr24_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint8_t *output       = (uint8_t*)output_;
+
+   int max_width = width - 17;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         __m256i lo, hi;
+         expand_rgb565_avx2(&lo, &hi, load_rgb16_avx2(input + w));
+         store_bgr24_avx2(output + 3 * w, lo, hi);
+      }
+
+      if (w < width)
+         conv_rgb565_bgr24(output + 3 * w, input + w, width - w, 1, 0, 0);
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_argb8888_bgr24_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint8_t *output       = (uint8_t*)output_;
+
+   int max_width = width - 17;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         store_bgr24_avx2(output + 3 * w,
+               _mm256_loadu_si256((const __m256i*)(input + w + 0)),
+               _mm256_loadu_si256((const __m256i*)(input + w + 8)));
+      }
+
+      if (w < width)
+         conv_argb8888_bgr24(output + 3 * w, input + w, width - w, 1, 0, 0);
+   }
+}
+
+// Loads 12 bytes into each 128-bit lane with 16-byte loads, so keep two pixels in reserve
+// to not read past the end of the row.
+static PIXCONV_TARGET_AVX2 void conv_bgr24_argb8888_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint8_t *input = (const uint8_t*)input_;
+   uint32_t *output     = (uint32_t*)output_;
+
+   const __m256i shuf = _mm256_setr_epi8(
+         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+   const __m256i a = _mm256_set1_epi32(0xff000000);
+
+   int max_width = width - 9;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const uint8_t *inp = input + 3 * w;
+         __m256i in = _mm256_inserti128_si256(
+               _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(inp + 0))),
+               _mm_loadu_si128((const __m128i*)(inp + 12)), 1);
+
+         _mm256_storeu_si256((__m256i*)(output + w), _mm256_or_si256(_mm256_shuffle_epi8(in, shuf), a));
+      }
+
+      if (w < width)
+         conv_bgr24_argb8888(output + w, input + 3 * w, width - w, 1, 0, 0);
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_argb8888_0rgb1555_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+
+   const __m256i mask_r = _mm256_set1_epi32(0x1f << 10);
+   const __m256i mask_g = _mm256_set1_epi32(0x1f <<  5);
+   const __m256i mask_b = _mm256_set1_epi32(0x1f <<  0);
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         const __m256i in0 = _mm256_loadu_si256((const __m256i*)(input + w + 0));
+         const __m256i in1 = _mm256_loadu_si256((const __m256i*)(input + w + 8));
+
+         __m256i res0 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in0, 9), mask_r),
+               _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in0, 6), mask_g),
+                  _mm256_and_si256(_mm256_srli_epi32(in0, 3), mask_b)));
+         __m256i res1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in1, 9), mask_r),
+               _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in1, 6), mask_g),
+                  _mm256_and_si256(_mm256_srli_epi32(in1, 3), mask_b)));
+
+         __m256i res = _mm256_permute4x64_epi64(_mm256_packs_epi32(res0, res1), _MM_SHUFFLE(3, 1, 2, 0));
+         _mm256_storeu_si256((__m256i*)(output + w), res);
+      }
+
+      if (w < width)
+         conv_argb8888_0rgb1555(output + w, input + w, width - w, 1, 0, 0);
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_argb8888_rgb565_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+
+   const __m256i mask_r = _mm256_set1_epi32(0x1f << 11);
+   const __m256i mask_g = _mm256_set1_epi32(0x3f <<  5);
+   const __m256i mask_b = _mm256_set1_epi32(0x1f <<  0);
+
+   int max_width = width - 15;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 16)
+      {
+         const __m256i in0 = _mm256_loadu_si256((const __m256i*)(input + w + 0));
+         const __m256i in1 = _mm256_loadu_si256((const __m256i*)(input + w + 8));
+
+         __m256i res0 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in0, 8), mask_r),
+               _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in0, 5), mask_g),
+                  _mm256_and_si256(_mm256_srli_epi32(in0, 3), mask_b)));
+         __m256i res1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in1, 8), mask_r),
+               _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in1, 5), mask_g),
+                  _mm256_and_si256(_mm256_srli_epi32(in1, 3), mask_b)));
+
+         // AVX2 has an unsigned 32 -> 16 pack, unlike SSE2.
+         __m256i res = _mm256_permute4x64_epi64(_mm256_packus_epi32(res0, res1), _MM_SHUFFLE(3, 1, 2, 0));
+         _mm256_storeu_si256((__m256i*)(output + w), res);
+      }
+
+      if (w < width)
+         conv_argb8888_rgb565(output + w, input + w, width - w, 1, 0, 0);
+   }
+}
+
+static PIXCONV_TARGET_AVX2 void conv_argb8888_abgr8888_avx2(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const __m256i shuf = _mm256_setr_epi8(
+         2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+         2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const __m256i in = _mm256_loadu_si256((const __m256i*)(input + w));
+         _mm256_storeu_si256((__m256i*)(output + w), _mm256_shuffle_epi8(in, shuf));
+      }
+
+      if (w < width)
+         conv_argb8888_abgr8888(output + w, input + w, width - w, 1, 0, 0);
+   }
+}
+#endif
+
+#if defined(__ARM_NEON__)
+// Widens 8 pixels of 5:5:5 or 5:6:5 to 8-bit channels, replicating the top bits into the bottom ones.
+static inline void expand_0rgb1555_neon(uint8x8x4_t *pix, uint16x8_t in)
+{
+   uint8x8_t r = vshrn_n_u16(in, 7);
+   uint8x8_t g = vshrn_n_u16(in, 2);
+   uint8x8_t b = vshrn_n_u16(vshlq_n_u16(in, 11), 8);
+
+   pix->val[0] = vsri_n_u8(b, b, 5);
+   pix->val[1] = vsri_n_u8(g, g, 5);
+   pix->val[2] = vsri_n_u8(r, r, 5);
+   pix->val[3] = vdup_n_u8(0xff);
+}
+
+static inline void expand_rgb565_neon(uint8x8x4_t *pix, uint16x8_t in)
+{
+   uint8x8_t r = vshrn_n_u16(in, 8);
+   uint8x8_t g = vshrn_n_u16(in, 3);
+   uint8x8_t b = vshrn_n_u16(vshlq_n_u16(in, 11), 8);
+
+   pix->val[0] = vsri_n_u8(b, b, 5);
+   pix->val[1] = vsri_n_u8(g, g, 6);
+   pix->val[2] = vsri_n_u8(r, r, 5);
+   pix->val[3] = vdup_n_u8(0xff);
+}
+
+static void conv_rgb565_0rgb1555_neon(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint16_t *output = (uint16_t*)output_;
 
-         // Non-POT pixel sizes ftl :(
-         store_bgr24_sse2(out, res_lo0, res_hi0, res_lo1, res_hi1);
-      }
+   const uint16x8_t hi_mask = vdupq_n_u16(0x7fe0);
+   const uint16x8_t lo_mask = vdupq_n_u16(0x1f);
 
-      for (; w < width; w++)
-      {
-         uint32_t col = input[w];
-         uint32_t b = (col >>  0) & 0x1f;
-         uint32_t g = (col >>  5) & 0x1f;
-         uint32_t r = (col >> 10) & 0x1f;
-         b = (b << 3) | (b >> 2);
-         g = (g << 3) | (g >> 2);
-         r = (r << 3) | (r >> 2);
+   int max_width = width - 7;
 
-         *out++ = b;
-         *out++ = g;
-         *out++ = r;
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         uint16x8_t in = vld1q_u16(input + w);
+         vst1q_u16(output + w, vorrq_u16(vandq_u16(vshrq_n_u16(in, 1), hi_mask), vandq_u16(in, lo_mask)));
       }
+
+      if (w < width)
+         conv_rgb565_0rgb1555(output + w, input + w, width - w, 1, 0, 0);
    }
 }
 
-void conv_rgb565_bgr24(void *output_, const void *input_,
+static void conv_0rgb1555_rgb565_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint16_t *input = (const uint16_t*)input_;
-   uint8_t *output      = (uint8_t*)output_;
+   uint16_t *output = (uint16_t*)output_;
 
-   const __m128i pix_mask_r = _mm_set1_epi16(0x1f << 10);
-   const __m128i pix_mask_g = _mm_set1_epi16(0x3f <<  5);
-   const __m128i pix_mask_b = _mm_set1_epi16(0x1f <<  5);
-   const __m128i mul16_r    = _mm_set1_epi16(0x0210);
-   const __m128i mul16_g    = _mm_set1_epi16(0x2080);
-   const __m128i mul16_b    = _mm_set1_epi16(0x4200);
-   const __m128i a          = _mm_set1_epi16(0x00ff);
+   const uint16x8_t hi_mask   = vdupq_n_u16((0x1f << 11) | (0x1f << 6));
+   const uint16x8_t lo_mask   = vdupq_n_u16(0x1f);
+   const uint16x8_t glow_mask = vdupq_n_u16(1 << 5);
 
-   int max_width = width - 15;
+   int max_width = width - 7;
 
-   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 1)
    {
-      uint8_t *out = output;
-
       int w;
-      for (w = 0; w < max_width; w += 16, out += 48)
+      for (w = 0; w < max_width; w += 8)
       {
-         const __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w));
-         const __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 8));
-         __m128i r0 = _mm_and_si128(_mm_srli_epi16(in0, 1), pix_mask_r);
-         __m128i g0 = _mm_and_si128(in0, pix_mask_g);
-         __m128i b0 = _mm_and_si128(_mm_slli_epi16(in0, 5), pix_mask_b);
-         __m128i r1 = _mm_and_si128(_mm_srli_epi16(in1, 1), pix_mask_r);
-         __m128i g1 = _mm_and_si128(in1, pix_mask_g);
-         __m128i b1 = _mm_and_si128(_mm_slli_epi16(in1, 5), pix_mask_b);
+         uint16x8_t in   = vld1q_u16(input + w);
+         uint16x8_t rg   = vandq_u16(vshlq_n_u16(in, 1), hi_mask);
+         uint16x8_t b    = vandq_u16(in, lo_mask);
+         uint16x8_t glow = vandq_u16(vshrq_n_u16(in, 4), glow_mask);
+         vst1q_u16(output + w, vorrq_u16(rg, vorrq_u16(b, glow)));
+      }
 
-         r0 = _mm_mulhi_epi16(r0, mul16_r);
-         g0 = _mm_mulhi_epi16(g0, mul16_g);
-         b0 = _mm_mulhi_epi16(b0, mul16_b);
-         r1 = _mm_mulhi_epi16(r1, mul16_r);
-         g1 = _mm_mulhi_epi16(g1, mul16_g);
-         b1 = _mm_mulhi_epi16(b1, mul16_b);
+      if (w < width)
+         conv_0rgb1555_rgb565(output + w, input + w, width - w, 1, 0, 0);
+   }
+}
 
-         __m128i res_lo_bg0 = _mm_unpacklo_epi8(b0, g0);
-         __m128i res_hi_bg0 = _mm_unpackhi_epi8(b0, g0);
-         __m128i res_lo_ra0 = _mm_unpacklo_epi8(r0, a);
-         __m128i res_hi_ra0 = _mm_unpackhi_epi8(r0, a);
-         __m128i res_lo_bg1 = _mm_unpacklo_epi8(b1, g1);
-         __m128i res_hi_bg1 = _mm_unpackhi_epi8(b1, g1);
-         __m128i res_lo_ra1 = _mm_unpacklo_epi8(r1, a);
-         __m128i res_hi_ra1 = _mm_unpackhi_epi8(r1, a);
+static void conv_0rgb1555_argb8888_neon(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
 
-         __m128i res_lo0 = _mm_or_si128(res_lo_bg0, _mm_slli_si128(res_lo_ra0, 2));
-         __m128i res_hi0 = _mm_or_si128(res_hi_bg0, _mm_slli_si128(res_hi_ra0, 2));
-         __m128i res_lo1 = _mm_or_si128(res_lo_bg1, _mm_slli_si128(res_lo_ra1, 2));
-         __m128i res_hi1 = _mm_or_si128(res_hi_bg1, _mm_slli_si128(res_hi_ra1, 2));
+   int max_width = width - 7;
 
-         store_bgr24_sse2(out, res_lo0, res_hi0, res_lo1, res_hi1);
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         uint8x8x4_t pix;
+         expand_0rgb1555_neon(&pix, vld1q_u16(input + w));
+         vst4_u8((uint8_t*)(output + w), pix);
       }
 
-      for (; w < width; w++)
-      {
-         uint32_t col = input[w];
-         uint32_t r = (col >> 11) & 0x1f;
-         uint32_t g = (col >>  5) & 0x3f;
-         uint32_t b = (col >>  0) & 0x1f;
-         r = (r << 3) | (r >> 2);
-         g = (g << 2) | (g >> 4);
-         b = (b << 3) | (b >> 2);
+      if (w < width)
+         conv_0rgb1555_argb8888(output + w, input + w, width - w, 1, 0, 0);
+   }
+}
 
-         *out++ = b;
-         *out++ = g;
-         *out++ = r;
+static void conv_rgb565_argb8888_neon(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         uint8x8x4_t pix;
+         expand_rgb565_neon(&pix, vld1q_u16(input + w));
+         vst4_u8((uint8_t*)(output + w), pix);
       }
+
+      if (w < width)
+         conv_rgb565_argb8888(output + w, input + w, width - w, 1, 0, 0);
    }
 }
-#else
-void conv_0rgb1555_bgr24(void *output_, const void *input_,
+
+static void conv_0rgb1555_bgr24_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint16_t *input = (const uint16_t*)input_;
    uint8_t *output       = (uint8_t*)output_;
 
+   int max_width = width - 7;
+
    for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
    {
-      uint8_t *out = output;
-      for (int w = 0; w < width; w++)
+      int w;
+      for (w = 0; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         uint32_t b = (col >>  0) & 0x1f;
-         uint32_t g = (col >>  5) & 0x1f;
-         uint32_t r = (col >> 10) & 0x1f;
-         b = (b << 3) | (b >> 2);
-         g = (g << 3) | (g >> 2);
-         r = (r << 3) | (r >> 2);
+         uint8x8x4_t pix;
+         expand_0rgb1555_neon(&pix, vld1q_u16(input + w));
 
-         *out++ = b;
-         *out++ = g;
-         *out++ = r;
+         uint8x8x3_t bgr = {{ pix.val[0], pix.val[1], pix.val[2] }};
+         vst3_u8(output + 3 * w, bgr);
       }
+
+      if (w < width)
+         conv_0rgb1555_bgr24(output + 3 * w, input + w, width - w, 1, 0, 0);
    }
 }
 
-void conv_rgb565_bgr24(void *output_, const void *input_,
+static void conv_rgb565_bgr24_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint16_t *input = (const uint16_t*)input_;
    uint8_t *output       = (uint8_t*)output_;
 
+   int max_width = width - 7;
+
    for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 1)
    {
-      uint8_t *out = output;
-      for (int w = 0; w < width; w++)
+      int w;
+      for (w = 0; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         uint32_t b = (col >>  0) & 0x1f;
-         uint32_t g = (col >>  5) & 0x3f;
-         uint32_t r = (col >> 11) & 0x1f;
-         b = (b << 3) | (b >> 2);
-         g = (g << 2) | (g >> 4);
-         r = (r << 3) | (r >> 2);
+         uint8x8x4_t pix;
+         expand_rgb565_neon(&pix, vld1q_u16(input + w));
 
-         *out++ = b;
-         *out++ = g;
-         *out++ = r;
+         uint8x8x3_t bgr = {{ pix.val[0], pix.val[1], pix.val[2] }};
+         vst3_u8(output + 3 * w, bgr);
       }
+
+      if (w < width)
+         conv_rgb565_bgr24(output + 3 * w, input + w, width - w, 1, 0, 0);
    }
 }
-#endif
 
-void conv_bgr24_argb8888(void *output_, const void *input_,
+static void conv_argb8888_bgr24_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   const uint8_t *input = (const uint8_t*)input_;
-   uint32_t *output     = (uint32_t*)output_;
+   const uint32_t *input = (const uint32_t*)input_;
+   uint8_t *output       = (uint8_t*)output_;
 
-   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride)
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 2)
    {
-      const uint8_t *inp = input;
-      for (int w = 0; w < width; w++)
+      int w;
+      for (w = 0; w < max_width; w += 8)
       {
-         uint32_t b = *inp++;
-         uint32_t g = *inp++;
-         uint32_t r = *inp++;
-         output[w] = (0xffu << 24) | (r << 16) | (g << 8) | (b << 0);
+         uint8x8x4_t pix = vld4_u8((const uint8_t*)(input + w));
+         uint8x8x3_t bgr = {{ pix.val[0], pix.val[1], pix.val[2] }};
+         vst3_u8(output + 3 * w, bgr);
       }
+
+      if (w < width)
+         conv_argb8888_bgr24(output + 3 * w, input + w, width - w, 1, 0, 0);
    }
 }
 
-void conv_argb8888_0rgb1555(void *output_, const void *input_,
+static void conv_bgr24_argb8888_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
-   const uint32_t *input = (const uint32_t*)input_;
-   uint16_t *output      = (uint16_t*)output_;
+   const uint8_t *input = (const uint8_t*)input_;
+   uint32_t *output     = (uint32_t*)output_;
 
-   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride)
    {
-      for (int w = 0; w < width; w++)
+      int w;
+      for (w = 0; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         uint16_t r = (col >> 19) & 0x1f;
-         uint16_t g = (col >> 11) & 0x1f;
-         uint16_t b = (col >>  3) & 0x1f;
-         output[w] = (r << 10) | (g << 5) | (b << 0);
+         uint8x8x3_t bgr = vld3_u8(input + 3 * w);
+         uint8x8x4_t pix = {{ bgr.val[0], bgr.val[1], bgr.val[2], vdup_n_u8(0xff) }};
+         vst4_u8((uint8_t*)(output + w), pix);
       }
+
+      if (w < width)
+         conv_bgr24_argb8888(output + w, input + 3 * w, width - w, 1, 0, 0);
    }
 }
 
-#if defined(__SSE2__)
-void conv_argb8888_bgr24(void *output_, const void *input_,
+static void conv_argb8888_0rgb1555_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint32_t *input = (const uint32_t*)input_;
-   uint8_t *output       = (uint8_t*)output_;
+   uint16_t *output      = (uint16_t*)output_;
 
-   int max_width = width - 15;
+   int max_width = width - 7;
 
-   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 2)
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
    {
-      uint8_t *out = output;
       int w;
-
-      for (w = 0; w < max_width; w += 16, out += 48)
+      for (w = 0; w < max_width; w += 8)
       {
-         store_bgr24_sse2(out,
-               _mm_loadu_si128((const __m128i*)(input + w +  0)),
-               _mm_loadu_si128((const __m128i*)(input + w +  4)),
-               _mm_loadu_si128((const __m128i*)(input + w +  8)),
-               _mm_loadu_si128((const __m128i*)(input + w + 12)));
-      }
+         uint8x8x4_t pix = vld4_u8((const uint8_t*)(input + w));
 
-      for (; w < width; w++)
-      {
-         uint32_t col = input[w];
-         *out++ = (uint8_t)(col >>  0);
-         *out++ = (uint8_t)(col >>  8);
-         *out++ = (uint8_t)(col >> 16);
+         // Shift-right-and-insert keeps the top bits already in place, 5 of each channel.
+         uint16x8_t res = vshrq_n_u16(vshll_n_u8(pix.val[2], 8), 1);
+         res = vsriq_n_u16(res, vshll_n_u8(pix.val[1], 8), 6);
+         res = vsriq_n_u16(res, vshll_n_u8(pix.val[0], 8), 11);
+         vst1q_u16(output + w, res);
       }
+
+      if (w < width)
+         conv_argb8888_0rgb1555(output + w, input + w, width - w, 1, 0, 0);
    }
 }
-#else
-void conv_argb8888_bgr24(void *output_, const void *input_,
+
+static void conv_argb8888_rgb565_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint32_t *input = (const uint32_t*)input_;
-   uint8_t *output       = (uint8_t*)output_;
+   uint16_t *output      = (uint16_t*)output_;
 
-   for (int h = 0; h < height; h++, output += out_stride, input += in_stride >> 2)
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
    {
-      uint8_t *out = output;
-      for (int w = 0; w < width; w++)
+      int w;
+      for (w = 0; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         *out++ = (uint8_t)(col >>  0);
-         *out++ = (uint8_t)(col >>  8);
-         *out++ = (uint8_t)(col >> 16);
+         uint8x8x4_t pix = vld4_u8((const uint8_t*)(input + w));
+
+         uint16x8_t res = vshll_n_u8(pix.val[2], 8);
+         res = vsriq_n_u16(res, vshll_n_u8(pix.val[1], 8), 5);
+         res = vsriq_n_u16(res, vshll_n_u8(pix.val[0], 8), 11);
+         vst1q_u16(output + w, res);
       }
+
+      if (w < width)
+         conv_argb8888_rgb565(output + w, input + w, width - w, 1, 0, 0);
    }
 }
-#endif
 
-void conv_argb8888_abgr8888(void *output_, const void *input_,
+static void conv_argb8888_abgr8888_neon(void *output_, const void *input_,
       int width, int height,
       int out_stride, int in_stride)
 {
    const uint32_t *input = (const uint32_t*)input_;
    uint32_t *output      = (uint32_t*)output_;
 
+   int max_width = width - 7;
+
    for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 2)
    {
-      for (int w = 0; w < width; w++)
+      int w;
+      for (w = 0; w < max_width; w += 8)
       {
-         uint32_t col = input[w];
-         output[w] = ((col << 16) & 0xff0000) | ((col >> 16) & 0xff) | (col & 0xff00ff00);
+         uint8x8x4_t pix = vld4_u8((const uint8_t*)(input + w));
+         uint8x8_t tmp = pix.val[0];
+         pix.val[0] = pix.val[2];
+         pix.val[2] = tmp;
+         vst4_u8((uint8_t*)(output + w), pix);
       }
+
+      if (w < width)
+         conv_argb8888_abgr8888(output + w, input + w, width - w, 1, 0, 0);
    }
 }
+#endif
 
-void conv_copy(void *output_, const void *input_,
-      int width, int height,
-      int out_stride, int in_stride)
+#define PIXCONV_KERNEL(in, out, simd, ident, conv) { SCALER_FMT_##in, SCALER_FMT_##out, simd, ident, conv }
+
+// In order of preference. The first one the CPU can run wins.
+static const struct pixconv_kernel pixconv_kernels[] = {
+#if defined(PIXCONV_HAVE_AVX2)
+   PIXCONV_KERNEL(RGB565,   0RGB1555, RARCH_SIMD_AVX2, "AVX2", conv_rgb565_0rgb1555_avx2),
+   PIXCONV_KERNEL(0RGB1555, RGB565,   RARCH_SIMD_AVX2, "AVX2", conv_0rgb1555_rgb565_avx2),
+   PIXCONV_KERNEL(0RGB1555, ARGB8888, RARCH_SIMD_AVX2, "AVX2", conv_0rgb1555_argb8888_avx2),
+   PIXCONV_KERNEL(RGB565,   ARGB8888, RARCH_SIMD_AVX2, "AVX2", conv_rgb565_argb8888_avx2),
+   PIXCONV_KERNEL(0RGB1555, BGR24,    RARCH_SIMD_AVX2, "AVX2", conv_0rgb1555_bgr24_avx2),
+   PIXCONV_KERNEL(RGB565,   BGR24,    RARCH_SIMD_AVX2, "AVX2", conv_rgb565_bgr24_avx2),
+   PIXCONV_KERNEL(BGR24,    ARGB8888, RARCH_SIMD_AVX2, "AVX2", conv_bgr24_argb8888_avx2),
+   PIXCONV_KERNEL(ARGB8888, 0RGB1555, RARCH_SIMD_AVX2, "AVX2", conv_argb8888_0rgb1555_avx2),
+   PIXCONV_KERNEL(ARGB8888, RGB565,   RARCH_SIMD_AVX2, "AVX2", conv_argb8888_rgb565_avx2),
+   PIXCONV_KERNEL(ARGB8888, BGR24,    RARCH_SIMD_AVX2, "AVX2", conv_argb8888_bgr24_avx2),
+   PIXCONV_KERNEL(ARGB8888, ABGR8888, RARCH_SIMD_AVX2, "AVX2", conv_argb8888_abgr8888_avx2),
+   PIXCONV_KERNEL(ABGR8888, ARGB8888, RARCH_SIMD_AVX2, "AVX2", conv_argb8888_abgr8888_avx2),
+#endif
+#if defined(__SSE2__)
+   PIXCONV_KERNEL(RGB565,   0RGB1555, RARCH_SIMD_SSE2, "SSE2", conv_rgb565_0rgb1555_sse2),
+   PIXCONV_KERNEL(0RGB1555, RGB565,   RARCH_SIMD_SSE2, "SSE2", conv_0rgb1555_rgb565_sse2),
+   PIXCONV_KERNEL(0RGB1555, ARGB8888, RARCH_SIMD_SSE2, "SSE2", conv_0rgb1555_argb8888_sse2),
+   PIXCONV_KERNEL(RGB565,   ARGB8888, RARCH_SIMD_SSE2, "SSE2", conv_rgb565_argb8888_sse2),
+   PIXCONV_KERNEL(0RGB1555, BGR24,    RARCH_SIMD_SSE2, "SSE2", conv_0rgb1555_bgr24_sse2),
+   PIXCONV_KERNEL(RGB565,   BGR24,    RARCH_SIMD_SSE2, "SSE2", conv_rgb565_bgr24_sse2),
+   PIXCONV_KERNEL(BGR24,    ARGB8888, RARCH_SIMD_SSE2, "SSE2", conv_bgr24_argb8888_sse2),
+   PIXCONV_KERNEL(ARGB8888, 0RGB1555, RARCH_SIMD_SSE2, "SSE2", conv_argb8888_0rgb1555_sse2),
+   PIXCONV_KERNEL(ARGB8888, RGB565,   RARCH_SIMD_SSE2, "SSE2", conv_argb8888_rgb565_sse2),
+   PIXCONV_KERNEL(ARGB8888, BGR24,    RARCH_SIMD_SSE2, "SSE2", conv_argb8888_bgr24_sse2),
+   PIXCONV_KERNEL(ARGB8888, ABGR8888, RARCH_SIMD_SSE2, "SSE2", conv_argb8888_abgr8888_sse2),
+   PIXCONV_KERNEL(ABGR8888, ARGB8888, RARCH_SIMD_SSE2, "SSE2", conv_argb8888_abgr8888_sse2),
+#endif
+#if defined(__ARM_NEON__)
+   PIXCONV_KERNEL(RGB565,   0RGB1555, RARCH_SIMD_NEON, "NEON", conv_rgb565_0rgb1555_neon),
+   PIXCONV_KERNEL(0RGB1555, RGB565,   RARCH_SIMD_NEON, "NEON", conv_0rgb1555_rgb565_neon),
+   PIXCONV_KERNEL(0RGB1555, ARGB8888, RARCH_SIMD_NEON, "NEON", conv_0rgb1555_argb8888_neon),
+   PIXCONV_KERNEL(RGB565,   ARGB8888, RARCH_SIMD_NEON, "NEON", conv_rgb565_argb8888_neon),
+   PIXCONV_KERNEL(0RGB1555, BGR24,    RARCH_SIMD_NEON, "NEON", conv_0rgb1555_bgr24_neon),
+   PIXCONV_KERNEL(RGB565,   BGR24,    RARCH_SIMD_NEON, "NEON", conv_rgb565_bgr24_neon),
+   PIXCONV_KERNEL(BGR24,    ARGB8888, RARCH_SIMD_NEON, "NEON", conv_bgr24_argb8888_neon),
+   PIXCONV_KERNEL(ARGB8888, 0RGB1555, RARCH_SIMD_NEON, "NEON", conv_argb8888_0rgb1555_neon),
+   PIXCONV_KERNEL(ARGB8888, RGB565,   RARCH_SIMD_NEON, "NEON", conv_argb8888_rgb565_neon),
+   PIXCONV_KERNEL(ARGB8888, BGR24,    RARCH_SIMD_NEON, "NEON", conv_argb8888_bgr24_neon),
+   PIXCONV_KERNEL(ARGB8888, ABGR8888, RARCH_SIMD_NEON, "NEON", conv_argb8888_abgr8888_neon),
+   PIXCONV_KERNEL(ABGR8888, ARGB8888, RARCH_SIMD_NEON, "NEON", conv_argb8888_abgr8888_neon),
+#endif
+   PIXCONV_KERNEL(RGB565,   0RGB1555, 0, "C", conv_rgb565_0rgb1555),
+   PIXCONV_KERNEL(0RGB1555, RGB565,   0, "C", conv_0rgb1555_rgb565),
+   PIXCONV_KERNEL(0RGB1555, ARGB8888, 0, "C", conv_0rgb1555_argb8888),
+   PIXCONV_KERNEL(RGB565,   ARGB8888, 0, "C", conv_rgb565_argb8888),
+   PIXCONV_KERNEL(0RGB1555, BGR24,    0, "C", conv_0rgb1555_bgr24),
+   PIXCONV_KERNEL(RGB565,   BGR24,    0, "C", conv_rgb565_bgr24),
+   PIXCONV_KERNEL(BGR24,    ARGB8888, 0, "C", conv_bgr24_argb8888),
+   PIXCONV_KERNEL(ARGB8888, 0RGB1555, 0, "C", conv_argb8888_0rgb1555),
+   PIXCONV_KERNEL(ARGB8888, RGB565,   0, "C", conv_argb8888_rgb565),
+   PIXCONV_KERNEL(ARGB8888, BGR24,    0, "C", conv_argb8888_bgr24),
+   PIXCONV_KERNEL(ARGB8888, ABGR8888, 0, "C", conv_argb8888_abgr8888),
+   PIXCONV_KERNEL(ABGR8888, ARGB8888, 0, "C", conv_argb8888_abgr8888),
+};
+
+scaler_pixconv_t pixconv_find(enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt, unsigned simd)
 {
-   int copy_len = abs(out_stride);
-   if (abs(in_stride) < copy_len)
-      copy_len = abs(in_stride);
+   if (in_fmt == out_fmt)
+      return conv_copy;
 
-   const uint8_t *input = (const uint8_t*)input_;
-   uint8_t *output      = (uint8_t*)output_;
+   for (unsigned i = 0; i < sizeof(pixconv_kernels) / sizeof(pixconv_kernels[0]); i++)
+   {
+      const struct pixconv_kernel *kernel = &pixconv_kernels[i];
+      if (kernel->in_fmt == in_fmt && kernel->out_fmt == out_fmt && (simd & kernel->simd) == kernel->simd)
+         return kernel->conv;
+   }
 
-   for (int h = 0; h < height; h++, output += out_stride, input += in_stride)
-      memcpy(output, input, copy_len);
+   return NULL;
 }
 
+const struct pixconv_kernel *pixconv_get_kernels(unsigned *count)
+{
+   *count = sizeof(pixconv_kernels) / sizeof(pixconv_kernels[0]);
+   return pixconv_kernels;
+}
@@ -16,6 +16,8 @@
 #ifndef PIXCONV_H__
 #define PIXCONV_H__
 
+#include "scaler.h"
+
 void conv_0rgb1555_argb8888(void *output, const void *input,
       int width, int height,
       int out_stride, int in_stride);
@@ -64,5 +66,27 @@ void conv_copy(void *output, const void *input,
       int width, int height,
       int out_stride, int in_stride);
 
+// The conv_* functions above are the portable reference versions.
+// SIMD versions are only reachable through pixconv_find().
+typedef void (*scaler_pixconv_t)(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+struct pixconv_kernel
+{
+   enum scaler_pix_fmt in_fmt;
+   enum scaler_pix_fmt out_fmt;
+   unsigned simd; // RARCH_SIMD_* flags the kernel needs.
+   const char *ident;
+   scaler_pixconv_t conv;
+};
+
+// Returns the fastest converter for the given formats which only needs features in simd,
+// conv_copy if the formats are the same, or NULL if no such conversion exists.
+scaler_pixconv_t pixconv_find(enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt, unsigned simd);
+
+// All compiled in kernels, in order of preference.
+const struct pixconv_kernel *pixconv_get_kernels(unsigned *count);
+
 #endif
 
@@ -21,8 +21,13 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
 #include "../../performance.h"
 
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#endif
+
 // In case aligned allocs are needed later ...
 void *scaler_alloc(size_t elem_size, size_t size)
 {
@@ -34,27 +39,47 @@ void scaler_free(void *ptr)
    free(ptr);
 }
 
-static bool allocate_frames(struct scaler_ctx *ctx)
+// Layout of the intermediate frames for the scaled path, which pool bands copy for their own frames.
+static void set_frame_layout(struct scaler_ctx *ctx)
 {
+   if (ctx->unscaled)
+      return;
+
    ctx->scaled.stride = ((ctx->out_width + 7) & ~7) * sizeof(uint64_t);
    ctx->scaled.width  = ctx->out_width;
    ctx->scaled.height = ctx->in_height;
-   ctx->scaled.frame  = (uint64_t*)scaler_alloc(sizeof(uint64_t), (ctx->scaled.stride * ctx->scaled.height) >> 3);
+
+   if (ctx->in_pixconv)
+      ctx->input.stride = ((ctx->in_width + 7) & ~7) * sizeof(uint32_t);
+   if (ctx->out_pixconv)
+      ctx->output.stride = ((ctx->out_width + 7) & ~7) * sizeof(uint32_t);
+}
+
+// Intermediate frames for the scaled path. Converting to and from ARGB8888 takes whole frames on special paths
+// and with frame_conv, and a line buffer otherwise.
+static bool allocate_frames(struct scaler_ctx *ctx)
+{
+   if (ctx->unscaled)
+      return true;
+
+   bool whole_frames = ctx->scaler_special || ctx->frame_conv;
+   int in_rows       = whole_frames ? ctx->in_height : 1;
+   int out_rows      = whole_frames ? ctx->out_height : 1;
+
+   ctx->scaled.frame = (uint64_t*)scaler_alloc(sizeof(uint64_t), (ctx->scaled.stride * ctx->scaled.height) >> 3);
    if (!ctx->scaled.frame)
       return false;
 
-   if (ctx->in_fmt != SCALER_FMT_ARGB8888)
+   if (ctx->in_pixconv)
    {
-      ctx->input.stride = ((ctx->in_width + 7) & ~7) * sizeof(uint32_t);
-      ctx->input.frame = (uint32_t*)scaler_alloc(sizeof(uint32_t), (ctx->input.stride * ctx->in_height) >> 2);
+      ctx->input.frame = (uint32_t*)scaler_alloc(sizeof(uint32_t), (ctx->input.stride * in_rows) >> 2);
       if (!ctx->input.frame)
          return false;
    }
 
-   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
+   if (ctx->out_pixconv)
    {
-      ctx->output.stride = ((ctx->out_width + 7) & ~7) * sizeof(uint32_t);
-      ctx->output.frame  = (uint32_t*)scaler_alloc(sizeof(uint32_t), (ctx->output.stride * ctx->out_height) >> 2);
+      ctx->output.frame = (uint32_t*)scaler_alloc(sizeof(uint32_t), (ctx->output.stride * out_rows) >> 2);
       if (!ctx->output.frame)
          return false;
    }
@@ -62,100 +87,389 @@ static bool allocate_frames(struct scaler_ctx *ctx)
    return true;
 }
 
+// CPU features only need to be queried once, and rarch_get_cpu_features() is rather chatty.
+static unsigned get_simd_features(void)
+{
+   static bool queried;
+   static unsigned simd;
+
+   if (!queried)
+   {
+      struct rarch_cpu_features cpu;
+      rarch_get_cpu_features(&cpu);
+      simd = cpu.simd;
+      queried = true;
+   }
+
+   return simd;
+}
+
 static bool set_direct_pix_conv(struct scaler_ctx *ctx)
 {
-   if (ctx->in_fmt == ctx->out_fmt)
-      ctx->direct_pixconv = conv_copy;
-   else if (ctx->in_fmt == SCALER_FMT_0RGB1555 && ctx->out_fmt == SCALER_FMT_ARGB8888)
-      ctx->direct_pixconv = conv_0rgb1555_argb8888;
-   else if (ctx->in_fmt == SCALER_FMT_RGB565 && ctx->out_fmt == SCALER_FMT_ARGB8888)
-      ctx->direct_pixconv = conv_rgb565_argb8888;
-   else if (ctx->in_fmt == SCALER_FMT_RGB565 && ctx->out_fmt == SCALER_FMT_BGR24)
-      ctx->direct_pixconv = conv_rgb565_bgr24;
-   else if (ctx->in_fmt == SCALER_FMT_0RGB1555 && ctx->out_fmt == SCALER_FMT_RGB565)
-      ctx->direct_pixconv = conv_0rgb1555_rgb565;
-   else if (ctx->in_fmt == SCALER_FMT_RGB565 && ctx->out_fmt == SCALER_FMT_0RGB1555)
-      ctx->direct_pixconv = conv_rgb565_0rgb1555;
-   else if (ctx->in_fmt == SCALER_FMT_BGR24 && ctx->out_fmt == SCALER_FMT_ARGB8888)
-      ctx->direct_pixconv = conv_bgr24_argb8888;
-   else if (ctx->in_fmt == SCALER_FMT_ARGB8888 && ctx->out_fmt == SCALER_FMT_0RGB1555)
-      ctx->direct_pixconv = conv_argb8888_0rgb1555;
-   else if (ctx->in_fmt == SCALER_FMT_ARGB8888 && ctx->out_fmt == SCALER_FMT_BGR24)
-      ctx->direct_pixconv = conv_argb8888_bgr24;
-   else if (ctx->in_fmt == SCALER_FMT_0RGB1555 && ctx->out_fmt == SCALER_FMT_BGR24)
-      ctx->direct_pixconv = conv_0rgb1555_bgr24;
-   else if (ctx->in_fmt == SCALER_FMT_RGB565 && ctx->out_fmt == SCALER_FMT_BGR24)
-      ctx->direct_pixconv = conv_rgb565_bgr24;
-   else if (ctx->in_fmt == SCALER_FMT_ARGB8888 && ctx->out_fmt == SCALER_FMT_ABGR8888)
-      ctx->direct_pixconv = conv_argb8888_abgr8888;
+   ctx->in_pixconv     = NULL;
+   ctx->out_pixconv    = NULL;
+   ctx->direct_pixconv = pixconv_find(ctx->in_fmt, ctx->out_fmt, get_simd_features());
+   return ctx->direct_pixconv != NULL;
+}
+
+// Scaling is done in ARGB8888. Special paths and frame_conv convert whole frames to and from it,
+// otherwise the filters convert a row at a time as they go.
+static bool set_pix_conv(struct scaler_ctx *ctx)
+{
+   unsigned simd = get_simd_features();
+
+   ctx->in_pixconv   = NULL;
+   ctx->out_pixconv  = NULL;
+   ctx->scaler_horiz = scaler_argb8888_horiz;
+   ctx->scaler_vert  = scaler_argb8888_vert;
+
+   if (ctx->in_fmt != SCALER_FMT_ARGB8888)
+   {
+      ctx->in_pixconv = pixconv_find(ctx->in_fmt, SCALER_FMT_ARGB8888, simd);
+      if (!ctx->in_pixconv)
+         return false;
+      if (!ctx->frame_conv)
+         ctx->scaler_horiz = scaler_argb8888_horiz_conv;
+   }
+
+   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
+   {
+      ctx->out_pixconv = pixconv_find(SCALER_FMT_ARGB8888, ctx->out_fmt, simd);
+      if (!ctx->out_pixconv)
+         return false;
+      if (!ctx->frame_conv)
+         ctx->scaler_vert = scaler_argb8888_vert_conv;
+   }
+
+   return true;
+}
+
+// Generic filter path. Scales horizontally into the 16-bit intermediate frame, and vertically from there.
+// With frame_conv, whole frames are converted to and from ARGB8888 around that.
+static void scale_generic(const struct scaler_ctx *ctx, void *output, const void *input)
+{
+   if (!ctx->frame_conv)
+   {
+      ctx->scaler_horiz(ctx, input, ctx->in_stride);
+      ctx->scaler_vert(ctx, output, ctx->out_stride);
+      return;
+   }
+
+   if (ctx->in_pixconv)
+   {
+      ctx->in_pixconv(ctx->input.frame, input,
+            ctx->in_width, ctx->in_height,
+            ctx->input.stride, ctx->in_stride);
+
+      ctx->scaler_horiz(ctx, ctx->input.frame, ctx->input.stride);
+   }
+   else
+      ctx->scaler_horiz(ctx, input, ctx->in_stride);
+
+   if (ctx->out_pixconv)
+   {
+      ctx->scaler_vert(ctx, ctx->output.frame, ctx->output.stride);
+
+      ctx->out_pixconv(output, ctx->output.frame,
+            ctx->out_width, ctx->out_height,
+            ctx->out_stride, ctx->output.stride);
+   }
+   else
+      ctx->scaler_vert(ctx, output, ctx->out_stride);
+}
+
+#ifdef HAVE_THREADS
+// Output rows below this aren't worth handing to another thread.
+#define SCALER_MIN_BAND_HEIGHT 16
+
+// A horizontal band of the output frame.
+// ctx is a shallow copy of the parent context, rebased so the band looks like a small frame of its own:
+// it only sees the input rows its vertical filter taps reach, and has its own intermediate frames for them.
+// Input rows on band edges are scaled horizontally by both neighbours, which is cheap compared to synchronizing.
+struct scaler_band
+{
+   struct scaler_ctx ctx;
+   int in_y;
+   int out_y;
+};
+
+struct scaler_worker
+{
+   struct scaler_pool *pool;
+   struct scaler_band *band;
+   sthread_t *thread;
+   scond_t *cond;
+   unsigned generation;
+};
+
+struct scaler_pool
+{
+   struct scaler_band bands[SCALER_MAX_THREADS];
+   unsigned num_bands;
+
+   // Band 0 is scaled on the calling thread, so there is one worker less than there are bands.
+   struct scaler_worker workers[SCALER_MAX_THREADS - 1];
+   unsigned num_workers;
+
+   slock_t *lock;
+   scond_t *done_cond;
+   unsigned generation;
+   unsigned pending;
+   bool alive;
+
+   const struct scaler_ctx *ctx;
+   void *output;
+   const void *input;
+};
+
+static void scale_band(const struct scaler_ctx *ctx, const struct scaler_band *band,
+      void *output, const void *input)
+{
+   const uint8_t *in = (const uint8_t*)input + band->in_y * ctx->in_stride;
+   uint8_t *out      = (uint8_t*)output + band->out_y * ctx->out_stride;
+
+   if (ctx->unscaled)
+   {
+      ctx->direct_pixconv(out, in,
+            band->ctx.out_width, band->ctx.out_height,
+            ctx->out_stride, ctx->in_stride);
+   }
    else
+      scale_generic(&band->ctx, out, in);
+}
+
+static bool init_band(const struct scaler_ctx *ctx, struct scaler_band *band, int out_y, int out_height)
+{
+   struct scaler_ctx *bctx = &band->ctx;
+
+   *bctx = *ctx;
+   bctx->threads = 0;
+   bctx->pool    = NULL;
+   memset(&bctx->scaled, 0, sizeof(bctx->scaled));
+   memset(&bctx->input, 0, sizeof(bctx->input));
+   memset(&bctx->output, 0, sizeof(bctx->output));
+
+   band->out_y        = out_y;
+   bctx->out_height   = out_height;
+
+   if (ctx->unscaled)
+   {
+      band->in_y      = out_y;
+      bctx->in_height = out_height;
+      return true;
+   }
+
+   int in_start = INT_MAX;
+   int in_end   = 0;
+   for (int h = 0; h < out_height; h++)
+   {
+      int pos = ctx->vert.filter_pos[out_y + h];
+      if (pos < in_start)
+         in_start = pos;
+      if (pos + (int)ctx->vert.filter_len > in_end)
+         in_end = pos + ctx->vert.filter_len;
+   }
+
+   band->in_y      = in_start;
+   bctx->in_height = in_end - in_start;
+
+   bctx->vert.filter     = ctx->vert.filter + out_y * ctx->vert.filter_stride;
+   bctx->vert.filter_pos = (int*)scaler_alloc(sizeof(int), out_height);
+   if (!bctx->vert.filter_pos)
       return false;
 
+   for (int h = 0; h < out_height; h++)
+      bctx->vert.filter_pos[h] = ctx->vert.filter_pos[out_y + h] - in_start;
+
+   int in_rows  = ctx->frame_conv ? bctx->in_height : 1;
+   int out_rows = ctx->frame_conv ? bctx->out_height : 1;
+
+   bctx->scaled.stride = ctx->scaled.stride;
+   bctx->scaled.width  = ctx->scaled.width;
+   bctx->scaled.height = bctx->in_height;
+   bctx->scaled.frame  = (uint64_t*)scaler_alloc(sizeof(uint64_t), (bctx->scaled.stride * bctx->scaled.height) >> 3);
+   if (!bctx->scaled.frame)
+      return false;
+
+   if (ctx->in_pixconv)
+   {
+      bctx->input.stride = ctx->input.stride;
+      bctx->input.frame  = (uint32_t*)scaler_alloc(sizeof(uint32_t), (bctx->input.stride * in_rows) >> 2);
+      if (!bctx->input.frame)
+         return false;
+   }
+
+   if (ctx->out_pixconv)
+   {
+      bctx->output.stride = ctx->output.stride;
+      bctx->output.frame  = (uint32_t*)scaler_alloc(sizeof(uint32_t), (bctx->output.stride * out_rows) >> 2);
+      if (!bctx->output.frame)
+         return false;
+   }
+
    return true;
 }
 
-static bool set_pix_conv(struct scaler_ctx *ctx)
+static void free_band(struct scaler_band *band)
 {
-   switch (ctx->in_fmt)
+   if (!band->ctx.unscaled)
+      scaler_free(band->ctx.vert.filter_pos);
+   scaler_free(band->ctx.scaled.frame);
+   scaler_free(band->ctx.input.frame);
+   scaler_free(band->ctx.output.frame);
+   memset(band, 0, sizeof(*band));
+}
+
+static void scaler_worker_thread(void *data)
+{
+   struct scaler_worker *worker = (struct scaler_worker*)data;
+   struct scaler_pool *pool     = worker->pool;
+
+   slock_lock(pool->lock);
+   for (;;)
    {
-      case SCALER_FMT_ARGB8888:
-         // No need to convert :D
-         break;
+      while (pool->alive && worker->generation == pool->generation)
+         scond_wait(worker->cond, pool->lock);
 
-      case SCALER_FMT_0RGB1555:
-         ctx->in_pixconv = conv_0rgb1555_argb8888;
+      if (!pool->alive)
          break;
 
-      case SCALER_FMT_RGB565:
-         ctx->in_pixconv = conv_rgb565_argb8888;
-         break;
+      worker->generation = pool->generation;
+      slock_unlock(pool->lock);
 
-      case SCALER_FMT_BGR24:
-         ctx->in_pixconv = conv_bgr24_argb8888;
-         break;
+      scale_band(pool->ctx, worker->band, pool->output, pool->input);
 
-      default:
-         return false;
+      slock_lock(pool->lock);
+      if (--pool->pending == 0)
+         scond_signal(pool->done_cond);
    }
+   slock_unlock(pool->lock);
+}
 
-   switch (ctx->out_fmt)
+static void scaler_pool_free(struct scaler_pool *pool)
+{
+   if (!pool)
+      return;
+
+   if (pool->lock)
    {
-      case SCALER_FMT_ARGB8888:
-         // No need to convert :D
-         break;
+      slock_lock(pool->lock);
+      pool->alive = false;
+      for (unsigned i = 0; i < pool->num_workers; i++)
+         scond_signal(pool->workers[i].cond);
+      slock_unlock(pool->lock);
+   }
 
-      case SCALER_FMT_0RGB1555:
-         ctx->out_pixconv = conv_argb8888_0rgb1555;
-         break;
+   for (unsigned i = 0; i < pool->num_workers; i++)
+   {
+      sthread_join(pool->workers[i].thread);
+      scond_free(pool->workers[i].cond);
+   }
 
-      case SCALER_FMT_BGR24:
-         ctx->out_pixconv = conv_argb8888_bgr24;
-         break;
+   for (unsigned i = 0; i < pool->num_bands; i++)
+      free_band(&pool->bands[i]);
 
-      default:
-         return false;
+   if (pool->done_cond)
+      scond_free(pool->done_cond);
+   if (pool->lock)
+      slock_free(pool->lock);
+   free(pool);
+}
+
+// Returns NULL if the frame is too small to be worth splitting up, or on error.
+// Either way, the caller just scales on its own thread.
+static struct scaler_pool *scaler_pool_new(const struct scaler_ctx *ctx)
+{
+   unsigned num_bands = ctx->threads > SCALER_MAX_THREADS ? SCALER_MAX_THREADS : ctx->threads;
+   if (num_bands > (unsigned)ctx->out_height / SCALER_MIN_BAND_HEIGHT)
+      num_bands = ctx->out_height / SCALER_MIN_BAND_HEIGHT;
+   if (num_bands < 2)
+      return NULL;
+
+   struct scaler_pool *pool = (struct scaler_pool*)calloc(1, sizeof(*pool));
+   if (!pool)
+      return NULL;
+
+   pool->alive     = true;
+   pool->lock      = slock_new();
+   pool->done_cond = scond_new();
+   if (!pool->lock || !pool->done_cond)
+      goto error;
+
+   for (unsigned i = 0; i < num_bands; i++)
+   {
+      int out_y   = ctx->out_height * i / num_bands;
+      int out_end = ctx->out_height * (i + 1) / num_bands;
+
+      pool->num_bands++;
+      if (!init_band(ctx, &pool->bands[i], out_y, out_end - out_y))
+         goto error;
    }
 
-   return true;
+   for (unsigned i = 0; i < num_bands - 1; i++)
+   {
+      struct scaler_worker *worker = &pool->workers[i];
+      worker->pool = pool;
+      worker->band = &pool->bands[i + 1];
+      worker->cond = scond_new();
+      if (!worker->cond)
+         goto error;
+
+      worker->thread = sthread_create(scaler_worker_thread, worker);
+      if (!worker->thread)
+      {
+         scond_free(worker->cond);
+         goto error;
+      }
+
+      pool->num_workers++;
+   }
+
+   return pool;
+
+error:
+   scaler_pool_free(pool);
+   return NULL;
 }
 
-bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
+static void scaler_pool_scale(struct scaler_pool *pool, const struct scaler_ctx *ctx,
+      void *output, const void *input)
 {
-   scaler_ctx_gen_reset(ctx);
+   slock_lock(pool->lock);
 
-   if (ctx->in_width == ctx->out_width && ctx->in_height == ctx->out_height)
-      ctx->unscaled = true; // Only pixel format conversion ...
-   else
+   // Strides may be changed between frames without regenerating the filter.
+   for (unsigned i = 0; i < pool->num_bands; i++)
    {
-      ctx->scaler_horiz = scaler_argb8888_horiz;
-      ctx->scaler_vert  = scaler_argb8888_vert;
-      ctx->unscaled     = false;
+      pool->bands[i].ctx.in_stride  = ctx->in_stride;
+      pool->bands[i].ctx.out_stride = ctx->out_stride;
    }
 
-   ctx->scaler_special = NULL;
+   pool->ctx     = ctx;
+   pool->output  = output;
+   pool->input   = input;
+   pool->pending = pool->num_workers;
+   pool->generation++;
 
-   if (!allocate_frames(ctx))
-      return false;
+   for (unsigned i = 0; i < pool->num_workers; i++)
+      scond_signal(pool->workers[i].cond);
+   slock_unlock(pool->lock);
+
+   scale_band(ctx, &pool->bands[0], output, input);
+
+   slock_lock(pool->lock);
+   while (pool->pending)
+      scond_wait(pool->done_cond, pool->lock);
+   slock_unlock(pool->lock);
+}
+#endif
+
+bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
+{
+   scaler_ctx_gen_reset(ctx);
+
+   // Only pixel format conversion ...
+   ctx->unscaled       = ctx->in_width == ctx->out_width && ctx->in_height == ctx->out_height;
+   ctx->scaler_special = NULL;
 
    if (ctx->unscaled)
    {
@@ -166,16 +480,33 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
    {
       if (!set_pix_conv(ctx))
          return false;
+      if (!scaler_gen_filter(ctx))
+         return false;
    }
 
-   if (!ctx->unscaled && !scaler_gen_filter(ctx))
-      return false;
+   set_frame_layout(ctx);
 
-   return true;
+#ifdef HAVE_THREADS
+   // Special paths work on the whole frame at once.
+   if (ctx->threads > 1 && (ctx->unscaled || !ctx->scaler_special))
+      ctx->pool = scaler_pool_new(ctx);
+
+   // Bands have intermediate frames of their own.
+   if (ctx->pool)
+      return true;
+#endif
+
+   // Special paths need whole intermediate frames, so this has to wait for the filter.
+   return allocate_frames(ctx);
 }
 
 void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
 {
+#ifdef HAVE_THREADS
+   scaler_pool_free(ctx->pool);
+   ctx->pool = NULL;
+#endif
+
    scaler_free(ctx->horiz.filter);
    scaler_free(ctx->horiz.filter_pos);
    scaler_free(ctx->vert.filter);
@@ -194,6 +525,14 @@ void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
 void scaler_ctx_scale(struct scaler_ctx *ctx,
       void *output, const void *input)
 {
+#ifdef HAVE_THREADS
+   if (ctx->pool)
+   {
+      scaler_pool_scale(ctx->pool, ctx, output, input);
+      return;
+   }
+#endif
+
    if (ctx->unscaled) // Just perform straight pixel conversion.
    {
       ctx->direct_pixconv(output, input,
@@ -205,7 +544,7 @@ void scaler_ctx_scale(struct scaler_ctx *ctx,
       const void *inp = input;
       int in_stride   = ctx->in_stride;
 
-      if (ctx->in_fmt != SCALER_FMT_ARGB8888)
+      if (ctx->in_pixconv)
       {
          ctx->in_pixconv(ctx->input.frame, input,
                ctx->in_width, ctx->in_height,
@@ -215,7 +554,7 @@ void scaler_ctx_scale(struct scaler_ctx *ctx,
          in_stride = ctx->input.stride;
       }
 
-      bool conv_out  = ctx->out_fmt != SCALER_FMT_ARGB8888;
+      bool conv_out  = ctx->out_pixconv != NULL;
       void *outp     = output;
       int out_stride = ctx->out_stride;
 
@@ -238,28 +577,5 @@ void scaler_ctx_scale(struct scaler_ctx *ctx,
       }
    }
    else // Take generic filter path.
-   {
-      if (ctx->in_fmt != SCALER_FMT_ARGB8888)
-      {
-         ctx->in_pixconv(ctx->input.frame, input,
-               ctx->in_width, ctx->in_height,
-               ctx->input.stride, ctx->in_stride);
-
-         ctx->scaler_horiz(ctx, ctx->input.frame, ctx->input.stride);
-      }
-      else
-         ctx->scaler_horiz(ctx, input, ctx->in_stride);
-
-      if (ctx->out_fmt != SCALER_FMT_ARGB8888)
-      {
-         ctx->scaler_vert(ctx, ctx->output.frame, ctx->output.stride);
-
-         ctx->out_pixconv(output, ctx->output.frame,
-               ctx->out_width, ctx->out_height,
-               ctx->out_stride, ctx->output.stride);
-      }
-      else
-         ctx->scaler_vert(ctx, output, ctx->out_stride);
-   }
+      scale_generic(ctx, output, input);
 }
-
@@ -22,6 +22,12 @@
 
 #define FILTER_UNITY (1 << 14)
 
+// Upper bound for scaler_ctx::threads.
+#define SCALER_MAX_THREADS 16
+
+// Number of generated filter axes kept around for reuse.
+#define SCALER_FILTER_CACHE_SIZE 16
+
 enum scaler_pix_fmt
 {
    SCALER_FMT_ARGB8888 = 0,
@@ -36,9 +42,14 @@ enum scaler_type
    SCALER_TYPE_UNKNOWN = 0,
    SCALER_TYPE_POINT,
    SCALER_TYPE_BILINEAR,
-   SCALER_TYPE_SINC
+   SCALER_TYPE_SINC,
+   SCALER_TYPE_LANCZOS2,
+   SCALER_TYPE_LANCZOS3,
+   SCALER_TYPE_AREA // Box filter. Best choice for downscaling by large factors.
 };
 
+struct scaler_pool;
+
 struct scaler_filter
 {
    int16_t *filter;
@@ -94,6 +105,16 @@ struct scaler_ctx
       uint32_t *frame;
       int stride;
    } output;
+
+   // Set before scaler_ctx_gen_filter() to convert whole frames to and from ARGB8888 around the filters,
+   // instead of a row at a time inside them. Output is identical either way.
+   bool frame_conv;
+
+   // Set before scaler_ctx_gen_filter() to split the output into horizontal bands,
+   // which are scaled in parallel on a worker pool owned by the context.
+   // 0 or 1 scales everything on the calling thread. Output is identical either way.
+   unsigned threads;
+   struct scaler_pool *pool;
 };
 
 bool scaler_ctx_gen_filter(struct scaler_ctx *ctx);
@@ -102,6 +123,22 @@ void scaler_ctx_gen_reset(struct scaler_ctx *ctx);
 void scaler_ctx_scale(struct scaler_ctx *ctx,
       void *output, const void *input);
 
+struct scaler_filter_cache_stats
+{
+   unsigned hits;
+   unsigned misses;
+};
+
+// Filters are cached per axis on (type, in length, out length), shared by all contexts.
+// The cache is only used after scaler_filter_cache_init(), which must be called before any thread uses the scaler.
+// Deinit must likewise only be called once they are done with it.
+void scaler_filter_cache_init(void);
+void scaler_filter_cache_deinit(void);
+
+// Frees all cached filters and resets the stats. Existing contexts are not affected.
+void scaler_filter_cache_clear(void);
+void scaler_filter_cache_get_stats(struct scaler_filter_cache_stats *stats);
+
 void *scaler_alloc(size_t elem_size, size_t size);
 void scaler_free(void *ptr);
 
@@ -59,192 +59,209 @@ static inline uint8_t clamp_8bit(int16_t col)
 // The C version of scalers perform the exact same operations as the SIMD code for testing purposes.
 
 #if defined(__SSE2__)
-void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride)
+static inline void scale_row_vert(const struct scaler_ctx *ctx, uint32_t *output, int h)
 {
-   const uint64_t *input = ctx->scaled.frame;
-   uint32_t *output = (uint32_t*)output_;
+   const uint64_t *input_base = ctx->scaled.frame + ctx->vert.filter_pos[h] * (ctx->scaled.stride >> 3);
+   const int16_t *filter_vert = ctx->vert.filter + h * ctx->vert.filter_stride;
 
-   const int16_t *filter_vert = ctx->vert.filter;
-
-   for (int h = 0; h < ctx->out_height; h++, filter_vert += ctx->vert.filter_stride, output += stride >> 2)
+   for (int w = 0; w < ctx->out_width; w++)
    {
-      const uint64_t *input_base = input + ctx->vert.filter_pos[h] * (ctx->scaled.stride >> 3);
+      __m128i res = _mm_setzero_si128();
 
-      for (int w = 0; w < ctx->out_width; w++)
-      {
-         __m128i res = _mm_setzero_si128();
+      const uint64_t *input_base_y = input_base + w;
 
-         const uint64_t *input_base_y = input_base + w;
-
-         size_t y;
-         for (y = 0; (y + 1) < ctx->vert.filter_len; y += 2, input_base_y += (ctx->scaled.stride >> 2))
-         {
-            __m128i coeff = _mm_set_epi64x(filter_vert[y + 1] * 0x0001000100010001ll, filter_vert[y + 0] * 0x0001000100010001ll);
-            __m128i col   = _mm_set_epi64x(input_base_y[ctx->scaled.stride >> 3], input_base_y[0]);
+      size_t y;
+      for (y = 0; (y + 1) < ctx->vert.filter_len; y += 2, input_base_y += (ctx->scaled.stride >> 2))
+      {
+         __m128i coeff = _mm_set_epi64x(filter_vert[y + 1] * 0x0001000100010001ll, filter_vert[y + 0] * 0x0001000100010001ll);
+         __m128i col   = _mm_set_epi64x(input_base_y[ctx->scaled.stride >> 3], input_base_y[0]);
 
-            res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
-         }
+         res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
+      }
 
-         for (; y < ctx->vert.filter_len; y++, input_base_y += (ctx->scaled.stride >> 3))
-         {
-            __m128i coeff = _mm_set_epi64x(0, filter_vert[y] * 0x0001000100010001ll);
-            __m128i col   = _mm_set_epi64x(0, input_base_y[0]);
+      for (; y < ctx->vert.filter_len; y++, input_base_y += (ctx->scaled.stride >> 3))
+      {
+         __m128i coeff = _mm_set_epi64x(0, filter_vert[y] * 0x0001000100010001ll);
+         __m128i col   = _mm_set_epi64x(0, input_base_y[0]);
 
-            res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
-         }
+         res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
+      }
 
-         res = _mm_adds_epi16(_mm_srli_si128(res, 8), res);
-         res = _mm_srai_epi16(res, (7 - 2 - 2));
+      res = _mm_adds_epi16(_mm_srli_si128(res, 8), res);
+      res = _mm_srai_epi16(res, (7 - 2 - 2));
 
-         __m128i final = _mm_packus_epi16(res, res);
+      __m128i final = _mm_packus_epi16(res, res);
 
-         output[w] = _mm_cvtsi128_si32(final);
-      }
+      output[w] = _mm_cvtsi128_si32(final);
    }
 }
 #else
-void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride)
+static inline void scale_row_vert(const struct scaler_ctx *ctx, uint32_t *output, int h)
 {
-   const uint64_t *input = ctx->scaled.frame;
-   uint32_t *output = (uint32_t*)output_;
-
-   const int16_t *filter_vert = ctx->vert.filter;
+   const uint64_t *input_base = ctx->scaled.frame + ctx->vert.filter_pos[h] * (ctx->scaled.stride >> 3);
+   const int16_t *filter_vert = ctx->vert.filter + h * ctx->vert.filter_stride;
 
-   for (int h = 0; h < ctx->out_height; h++, filter_vert += ctx->vert.filter_stride, output += stride >> 2)
+   for (int w = 0; w < ctx->out_width; w++)
    {
-      const uint64_t *input_base = input + ctx->vert.filter_pos[h] * (ctx->scaled.stride >> 3);
+      int16_t res_a = 0;
+      int16_t res_r = 0;
+      int16_t res_g = 0;
+      int16_t res_b = 0;
 
-      for (int w = 0; w < ctx->out_width; w++)
+      const uint64_t *input_base_y = input_base + w;
+      for (size_t y = 0; y < ctx->vert.filter_len; y++, input_base_y += (ctx->scaled.stride >> 3))
       {
-         int16_t res_a = 0;
-         int16_t res_r = 0;
-         int16_t res_g = 0;
-         int16_t res_b = 0;
-
-         const uint64_t *input_base_y = input_base + w;
-         for (size_t y = 0; y < ctx->vert.filter_len; y++, input_base_y += (ctx->scaled.stride >> 3))
-         {
-            uint64_t col = *input_base_y;
-
-            int16_t a = (col >> 48) & 0xffff;
-            int16_t r = (col >> 32) & 0xffff;
-            int16_t g = (col >> 16) & 0xffff;
-            int16_t b = (col >>  0) & 0xffff;
-
-            int16_t coeff = filter_vert[y];
-
-            res_a += (a * coeff) >> 16;
-            res_r += (r * coeff) >> 16;
-            res_g += (g * coeff) >> 16;
-            res_b += (b * coeff) >> 16;
-         }
-
-         res_a >>= (7 - 2 - 2);
-         res_r >>= (7 - 2 - 2);
-         res_g >>= (7 - 2 - 2);
-         res_b >>= (7 - 2 - 2);
-
-         output[w] = (clamp_8bit(res_a) << 24) | (clamp_8bit(res_r) << 16) | (clamp_8bit(res_g) << 8) | (clamp_8bit(res_b) << 0);
+         uint64_t col = *input_base_y;
+
+         int16_t a = (col >> 48) & 0xffff;
+         int16_t r = (col >> 32) & 0xffff;
+         int16_t g = (col >> 16) & 0xffff;
+         int16_t b = (col >>  0) & 0xffff;
+
+         int16_t coeff = filter_vert[y];
+
+         res_a += (a * coeff) >> 16;
+         res_r += (r * coeff) >> 16;
+         res_g += (g * coeff) >> 16;
+         res_b += (b * coeff) >> 16;
       }
+
+      res_a >>= (7 - 2 - 2);
+      res_r >>= (7 - 2 - 2);
+      res_g >>= (7 - 2 - 2);
+      res_b >>= (7 - 2 - 2);
+
+      output[w] = (clamp_8bit(res_a) << 24) | (clamp_8bit(res_r) << 16) | (clamp_8bit(res_g) << 8) | (clamp_8bit(res_b) << 0);
    }
 }
 #endif
 
 #if defined(__SSE2__)
-void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int stride)
+static inline void scale_row_horiz(const struct scaler_ctx *ctx, uint64_t *output, const uint32_t *input)
 {
-   const uint32_t *input = (const uint32_t*)input_;
-   uint64_t *output      = ctx->scaled.frame;
+   const int16_t *filter_horiz = ctx->horiz.filter;
 
-   for (int h = 0; h < ctx->scaled.height; h++, input += stride >> 2, output += ctx->scaled.stride >> 3)
+   for (int w = 0; w < ctx->scaled.width; w++, filter_horiz += ctx->horiz.filter_stride)
    {
-      const int16_t *filter_horiz = ctx->horiz.filter;
+      __m128i res = _mm_setzero_si128();
 
-      for (int w = 0; w < ctx->scaled.width; w++, filter_horiz += ctx->horiz.filter_stride)
-      {
-         __m128i res = _mm_setzero_si128();
+      const uint32_t *input_base_x = input + ctx->horiz.filter_pos[w];
 
-         const uint32_t *input_base_x = input + ctx->horiz.filter_pos[w];
-
-         size_t x;
-         for (x = 0; (x + 1) < ctx->horiz.filter_len; x += 2)
-         {
-            __m128i coeff = _mm_set_epi64x(filter_horiz[x + 1] * 0x0001000100010001ll, filter_horiz[x + 0] * 0x0001000100010001ll);
+      size_t x;
+      for (x = 0; (x + 1) < ctx->horiz.filter_len; x += 2)
+      {
+         __m128i coeff = _mm_set_epi64x(filter_horiz[x + 1] * 0x0001000100010001ll, filter_horiz[x + 0] * 0x0001000100010001ll);
 
-            __m128i col = _mm_unpacklo_epi8(_mm_set_epi64x(0,
-                     ((uint64_t)input_base_x[x + 1] << 32) | input_base_x[x + 0]), _mm_setzero_si128());
+         __m128i col = _mm_unpacklo_epi8(_mm_set_epi64x(0,
+                  ((uint64_t)input_base_x[x + 1] << 32) | input_base_x[x + 0]), _mm_setzero_si128());
 
-            col = _mm_slli_epi16(col, 7);
-            res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
-         }
+         col = _mm_slli_epi16(col, 7);
+         res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
+      }
 
-         for (; x < ctx->horiz.filter_len; x++)
-         {
-            __m128i coeff = _mm_set_epi64x(0, filter_horiz[x] * 0x0001000100010001ll);
-            __m128i col   = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, 0, input_base_x[x]), _mm_setzero_si128());
+      for (; x < ctx->horiz.filter_len; x++)
+      {
+         __m128i coeff = _mm_set_epi64x(0, filter_horiz[x] * 0x0001000100010001ll);
+         __m128i col   = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, 0, input_base_x[x]), _mm_setzero_si128());
 
-            col = _mm_slli_epi16(col, 7);
-            res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
-         }
+         col = _mm_slli_epi16(col, 7);
+         res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
+      }
 
-         res       = _mm_adds_epi16(_mm_srli_si128(res, 8), res);
+      res       = _mm_adds_epi16(_mm_srli_si128(res, 8), res);
 
 #ifdef __x86_64__
-         output[w] = _mm_cvtsi128_si64(res);
+      output[w] = _mm_cvtsi128_si64(res);
 #else // 32-bit doesn't have si64. Do it in two steps.
-         union
-         {
-            uint32_t *u32;
-            uint64_t *u64;
-         } u;
-         u.u64 = output + w;
-         u.u32[0] = _mm_cvtsi128_si32(res);
-         u.u32[1] = _mm_cvtsi128_si32(_mm_srli_si128(res, 4));
+      union
+      {
+         uint32_t *u32;
+         uint64_t *u64;
+      } u;
+      u.u64 = output + w;
+      u.u32[0] = _mm_cvtsi128_si32(res);
+      u.u32[1] = _mm_cvtsi128_si32(_mm_srli_si128(res, 4));
 #endif
-      }
    }
 }
 #else
-void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int stride)
+static inline void scale_row_horiz(const struct scaler_ctx *ctx, uint64_t *output, const uint32_t *input)
 {
-   const uint32_t *input = (uint32_t*)input_;
-   uint64_t *output      = ctx->scaled.frame;
+   const int16_t *filter_horiz = ctx->horiz.filter;
 
-   for (int h = 0; h < ctx->scaled.height; h++, input += stride >> 2, output += ctx->scaled.stride >> 3)
+   for (int w = 0; w < ctx->scaled.width; w++, filter_horiz += ctx->horiz.filter_stride)
    {
-      const int16_t *filter_horiz = ctx->horiz.filter;
+      const uint32_t *input_base_x = input + ctx->horiz.filter_pos[w];
 
-      for (int w = 0; w < ctx->scaled.width; w++, filter_horiz += ctx->horiz.filter_stride)
+      int16_t res_a = 0;
+      int16_t res_r = 0;
+      int16_t res_g = 0;
+      int16_t res_b = 0;
+
+      for (size_t x = 0; x < ctx->horiz.filter_len; x++)
       {
-         const uint32_t *input_base_x = input + ctx->horiz.filter_pos[w];
+         uint32_t col = input_base_x[x];
 
-         int16_t res_a = 0;
-         int16_t res_r = 0;
-         int16_t res_g = 0;
-         int16_t res_b = 0;
+         int16_t a = (col >> (24 - 7)) & (0xff << 7);
+         int16_t r = (col >> (16 - 7)) & (0xff << 7);
+         int16_t g = (col >> ( 8 - 7)) & (0xff << 7);
+         int16_t b = (col << ( 0 + 7)) & (0xff << 7);
 
-         for (size_t x = 0; x < ctx->horiz.filter_len; x++)
-         {
-            uint32_t col = input_base_x[x];
+         int16_t coeff = filter_horiz[x];
 
-            int16_t a = (col >> (24 - 7)) & (0xff << 7);
-            int16_t r = (col >> (16 - 7)) & (0xff << 7);
-            int16_t g = (col >> ( 8 - 7)) & (0xff << 7);
-            int16_t b = (col << ( 0 + 7)) & (0xff << 7);
+         res_a += (a * coeff) >> 16;
+         res_r += (r * coeff) >> 16;
+         res_g += (g * coeff) >> 16;
+         res_b += (b * coeff) >> 16;
+      }
+
+      output[w] = build_argb64(res_a, res_r, res_g, res_b);
+   }
+}
+#endif
 
-            int16_t coeff = filter_horiz[x];
+void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride)
+{
+   uint8_t *output = (uint8_t*)output_;
 
-            res_a += (a * coeff) >> 16;
-            res_r += (r * coeff) >> 16;
-            res_g += (g * coeff) >> 16;
-            res_b += (b * coeff) >> 16;
-         }
+   for (int h = 0; h < ctx->out_height; h++, output += stride)
+      scale_row_vert(ctx, (uint32_t*)output, h);
+}
 
-         output[w] = build_argb64(res_a, res_r, res_g, res_b);
-      }
+void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int stride)
+{
+   const uint8_t *input = (const uint8_t*)input_;
+   uint64_t *output     = ctx->scaled.frame;
+
+   for (int h = 0; h < ctx->scaled.height; h++, input += stride, output += ctx->scaled.stride >> 3)
+      scale_row_horiz(ctx, output, (const uint32_t*)input);
+}
+
+// Other formats are converted a row at a time to or from a line buffer in ctx->input or ctx->output,
+// which stays in cache, instead of converting the whole frame in a separate pass.
+// Filtering every tap straight from the source format would expand each pixel once per tap instead, which is slower.
+void scaler_argb8888_vert_conv(const struct scaler_ctx *ctx, void *output_, int stride)
+{
+   uint8_t *output = (uint8_t*)output_;
+
+   for (int h = 0; h < ctx->out_height; h++, output += stride)
+   {
+      scale_row_vert(ctx, ctx->output.frame, h);
+      ctx->out_pixconv(output, ctx->output.frame, ctx->out_width, 1, 0, 0);
+   }
+}
+
+void scaler_argb8888_horiz_conv(const struct scaler_ctx *ctx, const void *input_, int stride)
+{
+   const uint8_t *input = (const uint8_t*)input_;
+   uint64_t *output     = ctx->scaled.frame;
+
+   for (int h = 0; h < ctx->scaled.height; h++, input += stride, output += ctx->scaled.stride >> 3)
+   {
+      ctx->in_pixconv(ctx->input.frame, input, ctx->in_width, 1, 0, 0);
+      scale_row_horiz(ctx, output, ctx->input.frame);
    }
 }
-#endif
 
 void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
       void *output_, const void *input_,
@@ -21,6 +21,10 @@
 void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output, int stride);
 void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input, int stride);
 
+// Same filters for other formats. Reads with ctx->in_pixconv or writes with ctx->out_pixconv a row at a time.
+void scaler_argb8888_vert_conv(const struct scaler_ctx *ctx, void *output, int stride);
+void scaler_argb8888_horiz_conv(const struct scaler_ctx *ctx, const void *input, int stride);
+
 void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
       void *output, const void *input,
       int out_width, int out_height,
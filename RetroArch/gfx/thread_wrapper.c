@@ -17,10 +17,64 @@
 #include "../thread.h"
 #include "../general.h"
 #include "../performance.h"
+#include "scaler/scaler.h"
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Frames are triple buffered. The core thread always owns one buffer to write into and the video thread
+// one to read from. The third is passed back and forth through frame.ready with atomic exchanges,
+// so neither side waits for the other, and the video thread always picks up the newest frame.
+#define THREAD_FRAME_BUFFERS 3
+// Set in frame.ready while the buffer in it hasn't been picked up by the video thread.
+#define THREAD_FRAME_FRESH 4
+#define THREAD_FRAME_INDEX(x) ((x) & 3)
+
+struct thread_frame_buffer
+{
+   uint8_t *data;
+   bool dupe; // Core didn't send a new frame, data is not valid.
+   unsigned width;
+   unsigned height;
+   unsigned pitch;
+   rarch_time_t time; // When it was handed to thread_frame().
+   char msg[1024];
+};
+
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define frame_load_acquire(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define frame_exchange(ptr, val) __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL)
+#elif defined(__GNUC__)
+static inline unsigned frame_load_acquire(volatile unsigned *ptr)
+{
+   unsigned val = *ptr;
+   __sync_synchronize();
+   return val;
+}
+
+// __sync_lock_test_and_set() is only an acquire barrier.
+static inline unsigned frame_exchange(volatile unsigned *ptr, unsigned val)
+{
+   __sync_synchronize();
+   return __sync_lock_test_and_set(ptr, val);
+}
+#elif defined(_MSC_VER)
+static __forceinline unsigned frame_load_acquire(volatile unsigned *ptr)
+{
+   unsigned val = *ptr;
+   _ReadWriteBarrier();
+   return val;
+}
+
+#define frame_exchange(ptr, val) ((unsigned)_InterlockedExchange((volatile long*)(ptr), (long)(val)))
+#else
+#error "Don't know how to do atomic exchanges with this compiler."
+#endif
+
 enum thread_cmd
 {
    CMD_NONE = 0,
@@ -129,13 +183,24 @@ typedef struct thread_video
 
    struct
    {
-      slock_t *lock;
-      uint8_t *buffer;
-      unsigned width;
-      unsigned height;
-      unsigned pitch;
-      bool updated;
-      char msg[1024];
+      slock_t *lock; // Held by the video thread while rendering. Guards menu texture and state changes.
+
+      struct thread_frame_buffer buffers[THREAD_FRAME_BUFFERS];
+
+      unsigned write_index; // Only touched by the core thread.
+      unsigned read_index; // Only touched by the video thread.
+      volatile unsigned ready;
+
+      bool updated; // Guarded by thr->lock. Video thread has something new to look at.
+
+      // 0RGB1555 frames are converted to RGB565 on the video thread,
+      // so the core thread only has to copy them.
+      bool convert;
+      struct scaler_ctx scaler;
+      uint8_t *conv_buffer;
+
+      uint64_t dropped; // Only touched by the core thread.
+      struct rarch_threaded_video_stats stats; // Guarded by thr->lock.
    } frame;
 
    video_driver_t video_thread;
@@ -172,9 +237,20 @@ static void thread_loop(void *data)
       while (thr->send_cmd == CMD_NONE && !thr->frame.updated)
          scond_wait(thr->cond_thread, thr->lock);
       if (thr->frame.updated)
+      {
+         // Cleared before looking at frame.ready, so a frame arriving while we render wakes us up again.
          updated = true;
+         thr->frame.updated = false;
+         scond_signal(thr->cond_cmd);
+      }
       slock_unlock(thr->lock);
 
+      // Might already have picked up this frame last time around.
+      if (updated && (frame_load_acquire(&thr->frame.ready) & THREAD_FRAME_FRESH))
+         thr->frame.read_index = THREAD_FRAME_INDEX(frame_exchange(&thr->frame.ready, thr->frame.read_index));
+      else
+         updated = false;
+
       switch (thr->send_cmd)
       {
          case CMD_INIT:
@@ -318,11 +394,29 @@ static void thread_loop(void *data)
             thr->apply_state_changes = false;
          }
 
+         const struct thread_frame_buffer *buf = &thr->frame.buffers[thr->frame.read_index];
+         const uint8_t *frame = buf->dupe ? NULL : buf->data;
+         if (frame && thr->frame.convert)
+         {
+            RARCH_PERFORMANCE_INIT(thread_frame_conv);
+            RARCH_PERFORMANCE_START(thread_frame_conv);
+            struct scaler_ctx *scaler = &thr->frame.scaler;
+            scaler->in_width   = scaler->out_width  = buf->width;
+            scaler->in_height  = scaler->out_height = buf->height;
+            scaler->in_stride  = scaler->out_stride = buf->pitch;
+
+            scaler_ctx_scale(scaler, thr->frame.conv_buffer, frame);
+            frame = thr->frame.conv_buffer;
+            RARCH_PERFORMANCE_STOP(thread_frame_conv);
+         }
+
          bool ret = thr->driver->frame(thr->driver_data,
-               thr->frame.buffer, thr->frame.width, thr->frame.height,
-               thr->frame.pitch, *thr->frame.msg ? thr->frame.msg : NULL);
+               frame, buf->width, buf->height,
+               buf->pitch, *buf->msg ? buf->msg : NULL);
          slock_unlock(thr->frame.lock);
 
+         uint64_t latency = rarch_get_time_usec() - buf->time;
+
          bool alive = ret && thr->driver->alive(thr->driver_data);
          bool focus = ret && thr->driver->focus(thr->driver_data);
 
@@ -332,8 +426,15 @@ static void thread_loop(void *data)
          slock_lock(thr->lock);
          thr->alive = alive;
          thr->focus = focus;
-         thr->frame.updated = false;
          thr->vp = vp;
+
+         thr->frame.stats.rendered++;
+         if (buf->dupe)
+            thr->frame.stats.duplicated++;
+         thr->frame.stats.latency_total_usec += latency;
+         if (latency > thr->frame.stats.latency_max_usec)
+            thr->frame.stats.latency_max_usec = latency;
+
          scond_signal(thr->cond_cmd);
          slock_unlock(thr->lock);
       }
@@ -393,42 +494,57 @@ static bool thread_frame(void *data, const void *frame_,
    thread_video_t *thr = (thread_video_t*)data;
    unsigned copy_stride = width * (thr->info.rgb32 ? sizeof(uint32_t) : sizeof(uint16_t));
 
+   // A dupe would only make the video thread redraw an older frame than the one it hasn't picked up yet.
+   if (!frame_ && (frame_load_acquire(&thr->frame.ready) & THREAD_FRAME_FRESH))
+   {
+      RARCH_PERFORMANCE_STOP(thread_frame);
+      return true;
+   }
+
+   // The write buffer is ours alone, so no locking while copying.
+   struct thread_frame_buffer *buf = &thr->frame.buffers[thr->frame.write_index];
    const uint8_t *src = (const uint8_t*)frame_;
-   uint8_t *dst = thr->frame.buffer;
+   uint8_t *dst = buf->data;
 
-   slock_lock(thr->lock);
-   // Drop frame if updated flag is still set, as thread is still working on last frame.
-   if (!thr->frame.updated)
+   // Core rendered straight into the write buffer (see thread_get_current_software_framebuffer()).
+   if (src && src != dst)
    {
-      if (src)
-      {
-         for (unsigned h = 0; h < height; h++, src += pitch, dst += copy_stride)
-            memcpy(dst, src, copy_stride);
-      }
+      for (unsigned h = 0; h < height; h++, src += pitch, dst += copy_stride)
+         memcpy(dst, src, copy_stride);
+   }
 
-      thr->frame.updated = true;
-      thr->frame.width  = width;
-      thr->frame.height = height;
-      thr->frame.pitch  = copy_stride;
+   buf->dupe   = !src;
+   buf->width  = width;
+   buf->height = height;
+   buf->pitch  = copy_stride;
+   buf->time   = rarch_get_time_usec();
 
-      if (msg)
-         strlcpy(thr->frame.msg, msg, sizeof(thr->frame.msg));
-      else
-         *thr->frame.msg = '\0';
+   if (msg)
+      strlcpy(buf->msg, msg, sizeof(buf->msg));
+   else
+      *buf->msg = '\0';
 
-      scond_signal(thr->cond_thread);
+   // Whatever we get back is ours now. If it is still fresh, the video thread never saw it.
+   unsigned prev = frame_exchange(&thr->frame.ready, thr->frame.write_index | THREAD_FRAME_FRESH);
+   thr->frame.write_index = THREAD_FRAME_INDEX(prev);
+   if (prev & THREAD_FRAME_FRESH)
+      thr->frame.dropped++;
 
-      // If we are going to render menu,
-      // we'll want to block to avoid stepping menu
-      // at crazy speeds.
+   slock_lock(thr->lock);
+   thr->frame.updated = true;
+   thr->frame.stats.frames++;
+   scond_signal(thr->cond_thread);
+
+   // If we are going to render menu,
+   // we'll want to block to avoid stepping menu
+   // at crazy speeds.
 #if defined(HAVE_RGUI) || defined(HAVE_RMENU)
-      if (thr->texture.enable)
-      {
-         while (thr->frame.updated)
-            scond_wait(thr->cond_cmd, thr->lock);
-      }
-#endif
+   if (thr->texture.enable)
+   {
+      while (thr->frame.updated)
+         scond_wait(thr->cond_cmd, thr->lock);
    }
+#endif
    slock_unlock(thr->lock);
 
    RARCH_PERFORMANCE_STOP(thread_frame);
@@ -445,7 +561,7 @@ static void thread_set_nonblock_state(void *data, bool state)
 }
 
 static bool thread_init(thread_video_t *thr, const video_info_t *info, const input_driver_t **input,
-      void **input_data)
+      void **input_data, bool convert_0rgb1555)
 {
    thr->lock = slock_new();
    thr->frame.lock = slock_new();
@@ -460,11 +576,32 @@ static bool thread_init(thread_video_t *thr, const video_info_t *info, const inp
    size_t max_size = info->input_scale * RARCH_SCALE_BASE;
    max_size *= max_size;
    max_size *= info->rgb32 ? sizeof(uint32_t) : sizeof(uint16_t);
-   thr->frame.buffer = (uint8_t*)malloc(max_size);
-   if (!thr->frame.buffer)
-      return false;
+   for (unsigned i = 0; i < THREAD_FRAME_BUFFERS; i++)
+   {
+      thr->frame.buffers[i].data = (uint8_t*)malloc(max_size);
+      if (!thr->frame.buffers[i].data)
+         return false;
+      memset(thr->frame.buffers[i].data, 0x80, max_size);
+   }
+
+   thr->frame.write_index = 0;
+   thr->frame.ready       = 1;
+   thr->frame.read_index  = 2;
 
-   memset(thr->frame.buffer, 0x80, max_size);
+   if (convert_0rgb1555 && !info->rgb32)
+   {
+      thr->frame.convert = true;
+      thr->frame.scaler.scaler_type = SCALER_TYPE_POINT;
+      thr->frame.scaler.in_fmt      = SCALER_FMT_0RGB1555;
+      thr->frame.scaler.out_fmt     = SCALER_FMT_RGB565;
+      if (!scaler_ctx_gen_filter(&thr->frame.scaler))
+         return false;
+
+      thr->frame.conv_buffer = (uint8_t*)malloc(max_size);
+      if (!thr->frame.conv_buffer)
+         return false;
+      memset(thr->frame.conv_buffer, 0x80, max_size);
+   }
 
    thr->thread = sthread_create(thread_loop, thr);
    if (!thr->thread)
@@ -528,7 +665,17 @@ static void thread_free(void *data)
 #if defined(HAVE_RGUI) || defined(HAVE_RMENU)
    free(thr->texture.frame);
 #endif
-   free(thr->frame.buffer);
+   struct rarch_threaded_video_stats stats;
+   rarch_threaded_video_get_stats(thr, &stats);
+   RARCH_LOG("Threaded video: %llu frames, %llu dropped, %llu duplicated, %.2f ms average latency, %.2f ms max.\n",
+         (unsigned long long)stats.frames, (unsigned long long)stats.dropped, (unsigned long long)stats.duplicated,
+         stats.rendered ? stats.latency_total_usec / (1000.0 * stats.rendered) : 0.0,
+         stats.latency_max_usec / 1000.0);
+
+   for (unsigned i = 0; i < THREAD_FRAME_BUFFERS; i++)
+      free(thr->frame.buffers[i].data);
+   free(thr->frame.conv_buffer);
+   scaler_ctx_gen_reset(&thr->frame.scaler);
    slock_free(thr->frame.lock);
    slock_free(thr->lock);
    scond_free(thr->cond_cmd);
@@ -674,6 +821,26 @@ static void thread_apply_state_changes(void *data)
    slock_unlock(thr->frame.lock);
 }
 
+// Hands out the buffer the next thread_frame() would copy into, so the core can render there directly.
+// It stays ours until thread_frame() publishes it, and the video thread never touches the write buffer.
+static bool thread_get_current_software_framebuffer(void *data, struct retro_framebuffer *framebuffer)
+{
+   thread_video_t *thr = (thread_video_t*)data;
+   unsigned max_dim = thr->info.input_scale * RARCH_SCALE_BASE;
+
+   if (framebuffer->width > max_dim || framebuffer->height > max_dim)
+      return false;
+
+   framebuffer->data   = thr->frame.buffers[thr->frame.write_index].data;
+   framebuffer->pitch  = framebuffer->width * (thr->info.rgb32 ? sizeof(uint32_t) : sizeof(uint16_t));
+   framebuffer->memory_flags = RETRO_MEMORY_TYPE_CACHED;
+   if (thr->info.rgb32)
+      framebuffer->format = RETRO_PIXEL_FORMAT_XRGB8888;
+   else
+      framebuffer->format = thr->frame.convert ? RETRO_PIXEL_FORMAT_0RGB1555 : RETRO_PIXEL_FORMAT_RGB565;
+   return true;
+}
+
 static const video_poke_interface_t thread_poke = {
    thread_set_filtering,
 #ifdef HAVE_FBO
@@ -686,6 +853,10 @@ static const video_poke_interface_t thread_poke = {
    thread_set_texture_frame,
    thread_set_texture_enable,
 #endif
+   NULL,
+   NULL,
+   NULL,
+   thread_get_current_software_framebuffer,
 };
 
 static void thread_get_poke_interface(void *data, const video_poke_interface_t **iface)
@@ -751,7 +922,7 @@ static void thread_set_callbacks(thread_video_t *thr, const video_driver_t *driv
 
 bool rarch_threaded_video_init(const video_driver_t **out_driver, void **out_data,
       const input_driver_t **input, void **input_data,
-      const video_driver_t *driver, const video_info_t *info)
+      const video_driver_t *driver, const video_info_t *info, bool convert_0rgb1555)
 {
    thread_video_t *thr = (thread_video_t*)calloc(1, sizeof(*thr));
    if (!thr)
@@ -762,7 +933,14 @@ bool rarch_threaded_video_init(const video_driver_t **out_driver, void **out_dat
    thr->driver = driver;
    *out_driver = &thr->video_thread;
    *out_data   = thr;
-   return thread_init(thr, info, input, input_data);
+   return thread_init(thr, info, input, input_data, convert_0rgb1555);
 }
 
-
+void rarch_threaded_video_get_stats(void *data, struct rarch_threaded_video_stats *stats)
+{
+   thread_video_t *thr = (thread_video_t*)data;
+   slock_lock(thr->lock);
+   *stats = thr->frame.stats;
+   slock_unlock(thr->lock);
+   stats->dropped = thr->frame.dropped;
+}
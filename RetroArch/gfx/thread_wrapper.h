@@ -18,7 +18,21 @@
 
 // Starts a video driver in a new thread.
 // Access to video driver will be mediated through this driver.
+// If convert_0rgb1555 is set, frames are passed in as 0RGB1555 and converted to RGB565 on the video thread.
 bool rarch_threaded_video_init(const video_driver_t **out_driver, void **out_data,
       const input_driver_t **input, void **input_data,
-      const video_driver_t *driver, const video_info_t *info);
+      const video_driver_t *driver, const video_info_t *info, bool convert_0rgb1555);
+
+struct rarch_threaded_video_stats
+{
+   uint64_t frames; // Handed to the video thread, dupes included.
+   uint64_t dropped; // Replaced by a newer frame (or dupe) before the video thread got to them.
+   uint64_t rendered; // Passed on to the driver.
+   uint64_t duplicated; // Rendered frames which were dupes.
+   uint64_t latency_total_usec; // From thread_frame() until the driver returned, summed over rendered frames.
+   uint64_t latency_max_usec;
+};
+
+// data is the video driver handle from rarch_threaded_video_init(). Must be called from the thread feeding it frames.
+void rarch_threaded_video_get_stats(void *data, struct rarch_threaded_video_stats *stats);
 
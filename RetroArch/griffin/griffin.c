@@ -279,12 +279,14 @@ STATE TRACKER
 FIFO BUFFER
 ============================================================ */
 #include "../fifo_buffer.c"
+#include "../spsc_buffer.c"
 
 /*============================================================
 AUDIO RESAMPLER
 ============================================================ */
 #include "../audio/resampler.c"
 #include "../audio/sinc.c"
+#include "../audio/rate_control.c"
 
 /*============================================================
 RSOUND
@@ -298,6 +300,7 @@ RSOUND
 AUDIO UTILS
 ============================================================ */
 #include "../audio/utils.c"
+#include "../audio/flush.c"
 
 /*============================================================
 AUDIO
@@ -427,6 +430,7 @@ NETPLAY
 ============================================================ */
 #ifdef HAVE_NETPLAY
 #include "../netplay.c"
+#include "../netplay_predict.c"
 #endif
 
 /*============================================================
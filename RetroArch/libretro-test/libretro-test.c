@@ -180,8 +180,22 @@ static void render_checkered(void)
    uint16_t color_r = 31 << 11;
    uint16_t color_g = 63 <<  5;
 
-   uint16_t *line = frame_buf;
-   for (unsigned y = 0; y < 240; y++, line += 320)
+   // Render straight into the frontend's memory if it has some for us.
+   uint16_t *buf = frame_buf;
+   unsigned stride = 320;
+   struct retro_framebuffer fb = {0};
+   fb.width = 320;
+   fb.height = 240;
+   fb.access_flags = RETRO_MEMORY_ACCESS_WRITE;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &fb) &&
+         fb.format == RETRO_PIXEL_FORMAT_RGB565)
+   {
+      buf = (uint16_t*)fb.data;
+      stride = fb.pitch >> 1;
+   }
+
+   uint16_t *line = buf;
+   for (unsigned y = 0; y < 240; y++, line += stride)
    {
       unsigned index_y = ((y - y_coord) >> 4) & 1;
       for (unsigned x = 0; x < 320; x++)
@@ -193,9 +207,9 @@ static void render_checkered(void)
 
    for (unsigned y = mouse_rel_y - 5; y <= mouse_rel_y + 5; y++)
       for (unsigned x = mouse_rel_x - 5; x <= mouse_rel_x + 5; x++)
-         frame_buf[y * 320 + x] = 0x1f;
+         buf[y * stride + x] = 0x1f;
 
-   video_cb(frame_buf, 320, 240, 320 << 1);
+   video_cb(buf, 320, 240, stride << 1);
 }
 
 static void render_audio(void)
@@ -226,8 +240,20 @@ static void check_variables(void)
 void retro_run(void)
 {
    update_input();
-   render_checkered();
-   render_audio();
+
+   // Output that is thrown away anyway doesn't have to be made.
+   int av_enable = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+   environ_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable);
+
+   if (av_enable & RETRO_AV_ENABLE_VIDEO)
+      render_checkered();
+   else
+      video_cb(NULL, 320, 240, 0);
+
+   if (av_enable & RETRO_AV_ENABLE_AUDIO)
+      render_audio();
+   else
+      phase = (phase + 30000 / 60) % 100;
 
    bool updated = false;
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
@@ -480,7 +480,38 @@ enum retro_mod
                                            // If true, the libretro implementation supports calls to retro_load_game() with NULL as argument.
                                            // Used by cores which can run without particular game data.
                                            // This should be called within retro_set_environment() only.
+                                           //
+#define RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER (19 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+                                           // struct retro_framebuffer * --
+                                           // NOTE: This call is currently very experimental, and should not be considered part of the public API.
+                                           // The interface could be changed or removed at any time.
+                                           // Returns a frontend-owned buffer which the implementation can render its next frame into,
+                                           // saving the frontend from copying the frame after retro_video_refresh_t.
+                                           // Only useful for software rendering.
+                                           // width and height are set by the implementation, and must not exceed max_width/max_height from get_av_info().
+                                           // data, pitch and format are set by the frontend.
+                                           // The implementation must render in the returned format, which can differ from the one set with SET_PIXEL_FORMAT.
+                                           // If it cannot, or the call returns false, it should render into its own buffer as usual.
+                                           // Must be called every frame before rendering; the buffer can change from frame to frame.
+                                           // It is only valid until the next retro_video_refresh_t call, which should be passed data, width, height and pitch as-is.
+                                           // access_flags tells the frontend how the implementation is going to use the memory.
+                                           // Memory without RETRO_MEMORY_TYPE_CACHED in memory_flags can be very slow to read from.
+                                           //
+#define RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE (20 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+                                           // int * --
+                                           // NOTE: This call is currently very experimental, and should not be considered part of the public API.
+                                           // The interface could be changed or removed at any time.
+                                           // Tells the implementation whether the frontend will use the video and audio of the current frame.
+                                           // If RETRO_AV_ENABLE_VIDEO is not set, the frame will not be shown,
+                                           // and the implementation may skip rendering and pass NULL to retro_video_refresh_t.
+                                           // If RETRO_AV_ENABLE_AUDIO is not set, the audio will not be played, and the implementation may skip
+                                           // mixing and calling the audio callbacks.
+                                           // Happens e.g. when the frontend runs frames again to catch up with netplay input.
+                                           // Anything that ends up in save states must still be emulated the same way, or netplay desyncs.
+                                           // Query in every retro_run(). The answer can change from one frame to the next.
                                           
+#define RETRO_AV_ENABLE_VIDEO (1 << 0)
+#define RETRO_AV_ENABLE_AUDIO (1 << 1)
 
 // Pass this to retro_video_refresh_t if rendering to hardware.
 // Passing NULL to retro_video_refresh_t is still a frame dupe as normal.
@@ -597,6 +628,22 @@ enum retro_pixel_format
    RETRO_PIXEL_FORMAT_UNKNOWN  = INT_MAX
 };
 
+#define RETRO_MEMORY_ACCESS_WRITE (1 << 0) // The implementation will write to the buffer.
+#define RETRO_MEMORY_ACCESS_READ  (1 << 1) // The implementation will read from the buffer, e.g. to render on top of the last frame.
+#define RETRO_MEMORY_TYPE_CACHED  (1 << 0) // Reading from the buffer is as fast as reading from any other memory.
+
+struct retro_framebuffer
+{
+   void *data; // Set by frontend.
+   unsigned width; // Set by implementation.
+   unsigned height; // Set by implementation.
+   size_t pitch; // Set by frontend. In bytes.
+   enum retro_pixel_format format; // Set by frontend.
+
+   unsigned access_flags; // Set by implementation. RETRO_MEMORY_ACCESS_* flags.
+   unsigned memory_flags; // Set by frontend. RETRO_MEMORY_TYPE_* flags.
+};
+
 struct retro_message
 {
    const char *msg;        // Message to be displayed.
@@ -23,8 +23,12 @@
 #include "autosave.h"
 #include "dynamic.h"
 #include "message.h"
+#include "rewind.h"
+#include "netplay_predict.h"
+#include "performance.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 // Checks if input port/index is controlled by netplay or not.
 static bool netplay_is_alive(netplay_t *handle);
@@ -32,8 +36,6 @@ static bool netplay_is_alive(netplay_t *handle);
 static bool netplay_poll(netplay_t *handle);
 static int16_t netplay_input_state(netplay_t *handle, bool port, unsigned device, unsigned index, unsigned id);
 
-// If we're fast-forward replaying to resync, check if we should actually show frame.
-static bool netplay_should_skip(netplay_t *handle);
 static bool netplay_can_poll(netplay_t *handle);
 static void netplay_set_spectate_input(netplay_t *handle, int16_t input);
 
@@ -45,8 +47,6 @@ static bool netplay_get_cmd(netplay_t *handle);
 
 struct delta_frame
 {
-   void *state;
-
    uint16_t real_input_state;
    uint16_t simulated_input_state;
    bool is_simulated;
@@ -54,9 +54,57 @@ struct delta_frame
    bool used_real;
 };
 
-#define UDP_FRAME_PACKETS 16
+struct spectator
+{
+   int fd; // -1 if the slot is free.
+   struct sockaddr_storage addr;
+   uint32_t connect_frame;
+
+   // Their nick, size first, as it comes in.
+   uint8_t nick[33];
+   size_t nick_ptr;
+   bool joined;
+
+   // Our nick, BSV header and save state, sent before any input.
+   uint8_t *header;
+   size_t header_size;
+   size_t header_ptr;
+
+   uint64_t input_ptr; // Next byte of spectate_buffer to send.
+};
+
+// How far ahead of the other side's input we may run, and so how far back we may have to roll.
+#define NETPLAY_MAX_FRAMES 64
 #define MAX_SPECTATORS 16
 
+// Spectator input is written once to a shared buffer, and sent on to each spectator from its own position in it.
+// A spectator which falls so far behind that its unsent input would be overwritten is dropped.
+#define SPECTATE_BUFFER_SIZE 0x10000 // Power of two.
+// Spectators joining within this many frames of the last one get the same save state, and catch up on the input since.
+#define SPECTATE_STATE_FRAMES 15
+// Spectators which haven't told us their nick by then are dropped.
+#define SPECTATE_JOIN_FRAMES 300
+
+// Our input is sent again with every packet until the other side has it, so lost packets only cost a frame.
+// They can be missing as much as we may run ahead of them, plus as much as they may run ahead of us.
+#define INPUT_HISTORY 256 // Power of two, more than 2 * (NETPLAY_MAX_FRAMES + 1).
+// Input packet: the frame of theirs we need next, the first frame in the packet, then input for each frame from there on.
+#define INPUT_PACKET_HEADER 2
+#define INPUT_PACKET_MAX (INPUT_PACKET_HEADER + INPUT_HISTORY)
+
+// When we have to wait for their input, our packets may have been lost and they may be waiting just as well.
+// Resend after about a round trip, but never wait longer than MAX_RTO_USEC. Give up after TIMEOUT_USEC.
+#define INITIAL_RTO_USEC 100000
+#define MIN_RTO_USEC 10000
+#define MAX_RTO_USEC 500000
+#define TIMEOUT_USEC 8000000
+
+// Both sides have to be past the flip frame for a flip to be safe, so schedule flips this far ahead.
+#define FLIP_FRAMES(handle) (2 * ((handle)->buffer_size > 16 ? (handle)->buffer_size : 16))
+
+// Bump when what goes over the wire changes, so mismatched builds refuse to connect instead of desyncing.
+#define NETPLAY_PROTOCOL_VERSION 1
+
 #define NETPLAY_CMD_ACK 0
 #define NETPLAY_CMD_NAK 1
 #define NETPLAY_CMD_FLIP_PLAYERS 2
@@ -81,29 +129,67 @@ struct netplay
    size_t read_ptr; // Ptr to where we are reading. Generally, other_ptr <= read_ptr <= self_ptr.
    size_t tmp_ptr; // A temporary pointer used on replay.
 
+   // Save states for the frames in buffer. Only the newest is held in full,
+   // older ones are XOR deltas and only get rebuilt when we have to roll back.
+   state_manager_t *states;
+   void *state_buf; // Serialize target, padded to a multiple of 4 bytes.
    size_t state_size;
 
+   // Guesses the other side's input until it arrives.
+   const netplay_predictor_t *predictor;
+   struct netplay_input_model input_model;
+
+   // Rollback stats, logged when netplay ends.
+   rarch_time_t start_time;
+   uint64_t predicted_frames;
+   uint64_t mispredicted_frames;
+   uint64_t rollbacks;
+   uint64_t replayed_frames;
+   rarch_time_t restore_usec; // Rebuilding and loading the state we roll back to.
+   rarch_time_t replay_usec;  // The whole rollback, including running the frames again.
+
    bool is_replay; // Are we replaying old frames?
    bool can_poll; // We don't want to poll several times on a frame.
 
-   uint32_t packet_buffer[UDP_FRAME_PACKETS * 2]; // To compat UDP packet loss we also send old data along with the packets.
+   // Our input by frame, kept until they have it.
+   uint16_t sent_input[INPUT_HISTORY];
+   rarch_time_t sent_time[INPUT_HISTORY]; // When it first went out.
+   uint32_t other_ack; // They have our input for all frames before this.
+   bool other_waiting; // Their last packet suggests they are stuck waiting for our input.
+   rarch_time_t last_send;
+
+   // Round trip time estimate, the way TCP keeps it.
+   rarch_time_t srtt;
+   rarch_time_t rttvar;
+   rarch_time_t rto;
+   uint32_t rtt_frame; // Frames before this were resent, so it's unknown which send an ack is for.
+
+   // Network stats, logged when netplay ends.
+   uint64_t stalls;
+   uint64_t resends;
+   rarch_time_t stall_usec;
+   rarch_time_t max_stall_usec;
+
    uint32_t frame_count;
    uint32_t read_frame_count;
    uint32_t other_frame_count;
    uint32_t tmp_frame_count;
    struct addrinfo *addr;
    struct sockaddr_storage their_addr;
+   socklen_t their_addr_len;
    bool has_client_addr;
 
-   unsigned timeout_cnt;
-
    // Spectating.
    bool spectate;
    bool spectate_client;
-   int spectate_fds[MAX_SPECTATORS];
-   uint16_t *spectate_input;
-   size_t spectate_input_ptr;
-   size_t spectate_input_size;
+   struct spectator spectators[MAX_SPECTATORS];
+   uint8_t *spectate_buffer;
+   uint64_t spectate_written; // Bytes written to spectate_buffer so far.
+   // Last save state handed out to spectators, where in the input it was taken, and when.
+   uint32_t *spectate_state;
+   size_t spectate_state_size;
+   uint64_t spectate_state_ptr;
+   uint32_t spectate_state_frame;
 
    // Player flipping
    // Flipping state. If ptr >= flip_frame, we apply the flip.
@@ -146,6 +232,31 @@ static bool recv_all(int fd, void *data_, size_t size)
    return true;
 }
 
+static bool socket_nonblock(int fd)
+{
+#if defined(_WIN32)
+   u_long mode = 1;
+   return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#elif defined(__CELLOS_LV2__)
+   int yes = 1;
+   return setsockopt(fd, SOL_SOCKET, SO_NBIO, &yes, sizeof(int)) == 0;
+#else
+   return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+}
+
+// Whether a failed call on a non-blocking socket only means there was nothing to do right now.
+static bool socket_would_block(void)
+{
+#if defined(_WIN32)
+   return WSAGetLastError() == WSAEWOULDBLOCK;
+#elif defined(__CELLOS_LV2__) && !defined(__PSL1GHT__)
+   return sys_net_errno == SYS_NET_EWOULDBLOCK || sys_net_errno == SYS_NET_EAGAIN;
+#else
+   return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
 static void warn_hangup(void)
 {
    RARCH_WARN("Netplay has disconnected. Will continue without connection ...\n");
@@ -179,6 +290,34 @@ size_t audio_sample_batch_net(const int16_t *data, size_t frames)
       return frames;
 }
 
+// Installed while replaying, so the core's output does not go through the callbacks above at all.
+static void video_frame_discard(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   (void)data;
+   (void)width;
+   (void)height;
+   (void)pitch;
+}
+
+static void audio_sample_discard(int16_t left, int16_t right)
+{
+   (void)left;
+   (void)right;
+}
+
+static size_t audio_sample_batch_discard(const int16_t *data, size_t frames)
+{
+   (void)data;
+   return frames;
+}
+
+static void set_replay_callbacks(bool replay)
+{
+   pretro_set_video_refresh(replay ? video_frame_discard : video_frame_net);
+   pretro_set_audio_sample(replay ? audio_sample_discard : audio_sample_net);
+   pretro_set_audio_sample_batch(replay ? audio_sample_batch_discard : audio_sample_batch_net);
+}
+
 int16_t input_state_net(unsigned port, unsigned device, unsigned index, unsigned id)
 {
    if (netplay_is_alive(g_extern.netplay))
@@ -378,6 +517,14 @@ static bool init_udp_socket(netplay_t *handle, const char *server, uint16_t port
       return false;
    }
 
+   if (!socket_nonblock(handle->udp_fd))
+   {
+      RARCH_ERR("Failed to make socket non-blocking.\n");
+      close(handle->udp_fd);
+      handle->udp_fd = -1;
+      return false;
+   }
+
    if (!server)
    {
       // Note sure if we have to do this for UDP, but hey :)
@@ -466,6 +613,8 @@ static uint32_t implementation_magic_value(void)
    for (size_t i = 0; i < len; i++)
       res ^= ver[i] << ((i & 0xf) + 16);
 
+   res ^= NETPLAY_PROTOCOL_VERSION << 28;
+
    return res;
 }
 
@@ -726,15 +875,44 @@ static bool get_info_spectate(netplay_t *handle)
    return ret;
 }
 
-static void init_buffers(netplay_t *handle)
+static bool init_buffers(netplay_t *handle)
 {
    handle->buffer = (struct delta_frame*)calloc(handle->buffer_size, sizeof(*handle->buffer));
-   handle->state_size = pretro_serialize_size();
+   if (!handle->buffer)
+      return false;
+
    for (unsigned i = 0; i < handle->buffer_size; i++)
-   {
-      handle->buffer[i].state = malloc(handle->state_size);
       handle->buffer[i].is_simulated = true;
+
+   handle->state_size = pretro_serialize_size();
+   if (!handle->state_size)
+   {
+      RARCH_ERR("Implementation does not support save states. Cannot use netplay.\n");
+      return false;
+   }
+
+   size_t aligned_size = (handle->state_size + 3) & ~3;
+   handle->state_buf = calloc(1, aligned_size);
+   if (!handle->state_buf)
+      return false;
+
+   if (!pretro_serialize(handle->state_buf, handle->state_size))
+   {
+      RARCH_ERR("Failed to perform initial serialization for netplay.\n");
+      return false;
    }
+
+   // Deltas are usually a small fraction of a state, so start out with room for about a quarter of the window
+   // in full states. The whole window has to survive even when most of the state changes every frame,
+   // so the state manager grows the ring when it has to rather than dropping any of it.
+   // Deltas are not compressed any further, that would only add to the time a frame takes.
+   handle->states = state_manager_new(aligned_size, (handle->buffer_size / 4 + 2) * (aligned_size + 64),
+         handle->state_buf);
+   if (!handle->states)
+      return false;
+
+   state_manager_set_min_entries(handle->states, handle->buffer_size);
+   return true;
 }
 
 netplay_t *netplay_new(const char *server, uint16_t port,
@@ -742,8 +920,11 @@ netplay_t *netplay_new(const char *server, uint16_t port,
       bool spectate,
       const char *nick)
 {
-   if (frames > UDP_FRAME_PACKETS)
-      frames = UDP_FRAME_PACKETS;
+   if (frames > NETPLAY_MAX_FRAMES)
+   {
+      RARCH_WARN("Netplay can only run %u frames ahead.\n", NETPLAY_MAX_FRAMES);
+      frames = NETPLAY_MAX_FRAMES;
+   }
 
    netplay_t *handle = (netplay_t*)calloc(1, sizeof(*handle));
    if (!handle)
@@ -765,14 +946,21 @@ netplay_t *netplay_new(const char *server, uint16_t port,
 
    if (spectate)
    {
+      for (unsigned i = 0; i < MAX_SPECTATORS; i++)
+         handle->spectators[i].fd = -1;
+
       if (server)
       {
          if (!get_info_spectate(handle))
             goto error;
       }
-
-      for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-         handle->spectate_fds[i] = -1;
+      else
+      {
+         // Spectators are accepted and fed in between frames, never waited for.
+         handle->spectate_buffer = (uint8_t*)malloc(SPECTATE_BUFFER_SIZE);
+         if (!handle->spectate_buffer || !socket_nonblock(handle->fd))
+            goto error;
+      }
    }
    else
    {
@@ -789,7 +977,19 @@ netplay_t *netplay_new(const char *server, uint16_t port,
 
       handle->buffer_size = frames + 1;
 
-      init_buffers(handle);
+      if (!init_buffers(handle))
+         goto error;
+
+      handle->predictor = netplay_predictor_find(g_settings.input.netplay_predictor);
+      if (!handle->predictor)
+      {
+         RARCH_WARN("Unknown netplay predictor \"%s\", falling back to \"last\".\n", g_settings.input.netplay_predictor);
+         handle->predictor = netplay_predictor_find("last");
+      }
+      netplay_input_model_init(&handle->input_model);
+
+      handle->rto = INITIAL_RTO_USEC;
+      handle->start_time = rarch_get_time_usec();
       handle->has_connection = true;
    }
 
@@ -801,6 +1001,10 @@ error:
    if (handle->udp_fd >= 0)
       close(handle->udp_fd);
 
+   state_manager_free(handle->states);
+   free(handle->state_buf);
+   free(handle->buffer);
+   free(handle->spectate_buffer);
    free(handle);
    return NULL;
 }
@@ -811,80 +1015,115 @@ static bool netplay_is_alive(netplay_t *handle)
    return handle->has_connection;
 }
 
-static bool send_chunk(netplay_t *handle)
+// Sends all our input they don't have yet, along with which of their frames we need next.
+static bool send_input(netplay_t *handle)
 {
+   handle->last_send = rarch_get_time_usec();
+
    const struct sockaddr *addr = NULL;
+   socklen_t addr_len = 0;
    if (handle->addr)
+   {
       addr = handle->addr->ai_addr;
+      addr_len = handle->addr->ai_addrlen;
+   }
    else if (handle->has_client_addr)
+   {
       addr = (const struct sockaddr*)&handle->their_addr;
+      addr_len = handle->their_addr_len;
+   }
+
+   // Host doesn't know where to send until the client has sent something.
+   if (!addr)
+      return true;
+
+   uint32_t first = handle->other_ack;
+   if (handle->frame_count + 1 - first > INPUT_HISTORY)
+      first = handle->frame_count + 1 - INPUT_HISTORY;
 
-   if (addr)
+   uint32_t packet[INPUT_PACKET_MAX];
+   unsigned words = INPUT_PACKET_HEADER;
+   packet[0] = htonl(handle->read_frame_count);
+   packet[1] = htonl(first);
+   for (uint32_t frame = first; frame <= handle->frame_count; frame++)
+      packet[words++] = htonl(handle->sent_input[frame & (INPUT_HISTORY - 1)]);
+
+   ssize_t size = words * sizeof(uint32_t);
+   if (sendto(handle->udp_fd, CONST_CAST packet, size, 0, addr, addr_len) != size &&
+         !socket_would_block()) // A full send buffer is no different from a lost packet.
    {
-      if (sendto(handle->udp_fd, CONST_CAST handle->packet_buffer,
-               sizeof(handle->packet_buffer), 0, addr,
-               sizeof(struct sockaddr)) != sizeof(handle->packet_buffer))
-      {
-         warn_hangup();
-         handle->has_connection = false;
-         return false;
-      }
+      warn_hangup();
+      handle->has_connection = false;
+      return false;
    }
+
    return true;
 }
 
-#define MAX_RETRIES 16
-#define RETRY_MS 500
+// RFC 6298. Samples are from the first time a frame went out until it was acknowledged,
+// so they include the time the other side took to get to its next frame.
+static void update_rtt(netplay_t *handle, rarch_time_t sample)
+{
+   if (!handle->srtt)
+   {
+      handle->srtt = sample;
+      handle->rttvar = sample / 2;
+   }
+   else
+   {
+      rarch_time_t delta = handle->srtt > sample ? handle->srtt - sample : sample - handle->srtt;
+      handle->rttvar = (3 * handle->rttvar + delta) / 4;
+      handle->srtt = (7 * handle->srtt + sample) / 8;
+   }
+
+   handle->rto = handle->srtt + 4 * handle->rttvar;
+   if (handle->rto < MIN_RTO_USEC)
+      handle->rto = MIN_RTO_USEC;
+   if (handle->rto > MAX_RTO_USEC)
+      handle->rto = MAX_RTO_USEC;
+}
 
-static int poll_input(netplay_t *handle, bool block)
+// Waits up to timeout_usec for something to read. Commands on the TCP connection are handled right away.
+// Returns -1 on error, otherwise whether there is input to read.
+static int poll_input(netplay_t *handle, rarch_time_t timeout_usec)
 {
+#ifdef NETPLAY_HAVE_POLL
+   struct pollfd fds[2];
+   fds[0].fd = handle->udp_fd;
+   fds[0].events = POLLIN;
+   fds[1].fd = handle->fd;
+   fds[1].events = POLLIN;
+
+   int ret = poll(fds, 2, (timeout_usec + 999) / 1000);
+   if (ret < 0)
+      return errno == EINTR ? 0 : -1;
+
+   bool has_cmd = fds[1].revents & (POLLIN | POLLHUP | POLLERR);
+   bool has_input = fds[0].revents & (POLLIN | POLLERR);
+#else
    int max_fd = (handle->fd > handle->udp_fd ? handle->fd : handle->udp_fd) + 1;
-
    struct timeval tv = {0};
-   tv.tv_sec = 0;
-   tv.tv_usec = block ? (RETRY_MS * 1000) : 0;
-
-   do
-   { 
-      handle->timeout_cnt++;
-
-      // select() does not take pointer to const struct timeval.
-      // Technically possible for select() to modify tmp_tv, so we go paranoia mode.
-      struct timeval tmp_tv = tv;
+   tv.tv_sec = timeout_usec / 1000000;
+   tv.tv_usec = timeout_usec % 1000000;
 
-      fd_set fds;
-      FD_ZERO(&fds);
-      FD_SET(handle->udp_fd, &fds);
-      FD_SET(handle->fd, &fds);
-
-      if (select(max_fd, &fds, NULL, NULL, &tmp_tv) < 0)
-         return -1;
-
-      // Somewhat hacky,
-      // but we aren't using the TCP connection for anything useful atm.
-      if (FD_ISSET(handle->fd, &fds) && !netplay_get_cmd(handle))
-         return -1; 
-
-      if (FD_ISSET(handle->udp_fd, &fds))
-         return 1;
+   fd_set fds;
+   FD_ZERO(&fds);
+   FD_SET(handle->udp_fd, &fds);
+   FD_SET(handle->fd, &fds);
 
-      if (block && !send_chunk(handle))
-      {
-         warn_hangup();
-         handle->has_connection = false;
-         return -1;
-      }
+   if (select(max_fd, &fds, NULL, NULL, &tv) < 0)
+      return -1;
 
-      if (block)
-      {
-         RARCH_LOG("Network is stalling, resending packet... Count %u of %d ...\n",
-               handle->timeout_cnt, MAX_RETRIES);
-      }
-   } while ((handle->timeout_cnt < MAX_RETRIES) && block);
+   bool has_cmd = FD_ISSET(handle->fd, &fds);
+   bool has_input = FD_ISSET(handle->udp_fd, &fds);
+#endif
 
-   if (block)
+   // Somewhat hacky,
+   // but we aren't using the TCP connection for anything useful atm.
+   if (has_cmd && !netplay_get_cmd(handle))
       return -1;
-   return 0;
+
+   return has_input;
 }
 
 // Grab our own input state and send this over the network.
@@ -904,61 +1143,133 @@ static bool get_self_input_state(netplay_t *handle)
       }
    }
 
-   memmove(handle->packet_buffer, handle->packet_buffer + 2,
-         sizeof (handle->packet_buffer) - 2 * sizeof(uint32_t));
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2] = htonl(handle->frame_count); 
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2 + 1] = htonl(state);
+   handle->sent_input[handle->frame_count & (INPUT_HISTORY - 1)] = state;
+   handle->sent_time[handle->frame_count & (INPUT_HISTORY - 1)] = rarch_get_time_usec();
 
-   if (!send_chunk(handle))
-   {
-      warn_hangup();
-      handle->has_connection = false;
+   if (!send_input(handle))
       return false;
-   }
 
    ptr->self_state = state;
    handle->self_ptr = NEXT_PTR(handle->self_ptr);
    return true;
 }
 
-// TODO: Somewhat better prediction. :P
+// Guesses the other side's input for the frame we are about to run.
 static void simulate_input(netplay_t *handle)
 {
    size_t ptr = PREV_PTR(handle->self_ptr);
-   size_t prev = PREV_PTR(handle->read_ptr);
 
-   handle->buffer[ptr].simulated_input_state = handle->buffer[prev].real_input_state;
+   handle->buffer[ptr].simulated_input_state = handle->predictor->predict(&handle->input_model,
+         handle->frame_count - handle->read_frame_count + 1);
    handle->buffer[ptr].is_simulated = true;
    handle->buffer[ptr].used_real = false;
 }
 
-static void parse_packet(netplay_t *handle, uint32_t *buffer, unsigned size)
+// Their input arrives in frame order, as read_frame_count moves up.
+static void confirm_input(netplay_t *handle, uint16_t state)
+{
+   handle->buffer[handle->read_ptr].is_simulated = false;
+   handle->buffer[handle->read_ptr].real_input_state = state;
+   handle->read_ptr = NEXT_PTR(handle->read_ptr);
+   handle->read_frame_count++;
+   netplay_input_model_update(&handle->input_model, state);
+}
+
+static void parse_packet(netplay_t *handle, const uint32_t *packet, unsigned words)
 {
-   for (unsigned i = 0; i < size * 2; i++)
-      buffer[i] = ntohl(buffer[i]);
+   uint32_t ack = ntohl(packet[0]);
+   uint32_t first = ntohl(packet[1]);
 
-   for (unsigned i = 0; i < size && handle->read_frame_count <= handle->frame_count; i++)
+   // Packets can come out of order, so an older ack never takes back a newer one.
+   if (ack > handle->other_ack && ack <= handle->frame_count + 1)
    {
-      uint32_t frame = buffer[2 * i + 0];
-      uint32_t state = buffer[2 * i + 1];
+      if (ack > handle->rtt_frame)
+         update_rtt(handle, rarch_get_time_usec() - handle->sent_time[(ack - 1) & (INPUT_HISTORY - 1)]);
+      handle->other_ack = ack;
+   }
 
-      if (frame == handle->read_frame_count)
+   bool progress = false;
+   for (unsigned i = INPUT_PACKET_HEADER; i < words && handle->read_frame_count <= handle->frame_count; i++, first++)
+   {
+      if (first == handle->read_frame_count)
       {
-         handle->buffer[handle->read_ptr].is_simulated = false;
-         handle->buffer[handle->read_ptr].real_input_state = state;
-         handle->read_ptr = NEXT_PTR(handle->read_ptr);
-         handle->read_frame_count++;
-         handle->timeout_cnt = 0;
+         confirm_input(handle, ntohl(packet[i]));
+         progress = true;
       }
    }
+
+   // They only send without moving on when they time out waiting for us.
+   if (!progress && ack <= handle->frame_count)
+      handle->other_waiting = true;
 }
 
-static bool receive_data(netplay_t *handle, uint32_t *buffer, size_t size)
+// Reads every packet there is, without waiting.
+static bool receive_input(netplay_t *handle)
 {
-   socklen_t addrlen = sizeof(handle->their_addr);
-   if (recvfrom(handle->udp_fd, NONCONST_CAST buffer, size, 0, (struct sockaddr*)&handle->their_addr, &addrlen) != (ssize_t)size)
-      return false;
-   handle->has_client_addr = true;
+   for (;;)
+   {
+      uint32_t packet[INPUT_PACKET_MAX];
+      socklen_t addr_len = sizeof(handle->their_addr);
+      ssize_t ret = recvfrom(handle->udp_fd, NONCONST_CAST packet, sizeof(packet), 0,
+            (struct sockaddr*)&handle->their_addr, &addr_len);
+
+      if (ret < 0)
+         return socket_would_block();
+
+      handle->their_addr_len = addr_len;
+      handle->has_client_addr = true;
+
+      // Not one of ours.
+      if (ret < INPUT_PACKET_HEADER * (ssize_t)sizeof(uint32_t) || ret % sizeof(uint32_t))
+         continue;
+
+      parse_packet(handle, packet, ret / sizeof(uint32_t));
+   }
+}
+
+// Our buffer is full, we cannot go on before more of their input has arrived.
+static bool wait_for_input(netplay_t *handle)
+{
+   uint32_t first_read = handle->read_frame_count;
+   rarch_time_t start = rarch_get_time_usec();
+   rarch_time_t now = start;
+
+   while (handle->read_frame_count == first_read)
+   {
+      if (now - start > TIMEOUT_USEC)
+         return false;
+
+      // Either side may have lost the packet that would let the other go on.
+      // If they told us they are waiting, we know which.
+      // Packets are small and only go out while we wait, so unlike TCP there is no backing off.
+      if (handle->other_waiting || now - handle->last_send >= handle->rto)
+      {
+         if (!handle->other_waiting)
+         {
+            RARCH_LOG("Network is stalling, resending input (%u frames) ... Waited %.1f ms.\n",
+                  handle->frame_count + 1 - handle->other_ack, (now - start) / 1000.0);
+            handle->rtt_frame = handle->frame_count + 1;
+         }
+         handle->other_waiting = false;
+         handle->resends++;
+
+         if (!send_input(handle))
+            return false;
+         continue;
+      }
+
+      int ret = poll_input(handle, handle->last_send + handle->rto - now);
+      if (ret < 0 || (ret > 0 && !receive_input(handle)))
+         return false;
+
+      now = rarch_get_time_usec();
+   }
+
+   rarch_time_t stall = rarch_get_time_usec() - start;
+   handle->stalls++;
+   handle->stall_usec += stall;
+   if (stall > handle->max_stall_usec)
+      handle->max_stall_usec = stall;
    return true;
 }
 
@@ -977,50 +1288,26 @@ static bool netplay_poll(netplay_t *handle)
    if (handle->frame_count == 0)
    {
       handle->buffer[0].used_real = true;
-      handle->buffer[0].is_simulated = false;
-      handle->buffer[0].real_input_state = 0;
-      handle->read_ptr = NEXT_PTR(handle->read_ptr);
-      handle->read_frame_count++;
+      confirm_input(handle, 0);
       return true;
    }
 
+   int res = poll_input(handle, 0);
+   bool ok = res >= 0 && (res == 0 || receive_input(handle));
+
    // We might have reached the end of the buffer, where we simply have to block.
-   int res = poll_input(handle, handle->other_ptr == handle->self_ptr);
-   if (res == -1)
+   if (ok && handle->other_ptr == handle->self_ptr && handle->read_frame_count == handle->other_frame_count)
+      ok = wait_for_input(handle);
+
+   handle->other_waiting = false;
+
+   if (!ok)
    {
       handle->has_connection = false;
       warn_hangup();
       return false;
    }
 
-   if (res == 1)
-   {
-      uint32_t first_read = handle->read_frame_count;
-      do 
-      {
-         uint32_t buffer[UDP_FRAME_PACKETS * 2];
-         if (!receive_data(handle, buffer, sizeof(buffer)))
-         {
-            warn_hangup();
-            handle->has_connection = false;
-            return false;
-         }
-         parse_packet(handle, buffer, UDP_FRAME_PACKETS);
-
-      } while ((handle->read_frame_count <= handle->frame_count) && 
-            poll_input(handle, (handle->other_ptr == handle->self_ptr) && 
-               (first_read == handle->read_frame_count)) == 1);
-   }
-   else
-   {
-      // Cannot allow this. Should not happen though.
-      if (handle->self_ptr == handle->other_ptr)
-      {
-         warn_hangup();
-         return false;
-      }
-   }
-
    if (handle->read_ptr != handle->self_ptr)
       simulate_input(handle);
    else
@@ -1116,7 +1403,7 @@ static bool netplay_get_cmd(netplay_t *handle)
 
 void netplay_flip_players(netplay_t *handle)
 {
-   uint32_t flip_frame = handle->frame_count + 2 * UDP_FRAME_PACKETS;
+   uint32_t flip_frame = handle->frame_count + FLIP_FRAMES(handle);
    uint32_t flip_frame_net = htonl(flip_frame);
    const char *msg = NULL;
 
@@ -1133,7 +1420,7 @@ void netplay_flip_players(netplay_t *handle)
    }
 
    // Make sure both clients are definitely synced up.
-   if (handle->frame_count < (handle->flip_frame + 2 * UDP_FRAME_PACKETS))
+   if (handle->frame_count < (handle->flip_frame + FLIP_FRAMES(handle)))
    {
       msg = "Cannot flip players yet. Wait a second or two before attempting flip.";
       goto error;
@@ -1192,6 +1479,43 @@ int16_t netplay_input_state(netplay_t *handle, bool port, unsigned device, unsig
    return ((1 << id) & input_state) ? 1 : 0;
 }
 
+static void log_stats(netplay_t *handle)
+{
+   struct state_manager_stats stats;
+   state_manager_get_stats(handle->states, &stats);
+
+   if (stats.entries)
+   {
+      RARCH_LOG("Netplay: %u bytes stored per frame for %u byte states (%.1f%%).\n",
+            (unsigned)(stats.stored_bytes / stats.entries), (unsigned)handle->state_size,
+            handle->state_size ? 100.0 * stats.stored_bytes / (stats.entries * handle->state_size) : 0.0);
+   }
+
+   if (handle->predicted_frames)
+   {
+      double seconds = (rarch_get_time_usec() - handle->start_time) / 1000000.0;
+      RARCH_LOG("Netplay: \"%s\" predictor mispredicted %.2f%% of %llu frames. %.1f frames replayed per second.\n",
+            handle->predictor->ident, 100.0 * handle->mispredicted_frames / handle->predicted_frames,
+            (unsigned long long)handle->predicted_frames,
+            seconds > 0.0 ? handle->replayed_frames / seconds : 0.0);
+   }
+
+   if (handle->rollbacks)
+   {
+      RARCH_LOG("Netplay: %llu rollbacks, %.1f frames replayed on average. Restoring took %.3f ms, rollback in total %.3f ms on average (%.0f frames/s while replaying).\n",
+            (unsigned long long)handle->rollbacks,
+            (double)handle->replayed_frames / handle->rollbacks,
+            handle->restore_usec / (1000.0 * handle->rollbacks),
+            handle->replay_usec / (1000.0 * handle->rollbacks),
+            handle->replay_usec ? handle->replayed_frames * 1000000.0 / handle->replay_usec : 0.0);
+   }
+
+   RARCH_LOG("Netplay: round trip %.1f ms. Waited for input %llu times, %.1f ms in total, %.1f ms at most. %llu resends.\n",
+         handle->srtt / 1000.0, (unsigned long long)handle->stalls,
+         handle->stall_usec / 1000.0, handle->max_stall_usec / 1000.0,
+         (unsigned long long)handle->resends);
+}
+
 void netplay_free(netplay_t *handle)
 {
    close(handle->fd);
@@ -1199,18 +1523,22 @@ void netplay_free(netplay_t *handle)
    if (handle->spectate)
    {
       for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-         if (handle->spectate_fds[i] >= 0)
-            close(handle->spectate_fds[i]);
+      {
+         if (handle->spectators[i].fd >= 0)
+            close(handle->spectators[i].fd);
+         free(handle->spectators[i].header);
+      }
 
-      free(handle->spectate_input);
+      free(handle->spectate_buffer);
+      free(handle->spectate_state);
    }
    else
    {
       close(handle->udp_fd);
 
-      for (unsigned i = 0; i < handle->buffer_size; i++)
-         free(handle->buffer[i].state);
-
+      log_stats(handle);
+      state_manager_free(handle->states);
+      free(handle->state_buf);
       free(handle->buffer);
    }
 
@@ -1220,14 +1548,21 @@ void netplay_free(netplay_t *handle)
    free(handle);
 }
 
-static bool netplay_should_skip(netplay_t *handle)
+bool netplay_should_skip(netplay_t *handle)
 {
    return handle->is_replay && handle->has_connection;
 }
 
+// Serializes the current frame and adds it to the ring of states we can roll back to.
+static void netplay_push_state(netplay_t *handle)
+{
+   pretro_serialize(handle->state_buf, handle->state_size);
+   state_manager_push(handle->states, handle->state_buf);
+}
+
 static void netplay_pre_frame_net(netplay_t *handle)
 {
-   pretro_serialize(handle->buffer[handle->self_ptr].state, handle->state_size);
+   netplay_push_state(handle);
    handle->can_poll = true;
 
    input_poll_net();
@@ -1235,15 +1570,11 @@ static void netplay_pre_frame_net(netplay_t *handle)
 
 static void netplay_set_spectate_input(netplay_t *handle, int16_t input)
 {
-   if (handle->spectate_input_ptr >= handle->spectate_input_size)
-   {
-      handle->spectate_input_size++;
-      handle->spectate_input_size *= 2;
-      handle->spectate_input = (uint16_t*)realloc(handle->spectate_input,
-            handle->spectate_input_size * sizeof(uint16_t));
-   }
-
-   handle->spectate_input[handle->spectate_input_ptr++] = swap_if_big16(input);
+   // Buffer size is a multiple of the input size, so input never wraps around.
+   uint16_t value = swap_if_big16(input);
+   memcpy(handle->spectate_buffer + (handle->spectate_written & (SPECTATE_BUFFER_SIZE - 1)),
+         &value, sizeof(value));
+   handle->spectate_written += sizeof(value);
 }
 
 int16_t input_state_spectate(unsigned port, unsigned device, unsigned index, unsigned id)
@@ -1274,88 +1605,162 @@ int16_t input_state_spectate_client(unsigned port, unsigned device, unsigned ind
    return netplay_get_spectate_input(g_extern.netplay, port, device, index, id);
 }
 
-static void netplay_pre_frame_spectate(netplay_t *handle)
+static void drop_spectator(netplay_t *handle, unsigned index)
 {
-   if (handle->spectate_client)
-      return;
+   struct spectator *spectator = &handle->spectators[index];
 
-   fd_set fds;
-   FD_ZERO(&fds);
-   FD_SET(handle->fd, &fds);
+   RARCH_LOG("Client (#%u) disconnected ...\n", index);
 
-   struct timeval tmp_tv = {0};
-   if (select(handle->fd + 1, &fds, NULL, NULL, &tmp_tv) <= 0)
-      return;
+   char msg[512];
+   snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", index);
+   msg_queue_push(g_extern.msg_queue, msg, 1, 180);
 
-   if (!FD_ISSET(handle->fd, &fds))
-      return;
+   close(spectator->fd);
+   free(spectator->header);
+   memset(spectator, 0, sizeof(*spectator));
+   spectator->fd = -1;
+}
 
-   struct sockaddr_storage their_addr;
-   socklen_t addr_size = sizeof(their_addr);
-   int new_fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
-   if (new_fd < 0)
+static void accept_spectators(netplay_t *handle)
+{
+   for (;;)
    {
-      RARCH_ERR("Failed to accept incoming spectator.\n");
-      return;
-   }
+      struct sockaddr_storage their_addr;
+      socklen_t addr_size = sizeof(their_addr);
+      int new_fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
+      if (new_fd < 0)
+      {
+         if (!socket_would_block())
+            RARCH_ERR("Failed to accept incoming spectator.\n");
+         return;
+      }
 
-   int index = -1;
-   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-   {
-      if (handle->spectate_fds[i] == -1)
+      int index = -1;
+      for (unsigned i = 0; i < MAX_SPECTATORS; i++)
       {
-         index = i;
-         break;
+         if (handle->spectators[i].fd == -1)
+         {
+            index = i;
+            break;
+         }
       }
-   }
 
-   // No vacant client streams :(
-   if (index == -1)
-   {
-      close(new_fd);
-      return;
-   }
+      // No vacant client streams :(
+      if (index == -1 || !socket_nonblock(new_fd))
+      {
+         close(new_fd);
+         continue;
+      }
 
-   if (!get_nickname(handle, new_fd))
-   {
-      RARCH_ERR("Failed to get nickname from client.\n");
-      close(new_fd);
-      return;
-   }
+      // Keep what the kernel will queue up small, so a slow spectator shows up in our buffer.
+      int bufsize = SPECTATE_BUFFER_SIZE;
+      setsockopt(new_fd, SOL_SOCKET, SO_SNDBUF, CONST_CAST &bufsize, sizeof(int));
 
-   if (!send_nickname(handle, new_fd))
-   {
-      RARCH_ERR("Failed to send nickname to client.\n");
-      close(new_fd);
-      return;
+      struct spectator *spectator = &handle->spectators[index];
+      spectator->fd = new_fd;
+      spectator->addr = their_addr;
+      spectator->connect_frame = handle->frame_count;
    }
+}
 
-   size_t header_size;
-   uint32_t *header = bsv_header_generate(&header_size, implementation_magic_value());
-   if (!header)
+// Reads as much of their nick as has arrived. Returns false if they have to be dropped.
+static bool read_spectator_nick(struct spectator *spectator)
+{
+   // Size comes first, then we know how much more there is.
+   size_t size;
+   while (spectator->nick_ptr < (size = spectator->nick_ptr ? 1 + spectator->nick[0] : 1))
    {
-      RARCH_ERR("Failed to generate BSV header.\n");
-      close(new_fd);
-      return;
+      ssize_t ret = recv(spectator->fd, NONCONST_CAST spectator->nick + spectator->nick_ptr,
+            size - spectator->nick_ptr, 0);
+      if (ret == 0)
+         return false;
+      if (ret < 0)
+         return socket_would_block();
+
+      spectator->nick_ptr += ret;
+      if (spectator->nick[0] >= sizeof(spectator->nick) - 1)
+      {
+         RARCH_ERR("Invalid nick size.\n");
+         return false;
+      }
    }
 
-   int bufsize = header_size;
-   setsockopt(new_fd, SOL_SOCKET, SO_SNDBUF, CONST_CAST &bufsize, sizeof(int));
+   spectator->joined = true;
+   return true;
+}
+
+// Spectators start out from a save state, then follow along on the input from where it was taken.
+// Joins close together share one state instead of serializing the core for each.
+static bool join_spectator(netplay_t *handle, unsigned index)
+{
+   struct spectator *spectator = &handle->spectators[index];
 
-   if (!send_all(new_fd, header, header_size))
+   if (!handle->spectate_state ||
+         handle->frame_count - handle->spectate_state_frame > SPECTATE_STATE_FRAMES ||
+         handle->spectate_written - handle->spectate_state_ptr > SPECTATE_BUFFER_SIZE / 2)
    {
-      RARCH_ERR("Failed to send header to client.\n");
-      close(new_fd);
-      free(header);
-      return;
+      free(handle->spectate_state);
+      handle->spectate_state = bsv_header_generate(&handle->spectate_state_size, implementation_magic_value());
+      if (!handle->spectate_state)
+      {
+         RARCH_ERR("Failed to generate BSV header.\n");
+         return false;
+      }
+
+      handle->spectate_state_ptr = handle->spectate_written;
+      handle->spectate_state_frame = handle->frame_count;
    }
 
-   free(header);
-   handle->spectate_fds[index] = new_fd;
+   uint8_t nick_size = strlen(handle->nick);
+   spectator->header_size = sizeof(nick_size) + nick_size + handle->spectate_state_size;
+   spectator->header = (uint8_t*)malloc(spectator->header_size);
+   if (!spectator->header)
+      return false;
+
+   spectator->header[0] = nick_size;
+   memcpy(spectator->header + sizeof(nick_size), handle->nick, nick_size);
+   memcpy(spectator->header + sizeof(nick_size) + nick_size, handle->spectate_state, handle->spectate_state_size);
+   spectator->header_ptr = 0;
+   spectator->input_ptr = handle->spectate_state_ptr;
 
 #ifndef HAVE_SOCKET_LEGACY
-   log_connection(&their_addr, index, handle->other_nick);
+   char nick[sizeof(spectator->nick)] = {0};
+   memcpy(nick, spectator->nick + 1, spectator->nick[0]);
+   log_connection(&spectator->addr, index, nick);
 #endif
+
+   return true;
+}
+
+static void netplay_pre_frame_spectate(netplay_t *handle)
+{
+   if (handle->spectate_client)
+      return;
+
+   accept_spectators(handle);
+
+   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
+   {
+      struct spectator *spectator = &handle->spectators[i];
+      if (spectator->fd == -1 || spectator->joined)
+         continue;
+
+      if (!read_spectator_nick(spectator))
+      {
+         RARCH_ERR("Failed to get nickname from client.\n");
+         drop_spectator(handle, i);
+      }
+      else if (spectator->joined)
+      {
+         if (!join_spectator(handle, i))
+            drop_spectator(handle, i);
+      }
+      else if (handle->frame_count - spectator->connect_frame > SPECTATE_JOIN_FRAMES)
+      {
+         RARCH_WARN("Client (#%u) never sent its nickname.\n", i);
+         drop_spectator(handle, i);
+      }
+   }
 }
 
 void netplay_pre_frame(netplay_t *handle)
@@ -1374,6 +1779,20 @@ static void netplay_post_frame_net(netplay_t *handle)
    if (handle->other_frame_count == handle->read_frame_count)
       return;
 
+   // Check how our guesses for the input that just came in went.
+   size_t ptr = handle->other_ptr;
+   for (uint32_t frame = handle->other_frame_count; frame < handle->read_frame_count; frame++)
+   {
+      const struct delta_frame *delta = &handle->buffer[ptr];
+      if (!delta->used_real)
+      {
+         handle->predicted_frames++;
+         if (delta->simulated_input_state != delta->real_input_state)
+            handle->mispredicted_frames++;
+      }
+      ptr = NEXT_PTR(ptr);
+   }
+
    // Skip ahead if we predicted correctly. Skip until our simulation failed.
    while (handle->other_frame_count < handle->read_frame_count)
    {
@@ -1391,11 +1810,35 @@ static void netplay_post_frame_net(netplay_t *handle)
       handle->tmp_ptr = handle->other_ptr;
       handle->tmp_frame_count = handle->other_frame_count;
 
-      pretro_unserialize(handle->buffer[handle->other_ptr].state, handle->state_size);
+      // The newest state held is the one from before this frame ran.
+      // Going back to the mispredicted frame drops all states after it, they are pushed again as we replay.
+      rarch_time_t start = rarch_get_time_usec();
+      void *state = NULL;
+      if (!state_manager_seek(handle->states, handle->frame_count - 1 - handle->other_frame_count, &state))
+      {
+         RARCH_ERR("Netplay: state to roll back to is gone. Expect a desync.\n");
+         handle->other_ptr = handle->read_ptr;
+         handle->other_frame_count = handle->read_frame_count;
+         handle->is_replay = false;
+         return;
+      }
+      pretro_unserialize(state, handle->state_size);
+      handle->restore_usec += rarch_get_time_usec() - start;
+      set_replay_callbacks(true);
+
+      // We know more about their input now, so guess again for the frames it has yet to arrive for.
+      for (size_t i = handle->read_ptr, frame = handle->read_frame_count; i != handle->self_ptr; i = NEXT_PTR(i), frame++)
+      {
+         if (handle->buffer[i].is_simulated)
+            handle->buffer[i].simulated_input_state = handle->predictor->predict(&handle->input_model,
+                  frame - handle->read_frame_count + 1);
+      }
+
       bool first = true;
       while (first || (handle->tmp_ptr != handle->self_ptr))
       {
-         pretro_serialize(handle->buffer[handle->tmp_ptr].state, handle->state_size);
+         if (!first)
+            netplay_push_state(handle);
 #if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
          lock_autosave();
 #endif
@@ -1405,8 +1848,13 @@ static void netplay_post_frame_net(netplay_t *handle)
 #endif
          handle->tmp_ptr = NEXT_PTR(handle->tmp_ptr);
          handle->tmp_frame_count++;
+         handle->replayed_frames++;
          first = false;
       }
+      set_replay_callbacks(false);
+
+      handle->rollbacks++;
+      handle->replay_usec += rarch_get_time_usec() - start;
 
       handle->other_ptr = handle->read_ptr;
       handle->other_frame_count = handle->read_frame_count;
@@ -1414,32 +1862,61 @@ static void netplay_post_frame_net(netplay_t *handle)
    }
 }
 
-static void netplay_post_frame_spectate(netplay_t *handle)
+// Sends whatever the spectator will take without blocking. Returns false if it has to be dropped.
+static bool flush_spectator(netplay_t *handle, struct spectator *spectator)
 {
-   if (handle->spectate_client)
-      return;
+   // Input it still has to get has been overwritten. Skipping any of it would desync, so it's dropped.
+   if (handle->spectate_written - spectator->input_ptr > SPECTATE_BUFFER_SIZE)
+   {
+      RARCH_WARN("Spectator fell %llu bytes behind.\n",
+            (unsigned long long)(handle->spectate_written - spectator->input_ptr));
+      return false;
+   }
 
-   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
+   while (spectator->header)
    {
-      if (handle->spectate_fds[i] == -1)
-         continue;
+      ssize_t ret = send(spectator->fd, CONST_CAST spectator->header + spectator->header_ptr,
+            spectator->header_size - spectator->header_ptr, 0);
+      if (ret <= 0)
+         return ret < 0 && socket_would_block();
 
-      if (!send_all(handle->spectate_fds[i],
-               handle->spectate_input, handle->spectate_input_ptr * sizeof(int16_t)))
+      spectator->header_ptr += ret;
+      if (spectator->header_ptr == spectator->header_size)
       {
-         RARCH_LOG("Client (#%u) disconnected ...\n", i);
+         free(spectator->header);
+         spectator->header = NULL;
+      }
+   }
 
-         char msg[512];
-         snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", i);
-         msg_queue_push(g_extern.msg_queue, msg, 1, 180);
+   while (spectator->input_ptr < handle->spectate_written)
+   {
+      size_t ptr = spectator->input_ptr & (SPECTATE_BUFFER_SIZE - 1);
+      size_t size = handle->spectate_written - spectator->input_ptr;
+      if (size > SPECTATE_BUFFER_SIZE - ptr)
+         size = SPECTATE_BUFFER_SIZE - ptr;
 
-         close(handle->spectate_fds[i]);
-         handle->spectate_fds[i] = -1;
-         break;
-      }
+      ssize_t ret = send(spectator->fd, CONST_CAST handle->spectate_buffer + ptr, size, 0);
+      if (ret <= 0)
+         return ret < 0 && socket_would_block();
+
+      spectator->input_ptr += ret;
    }
 
-   handle->spectate_input_ptr = 0;
+   return true;
+}
+
+static void netplay_post_frame_spectate(netplay_t *handle)
+{
+   if (handle->spectate_client)
+      return;
+
+   handle->frame_count++;
+
+   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
+   {
+      if (handle->spectators[i].joined && !flush_spectator(handle, &handle->spectators[i]))
+         drop_spectator(handle, i);
+   }
 }
 
 // Here we check if we have new input and replay from recorded input.
@@ -53,6 +53,10 @@ void netplay_free(netplay_t *handle);
 // On regular netplay, flip who controls player 1 and 2.
 void netplay_flip_players(netplay_t *handle);
 
+// True while frames are run again to catch up with the other side's input.
+// Their audio and video are thrown away.
+bool netplay_should_skip(netplay_t *handle);
+
 // Call this before running retro_run()
 void netplay_pre_frame(netplay_t *handle);
 // Call this after running retro_run()
@@ -49,6 +49,11 @@
 #else
 #include <signal.h>
 #endif
+
+#if !defined(__CELLOS_LV2__) && !defined(HAVE_SOCKET_LEGACY)
+#include <poll.h>
+#define NETPLAY_HAVE_POLL
+#endif
 #endif
 
 #ifdef _XBOX
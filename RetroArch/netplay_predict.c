@@ -0,0 +1,159 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netplay_predict.h"
+#include <string.h>
+
+void netplay_input_model_init(struct netplay_input_model *model)
+{
+   memset(model, 0, sizeof(*model));
+}
+
+// Older presses are forgotten gradually, so the model follows the player as the game changes.
+#define PRESS_HISTORY 64
+
+// What the idle predictor takes presses for, until it knows better.
+#define TAP_FRAMES 4
+
+static void add_press(struct netplay_input_model *model, unsigned button, uint32_t length)
+{
+   uint16_t *lengths = model->press_lengths[button];
+   if (model->presses[button] >= PRESS_HISTORY)
+   {
+      model->presses[button] = 0;
+      for (unsigned i = 0; i <= NETPLAY_PRESS_LENGTHS; i++)
+      {
+         lengths[i] >>= 1;
+         model->presses[button] += lengths[i];
+      }
+   }
+
+   lengths[length > NETPLAY_PRESS_LENGTHS ? NETPLAY_PRESS_LENGTHS : length - 1]++;
+   model->presses[button]++;
+}
+
+void netplay_input_model_update(struct netplay_input_model *model, uint16_t input)
+{
+   for (unsigned i = 0; i < NETPLAY_PREDICT_BUTTONS; i++)
+   {
+      bool pressed = input & (1 << i);
+      bool was_pressed = model->last & (1 << i);
+
+      if (model->frames && pressed == was_pressed)
+      {
+         model->age[i]++;
+         continue;
+      }
+
+      if (model->frames && was_pressed)
+         add_press(model, i, model->age[i]);
+      model->age[i] = 1;
+   }
+
+   model->last = input;
+   model->frames++;
+}
+
+// When a held button is predicted to be released at the wrong time, we roll back twice:
+// once when it turns out to still be held, and again when it is really released.
+// Predicting "held" only costs the one rollback for the release itself.
+// So releasing after length frames is only worth it if presses of exactly that length
+// are more common than longer ones. Returns the press length, at least as long as the press so far,
+// where that pays off the most, or 0 if it never does and the button should stay held.
+// prior_weight presses of prior_length are added to what has been seen.
+// With lean_released, a release that is as likely to be right as wrong is predicted as well.
+static unsigned release_length(const struct netplay_input_model *model, unsigned button,
+      unsigned prior_length, unsigned prior_weight, bool lean_released)
+{
+   uint32_t age = model->age[button];
+   if (!age || age > NETPLAY_PRESS_LENGTHS)
+      return 0;
+
+   const uint16_t *lengths = model->press_lengths[button];
+   int longer = lengths[NETPLAY_PRESS_LENGTHS];
+   int best_score = lean_released ? -1 : 0;
+   unsigned best = 0;
+
+   for (unsigned length = NETPLAY_PRESS_LENGTHS; length >= age; length--)
+   {
+      int count = lengths[length - 1] + (length == prior_length ? prior_weight : 0);
+      int score = count - longer;
+      if (score > best_score)
+      {
+         best_score = score;
+         best = length;
+      }
+      longer += count;
+   }
+
+   return best;
+}
+
+static uint16_t predict_releases(const struct netplay_input_model *model, unsigned frames_ahead,
+      unsigned prior_length, unsigned prior_weight, bool lean_released)
+{
+   uint16_t input = model->last;
+   for (unsigned i = 0; i < NETPLAY_PREDICT_BUTTONS; i++)
+   {
+      if (!(input & (1 << i)))
+         continue;
+
+      unsigned length = release_length(model, i, prior_length, prior_weight, lean_released);
+      if (length && model->age[i] + frames_ahead > length)
+         input &= ~(1 << i);
+   }
+   return input;
+}
+
+// Whatever they did last, they keep doing.
+static uint16_t predict_last(const struct netplay_input_model *model, unsigned frames_ahead)
+{
+   (void)frames_ahead;
+   return model->last;
+}
+
+// Presses end when that button's presses usually end, if they do so consistently enough to be worth betting on.
+static uint16_t predict_hold(const struct netplay_input_model *model, unsigned frames_ahead)
+{
+   return predict_releases(model, frames_ahead, 0, 0, false);
+}
+
+// Like hold, but leans towards buttons going back to released. Until a button has shown otherwise,
+// its presses are taken for taps of TAP_FRAMES, and when releasing is as good a bet as holding, we release.
+static uint16_t predict_idle(const struct netplay_input_model *model, unsigned frames_ahead)
+{
+   return predict_releases(model, frames_ahead, TAP_FRAMES, 2, true);
+}
+
+static const netplay_predictor_t predictors[] = {
+   { "last", predict_last },
+   { "hold", predict_hold },
+   { "idle", predict_idle },
+};
+
+const netplay_predictor_t *netplay_predictor_find(const char *ident)
+{
+   for (unsigned i = 0; i < sizeof(predictors) / sizeof(predictors[0]); i++)
+      if (!strcmp(predictors[i].ident, ident))
+         return &predictors[i];
+   return NULL;
+}
+
+const netplay_predictor_t *netplay_predictor_get(unsigned index)
+{
+   if (index >= sizeof(predictors) / sizeof(predictors[0]))
+      return NULL;
+   return &predictors[index];
+}
@@ -0,0 +1,58 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_PREDICT_H
+#define __RARCH_NETPLAY_PREDICT_H
+
+#include <stdint.h>
+#include "boolean.h"
+
+#define NETPLAY_PREDICT_BUTTONS 16
+
+// Press lengths are counted separately up to this many frames. Longer presses all count as one.
+#define NETPLAY_PRESS_LENGTHS 32
+
+// What we have learned about the other player's input so far.
+// Fed with their confirmed input, one frame at a time, in order.
+struct netplay_input_model
+{
+   uint16_t last; // Last confirmed input.
+   uint32_t frames;
+   uint32_t age[NETPLAY_PREDICT_BUTTONS]; // Frames the button has been in its current state, including last.
+
+   // How often presses of each length in frames (index + 1) have been seen lately.
+   // The last entry counts all longer presses.
+   uint16_t press_lengths[NETPLAY_PREDICT_BUTTONS][NETPLAY_PRESS_LENGTHS + 1];
+   uint16_t presses[NETPLAY_PREDICT_BUTTONS];
+};
+
+typedef struct netplay_predictor
+{
+   const char *ident;
+   // Guesses the input frames_ahead frames after the last confirmed one. 1 is the very next frame.
+   uint16_t (*predict)(const struct netplay_input_model *model, unsigned frames_ahead);
+} netplay_predictor_t;
+
+void netplay_input_model_init(struct netplay_input_model *model);
+void netplay_input_model_update(struct netplay_input_model *model, uint16_t input);
+
+// Returns NULL if there is no predictor by that name.
+const netplay_predictor_t *netplay_predictor_find(const char *ident);
+
+// Returns NULL past the last predictor.
+const netplay_predictor_t *netplay_predictor_get(unsigned index);
+
+#endif
+
@@ -25,6 +25,10 @@
 #include <unistd.h>
 #endif
 
+#if defined(_WIN32) && !defined(_XBOX)
+#include <windows.h>
+#endif
+
 #if defined(__CELLOS_LV2__) || defined(GEKKO)
 #ifndef _PPU_INTRINSICS_H
 #include <ppu_intrinsics.h>
@@ -159,6 +163,7 @@ rarch_time_t rarch_get_time_usec(void)
 #endif
 
 #ifdef CPU_X86
+// Sub-leaf is always 0. Leaf 7 needs it, other leaves ignore it.
 static void x86_cpuid(int func, int flags[4])
 {
    // On Android, we compile RetroArch with PIC, and we are not allowed to clobber the ebx
@@ -177,14 +182,30 @@ static void x86_cpuid(int func, int flags[4])
          "cpuid\n"
          "xchg %%" REG_b ", %%" REG_S "\n"
          : "=a"(flags[0]), "=S"(flags[1]), "=c"(flags[2]), "=d"(flags[3])
-         : "a"(func));
+         : "a"(func), "c"(0));
 #elif defined(_MSC_VER)
-   __cpuid(flags, func);
+   __cpuidex(flags, func, 0);
 #else
    RARCH_WARN("Unknown compiler. Cannot check CPUID with inline assembly.\n");
    memset(flags, 0, 4 * sizeof(int));
 #endif
 }
+
+// Checks if the OS saves YMM registers on context switch.
+// Only valid to call if OSXSAVE is set in CPUID.
+static uint64_t x86_xgetbv(void)
+{
+#if defined(__GNUC__)
+   uint32_t eax, edx;
+   // xgetbv, spelled out for old assemblers.
+   asm volatile (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+   return ((uint64_t)edx << 32) | eax;
+#elif defined(_MSC_VER)
+   return _xgetbv(0);
+#else
+   return 0;
+#endif
+}
 #endif
 
 void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
@@ -200,7 +221,8 @@ void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
    memcpy(vendor, vendor_shuffle, sizeof(vendor_shuffle));
    RARCH_LOG("[CPUID]: Vendor: %s\n", vendor);
 
-   if (flags[0] < 1) // Does CPUID not support func = 1? (unlikely ...)
+   int max_flag = flags[0];
+   if (max_flag < 1) // Does CPUID not support func = 1? (unlikely ...)
       return;
 
    x86_cpuid(1, flags);
@@ -211,13 +233,29 @@ void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
    if (flags[3] & (1 << 26))
       cpu->simd |= RARCH_SIMD_SSE2;
 
+   // AVX, AVX2 and FMA3 use YMM registers, so also make sure the OS preserves them.
+   // OSXSAVE (bit 27) has to be set before xgetbv can be used at all.
    const int avx_flags = (1 << 27) | (1 << 28);
-   if ((flags[2] & avx_flags) == avx_flags)
+   bool ymm_enabled = (flags[2] & avx_flags) == avx_flags && (x86_xgetbv() & 0x6) == 0x6;
+
+   if (ymm_enabled)
       cpu->simd |= RARCH_SIMD_AVX;
 
+   if (ymm_enabled && (flags[2] & (1 << 12)))
+      cpu->simd |= RARCH_SIMD_FMA3;
+
+   if (ymm_enabled && max_flag >= 7)
+   {
+      x86_cpuid(7, flags);
+      if (flags[1] & (1 << 5))
+         cpu->simd |= RARCH_SIMD_AVX2;
+   }
+
    RARCH_LOG("[CPUID]: SSE:  %u\n", !!(cpu->simd & RARCH_SIMD_SSE));
    RARCH_LOG("[CPUID]: SSE2: %u\n", !!(cpu->simd & RARCH_SIMD_SSE2));
    RARCH_LOG("[CPUID]: AVX:  %u\n", !!(cpu->simd & RARCH_SIMD_AVX));
+   RARCH_LOG("[CPUID]: AVX2: %u\n", !!(cpu->simd & RARCH_SIMD_AVX2));
+   RARCH_LOG("[CPUID]: FMA3: %u\n", !!(cpu->simd & RARCH_SIMD_FMA3));
 #elif defined(ANDROID) && defined(ANDROID_ARM)
    uint64_t cpu_flags = android_getCpuFeatures();
 
@@ -225,7 +263,8 @@ void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
       cpu->simd |= RARCH_SIMD_NEON;
 
    RARCH_LOG("[CPUID]: NEON: %u\n", !!(cpu->simd & RARCH_SIMD_NEON));
-#elif defined(__BLACKBERRY_QNX__)
+#elif defined(__BLACKBERRY_QNX__) || defined(__ARM_NEON__)
+   // The compiler was told NEON is there (iOS, Linux ARM with -mfpu=neon), so the CPU has to have it.
    cpu->simd |= RARCH_SIMD_NEON;
    RARCH_LOG("[CPUID]: NEON: %u\n", !!(cpu->simd & RARCH_SIMD_NEON));
 #elif defined(__CELLOS_LV2__)
@@ -236,3 +275,19 @@ void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
    RARCH_LOG("[CPUID]: VMX128: %u\n", !!(cpu->simd & RARCH_SIMD_VMX128));
 #endif
 }
+
+unsigned rarch_get_cpu_cores(void)
+{
+#if defined(_WIN32) && !defined(_XBOX)
+   SYSTEM_INFO sysinfo;
+   GetSystemInfo(&sysinfo);
+   return sysinfo.dwNumberOfProcessors;
+#elif defined(ANDROID)
+   return android_getCpuCount();
+#elif defined(_SC_NPROCESSORS_ONLN)
+   long ret = sysconf(_SC_NPROCESSORS_ONLN);
+   return ret > 0 ? (unsigned)ret : 1;
+#else
+   return 1;
+#endif
+}
@@ -57,9 +57,14 @@ struct rarch_cpu_features
 #define RARCH_SIMD_VMX128   (1 << 3)
 #define RARCH_SIMD_AVX      (1 << 4)
 #define RARCH_SIMD_NEON     (1 << 5)
+#define RARCH_SIMD_AVX2     (1 << 6)
+#define RARCH_SIMD_FMA3     (1 << 7)
 
 void rarch_get_cpu_features(struct rarch_cpu_features *cpu);
 
+// Number of logical cores online. Always at least 1.
+unsigned rarch_get_cpu_cores(void);
+
 #ifdef PERF_TEST
 
 #define RARCH_PERFORMANCE_INIT(X)  static rarch_perf_counter_t X = {#X}; \
@@ -36,13 +36,14 @@ extern "C" {
 #include <stdio.h>
 #include <stdlib.h>
 #include "../boolean.h"
-#include "../fifo_buffer.h"
+#include "../spsc_buffer.h"
 #include "../thread.h"
 #include "../general.h"
 #include "../gfx/scaler/scaler.h"
 #include "../conf/config_file.h"
 #include "../audio/utils.h"
 #include "../audio/resampler.h"
+#include "../performance.h"
 #include "ffemu.h"
 #include <assert.h>
 
@@ -159,12 +160,13 @@ struct ffemu
    
    struct ffemu_params params;
 
+   // The FIFOs are filled by the main thread and drained by the encoder thread.
+   // cond and cond_lock are only used to sleep when there's nothing to do.
    scond_t *cond;
    slock_t *cond_lock;
-   slock_t *lock;
-   fifo_buffer_t *audio_fifo;
-   fifo_buffer_t *video_fifo;
-   fifo_buffer_t *attr_fifo;
+   spsc_buffer_t *audio_fifo;
+   spsc_buffer_t *video_fifo;
+   spsc_buffer_t *attr_fifo;
    sthread_t *thread;
 
    volatile bool alive;
@@ -283,6 +285,7 @@ static bool ffemu_init_audio(ffemu_t *handle)
       rarch_resampler_realloc(&audio->resampler_data,
             &audio->resampler,
             *g_settings.audio.resampler ? g_settings.audio.resampler : NULL,
+            (enum resampler_quality)g_settings.audio.resampler_quality,
             audio->ratio);
    }
    else
@@ -556,19 +559,18 @@ static void ffemu_thread(void *data);
 
 static bool init_thread(ffemu_t *handle)
 {
-   handle->lock = slock_new();
    handle->cond_lock = slock_new();
    handle->cond = scond_new();
-   handle->audio_fifo = fifo_new(32000 * sizeof(int16_t) * handle->params.channels * MAX_FRAMES / 60); // Some arbitrary max size.
-   handle->attr_fifo = fifo_new(sizeof(struct ffemu_video_data) * MAX_FRAMES);
-   handle->video_fifo = fifo_new(handle->params.fb_width * handle->params.fb_height *
+   handle->audio_fifo = spsc_new(32000 * sizeof(int16_t) * handle->params.channels * MAX_FRAMES / 60); // Some arbitrary max size.
+   handle->attr_fifo = spsc_new(sizeof(struct ffemu_video_data) * MAX_FRAMES);
+   handle->video_fifo = spsc_new(handle->params.fb_width * handle->params.fb_height *
             handle->video.pix_size * MAX_FRAMES);
 
    handle->alive = true;
    handle->can_sleep = true;
    handle->thread = sthread_create(ffemu_thread, handle);
 
-   assert(handle->lock && handle->cond_lock &&
+   assert(handle->cond_lock &&
       handle->cond && handle->audio_fifo &&
       handle->attr_fifo && handle->video_fifo && handle->thread);
 
@@ -588,7 +590,6 @@ static void deinit_thread(ffemu_t *handle)
    scond_signal(handle->cond);
    sthread_join(handle->thread);
 
-   slock_free(handle->lock);
    slock_free(handle->cond_lock);
    scond_free(handle->cond);
 
@@ -599,19 +600,19 @@ static void deinit_thread_buf(ffemu_t *handle)
 {
    if (handle->audio_fifo)
    {
-      fifo_free(handle->audio_fifo);
+      spsc_free(handle->audio_fifo);
       handle->audio_fifo = NULL;
    }
    
    if (handle->attr_fifo)
    {
-      fifo_free(handle->attr_fifo);
+      spsc_free(handle->attr_fifo);
       handle->attr_fifo = NULL;
    }
 
    if (handle->video_fifo)
    {
-      fifo_free(handle->video_fifo);
+      spsc_free(handle->video_fifo);
       handle->video_fifo = NULL;
    }
 }
@@ -709,9 +710,7 @@ bool ffemu_push_video(ffemu_t *handle, const struct ffemu_video_data *data)
 
    for (;;)
    {
-      slock_lock(handle->lock);
-      unsigned avail = fifo_write_avail(handle->attr_fifo);
-      slock_unlock(handle->lock);
+      unsigned avail = spsc_write_avail(handle->attr_fifo);
 
       if (!handle->alive)
          return false;
@@ -732,8 +731,6 @@ bool ffemu_push_video(ffemu_t *handle, const struct ffemu_video_data *data)
       slock_unlock(handle->cond_lock);
    }
 
-   slock_lock(handle->lock);
-
    // Tightly pack our frame to conserve memory. libretro tends to use a very large pitch.
    struct ffemu_video_data attr_data = *data;
 
@@ -742,13 +739,12 @@ bool ffemu_push_video(ffemu_t *handle, const struct ffemu_video_data *data)
    else
       attr_data.pitch = attr_data.width * handle->video.pix_size;
 
-   fifo_write(handle->attr_fifo, &attr_data, sizeof(attr_data));
-
+   // The frame goes in before its attributes, so the encoder thread never sees attributes without the frame.
    int offset = 0;
    for (unsigned y = 0; y < attr_data.height; y++, offset += data->pitch)
-      fifo_write(handle->video_fifo, (const uint8_t*)data->data + offset, attr_data.pitch);
+      spsc_write(handle->video_fifo, (const uint8_t*)data->data + offset, attr_data.pitch);
 
-   slock_unlock(handle->lock);
+   spsc_write(handle->attr_fifo, &attr_data, sizeof(attr_data));
    scond_signal(handle->cond);
 
    return true;
@@ -758,9 +754,7 @@ bool ffemu_push_audio(ffemu_t *handle, const struct ffemu_audio_data *data)
 {
    for (;;)
    {
-      slock_lock(handle->lock);
-      unsigned avail = fifo_write_avail(handle->audio_fifo);
-      slock_unlock(handle->lock);
+      unsigned avail = spsc_write_avail(handle->audio_fifo);
 
       if (!handle->alive)
          return false;
@@ -781,9 +775,7 @@ bool ffemu_push_audio(ffemu_t *handle, const struct ffemu_audio_data *data)
       slock_unlock(handle->cond_lock);
    }
 
-   slock_lock(handle->lock);
-   fifo_write(handle->audio_fifo, data->data, data->frames * handle->params.channels * sizeof(int16_t));
-   slock_unlock(handle->lock);
+   spsc_write(handle->audio_fifo, data->data, data->frames * handle->params.channels * sizeof(int16_t));
    scond_signal(handle->cond);
 
    return true;
@@ -846,12 +838,16 @@ static void ffemu_scale_input(ffemu_t *handle, const struct ffemu_video_data *da
          handle->video.scaler.in_height = data->height;
          handle->video.scaler.in_stride = data->pitch;
 
-         handle->video.scaler.scaler_type = shrunk ? SCALER_TYPE_BILINEAR : SCALER_TYPE_POINT;
+         handle->video.scaler.scaler_type = shrunk ? SCALER_TYPE_AREA : SCALER_TYPE_POINT;
 
          handle->video.scaler.out_width  = handle->params.out_width;
          handle->video.scaler.out_height = handle->params.out_height;
          handle->video.scaler.out_stride = handle->video.conv_frame->linesize[0];
 
+         // Emulation keeps running alongside us, so leave it a core.
+         unsigned cores = rarch_get_cpu_cores();
+         handle->video.scaler.threads = cores > 1 ? cores - 1 : 1;
+
          scaler_ctx_gen_filter(&handle->video.scaler);
       }
 
@@ -1086,10 +1082,10 @@ static bool ffemu_push_audio_thread(ffemu_t *handle, struct ffemu_audio_data *da
 
 static void ffemu_flush_audio(ffemu_t *handle, void *audio_buf, size_t audio_buf_size)
 {
-   size_t avail = fifo_read_avail(handle->audio_fifo);
+   size_t avail = spsc_read_avail(handle->audio_fifo);
    if (avail)
    {
-      fifo_read(handle->audio_fifo, audio_buf, avail);
+      spsc_read(handle->audio_fifo, audio_buf, avail);
 
       struct ffemu_audio_data aud = {0};
       aud.frames = avail / (sizeof(int16_t) * handle->params.channels);
@@ -1130,9 +1126,9 @@ static void ffemu_flush_buffers(ffemu_t *handle)
    {
       did_work = false;
 
-      if (fifo_read_avail(handle->audio_fifo) >= audio_buf_size)
+      if (spsc_read_avail(handle->audio_fifo) >= audio_buf_size)
       {
-         fifo_read(handle->audio_fifo, audio_buf, audio_buf_size);
+         spsc_read(handle->audio_fifo, audio_buf, audio_buf_size);
 
          struct ffemu_audio_data aud = {0};
          aud.frames = handle->audio.codec->frame_size;
@@ -1143,10 +1139,10 @@ static void ffemu_flush_buffers(ffemu_t *handle)
       }
 
       struct ffemu_video_data attr_buf;
-      if (fifo_read_avail(handle->attr_fifo) >= sizeof(attr_buf))
+      if (spsc_read_avail(handle->attr_fifo) >= sizeof(attr_buf))
       {
-         fifo_read(handle->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(handle->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
+         spsc_read(handle->attr_fifo, &attr_buf, sizeof(attr_buf));
+         spsc_read(handle->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
          attr_buf.data = video_buf;
          ffemu_push_video_thread(handle, &attr_buf);
 
@@ -1197,13 +1193,11 @@ static void ffemu_thread(void *data)
       bool avail_video = false;
       bool avail_audio = false;
 
-      slock_lock(ff->lock);
-      if (fifo_read_avail(ff->attr_fifo) >= sizeof(attr_buf))
+      if (spsc_read_avail(ff->attr_fifo) >= sizeof(attr_buf))
          avail_video = true;
 
-      if (fifo_read_avail(ff->audio_fifo) >= audio_buf_size)
+      if (spsc_read_avail(ff->audio_fifo) >= audio_buf_size)
          avail_audio = true;
-      slock_unlock(ff->lock);
 
       if (!avail_video && !avail_audio)
       {
@@ -1222,10 +1216,8 @@ static void ffemu_thread(void *data)
 
       if (avail_video)
       {
-         slock_lock(ff->lock);
-         fifo_read(ff->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(ff->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
-         slock_unlock(ff->lock);
+         spsc_read(ff->attr_fifo, &attr_buf, sizeof(attr_buf));
+         spsc_read(ff->video_fifo, video_buf, attr_buf.height * attr_buf.pitch);
          scond_signal(ff->cond);
 
          attr_buf.data = video_buf;
@@ -1234,9 +1226,7 @@ static void ffemu_thread(void *data)
 
       if (avail_audio)
       {
-         slock_lock(ff->lock);
-         fifo_read(ff->audio_fifo, audio_buf, audio_buf_size);
-         slock_unlock(ff->lock);
+         spsc_read(ff->audio_fifo, audio_buf, audio_buf_size);
          scond_signal(ff->cond);
 
          struct ffemu_audio_data aud = {0};
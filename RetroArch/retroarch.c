@@ -26,6 +26,7 @@
 #include "dynamic.h"
 #include "performance.h"
 #include "audio/utils.h"
+#include "audio/flush.h"
 #include "record/ffemu.h"
 #include "rewind.h"
 #include "movie.h"
@@ -74,6 +75,16 @@ static void check_fast_forward_button(void)
 }
 
 #if defined(HAVE_SCREENSHOTS) && !defined(_XBOX)
+// Encoding happens on a background thread if we have threads, so deflate doesn't cause a hitch.
+static bool dump_screenshot(const void *frame, unsigned width, unsigned height, int pitch, bool bgr24)
+{
+#ifdef HAVE_THREADS
+   return screenshot_dump_async(g_settings.screenshot_directory, frame, width, height, pitch, bgr24);
+#else
+   return screenshot_dump(g_settings.screenshot_directory, frame, width, height, pitch, bgr24);
+#endif
+}
+
 static bool take_screenshot_viewport(void)
 {
    struct rarch_viewport vp = {0};
@@ -93,9 +104,7 @@ static bool take_screenshot_viewport(void)
    }
 
    // Data read from viewport is in bottom-up order, suitable for BMP.
-   if (!screenshot_dump(g_settings.screenshot_directory,
-         buffer,
-         vp.width, vp.height, vp.width * 3, true))
+   if (!dump_screenshot(buffer, vp.width, vp.height, vp.width * 3, true))
    {
       free(buffer);
       return false;
@@ -107,15 +116,19 @@ static bool take_screenshot_viewport(void)
 
 static bool take_screenshot_raw(void)
 {
+   // Frame might be in memory that is slow to read from, e.g. a write-combined PBO mapping.
+   driver_detach_frame_cache();
+
    const void *data = g_extern.frame_cache.data;
    unsigned width   = g_extern.frame_cache.width;
    unsigned height  = g_extern.frame_cache.height;
    int pitch        = g_extern.frame_cache.pitch;
+   if (!data)
+      return false;
 
    // Negative pitch is needed as screenshot takes bottom-up,
    // but we use top-down.
-   return screenshot_dump(g_settings.screenshot_directory,
-         (const uint8_t*)data + (height - 1) * pitch, 
+   return dump_screenshot((const uint8_t*)data + (height - 1) * pitch, 
          width, height, -pitch, false);
 }
 
@@ -163,27 +176,6 @@ static void take_screenshot(void)
 }
 #endif
 
-static void readjust_audio_input_rate(void)
-{
-   int avail = audio_write_avail_func();
-   //RARCH_LOG_OUTPUT("Audio buffer is %u%% full\n",
-   //      (unsigned)(100 - (avail * 100) / g_extern.audio_data.driver_buffer_size));
-
-   unsigned write_index = g_extern.measure_data.buffer_free_samples_count++ & (AUDIO_BUFFER_FREE_SAMPLES_COUNT - 1);
-   g_extern.measure_data.buffer_free_samples[write_index] = avail;
-
-   int half_size = g_extern.audio_data.driver_buffer_size / 2;
-   int delta_mid = avail - half_size;
-   double direction = (double)delta_mid / half_size;
-
-   double adjust = 1.0 + g_settings.audio.rate_control_delta * direction;
-
-   g_extern.audio_data.src_ratio = g_extern.audio_data.orig_src_ratio * adjust;
-
-   //RARCH_LOG_OUTPUT("New rate: %lf, Orig rate: %lf\n",
-   //      g_extern.audio_data.src_ratio, g_extern.audio_data.orig_src_ratio);
-}
-
 #ifdef HAVE_FFMPEG
 static void deinit_recording(void);
 
@@ -244,6 +236,23 @@ static void recording_dump_frame(const void *data, unsigned width, unsigned heig
 }
 #endif
 
+static void video_frame_conv_0rgb1555(const void **data, unsigned width, unsigned height, size_t *pitch)
+{
+   RARCH_PERFORMANCE_INIT(video_frame_conv);
+   RARCH_PERFORMANCE_START(video_frame_conv);
+   driver.scaler.in_width = width;
+   driver.scaler.in_height = height;
+   driver.scaler.out_width = width;
+   driver.scaler.out_height = height;
+   driver.scaler.in_stride = *pitch;
+   driver.scaler.out_stride = width * sizeof(uint16_t);
+
+   scaler_ctx_scale(&driver.scaler, driver.scaler_out, *data);
+   *data = driver.scaler_out;
+   *pitch = driver.scaler.out_stride;
+   RARCH_PERFORMANCE_STOP(video_frame_conv);
+}
+
 static void video_frame(const void *data, unsigned width, unsigned height, size_t pitch)
 {
    if (!g_extern.video_active)
@@ -253,29 +262,26 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
    g_extern.frame_cache.width  = width;
    g_extern.frame_cache.height = height;
    g_extern.frame_cache.pitch  = pitch;
+   g_extern.frame_cache.from_driver = data && data == driver.software_framebuffer;
 
-   if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && data && data != RETRO_HW_FRAME_BUFFER_VALID)
-   {
-      RARCH_PERFORMANCE_INIT(video_frame_conv);
-      RARCH_PERFORMANCE_START(video_frame_conv);
-      driver.scaler.in_width = width;
-      driver.scaler.in_height = height;
-      driver.scaler.out_width = width;
-      driver.scaler.out_height = height;
-      driver.scaler.in_stride = pitch;
-      driver.scaler.out_stride = width * sizeof(uint16_t);
+   bool conv = g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_0RGB1555 && data && data != RETRO_HW_FRAME_BUFFER_VALID;
 
-      scaler_ctx_scale(&driver.scaler, driver.scaler_out, data);
-      data = driver.scaler_out;
-      pitch = driver.scaler.out_stride;
-      RARCH_PERFORMANCE_STOP(video_frame_conv);
-   }
+   // Threaded video converts on the video thread, we only hand over the raw frame.
+   if (conv && !driver.scaler_threaded)
+      video_frame_conv_0rgb1555(&data, width, height, &pitch);
 
    // Slightly messy code,
    // but we really need to do processing before blocking on VSync for best possible scheduling.
 #ifdef HAVE_FFMPEG
    if (g_extern.recording && (!g_extern.filter.active || !g_settings.video.post_filter_record || !data || g_extern.record_gpu_buffer))
-      recording_dump_frame(data, width, height, pitch);
+   {
+      const void *record_data = data;
+      size_t record_pitch = pitch;
+      if (conv && driver.scaler_threaded)
+         video_frame_conv_0rgb1555(&record_data, width, height, &record_pitch);
+
+      recording_dump_frame(record_data, width, height, record_pitch);
+   }
 #endif
 
    const char *msg = msg_queue_pull(g_extern.msg_queue);
@@ -339,132 +345,6 @@ void rarch_render_cached_frame(void)
 #endif
 }
 
-static bool audio_flush(const int16_t *data, size_t samples)
-{
-#ifdef HAVE_FFMPEG
-   if (g_extern.recording)
-   {
-      struct ffemu_audio_data ffemu_data = {0};
-      ffemu_data.data                    = data;
-      ffemu_data.frames                  = samples / 2;
-
-      ffemu_push_audio(g_extern.rec, &ffemu_data);
-   }
-#endif
-
-   if (g_extern.is_paused || g_extern.audio_data.mute)
-      return true;
-   if (!g_extern.audio_active)
-      return false;
-
-   const float *output_data = NULL;
-   unsigned output_frames      = 0;
-
-   struct resampler_data src_data = {0};
-   RARCH_PERFORMANCE_INIT(audio_convert_s16);
-   RARCH_PERFORMANCE_START(audio_convert_s16);
-   audio_convert_s16_to_float(g_extern.audio_data.data, data, samples,
-         g_extern.audio_data.volume_gain);
-   RARCH_PERFORMANCE_STOP(audio_convert_s16);
-
-#if defined(HAVE_DYLIB)
-   rarch_dsp_output_t dsp_output = {0};
-   rarch_dsp_input_t dsp_input   = {0};
-   dsp_input.samples             = g_extern.audio_data.data;
-   dsp_input.frames              = samples >> 1;
-
-   if (g_extern.audio_data.dsp_plugin)
-      g_extern.audio_data.dsp_plugin->process(g_extern.audio_data.dsp_handle, &dsp_output, &dsp_input);
-
-   src_data.data_in      = dsp_output.samples ? dsp_output.samples : g_extern.audio_data.data;
-   src_data.input_frames = dsp_output.samples ? dsp_output.frames : (samples >> 1);
-#else
-   src_data.data_in      = g_extern.audio_data.data;
-   src_data.input_frames = samples >> 1;
-#endif
-
-   src_data.data_out = g_extern.audio_data.outsamples;
-
-   if (g_extern.audio_data.rate_control)
-      readjust_audio_input_rate();
-
-   src_data.ratio = g_extern.audio_data.src_ratio;
-   if (g_extern.is_slowmotion)
-      src_data.ratio *= g_settings.slowmotion_ratio;
-
-   RARCH_PERFORMANCE_INIT(resampler_proc);
-   RARCH_PERFORMANCE_START(resampler_proc);
-   rarch_resampler_process(g_extern.audio_data.resampler,
-         g_extern.audio_data.resampler_data, &src_data);
-   RARCH_PERFORMANCE_STOP(resampler_proc);
-
-   output_data   = g_extern.audio_data.outsamples;
-   output_frames = src_data.output_frames;
-
-   if (g_extern.audio_data.use_float)
-   {
-      if (audio_write_func(output_data, output_frames * sizeof(float) * 2) < 0)
-      {
-         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
-         return false;
-      }
-   }
-   else
-   {
-      RARCH_PERFORMANCE_INIT(audio_convert_float);
-      RARCH_PERFORMANCE_START(audio_convert_float);
-      audio_convert_float_to_s16(g_extern.audio_data.conv_outsamples,
-            output_data, output_frames * 2);
-      RARCH_PERFORMANCE_STOP(audio_convert_float);
-
-      if (audio_write_func(g_extern.audio_data.conv_outsamples, output_frames * sizeof(int16_t) * 2) < 0)
-      {
-         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
-         return false;
-      }
-   }
-
-   return true;
-}
-
-static void audio_sample_rewind(int16_t left, int16_t right)
-{
-   g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] = right;
-   g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] = left;
-}
-
-size_t audio_sample_batch_rewind(const int16_t *data, size_t frames)
-{
-   size_t samples = frames << 1;
-   for (size_t i = 0; i < samples; i++)
-      g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] = data[i];
-
-   return frames;
-}
-
-static void audio_sample(int16_t left, int16_t right)
-{
-   g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = left;
-   g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = right;
-
-   if (g_extern.audio_data.data_ptr < g_extern.audio_data.chunk_size)
-      return;
-
-   g_extern.audio_active = audio_flush(g_extern.audio_data.conv_outsamples,
-         g_extern.audio_data.data_ptr) && g_extern.audio_active;
-
-   g_extern.audio_data.data_ptr = 0;
-}
-
-size_t audio_sample_batch(const int16_t *data, size_t frames)
-{
-   if (frames > (AUDIO_CHUNK_SIZE_NONBLOCKING >> 1))
-      frames = AUDIO_CHUNK_SIZE_NONBLOCKING >> 1;
-
-   g_extern.audio_active = audio_flush(data, frames << 1) && g_extern.audio_active;
-   return frames;
-}
-
 #ifdef HAVE_OVERLAY
 static inline void input_poll_overlay(void)
 {
@@ -681,7 +561,7 @@ static void print_help(void)
    puts("\t-H/--host: Host netplay as player 1.");
    puts("\t-C/--connect: Connect to netplay as player 2.");
    puts("\t--port: Port used to netplay. Default is 55435.");
-   puts("\t-F/--frames: Sync frames when using netplay.");
+   puts("\t-F/--frames: Sync frames when using netplay. At most 64.");
    puts("\t--spectate: Netplay will become spectating mode.");
    puts("\t\tHost can live stream the game content to players that connect.");
    puts("\t\tHowever, the client will not be able to play. Multiple clients can connect to the host.");
@@ -1458,11 +1338,54 @@ void rarch_init_rewind(void)
    g_extern.state_manager = state_manager_new(aligned_state_size, g_settings.rewind_buffer_size, g_extern.state_buf);
 
    if (!g_extern.state_manager)
+   {
       RARCH_WARN("Failed to init rewind buffer. Rewinding will be disabled.\n");
+      return;
+   }
+
+   enum state_manager_codec codec = STATE_MANAGER_CODEC_NONE;
+   if (!strcmp(g_settings.rewind_compression, "rle"))
+      codec = STATE_MANAGER_CODEC_RLE;
+   else if (!strcmp(g_settings.rewind_compression, "deflate"))
+      codec = STATE_MANAGER_CODEC_DEFLATE;
+   else if (strcmp(g_settings.rewind_compression, "none"))
+      RARCH_WARN("Unknown rewind compression \"%s\".\n", g_settings.rewind_compression);
+
+   if (!state_manager_set_codec(g_extern.state_manager, codec))
+   {
+      RARCH_WARN("Rewind compression \"%s\" is not supported, falling back to RLE.\n", g_settings.rewind_compression);
+      state_manager_set_codec(g_extern.state_manager, STATE_MANAGER_CODEC_RLE);
+   }
+
+   if (g_settings.rewind_keyframe_interval &&
+         !state_manager_set_keyframe_interval(g_extern.state_manager, g_settings.rewind_keyframe_interval))
+      RARCH_WARN("Failed to allocate rewind keyframe buffer.\n");
+
+   if (g_settings.rewind_threaded && !state_manager_init_thread(g_extern.state_manager))
+      RARCH_WARN("Failed to start rewind thread. Rewind deltas will be generated on the main thread.\n");
+}
+
+void rarch_log_rewind_stats(void)
+{
+   if (!g_extern.state_manager)
+      return;
+
+   struct state_manager_stats stats;
+   state_manager_get_stats(g_extern.state_manager, &stats);
+
+   float fps = g_extern.system.av_info.timing.fps;
+   float seconds = fps > 0.0f ? stats.entries * (g_settings.rewind_granularity ? g_settings.rewind_granularity : 1) / fps : 0.0f;
+
+   RARCH_LOG("Rewind buffer holds %.1f seconds (%u states) in %u KiB of %u KiB, compression ratio %.2f.\n",
+         seconds, (unsigned)stats.entries,
+         (unsigned)(stats.stored_bytes >> 10), (unsigned)(stats.capacity >> 10),
+         stats.stored_bytes ? (double)stats.raw_bytes / stats.stored_bytes : 1.0);
 }
 
 void rarch_deinit_rewind(void)
 {
+   rarch_log_rewind_stats();
+
    if (g_extern.state_manager)
       state_manager_free(g_extern.state_manager);
    g_extern.state_manager = NULL;
@@ -2038,10 +1961,10 @@ static inline void setup_rewind_audio(void)
    for (unsigned i = 0; i < g_extern.audio_data.data_ptr; i += 2)
    {
       g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] =
-         g_extern.audio_data.conv_outsamples[i + 1];
+         g_extern.audio_data.sample_buf[i + 1];
 
       g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] =
-         g_extern.audio_data.conv_outsamples[i + 0];
+         g_extern.audio_data.sample_buf[i + 0];
    }
 
    g_extern.audio_data.data_ptr = 0;
@@ -2092,8 +2015,13 @@ static void check_rewind(void)
       if (cnt == 0)
 #endif
       {
-         pretro_serialize(g_extern.state_buf, g_extern.state_size);
-         state_manager_push(g_extern.state_manager, g_extern.state_buf);
+         // In threaded mode, we serialize straight into a buffer owned by the rewind thread.
+         void *buf = state_manager_capture_buffer(g_extern.state_manager);
+         if (!buf)
+            buf = g_extern.state_buf;
+
+         pretro_serialize(buf, g_extern.state_size);
+         state_manager_push(g_extern.state_manager, buf);
       }
    }
 
@@ -2543,6 +2471,12 @@ static void check_screenshot(void)
       take_screenshot();
 
    old_pressed = pressed;
+
+#ifdef HAVE_THREADS
+   // Nothing else will show the message while paused.
+   if (screenshot_async_poll() && g_extern.is_paused)
+      rarch_render_cached_frame();
+#endif
 }
 #endif
 
@@ -2768,6 +2702,7 @@ void rarch_main_clear_state(void)
    if (g_extern.log_file)
       fclose(g_extern.log_file);
 
+   free(g_extern.frame_cache.copy);
    memset(&g_extern, 0, sizeof(g_extern));
 
    init_state();
@@ -2862,6 +2797,7 @@ int rarch_main_init(int argc, char *argv[])
 
    validate_cpu_features();
    config_load();
+   scaler_filter_cache_init();
 
    init_libretro_sym(g_extern.libretro_dummy);
    rarch_init_system_info();
@@ -2956,6 +2892,7 @@ error:
    pretro_deinit();
    uninit_drivers();
    uninit_libretro_sym();
+   scaler_filter_cache_deinit();
 
    g_extern.main_is_init = false;
    return 1;
@@ -3074,6 +3011,10 @@ void rarch_main_deinit(void)
    deinit_recording();
 #endif
 
+#if defined(HAVE_SCREENSHOTS) && !defined(_XBOX) && defined(HAVE_THREADS)
+   screenshot_async_deinit();
+#endif
+
    if (g_extern.use_sram)
       save_files();
 
@@ -3095,6 +3036,7 @@ void rarch_main_deinit(void)
    pretro_deinit();
    uninit_drivers();
    uninit_libretro_sym();
+   scaler_filter_cache_deinit();
 
    if (g_extern.rom_file_temporary)
    {
@@ -21,48 +21,122 @@
 #include <limits.h>
 #include "general.h"
 
+#ifdef HAVE_ZLIB_DEFLATE
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
+// Every pushed delta is one contiguous block in the ring. Blocks are chained both ways,
+// so pop can walk back from the newest block and the allocator can evict from the oldest.
+// Every keyframe_interval pushes, the block also carries the full new state after the delta,
+// so seeking can start from there and patch forward instead of walking back delta by delta.
+// When deltas are no smaller than the state itself, blocks carry only the full state (see push_state()).
+struct rewind_block
+{
+   size_t prev;       // Offset of the previous (older) block.
+   size_t next;       // Offset of the next (newer) block.
+   uint64_t frame;    // Number of the state this block leads up to.
+   uint32_t size;     // Bytes taken up in the ring, including this header. Multiple of 8.
+   uint32_t raw_size; // Size of the uncompressed delta.
+   uint32_t comp_size;
+   uint32_t codec;
+   uint32_t key_size; // Compressed size of the keyframe, 0 if this block has none.
+   uint32_t key_codec;
+   uint32_t key_only; // Non-zero if there is no delta, so the previous state has to come from the previous block's keyframe.
+};
+
+// Maps frame numbers of keyframe blocks to their offset in the ring. Kept in frame order.
+struct keyframe_entry
+{
+   uint64_t frame;
+   size_t offset;
+};
+
 struct state_manager
 {
-   uint64_t *buffer;
-   size_t buf_size;
-   size_t buf_size_mask;
+   uint8_t *buffer;
+   size_t capacity;
+
+   size_t head;      // Offset of the newest block.
+   size_t tail;      // Offset of the oldest block.
+   size_t write_ptr; // Where the block after head would start.
+   size_t entries;
+
    uint32_t *tmp_state;
-   size_t top_ptr;
-   size_t bottom_ptr;
    size_t state_size;
-   bool first_pop;
-};
 
-static inline size_t nearest_pow2_size(size_t v)
-{
-   size_t orig = v;
-   v--;
-   v |= v >> 1;
-   v |= v >> 2;
-   v |= v >> 4;
-#if SIZE_MAX >= UINT16_C(0xffff)
-      v |= v >> 8;
-#endif
-#if SIZE_MAX >= UINT32_C(0xffffffff)
-      v |= v >> 16;
+   // Scratch for the raw delta of the state being pushed or popped, and its compressed form.
+   uint8_t *delta_buf;
+   uint8_t *comp_buf;
+   uint8_t *key_buf;
+   size_t delta_buf_size;
+
+   uint64_t frame_count;
+   unsigned min_entries; // Newest deltas which are never evicted, see state_manager_set_min_entries().
+   unsigned keyframe_interval;
+   unsigned keyframe_counter;
+
+   bool big_deltas;          // The last delta was not smaller than the state.
+   unsigned key_only_pushes; // Full states stored in a row without checking the delta, see push_state().
+   bool current_in_ring;     // tmp_state is out of date, the current state is the newest block's keyframe.
+
+   // Circular list of keyframe_entry, grown as needed.
+   struct keyframe_entry *keyframes;
+   size_t keyframes_size;
+   size_t keyframes_first;
+   size_t keyframes_count;
+
+   enum state_manager_codec codec;
+#ifdef HAVE_ZLIB_DEFLATE
+   z_stream deflate_stream;
+   z_stream inflate_stream;
+   bool deflate_inited;
+   bool inflate_inited;
 #endif
-#if SIZE_MAX >= UINT64_C(0xffffffffffffffff)
-      v |= v >> 32;
+
+   size_t raw_bytes;
+   size_t stored_bytes;
+   bool logged_full;
+
+   bool first_pop;
+
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;      // Signals the worker that a state is queued up, or that it should quit.
+   scond_t *done_cond; // Signals the main thread that a capture buffer was released.
+
+   uint32_t *capture_buf[2];
+   bool capture_free[2];
+   unsigned queue[2];
+   unsigned queue_len;
+   bool busy;
+   bool alive;
 #endif
-   v++;
+};
 
-   size_t next = v;
-   size_t prev = v >> 1;
+#define BLOCK_HEADER_SIZE ((sizeof(struct rewind_block) + 7) & ~(size_t)7)
 
-   if ((next - orig) < (orig - prev))
-      return next;
-   else
-      return prev;
+static inline struct rewind_block *block_at(const state_manager_t *state, size_t offset)
+{
+   return (struct rewind_block*)(state->buffer + offset);
 }
 
 state_manager_t *state_manager_new(size_t state_size, size_t buffer_size, void *init_buffer)
 {
-   if (buffer_size <= state_size * 4) // Need a sufficient buffer size.
+   // Need room for at least one delta with a keyframe.
+   if (buffer_size < BLOCK_HEADER_SIZE + 2 * state_size + 16)
       return NULL;
 
    state_manager_t *state = (state_manager_t*)calloc(1, sizeof(*state));
@@ -71,16 +145,18 @@ state_manager_t *state_manager_new(size_t state_size, size_t buffer_size, void *
 
    // We need 4-byte aligned state_size to avoid having to enforce this with unneeded memcpy's!
    rarch_assert(state_size % 4 == 0);
-   state->top_ptr = 1;
 
    state->state_size = state_size / sizeof(uint32_t); // Works in multiple of 4.
-   state->buf_size = nearest_pow2_size(buffer_size) / sizeof(uint64_t); // Works in multiple of 8.
-   state->buf_size_mask = state->buf_size - 1;
-   RARCH_LOG("Readjusted rewind buffer size to %u MiB\n", (unsigned)(sizeof(uint64_t) * (state->buf_size >> 20)));
+   state->capacity = buffer_size & ~(size_t)7;
+   state->codec = STATE_MANAGER_CODEC_NONE;
+
+   // Spans closer together than a span header are merged (see generate_delta()),
+   // so a delta is never more than one header bigger than the state itself.
+   state->delta_buf_size = state_size + 8;
 
-   if (!(state->buffer = (uint64_t*)calloc(1, state->buf_size * sizeof(uint64_t))))
+   if (!(state->buffer = (uint8_t*)malloc(state->capacity)))
       goto error;
-   if (!(state->tmp_state = (uint32_t*)calloc(1, state->state_size * sizeof(uint32_t))))
+   if (!(state->tmp_state = (uint32_t*)calloc(1, state_size)))
       goto error;
 
    memcpy(state->tmp_state, init_buffer, state_size);
@@ -88,106 +164,1059 @@ state_manager_t *state_manager_new(size_t state_size, size_t buffer_size, void *
    return state;
 
 error:
-   if (state)
-   {
-      free(state->buffer);
-      free(state->tmp_state);
-      free(state);
-   }
+   state_manager_free(state);
    return NULL;
 }
 
+#ifdef HAVE_THREADS
+static void deinit_thread(state_manager_t *state);
+#endif
+
 void state_manager_free(state_manager_t *state)
 {
+   if (!state)
+      return;
+
+#ifdef HAVE_THREADS
+   deinit_thread(state);
+#endif
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->deflate_inited)
+      deflateEnd(&state->deflate_stream);
+   if (state->inflate_inited)
+      inflateEnd(&state->inflate_stream);
+#endif
+
    free(state->buffer);
    free(state->tmp_state);
+   free(state->delta_buf);
+   free(state->comp_buf);
+   free(state->key_buf);
+   free(state->keyframes);
    free(state);
 }
 
+#ifdef HAVE_THREADS
+static void wait_idle(state_manager_t *state);
+#endif
+
+// Uncompressed deltas without keyframes are generated straight into the ring.
+// Anything else goes through these first.
+static bool alloc_scratch(state_manager_t *state)
+{
+   if (!state->delta_buf)
+      state->delta_buf = (uint8_t*)malloc(state->delta_buf_size);
+   if (!state->comp_buf)
+      state->comp_buf = (uint8_t*)malloc(state->delta_buf_size);
+   return state->delta_buf && state->comp_buf;
+}
+
+// Storing keyframes also needs somewhere to compress them to.
+static bool alloc_key_scratch(state_manager_t *state)
+{
+   if (!state->key_buf)
+      state->key_buf = (uint8_t*)malloc(state->delta_buf_size);
+   return alloc_scratch(state) && state->key_buf;
+}
+
+bool state_manager_set_codec(state_manager_t *state, enum state_manager_codec codec)
+{
+#ifdef HAVE_THREADS
+   wait_idle(state);
+#endif
+
+   if (codec != STATE_MANAGER_CODEC_NONE && !alloc_scratch(state))
+      return false;
+
+   switch (codec)
+   {
+      case STATE_MANAGER_CODEC_NONE:
+      case STATE_MANAGER_CODEC_RLE:
+         break;
+
+#ifdef HAVE_ZLIB_DEFLATE
+      case STATE_MANAGER_CODEC_DEFLATE:
+         if (!state->deflate_inited)
+         {
+            if (deflateInit(&state->deflate_stream, Z_BEST_SPEED) != Z_OK)
+               return false;
+            state->deflate_inited = true;
+         }
+         break;
+#endif
+
+      default:
+         return false;
+   }
+
+   state->codec = codec;
+   return true;
+}
+
+bool state_manager_set_keyframe_interval(state_manager_t *state, unsigned interval)
+{
+#ifdef HAVE_THREADS
+   wait_idle(state);
+#endif
+
+   if (interval && !alloc_key_scratch(state))
+      return false;
+
+   state->keyframe_interval = interval;
+   state->keyframe_counter = 0;
+   return true;
+}
+
+void state_manager_set_min_entries(state_manager_t *state, unsigned entries)
+{
+#ifdef HAVE_THREADS
+   wait_idle(state);
+#endif
+
+   state->min_entries = entries;
+}
+
+void state_manager_get_stats(state_manager_t *state, struct state_manager_stats *stats)
+{
+#ifdef HAVE_THREADS
+   wait_idle(state);
+#endif
+
+   stats->entries      = state->entries;
+   stats->raw_bytes    = state->raw_bytes;
+   stats->stored_bytes = state->stored_bytes;
+   stats->capacity     = state->capacity;
+}
+
+// Zero-run RLE. A token byte < 0x80 is followed by token + 1 literal bytes,
+// a token byte >= 0x80 expands to (token & 0x7f) + 1 zero bytes.
+// Returns 0 if the output would not fit in out_size.
+static size_t rle_compress(const uint8_t *in, size_t size, uint8_t *out, size_t out_size)
+{
+   size_t i = 0, o = 0;
+   while (i < size)
+   {
+      size_t run = 0;
+      while (i + run < size && run < 128 && !in[i + run])
+         run++;
+
+      if (run >= 2)
+      {
+         if (o + 1 > out_size)
+            return 0;
+         out[o++] = 0x80 | (run - 1);
+         i += run;
+         continue;
+      }
+
+      // Literal run until we see at least two zeros in a row.
+      size_t start = i;
+      while (i < size && i - start < 128 && !(!in[i] && i + 1 < size && !in[i + 1]))
+         i++;
+
+      size_t len = i - start;
+      if (o + 1 + len > out_size)
+         return 0;
+      out[o++] = len - 1;
+      memcpy(out + o, in + start, len);
+      o += len;
+   }
+
+   return o;
+}
+
+static bool rle_decompress(const uint8_t *in, size_t size, uint8_t *out, size_t out_size)
+{
+   size_t i = 0, o = 0;
+   while (i < size)
+   {
+      uint8_t token = in[i++];
+      size_t len = (token & 0x7f) + 1;
+      if (o + len > out_size)
+         return false;
+
+      if (token & 0x80)
+         memset(out + o, 0, len);
+      else
+      {
+         if (i + len > size)
+            return false;
+         memcpy(out + o, in + i, len);
+         i += len;
+      }
+      o += len;
+   }
+
+   return o == out_size;
+}
+
+#ifdef HAVE_ZLIB_DEFLATE
+static size_t deflate_compress(state_manager_t *state, const uint8_t *in, size_t size, uint8_t *out, size_t out_size)
+{
+   z_stream *stream = &state->deflate_stream;
+   deflateReset(stream);
+
+   stream->next_in   = (Bytef*)in;
+   stream->avail_in  = size;
+   stream->next_out  = out;
+   stream->avail_out = out_size;
+
+   if (deflate(stream, Z_FINISH) != Z_STREAM_END)
+      return 0;
+
+   return out_size - stream->avail_out;
+}
+
+static bool deflate_decompress(state_manager_t *state, const uint8_t *in, size_t size, uint8_t *out, size_t out_size)
+{
+   z_stream *stream = &state->inflate_stream;
+   if (!state->inflate_inited)
+   {
+      memset(stream, 0, sizeof(*stream));
+      if (inflateInit(stream) != Z_OK)
+         return false;
+      state->inflate_inited = true;
+   }
+   else
+      inflateReset(stream);
+
+   stream->next_in   = (Bytef*)in;
+   stream->avail_in  = size;
+   stream->next_out  = out;
+   stream->avail_out = out_size;
+
+   return inflate(stream, Z_FINISH) == Z_STREAM_END && stream->avail_out == 0;
+}
+#endif
+
+// Returns the compressed size, or 0 if the data did not get any smaller.
+static size_t compress_data(state_manager_t *state, enum state_manager_codec codec,
+      const uint8_t *in, size_t size, uint8_t *out)
+{
+   switch (codec)
+   {
+      case STATE_MANAGER_CODEC_RLE:
+         return rle_compress(in, size, out, size);
+
+#ifdef HAVE_ZLIB_DEFLATE
+      case STATE_MANAGER_CODEC_DEFLATE:
+         return deflate_compress(state, in, size, out, size);
+#endif
+
+      default:
+         return 0;
+   }
+}
+
+static bool decompress_data(state_manager_t *state, enum state_manager_codec codec,
+      const uint8_t *in, size_t size, uint8_t *out, size_t out_size)
+{
+   switch (codec)
+   {
+      case STATE_MANAGER_CODEC_NONE:
+         if (size != out_size)
+            return false;
+         memcpy(out, in, size);
+         return true;
+
+      case STATE_MANAGER_CODEC_RLE:
+         return rle_decompress(in, size, out, out_size);
+
+#ifdef HAVE_ZLIB_DEFLATE
+      case STATE_MANAGER_CODEC_DEFLATE:
+         return deflate_decompress(state, in, size, out, out_size);
+#endif
+
+      default:
+         return false;
+   }
+}
+
+static inline size_t block_raw_bytes(const state_manager_t *state, const struct rewind_block *block)
+{
+   return block->raw_size + (block->key_size ? state->state_size * sizeof(uint32_t) : 0);
+}
+
+static void keyframe_push(state_manager_t *state, uint64_t frame, size_t offset)
+{
+   if (state->keyframes_count == state->keyframes_size)
+   {
+      size_t new_size = state->keyframes_size ? state->keyframes_size * 2 : 16;
+      struct keyframe_entry *list = (struct keyframe_entry*)malloc(new_size * sizeof(*list));
+      if (!list)
+         return; // Seeking will just have to walk further.
+
+      for (size_t i = 0; i < state->keyframes_count; i++)
+         list[i] = state->keyframes[(state->keyframes_first + i) % state->keyframes_size];
+
+      free(state->keyframes);
+      state->keyframes = list;
+      state->keyframes_size = new_size;
+      state->keyframes_first = 0;
+   }
+
+   struct keyframe_entry *entry = &state->keyframes[(state->keyframes_first + state->keyframes_count) % state->keyframes_size];
+   entry->frame = frame;
+   entry->offset = offset;
+   state->keyframes_count++;
+}
+
+static inline const struct keyframe_entry *keyframe_get(const state_manager_t *state, size_t index)
+{
+   return &state->keyframes[(state->keyframes_first + index) % state->keyframes_size];
+}
+
+// Blocks are evicted oldest first and dropped newest first, so the keyframe list only changes at its ends.
+static void keyframe_remove(state_manager_t *state, const struct rewind_block *block)
+{
+   if (!block->key_size || !state->keyframes_count)
+      return;
+
+   if (keyframe_get(state, 0)->frame == block->frame)
+   {
+      state->keyframes_first = (state->keyframes_first + 1) % state->keyframes_size;
+      state->keyframes_count--;
+   }
+   else if (keyframe_get(state, state->keyframes_count - 1)->frame == block->frame)
+      state->keyframes_count--;
+}
+
+static void evict_oldest(state_manager_t *state)
+{
+   const struct rewind_block *block = block_at(state, state->tail);
+   keyframe_remove(state, block);
+   state->raw_bytes    -= block_raw_bytes(state, block);
+   state->stored_bytes -= block->size;
+   state->tail = block->next;
+   state->entries--;
+
+   if (!state->logged_full)
+   {
+      state->logged_full = true;
+      RARCH_LOG("Rewind buffer is full. Holding %u states, compression ratio %.2f.\n",
+            (unsigned)state->entries,
+            state->stored_bytes ? (double)state->raw_bytes / state->stored_bytes : 1.0);
+   }
+}
+
+// Any block can carry a keyframe, even without a keyframe interval (see push_state()).
+static inline size_t max_block_size(const state_manager_t *state)
+{
+   size_t state_size = state->state_size * sizeof(uint32_t);
+   return BLOCK_HEADER_SIZE + ((state->delta_buf_size + 7) & ~(size_t)7) + ((state_size + 7) & ~(size_t)7);
+}
+
+// Number of states older than the current one which can be gone back to. Each block leads back to one,
+// except a key-only block at the tail, since the keyframe it would restore was evicted with the block before it.
+static size_t states_held(const state_manager_t *state)
+{
+   if (state->entries && block_at(state, state->tail)->key_only)
+      return state->entries - 1;
+   return state->entries;
+}
+
+// Whether evicting the oldest block would leave fewer than min_entries states to go back to after the push.
+static bool keep_oldest(const state_manager_t *state)
+{
+   size_t held = state->entries;
+   if (held > 1 && block_at(state, block_at(state, state->tail)->next)->key_only)
+      held--;
+   return held < state->min_entries;
+}
+
+// Moves all blocks, oldest first, to the start of a bigger ring with at least size bytes free after them.
+// The ring never grows beyond what min_entries blocks of the largest possible size take up,
+// plus one kept in front of a key-only block and one for the space left unused at the end
+// when a block does not fit there.
+static bool grow_ring(state_manager_t *state, size_t size)
+{
+   if (!state->min_entries)
+      return false;
+
+   size_t max_capacity = (state->min_entries + 2) * max_block_size(state);
+   size_t capacity = state->capacity * 2;
+   if (capacity < state->stored_bytes + size)
+      capacity = state->stored_bytes + size;
+   if (capacity > max_capacity)
+      capacity = max_capacity;
+   capacity &= ~(size_t)7;
+
+   if (capacity <= state->capacity || capacity < state->stored_bytes + size)
+      return false;
+
+   uint8_t *buffer = (uint8_t*)malloc(capacity);
+   if (!buffer)
+      return false;
+
+   size_t offset = state->tail, pos = 0, prev = 0;
+   state->keyframes_first = 0;
+   state->keyframes_count = 0;
+   for (size_t i = 0; i < state->entries; i++)
+   {
+      const struct rewind_block *block = block_at(state, offset);
+      struct rewind_block *moved = (struct rewind_block*)(buffer + pos);
+      memcpy(moved, block, block->size);
+      offset = block->next;
+
+      moved->prev = prev;
+      moved->next = 0;
+      if (i)
+         ((struct rewind_block*)(buffer + prev))->next = pos;
+      if (moved->key_size)
+         keyframe_push(state, moved->frame, pos);
+
+      prev = pos;
+      pos += moved->size;
+   }
+
+   RARCH_LOG("Growing state buffer to %u KiB to hold %u states.\n",
+         (unsigned)(capacity >> 10), state->min_entries);
+
+   free(state->buffer);
+   state->buffer = buffer;
+   state->capacity = capacity;
+   state->tail = 0;
+   state->head = prev;
+   state->write_ptr = pos;
+   return true;
+}
+
+// Reserves size bytes for a new block after the newest one, evicting the oldest blocks as needed.
+// Blocks never straddle the end of the ring; if there is not enough room left before the end,
+// the tail end of the ring is left unused and we start over at offset 0.
+// If that would leave fewer than min_entries states to go back to, the ring grows instead.
+static struct rewind_block *alloc_block(state_manager_t *state, size_t size)
+{
+   if (size > state->capacity && !grow_ring(state, size))
+      return NULL;
+
+   if (!state->entries)
+      state->write_ptr = 0;
+
+   size_t pos = state->write_ptr;
+   if (pos + size > state->capacity)
+   {
+      // Any blocks stored after write_ptr are older than the ones at the start of the ring,
+      // so they have to go before we can start overwriting from offset 0.
+      while (state->entries && state->tail >= pos)
+      {
+         if (keep_oldest(state) && grow_ring(state, size))
+            return alloc_block(state, size);
+         evict_oldest(state);
+      }
+      pos = 0;
+   }
+
+   while (state->entries && state->tail >= pos && state->tail < pos + size)
+   {
+      if (keep_oldest(state) && grow_ring(state, size))
+         return alloc_block(state, size);
+      evict_oldest(state);
+   }
+
+   struct rewind_block *block = block_at(state, pos);
+   block->size = size;
+   block->prev = state->head;
+   block->next = 0;
+
+   if (state->entries)
+      block_at(state, state->head)->next = pos;
+   else
+      state->tail = pos;
+
+   state->head = pos;
+   state->write_ptr = pos + size;
+   state->entries++;
+   state->stored_bytes += size;
+
+   return block;
+}
+
+static void apply_delta(state_manager_t *state, const uint8_t *delta, size_t size)
+{
+   const uint8_t *end = delta + size;
+   while (delta < end)
+   {
+      uint32_t header[2];
+      memcpy(header, delta, sizeof(header));
+      delta += sizeof(header);
+
+      uint32_t *out = state->tmp_state + header[0];
+      const uint32_t *xor_ = (const uint32_t*)delta;
+      for (uint32_t i = 0; i < header[1]; i++)
+         out[i] ^= xor_[i];
+
+      delta += header[1] * sizeof(uint32_t);
+   }
+}
+
+static bool apply_block(state_manager_t *state, const struct rewind_block *block)
+{
+   const uint8_t *payload = (const uint8_t*)block + BLOCK_HEADER_SIZE;
+
+   if (block->codec == STATE_MANAGER_CODEC_NONE)
+      apply_delta(state, payload, block->raw_size);
+   else if (decompress_data(state, (enum state_manager_codec)block->codec,
+            payload, block->comp_size, state->delta_buf, block->raw_size))
+      apply_delta(state, state->delta_buf, block->raw_size);
+   else
+   {
+      RARCH_ERR("Failed to decompress rewind delta.\n");
+      return false;
+   }
+
+   return true;
+}
+
+// Restores the state a block's keyframe holds.
+static bool load_key(state_manager_t *state, const struct rewind_block *block)
+{
+   const uint8_t *keyframe = (const uint8_t*)block + BLOCK_HEADER_SIZE + ((block->comp_size + 7) & ~7);
+   state->current_in_ring = false;
+   if (!decompress_data(state, (enum state_manager_codec)block->key_codec, keyframe, block->key_size,
+            (uint8_t*)state->tmp_state, state->state_size * sizeof(uint32_t)))
+   {
+      RARCH_ERR("Failed to decompress rewind keyframe.\n");
+      return false;
+   }
+
+   return true;
+}
+
+// Brings tmp_state up to date if the newest state was only stored in the ring.
+static bool load_current(state_manager_t *state)
+{
+   return !state->current_in_ring || load_key(state, block_at(state, state->head));
+}
+
+// Drops the newest block. The next push will reuse its space.
+static void drop_newest(state_manager_t *state)
+{
+   const struct rewind_block *block = block_at(state, state->head);
+   keyframe_remove(state, block);
+   state->raw_bytes    -= block_raw_bytes(state, block);
+   state->stored_bytes -= block->size;
+   state->write_ptr = state->head;
+   state->head = block->prev;
+   state->entries--;
+   state->frame_count--;
+}
+
 bool state_manager_pop(state_manager_t *state, void **data)
 { 
+#ifdef HAVE_THREADS
+   // The worker might be halfway through a push. Let it finish so we pop from a consistent ring.
+   wait_idle(state);
+#endif
+
    *data = state->tmp_state;
    if (state->first_pop)
    {
       state->first_pop = false;
-      return true;
+      return load_current(state);
    }
 
-   state->top_ptr = (state->top_ptr - 1) & state->buf_size_mask;
+   if (!states_held(state)) // Our stack is completely empty... :v
+      return false;
+
+   // A key-only block has no delta to undo, but the block before it always has a keyframe.
+   const struct rewind_block *block = block_at(state, state->head);
+   bool ok = block->key_only ? load_key(state, block_at(state, block->prev)) : apply_block(state, block);
+   drop_newest(state);
+   return ok;
+}
 
-   if (state->top_ptr == state->bottom_ptr) // Our stack is completely empty... :v
-   {
-      state->top_ptr = (state->top_ptr + 1) & state->buf_size_mask;
+bool state_manager_seek(state_manager_t *state, unsigned frames_back, void **data)
+{
+#ifdef HAVE_THREADS
+   wait_idle(state);
+#endif
+
+   *data = state->tmp_state;
+   if (frames_back > states_held(state))
       return false;
+
+   state->first_pop = false;
+   uint64_t target = state->frame_count - frames_back;
+
+   // Find the newest keyframe at or before the target, and the oldest one at or after it.
+   const struct keyframe_entry *before = NULL, *after = NULL;
+   size_t lo = 0, hi = state->keyframes_count;
+   while (lo < hi)
+   {
+      size_t mid = (lo + hi) / 2;
+      if (keyframe_get(state, mid)->frame <= target)
+         lo = mid + 1;
+      else
+         hi = mid;
    }
 
-   while (state->buffer[state->top_ptr])
+   if (lo)
+      before = keyframe_get(state, lo - 1);
+   if (before && before->frame == target)
+      after = before;
+   else if (lo < state->keyframes_count)
+      after = keyframe_get(state, lo);
+
+   // XOR deltas work both ways, so we can patch forward from the keyframe before the target
+   // when that is fewer deltas than walking back. Key-only blocks are keyframes themselves, so there are none in the way.
+   uint64_t back = after ? after->frame - target : frames_back;
+   if (before && target - before->frame < back)
    {
-      // Apply the xor patch.
-      uint32_t addr = state->buffer[state->top_ptr] >> 32;
-      uint32_t xor_ = state->buffer[state->top_ptr] & 0xFFFFFFFFU;
-      state->tmp_state[addr] ^= xor_;
+      size_t offset = before->offset;
+      while (state->frame_count > target)
+         drop_newest(state);
+
+      const struct rewind_block *block = block_at(state, offset);
+      if (!load_key(state, block))
+         return false;
 
-      state->top_ptr = (state->top_ptr - 1) & state->buf_size_mask;
+      while (block->frame < target)
+      {
+         block = block_at(state, block->next);
+         if (!apply_block(state, block))
+            return false;
+      }
+
+      return true;
    }
 
-   if (state->top_ptr == state->bottom_ptr) // Our stack is completely empty... :v
+   // Otherwise walk back, from the keyframe after the target if there is one, or else from the current state.
+   // Key-only blocks are never walked over, since the one after the target is where we start.
+   bool ok;
+   if (after && after->frame < state->frame_count)
    {
-      state->top_ptr = (state->top_ptr + 1) & state->buf_size_mask;
-      return true;
+      size_t offset = after->offset;
+      uint64_t start = after->frame;
+      while (state->frame_count > start)
+         drop_newest(state);
+      ok = load_key(state, block_at(state, offset));
    }
+   else
+      ok = load_current(state);
 
-   return true;
+   while (ok && state->frame_count > target)
+   {
+      ok = apply_block(state, block_at(state, state->head));
+      drop_newest(state);
+   }
+   return ok;
 }
 
-static void reassign_bottom(state_manager_t *state)
+// Returns the first word index >= i where the states differ, or size if they are identical.
+// Unchanged blocks are skipped in bulk, which is where most of the time is spent
+// since only a small fraction of a save state changes between frames.
+static size_t find_change(const uint32_t *a, const uint32_t *b, size_t i, size_t size)
 {
-   state->bottom_ptr = (state->top_ptr + 1) & state->buf_size_mask;
-   while (state->buffer[state->bottom_ptr]) // Skip ahead until we find the first 0 (boundary for state delta).
-      state->bottom_ptr = (state->bottom_ptr + 1) & state->buf_size_mask;
+#if defined(__AVX2__)
+   for (; i + 8 <= size; i += 8)
+   {
+      __m256i v0 = _mm256_loadu_si256((const __m256i*)(a + i));
+      __m256i v1 = _mm256_loadu_si256((const __m256i*)(b + i));
+      unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi32(v0, v1));
+      if (mask != 0xffffffffu)
+         break; // Let the scalar loop find the exact word.
+   }
+#elif defined(__SSE2__)
+   for (; i + 4 <= size; i += 4)
+   {
+      __m128i v0 = _mm_loadu_si128((const __m128i*)(a + i));
+      __m128i v1 = _mm_loadu_si128((const __m128i*)(b + i));
+      unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi32(v0, v1));
+      if (mask != 0xffff)
+         break; // Let the scalar loop find the exact word.
+   }
+#elif defined(HAVE_NEON)
+   for (; i + 4 <= size; i += 4)
+   {
+      uint32x4_t diff = veorq_u32(vld1q_u32(a + i), vld1q_u32(b + i));
+      uint32x2_t tmp = vorr_u32(vget_low_u32(diff), vget_high_u32(diff));
+      if (vget_lane_u32(vpmax_u32(tmp, tmp), 0))
+         break;
+   }
+#endif
+
+   for (; i < size; i++)
+      if (a[i] != b[i])
+         return i;
+
+   return size;
 }
 
-static void generate_delta(state_manager_t *state, const void *data)
+// Encodes the difference between the current state and the new one as a sequence of
+// [index, length, length XOR words] spans, one per contiguous run of changed words.
+// The changed words are copied over as we go, so the current state becomes the new one
+// without touching the parts that did not change.
+// Output is at most delta_buf_size bytes.
+static size_t generate_delta(state_manager_t *state, const void *data, uint8_t *delta)
 {
-   bool crossed = false;
-   const uint32_t *old_state = state->tmp_state;
+   uint32_t *old_state = state->tmp_state;
    const uint32_t *new_state = (const uint32_t*)data;
+   size_t size = state->state_size;
+   uint8_t *out = delta;
 
-   state->buffer[state->top_ptr++] = 0; // For each separate delta, we have a 0 value sentinel in between.
-   state->top_ptr &= state->buf_size_mask;
+   for (size_t i = find_change(old_state, new_state, 0, size); i < size;
+         i = find_change(old_state, new_state, i, size))
+   {
+      uint8_t *header_out = out;
+      uint32_t *xor_ = (uint32_t*)(out + 2 * sizeof(uint32_t));
+      size_t start = i, last = i;
 
-   // Check if top_ptr and bottom_ptr crossed each other, which means we need to delete old cruft.
-   if (state->top_ptr == state->bottom_ptr)
-      crossed = true;
+      // Up to two unchanged words cost no more as zeroes in the span than a new span header would,
+      // so the span only ends after three. Every span but the first then stands for at least three
+      // unchanged words it leaves out, more than its header, so the delta can't end up much bigger than the state.
+      for (; i < size && i - last <= 3; i++)
+      {
+         uint32_t x = old_state[i] ^ new_state[i];
+         if (x)
+         {
+            old_state[i] = new_state[i];
+            last = i;
+         }
+         *xor_++ = x;
+      }
+
+      // Unchanged words we scanned past the end of the span.
+      xor_ -= i - (last + 1);
+      i = last + 1;
+
+      uint32_t header[2] = { start, i - start };
+      memcpy(header_out, header, sizeof(header));
+      out = (uint8_t*)xor_;
+   }
+
+   return out - delta;
+}
+
+// Uncompressed deltas are generated straight into the ring, saving a copy of every delta.
+// Room for the largest possible delta is reserved first, and whatever it did not use is given back.
+static bool push_state_in_place(state_manager_t *state, const void *data)
+{
+   size_t max_size = BLOCK_HEADER_SIZE + ((state->delta_buf_size + 7) & ~(size_t)7);
+   struct rewind_block *block = alloc_block(state, max_size);
+   if (!block)
+      return false;
+
+   size_t raw_size = generate_delta(state, data, (uint8_t*)block + BLOCK_HEADER_SIZE);
+
+   block->size = BLOCK_HEADER_SIZE + ((raw_size + 7) & ~(size_t)7);
+   state->write_ptr = state->head + block->size;
+   state->stored_bytes -= max_size - block->size;
 
-   for (uint64_t i = 0; i < state->state_size; i++)
+   state->frame_count++;
+   block->frame = state->frame_count;
+   block->raw_size = raw_size;
+   block->comp_size = raw_size;
+   block->codec = STATE_MANAGER_CODEC_NONE;
+   block->key_size = 0;
+   block->key_codec = STATE_MANAGER_CODEC_NONE;
+   block->key_only = 0;
+
+   state->big_deltas = raw_size >= state->state_size * sizeof(uint32_t);
+   state->raw_bytes += raw_size;
+   state->first_pop = true;
+   return true;
+}
+
+// Stores the whole state, without a delta. Only done when the newest block has a keyframe,
+// so going back past this block can restore that instead.
+// If current is false, tmp_state is left as it is and the state is read back from the ring when needed.
+static bool push_key_only(state_manager_t *state, const void *data, bool current)
+{
+   const uint8_t *key = (const uint8_t*)data;
+   size_t key_size = state->state_size * sizeof(uint32_t);
+   enum state_manager_codec key_codec = state->codec;
+
+   size_t size = compress_data(state, key_codec, key, key_size, state->key_buf);
+   if (size && size < key_size)
    {
-      uint64_t xor_ = old_state[i] ^ new_state[i];
+      key = state->key_buf;
+      key_size = size;
+   }
+   else
+      key_codec = STATE_MANAGER_CODEC_NONE;
+
+   struct rewind_block *block = alloc_block(state, BLOCK_HEADER_SIZE + ((key_size + 7) & ~(size_t)7));
+   if (!block)
+      return false;
+
+   state->frame_count++;
+   block->frame = state->frame_count;
+   block->raw_size = 0;
+   block->comp_size = 0;
+   block->codec = STATE_MANAGER_CODEC_NONE;
+   block->key_size = key_size;
+   block->key_codec = key_codec;
+   block->key_only = 1;
 
-      // If the data differs (xor != 0), we push that xor on the stack with index and xor.
-      // This can be reversed by reapplying the xor.
-      // This, if states don't really differ much, we'll save lots of space :)
-      // Hopefully this will work really well with save states.
-      if (xor_)
+   memcpy((uint8_t*)block + BLOCK_HEADER_SIZE, key, key_size);
+   keyframe_push(state, block->frame, state->head);
+
+   state->keyframe_counter = 0;
+   state->current_in_ring = !current;
+   state->raw_bytes += block_raw_bytes(state, block);
+   state->first_pop = true;
+   return true;
+}
+
+// When most of the state changes every frame, a delta is no smaller than the state itself,
+// and is slower to generate and restore than a plain copy. Then whole states are stored instead,
+// as key-only blocks, without diffing them at all. Every KEY_ONLY_RECHECK pushes we diff again
+// to see whether deltas have become worthwhile.
+#define KEY_ONLY_RECHECK 64
+
+static bool push_state(state_manager_t *state, const void *data)
+{
+   bool head_has_key = state->entries && block_at(state, state->head)->key_size;
+   bool big_deltas = state->big_deltas && alloc_key_scratch(state);
+
+   if (big_deltas && head_has_key && ++state->key_only_pushes < KEY_ONLY_RECHECK)
+      return push_key_only(state, data, false);
+   state->key_only_pushes = 0;
+
+   if (!load_current(state))
+      return false;
+
+   bool keyframe = state->keyframe_interval && ++state->keyframe_counter >= state->keyframe_interval;
+   if (keyframe)
+      state->keyframe_counter = 0;
+   else if (state->codec == STATE_MANAGER_CODEC_NONE && !big_deltas)
+      return push_state_in_place(state, data);
+
+   size_t raw_size = generate_delta(state, data, state->delta_buf);
+   state->big_deltas = raw_size >= state->state_size * sizeof(uint32_t);
+
+   if (state->big_deltas && alloc_key_scratch(state))
+   {
+      if (head_has_key)
       {
-         state->buffer[state->top_ptr] = (i << 32) | xor_;
-         state->top_ptr = (state->top_ptr + 1) & state->buf_size_mask;
+         if (push_key_only(state, data, true))
+            return true;
 
-         if (state->top_ptr == state->bottom_ptr)
-            crossed = true;
+         apply_delta(state, state->delta_buf, raw_size);
+         return false;
       }
+
+      // Give this block a keyframe, so the following ones can be key-only.
+      keyframe = true;
+   }
+
+   const uint8_t *payload = state->delta_buf;
+   enum state_manager_codec codec = state->codec;
+
+   // Store the delta as-is if compression did not help.
+   size_t comp_size = compress_data(state, codec, state->delta_buf, raw_size, state->comp_buf);
+   if (comp_size && comp_size < raw_size)
+      payload = state->comp_buf;
+   else
+   {
+      comp_size = raw_size;
+      codec = STATE_MANAGER_CODEC_NONE;
    }
 
-   if (crossed)
-      reassign_bottom(state);
+   const uint8_t *key = NULL;
+   size_t key_size = 0;
+   enum state_manager_codec key_codec = state->codec;
+
+   if (keyframe)
+   {
+      key = (const uint8_t*)data;
+      key_size = state->state_size * sizeof(uint32_t);
+
+      size_t size = compress_data(state, key_codec, key, key_size, state->key_buf);
+      if (size && size < key_size)
+      {
+         key = state->key_buf;
+         key_size = size;
+      }
+      else
+         key_codec = STATE_MANAGER_CODEC_NONE;
+   }
+
+   size_t delta_space = (comp_size + 7) & ~(size_t)7;
+   struct rewind_block *block = alloc_block(state, BLOCK_HEADER_SIZE + delta_space + ((key_size + 7) & ~(size_t)7));
+   if (!block)
+   {
+      // Undo the delta so the current state still matches the newest block.
+      apply_delta(state, state->delta_buf, raw_size);
+      return false;
+   }
+
+   state->frame_count++;
+   block->frame = state->frame_count;
+   block->raw_size = raw_size;
+   block->comp_size = comp_size;
+   block->codec = codec;
+   block->key_size = key_size;
+   block->key_codec = key_codec;
+   block->key_only = 0;
+
+   uint8_t *block_data = (uint8_t*)block + BLOCK_HEADER_SIZE;
+   memcpy(block_data, payload, comp_size);
+   if (key)
+   {
+      memcpy(block_data + delta_space, key, key_size);
+      keyframe_push(state, block->frame, state->head);
+   }
+   state->raw_bytes += block_raw_bytes(state, block);
+   state->first_pop = true;
+
+   return true;
 }
 
-bool state_manager_push(state_manager_t *state, const void *data)
+#ifdef HAVE_THREADS
+static void wait_idle(state_manager_t *state)
 {
-   generate_delta(state, data);
-   memcpy(state->tmp_state, data, state->state_size * sizeof(uint32_t));
-   state->first_pop = true;
+   if (!state->thread)
+      return;
+
+   slock_lock(state->lock);
+   while (state->queue_len || state->busy)
+      scond_wait(state->done_cond, state->lock);
+   slock_unlock(state->lock);
+}
+
+static void capture_thread(void *data)
+{
+   state_manager_t *state = (state_manager_t*)data;
+
+   slock_lock(state->lock);
+   for (;;)
+   {
+      while (!state->queue_len && state->alive)
+         scond_wait(state->cond, state->lock);
+
+      if (!state->queue_len)
+         break;
+
+      unsigned index = state->queue[0];
+      state->queue[0] = state->queue[1];
+      state->queue_len--;
+      state->busy = true;
+      slock_unlock(state->lock);
+
+      push_state(state, state->capture_buf[index]);
+
+      slock_lock(state->lock);
+      state->capture_free[index] = true;
+      state->busy = false;
+      scond_signal(state->done_cond);
+   }
+   slock_unlock(state->lock);
+}
+
+static void deinit_thread(state_manager_t *state)
+{
+   if (state->thread)
+   {
+      slock_lock(state->lock);
+      state->alive = false;
+      scond_signal(state->cond);
+      slock_unlock(state->lock);
+      sthread_join(state->thread);
+   }
+
+   if (state->lock)
+      slock_free(state->lock);
+   if (state->cond)
+      scond_free(state->cond);
+   if (state->done_cond)
+      scond_free(state->done_cond);
+
+   free(state->capture_buf[0]);
+   free(state->capture_buf[1]);
+
+   state->thread = NULL;
+   state->lock = NULL;
+   state->cond = NULL;
+   state->done_cond = NULL;
+   state->capture_buf[0] = state->capture_buf[1] = NULL;
+}
+
+bool state_manager_init_thread(state_manager_t *state)
+{
+   if (state->thread)
+      return true;
+
+   size_t state_size = state->state_size * sizeof(uint32_t);
+   state->capture_buf[0] = (uint32_t*)calloc(1, state_size);
+   state->capture_buf[1] = (uint32_t*)calloc(1, state_size);
+   state->capture_free[0] = state->capture_free[1] = true;
+   state->queue_len = 0;
+   state->busy = false;
+   state->alive = true;
+
+   state->lock = slock_new();
+   state->cond = scond_new();
+   state->done_cond = scond_new();
+
+   if (!state->capture_buf[0] || !state->capture_buf[1] ||
+         !state->lock || !state->cond || !state->done_cond)
+      goto error;
+
+   if (!(state->thread = sthread_create(capture_thread, state)))
+      goto error;
 
    return true;
+
+error:
+   deinit_thread(state);
+   return false;
 }
 
+void *state_manager_capture_buffer(state_manager_t *state)
+{
+   if (!state->thread)
+      return NULL;
+
+   slock_lock(state->lock);
+   while (!state->capture_free[0] && !state->capture_free[1])
+      scond_wait(state->done_cond, state->lock);
+
+   unsigned index = state->capture_free[0] ? 0 : 1;
+   state->capture_free[index] = false;
+   slock_unlock(state->lock);
+
+   return state->capture_buf[index];
+}
+
+bool state_manager_push(state_manager_t *state, const void *data)
+{
+   if (state->thread)
+   {
+      for (unsigned i = 0; i < 2; i++)
+      {
+         if (data != state->capture_buf[i])
+            continue;
+
+         slock_lock(state->lock);
+         state->queue[state->queue_len++] = i;
+         scond_signal(state->cond);
+         slock_unlock(state->lock);
+         return true;
+      }
+
+      wait_idle(state);
+   }
+
+   return push_state(state, data);
+}
+#else
+bool state_manager_init_thread(state_manager_t *state)
+{
+   (void)state;
+   return false;
+}
+
+void *state_manager_capture_buffer(state_manager_t *state)
+{
+   (void)state;
+   return NULL;
+}
+
+bool state_manager_push(state_manager_t *state, const void *data)
+{
+   return push_state(state, data);
+}
+#endif
@@ -21,6 +21,22 @@
 
 typedef struct state_manager state_manager_t;
 
+// How each delta is compressed before it is put into the ring.
+enum state_manager_codec
+{
+   STATE_MANAGER_CODEC_NONE = 0,
+   STATE_MANAGER_CODEC_RLE,     // Zero-run RLE over the XOR stream. Cheap, always available.
+   STATE_MANAGER_CODEC_DEFLATE  // zlib at its fastest level. Only with HAVE_ZLIB_DEFLATE.
+};
+
+struct state_manager_stats
+{
+   size_t entries;      // Number of deltas currently held.
+   size_t raw_bytes;    // Uncompressed size of those deltas.
+   size_t stored_bytes; // Ring space they take up, including block headers.
+   size_t capacity;     // Total ring size.
+};
+
 // Always pass in at least 4-byte aligned data and sizes!
 
 state_manager_t *state_manager_new(size_t state_size, size_t buffer_size, void *init_buffer);
@@ -28,4 +44,36 @@ void state_manager_free(state_manager_t *state);
 bool state_manager_pop(state_manager_t *state, void **data);
 bool state_manager_push(state_manager_t *state, const void *data);
 
+// Jumps back frames_back states from the current one (the newest pushed, or the last popped or seeked to),
+// dropping everything newer. Unlike pop, it never hands back the current state first,
+// so right after a push, seeking back n states is the same as n + 1 pops; after a pop or seek, it is n pops.
+// The next pop continues from the state seeked to, going back one more.
+// Restores from the nearest keyframe and patches forward when that is cheaper than walking back.
+// Returns false if fewer states than that are held.
+bool state_manager_seek(state_manager_t *state, unsigned frames_back, void **data);
+
+// Stores a full state along with every interval-th delta, so seeking never has to apply
+// more than about interval deltas. 0 disables keyframes.
+bool state_manager_set_keyframe_interval(state_manager_t *state, unsigned interval);
+
+// Never evicts any of the newest `entries` deltas. The ring grows instead, up to what that many deltas
+// of the largest possible size take up, so seeking back that far always works.
+// Lets the ring start out small when deltas are usually a fraction of a state. 0 (the default) never grows.
+void state_manager_set_min_entries(state_manager_t *state, unsigned entries);
+
+// Returns false if the codec is not supported by this build. Only affects deltas pushed afterwards.
+bool state_manager_set_codec(state_manager_t *state, enum state_manager_codec codec);
+void state_manager_get_stats(state_manager_t *state, struct state_manager_stats *stats);
+
+// Moves delta generation and compression to a worker thread.
+// Afterwards, serialize into the buffer returned by state_manager_capture_buffer()
+// and pass that to state_manager_push(), which then only queues it up.
+// Pop and the other calls wait for queued pushes to finish first.
+// Returns false if threads are not supported or the worker could not be started.
+bool state_manager_init_thread(state_manager_t *state);
+
+// Returns one of the two capture buffers, blocking if the worker is behind by more than a state.
+// Returns NULL if the state manager is not threaded.
+void *state_manager_capture_buffer(state_manager_t *state);
+
 #endif
@@ -23,11 +23,16 @@
 #include "general.h"
 #include "file.h"
 #include "gfx/scaler/scaler.h"
+#include "message.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
 #ifdef HAVE_ZLIB_DEFLATE
 #include "gfx/rpng/rpng.h"
 #else
@@ -96,7 +101,7 @@ static void dump_line_32(uint8_t *line, const uint32_t *src, unsigned width)
 }
 
 static void dump_content(FILE *file, const void *frame,
-      int width, int height, int pitch, bool bgr24)
+      int width, int height, int pitch, bool bgr24, enum retro_pixel_format pix_fmt)
 {
    union
    {
@@ -124,7 +129,7 @@ static void dump_content(FILE *file, const void *frame,
       for (int j = 0; j < height; j++, u.u8 += pitch)
          dump_line_bgr(lines[j], u.u8, width);
    }
-   else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
+   else if (pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
    {
       for (int j = 0; j < height; j++, u.u8 += pitch)
          dump_line_32(lines[j], u.u32, width);
@@ -144,22 +149,16 @@ end:
 }
 #endif
 
-// Take frame bottom-up.
-bool screenshot_dump(const char *folder, const void *frame,
-      unsigned width, unsigned height, int pitch, bool bgr24)
-{
-   char filename[PATH_MAX];
-   char shotname[PATH_MAX];
-
 #ifdef HAVE_ZLIB_DEFLATE
 #define IMG_EXT "png"
 #else
 #define IMG_EXT "bmp"
 #endif
 
-   fill_dated_filename(shotname, IMG_EXT, sizeof(shotname));
-   fill_pathname_join(filename, folder, shotname, sizeof(filename));
-
+// Take frame bottom-up.
+static bool screenshot_write(const char *filename, const void *frame,
+      unsigned width, unsigned height, int pitch, bool bgr24, enum retro_pixel_format pix_fmt)
+{
 #ifdef HAVE_ZLIB_DEFLATE
    uint8_t *out_buffer = (uint8_t*)malloc(width * height * 3);
    if (!out_buffer)
@@ -177,7 +176,7 @@ bool screenshot_dump(const char *folder, const void *frame,
 
    if (bgr24)
       scaler.in_fmt = SCALER_FMT_BGR24;
-   else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
+   else if (pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
       scaler.in_fmt = SCALER_FMT_ARGB8888;
    else
       scaler.in_fmt = SCALER_FMT_RGB565;
@@ -187,7 +186,9 @@ bool screenshot_dump(const char *folder, const void *frame,
    scaler_ctx_gen_reset(&scaler);
 
    RARCH_LOG("Using RPNG for PNG screenshots.\n");
-   bool ret = rpng_save_image_bgr24(filename, out_buffer, width, height, width * 3);
+   // Runs off the main thread when threaded, but rapid-fire screenshots still queue up behind it.
+   bool ret = rpng_save_image_bgr24_ex(filename, out_buffer, width, height, width * 3,
+         RPNG_COMPRESSION_BEST, rarch_get_cpu_cores());
    if (!ret)
       RARCH_ERR("Failed to take screenshot.\n");
    free(out_buffer);
@@ -203,7 +204,7 @@ bool screenshot_dump(const char *folder, const void *frame,
    bool ret = write_header_bmp(file, width, height);
 
    if (ret)
-      dump_content(file, frame, width, height, pitch, bgr24);
+      dump_content(file, frame, width, height, pitch, bgr24, pix_fmt);
    else
       RARCH_ERR("Failed to write image header.\n");
 
@@ -212,3 +213,264 @@ bool screenshot_dump(const char *folder, const void *frame,
 #endif
 }
 
+// Several screenshots within the same second would otherwise overwrite each other.
+static void screenshot_filename(char *filename, size_t size, const char *folder)
+{
+   static char last_shotname[PATH_MAX];
+   static unsigned count;
+
+   char shotname[PATH_MAX];
+   fill_dated_filename(shotname, IMG_EXT, sizeof(shotname));
+
+   if (strcmp(shotname, last_shotname) == 0)
+   {
+      char numbered[PATH_MAX];
+      size_t len = strlen(shotname) - strlen("." IMG_EXT);
+      snprintf(numbered, sizeof(numbered), "%.*s-%u." IMG_EXT, (int)len, shotname, ++count);
+      fill_pathname_join(filename, folder, numbered, size);
+   }
+   else
+   {
+      strlcpy(last_shotname, shotname, sizeof(last_shotname));
+      count = 0;
+      fill_pathname_join(filename, folder, shotname, size);
+   }
+}
+
+bool screenshot_dump(const char *folder, const void *frame,
+      unsigned width, unsigned height, int pitch, bool bgr24)
+{
+   char filename[PATH_MAX];
+   screenshot_filename(filename, sizeof(filename), folder);
+   return screenshot_write(filename, frame, width, height, pitch, bgr24, g_extern.system.pix_fmt);
+}
+
+#ifdef HAVE_THREADS
+// Screenshots are encoded on a background thread, so deflate doesn't stall the main loop.
+// Frames are copied into a small pool of buffers which are reused between screenshots.
+// If all of them are busy, the screenshot is dropped rather than waiting.
+#define SCREENSHOT_QUEUE_SIZE 4
+
+enum screenshot_job_state
+{
+   SCREENSHOT_JOB_FREE = 0,
+   SCREENSHOT_JOB_QUEUED,
+   SCREENSHOT_JOB_DONE
+};
+
+struct screenshot_job
+{
+   enum screenshot_job_state state;
+   unsigned seq;
+
+   uint8_t *buffer; // Bottom-up, tightly packed.
+   size_t buffer_size;
+   unsigned width;
+   unsigned height;
+   unsigned pitch;
+   bool bgr24;
+   enum retro_pixel_format pix_fmt;
+
+   char filename[PATH_MAX];
+   bool ret;
+};
+
+static struct
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   bool quit;
+
+   struct screenshot_job jobs[SCREENSHOT_QUEUE_SIZE];
+   unsigned seq;
+} screenshot_async;
+
+// Oldest queued job first, so screenshots finish in the order they were taken.
+static struct screenshot_job *screenshot_next_job(void)
+{
+   struct screenshot_job *next = NULL;
+   for (unsigned i = 0; i < SCREENSHOT_QUEUE_SIZE; i++)
+   {
+      struct screenshot_job *job = &screenshot_async.jobs[i];
+      if (job->state == SCREENSHOT_JOB_QUEUED && (!next || (int)(job->seq - next->seq) < 0))
+         next = job;
+   }
+   return next;
+}
+
+static void screenshot_thread(void *data)
+{
+   (void)data;
+
+   slock_lock(screenshot_async.lock);
+   for (;;)
+   {
+      struct screenshot_job *job = screenshot_next_job();
+      if (!job)
+      {
+         // Everything queued is written out before quitting.
+         if (screenshot_async.quit)
+            break;
+         scond_wait(screenshot_async.cond, screenshot_async.lock);
+         continue;
+      }
+      slock_unlock(screenshot_async.lock);
+
+      // Only we touch a queued job.
+      bool ret = screenshot_write(job->filename, job->buffer,
+            job->width, job->height, job->pitch, job->bgr24, job->pix_fmt);
+
+      slock_lock(screenshot_async.lock);
+      job->ret   = ret;
+      job->state = SCREENSHOT_JOB_DONE;
+   }
+   slock_unlock(screenshot_async.lock);
+}
+
+static bool screenshot_async_init(void)
+{
+   if (screenshot_async.thread)
+      return true;
+
+   screenshot_async.lock = slock_new();
+   screenshot_async.cond = scond_new();
+   screenshot_async.quit = false;
+   if (!screenshot_async.lock || !screenshot_async.cond)
+      goto error;
+
+   screenshot_async.thread = sthread_create(screenshot_thread, NULL);
+   if (!screenshot_async.thread)
+      goto error;
+
+   return true;
+
+error:
+   RARCH_ERR("Failed to start screenshot thread.\n");
+   if (screenshot_async.lock)
+      slock_free(screenshot_async.lock);
+   if (screenshot_async.cond)
+      scond_free(screenshot_async.cond);
+   screenshot_async.lock = NULL;
+   screenshot_async.cond = NULL;
+   return false;
+}
+
+bool screenshot_dump_async(const char *folder, const void *frame,
+      unsigned width, unsigned height, int pitch, bool bgr24)
+{
+   if (!screenshot_async_init())
+      return screenshot_dump(folder, frame, width, height, pitch, bgr24);
+
+   // Only we ever take a job out of the free state, so it's ours once found.
+   struct screenshot_job *job = NULL;
+   slock_lock(screenshot_async.lock);
+   for (unsigned i = 0; i < SCREENSHOT_QUEUE_SIZE && !job; i++)
+      if (screenshot_async.jobs[i].state == SCREENSHOT_JOB_FREE)
+         job = &screenshot_async.jobs[i];
+   slock_unlock(screenshot_async.lock);
+
+   if (!job)
+   {
+      RARCH_WARN("Screenshot queue is full, dropping screenshot.\n");
+      return false;
+   }
+
+   unsigned bpp;
+   if (bgr24)
+      bpp = 3;
+   else if (g_extern.system.pix_fmt == RETRO_PIXEL_FORMAT_XRGB8888)
+      bpp = sizeof(uint32_t);
+   else
+      bpp = sizeof(uint16_t);
+
+   unsigned line_size = width * bpp;
+   size_t size = (size_t)line_size * height;
+   if (size > job->buffer_size)
+   {
+      uint8_t *buffer = (uint8_t*)realloc(job->buffer, size);
+      if (!buffer)
+         return false;
+      job->buffer = buffer;
+      job->buffer_size = size;
+   }
+
+   RARCH_PERFORMANCE_INIT(screenshot_copy);
+   RARCH_PERFORMANCE_START(screenshot_copy);
+   const uint8_t *src = (const uint8_t*)frame;
+   uint8_t *dst = job->buffer;
+   for (unsigned h = 0; h < height; h++, src += pitch, dst += line_size)
+      memcpy(dst, src, line_size);
+   RARCH_PERFORMANCE_STOP(screenshot_copy);
+
+   job->width   = width;
+   job->height  = height;
+   job->pitch   = line_size;
+   job->bgr24   = bgr24;
+   job->pix_fmt = g_extern.system.pix_fmt;
+   screenshot_filename(job->filename, sizeof(job->filename), folder);
+
+   slock_lock(screenshot_async.lock);
+   job->seq   = screenshot_async.seq++;
+   job->state = SCREENSHOT_JOB_QUEUED;
+   scond_signal(screenshot_async.cond);
+   slock_unlock(screenshot_async.lock);
+
+   return true;
+}
+
+bool screenshot_async_poll(void)
+{
+   if (!screenshot_async.thread)
+      return false;
+
+   bool finished = false;
+   slock_lock(screenshot_async.lock);
+   for (unsigned i = 0; i < SCREENSHOT_QUEUE_SIZE; i++)
+   {
+      struct screenshot_job *job = &screenshot_async.jobs[i];
+      if (job->state != SCREENSHOT_JOB_DONE)
+         continue;
+
+      if (job->ret)
+      {
+         char msg[PATH_MAX + 32];
+         snprintf(msg, sizeof(msg), "Saved screenshot to \"%s\".", path_basename(job->filename));
+         RARCH_LOG("%s\n", msg);
+         msg_queue_clear(g_extern.msg_queue);
+         msg_queue_push(g_extern.msg_queue, msg, 1, 180);
+      }
+      else
+      {
+         RARCH_WARN("Failed to save screenshot to \"%s\".\n", job->filename);
+         msg_queue_clear(g_extern.msg_queue);
+         msg_queue_push(g_extern.msg_queue, "Failed to save screenshot.", 1, 180);
+      }
+
+      job->state = SCREENSHOT_JOB_FREE;
+      finished = true;
+   }
+   slock_unlock(screenshot_async.lock);
+
+   return finished;
+}
+
+void screenshot_async_deinit(void)
+{
+   if (!screenshot_async.thread)
+      return;
+
+   slock_lock(screenshot_async.lock);
+   screenshot_async.quit = true;
+   scond_signal(screenshot_async.cond);
+   slock_unlock(screenshot_async.lock);
+
+   sthread_join(screenshot_async.thread);
+
+   slock_free(screenshot_async.lock);
+   scond_free(screenshot_async.cond);
+   for (unsigned i = 0; i < SCREENSHOT_QUEUE_SIZE; i++)
+      free(screenshot_async.jobs[i].buffer);
+   memset(&screenshot_async, 0, sizeof(screenshot_async));
+}
+#endif
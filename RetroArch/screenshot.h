@@ -20,9 +20,26 @@
 #include <stddef.h>
 #include "boolean.h"
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 bool screenshot_dump(const char *folder, const void *frame, 
       unsigned width, unsigned height, int pitch, bool bgr24);
 
+#ifdef HAVE_THREADS
+// Like screenshot_dump(), but the frame is copied and written out on a background thread.
+// Returns false if too many screenshots are already in flight.
+bool screenshot_dump_async(const char *folder, const void *frame,
+      unsigned width, unsigned height, int pitch, bool bgr24);
+
+// Reports finished screenshots through msg_queue. Returns true if any finished.
+bool screenshot_async_poll(void);
+
+// Waits for queued screenshots to be written.
+void screenshot_async_deinit(void);
+#endif
+
 void screenshot_generate_filename(char *filename, size_t size);
 
 #endif
@@ -166,6 +166,7 @@ void config_set_defaults(void)
    g_settings.video.vsync = vsync;
    g_settings.video.hard_sync = hard_sync;
    g_settings.video.hard_sync_frames = hard_sync_frames;
+   g_settings.video.pbo_upload = pbo_upload;
    g_settings.video.threaded = video_threaded;
    g_settings.video.smooth = video_smooth;
    g_settings.video.force_aspect = force_aspect;
@@ -202,10 +203,14 @@ void config_set_defaults(void)
    g_settings.audio.rate_control = rate_control;
    g_settings.audio.rate_control_delta = rate_control_delta;
    g_settings.audio.volume = audio_volume;
+   g_settings.audio.resampler_quality = audio_resampler_quality;
 
    g_settings.rewind_enable = rewind_enable;
    g_settings.rewind_buffer_size = rewind_buffer_size;
    g_settings.rewind_granularity = rewind_granularity;
+   strlcpy(g_settings.rewind_compression, rewind_compression, sizeof(g_settings.rewind_compression));
+   g_settings.rewind_threaded = rewind_threaded;
+   g_settings.rewind_keyframe_interval = rewind_keyframe_interval;
    g_settings.slowmotion_ratio = slowmotion_ratio;
    g_settings.pause_nonactive = pause_nonactive;
    g_settings.autosave_interval = autosave_interval;
@@ -241,6 +246,7 @@ void config_set_defaults(void)
 
    g_settings.input.axis_threshold = axis_threshold;
    g_settings.input.netplay_client_swap_input = netplay_client_swap_input;
+   strlcpy(g_settings.input.netplay_predictor, netplay_predictor, sizeof(g_settings.input.netplay_predictor));
    g_settings.input.turbo_period = turbo_period;
    g_settings.input.turbo_duty_cycle = turbo_duty_cycle;
    g_settings.input.overlay_opacity = 1.0f;
@@ -486,6 +492,7 @@ bool config_load_file(const char *path)
    if (g_settings.video.hard_sync_frames > 3)
       g_settings.video.hard_sync_frames = 3;
 
+   CONFIG_GET_BOOL(video.pbo_upload, "video_pbo_upload");
    CONFIG_GET_BOOL(video.threaded, "video_threaded");
    CONFIG_GET_BOOL(video.smooth, "video_smooth");
    CONFIG_GET_BOOL(video.force_aspect, "video_force_aspect");
@@ -621,6 +628,7 @@ bool config_load_file(const char *path)
 
    CONFIG_GET_FLOAT(input.axis_threshold, "input_axis_threshold");
    CONFIG_GET_BOOL(input.netplay_client_swap_input, "netplay_client_swap_input");
+   CONFIG_GET_STRING(input.netplay_predictor, "netplay_predictor");
 
    for (unsigned i = 0; i < MAX_PLAYERS; i++)
    {
@@ -638,6 +646,7 @@ bool config_load_file(const char *path)
    CONFIG_GET_BOOL(audio.rate_control, "audio_rate_control");
    CONFIG_GET_FLOAT(audio.rate_control_delta, "audio_rate_control_delta");
    CONFIG_GET_FLOAT(audio.volume, "audio_volume");
+   CONFIG_GET_INT(audio.resampler_quality, "audio_resampler_quality");
 
    CONFIG_GET_STRING(video.driver, "video_driver");
    CONFIG_GET_STRING(video.gl_context, "video_gl_context");
@@ -679,6 +688,9 @@ bool config_load_file(const char *path)
       g_settings.rewind_buffer_size = buffer_size * UINT64_C(1000000);
 
    CONFIG_GET_INT(rewind_granularity, "rewind_granularity");
+   CONFIG_GET_STRING(rewind_compression, "rewind_compression");
+   CONFIG_GET_BOOL(rewind_threaded, "rewind_threaded");
+   CONFIG_GET_INT(rewind_keyframe_interval, "rewind_keyframe_interval");
    CONFIG_GET_FLOAT(slowmotion_ratio, "slowmotion_ratio");
    if (g_settings.slowmotion_ratio < 1.0f)
       g_settings.slowmotion_ratio = 1.0f;
@@ -966,6 +978,7 @@ bool config_save_file(const char *path)
    config_set_string(conf, "cheat_database_path", g_settings.cheat_database);
    config_set_bool(conf, "rewind_enable", g_settings.rewind_enable);
    config_set_int(conf, "rewind_granularity", g_settings.rewind_granularity);
+   config_set_string(conf, "rewind_compression", g_settings.rewind_compression);
    config_set_string(conf, "video_shader", g_settings.video.shader_path);
    config_set_bool(conf, "video_shader_enable", g_settings.video.shader_enable);
    config_set_float(conf, "video_aspect_ratio", g_settings.video.aspect_ratio);
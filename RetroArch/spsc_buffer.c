@@ -0,0 +1,156 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spsc_buffer.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// head and tail count bytes ever written and read. They are allowed to wrap around,
+// as long as the storage is a power of two, head - tail is always the amount of buffered data.
+// Only the producer stores head, and only the consumer stores tail.
+// The release store of an index publishes the data copied before it,
+// and the acquire load on the other side makes sure that data is visible.
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define spsc_load_acquire(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define spsc_store_release(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#elif defined(__GNUC__)
+static inline size_t spsc_load_acquire(volatile size_t *ptr)
+{
+   size_t val = *ptr;
+   __sync_synchronize();
+   return val;
+}
+
+static inline void spsc_store_release(volatile size_t *ptr, size_t val)
+{
+   __sync_synchronize();
+   *ptr = val;
+}
+#elif defined(_MSC_VER)
+// MSVC gives volatile accesses acquire/release semantics, we just need to keep the compiler from reordering.
+static __forceinline size_t spsc_load_acquire(volatile size_t *ptr)
+{
+   size_t val = *ptr;
+   _ReadWriteBarrier();
+   return val;
+}
+
+static __forceinline void spsc_store_release(volatile size_t *ptr, size_t val)
+{
+   _ReadWriteBarrier();
+   *ptr = val;
+}
+#else
+#error "Don't know how to do atomic loads and stores with this compiler."
+#endif
+
+// Keeps the indices on separate cache lines, so the producer and consumer don't keep stealing each other's line.
+#define SPSC_CACHE_LINE 64
+
+struct spsc_buffer
+{
+   uint8_t *buffer;
+   size_t size; // What the user asked for, write_avail never goes beyond this.
+   size_t mask; // Storage is rounded up to a power of two.
+   uint8_t pad0[SPSC_CACHE_LINE];
+
+   volatile size_t head;
+   uint8_t pad1[SPSC_CACHE_LINE - sizeof(size_t)];
+
+   volatile size_t tail;
+   uint8_t pad2[SPSC_CACHE_LINE - sizeof(size_t)];
+};
+
+spsc_buffer_t *spsc_new(size_t size)
+{
+   spsc_buffer_t *buf = (spsc_buffer_t*)calloc(1, sizeof(*buf));
+   if (!buf)
+      return NULL;
+
+   size_t storage = 1;
+   while (storage < size)
+      storage <<= 1;
+
+   buf->buffer = (uint8_t*)calloc(1, storage);
+   if (!buf->buffer)
+   {
+      free(buf);
+      return NULL;
+   }
+
+   buf->size = size;
+   buf->mask = storage - 1;
+   return buf;
+}
+
+void spsc_free(spsc_buffer_t *buffer)
+{
+   free(buffer->buffer);
+   free(buffer);
+}
+
+size_t spsc_read_avail(spsc_buffer_t *buffer)
+{
+   return spsc_load_acquire(&buffer->head) - buffer->tail;
+}
+
+size_t spsc_write_avail(spsc_buffer_t *buffer)
+{
+   return buffer->size - (buffer->head - spsc_load_acquire(&buffer->tail));
+}
+
+void spsc_write(spsc_buffer_t *buffer, const void *in_buf, size_t size)
+{
+   size_t head = buffer->head;
+   size_t pos = head & buffer->mask;
+
+   size_t first_write = size;
+   size_t rest_write = 0;
+   if (pos + size > buffer->mask + 1)
+   {
+      first_write = buffer->mask + 1 - pos;
+      rest_write = size - first_write;
+   }
+
+   memcpy(buffer->buffer + pos, in_buf, first_write);
+   memcpy(buffer->buffer, (const uint8_t*)in_buf + first_write, rest_write);
+
+   spsc_store_release(&buffer->head, head + size);
+}
+
+void spsc_read(spsc_buffer_t *buffer, void *out_buf, size_t size)
+{
+   size_t tail = buffer->tail;
+   size_t pos = tail & buffer->mask;
+
+   size_t first_read = size;
+   size_t rest_read = 0;
+   if (pos + size > buffer->mask + 1)
+   {
+      first_read = buffer->mask + 1 - pos;
+      rest_read = size - first_read;
+   }
+
+   memcpy(out_buf, buffer->buffer + pos, first_read);
+   memcpy((uint8_t*)out_buf + first_read, buffer->buffer, rest_read);
+
+   spsc_store_release(&buffer->tail, tail + size);
+}
+
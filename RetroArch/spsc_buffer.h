@@ -0,0 +1,36 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SPSC_BUFFER_H
+#define __SPSC_BUFFER_H
+
+#include <stddef.h>
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// Same interface as fifo_buffer_t, but no lock is needed around calls.
+// spsc_write() and spsc_write_avail() must only be called from the producer,
+// spsc_read() and spsc_read_avail() only from the consumer.
+// Like fifo_write()/fifo_read(), callers must check avail before writing or reading.
+typedef struct spsc_buffer spsc_buffer_t;
+
+spsc_buffer_t *spsc_new(size_t size);
+void spsc_write(spsc_buffer_t *buffer, const void *in_buf, size_t size);
+void spsc_read(spsc_buffer_t *buffer, void *out_buf, size_t size);
+void spsc_free(spsc_buffer_t *buffer);
+size_t spsc_read_avail(spsc_buffer_t *buffer);
+size_t spsc_write_avail(spsc_buffer_t *buffer);
+
+#endif
+
@@ -0,0 +1,178 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Pushes the same audio through the single sample callback and the batch callback into a fake driver,
+// and checks the driver gets exactly the same output both ways.
+// audio_sample() collects a whole chunk before flushing it, and audio_flush() processes the chunk a tile at a time,
+// so this catches the flush writing its output over parts of the chunk it hasn't read yet.
+// Upsampling makes the output bigger than the input, and nonblocking chunks are several tiles long.
+// Then times audio_flush() on nonblocking chunks and dumps the perf counters.
+
+#include "../audio/flush.h"
+#include "../audio/utils.h"
+#include "../general.h"
+#include "../driver.h"
+#include "../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+struct global g_extern;
+struct settings g_settings;
+driver_t driver;
+
+#define IN_RATE 32040.0
+#define OUT_RATE 48000.0
+#define TEST_CHUNKS 64
+#define BENCH_CHUNKS 4000
+
+static struct
+{
+   uint8_t *data;
+   size_t size;
+   size_t capacity;
+} sink;
+
+static ssize_t sink_write(void *data, const void *buf, size_t size)
+{
+   if (sink.size + size <= sink.capacity)
+      memcpy(sink.data + sink.size, buf, size);
+   sink.size += size;
+   return size;
+}
+
+static ssize_t null_write(void *data, const void *buf, size_t size)
+{
+   return size;
+}
+
+static audio_driver_t test_audio = { NULL, sink_write };
+
+// Same buffers init_audio() sets up.
+static void init(bool use_float, size_t chunk_size)
+{
+   size_t max_bufsamples = AUDIO_CHUNK_SIZE_NONBLOCKING * 2;
+   size_t outsamples_max = max_bufsamples * AUDIO_MAX_RATIO;
+
+   memset(&g_extern.audio_data, 0, sizeof(g_extern.audio_data));
+   g_extern.audio_data.conv_outsamples = (int16_t*)malloc(outsamples_max * sizeof(int16_t));
+   g_extern.audio_data.sample_buf      = (int16_t*)malloc(AUDIO_CHUNK_SIZE_NONBLOCKING * sizeof(int16_t));
+   g_extern.audio_data.data            = (float*)malloc(max_bufsamples * sizeof(float));
+   g_extern.audio_data.outsamples      = (float*)malloc(outsamples_max * sizeof(float));
+
+   g_extern.audio_data.chunk_size  = chunk_size;
+   g_extern.audio_data.use_float   = use_float;
+   g_extern.audio_data.volume_gain = 1.0f;
+   g_extern.audio_data.src_ratio   = g_extern.audio_data.orig_src_ratio = OUT_RATE / IN_RATE;
+
+   rarch_resampler_realloc(&g_extern.audio_data.resampler_data, &g_extern.audio_data.resampler,
+         NULL, RESAMPLER_QUALITY_DONTCARE, g_extern.audio_data.orig_src_ratio);
+
+   g_extern.audio_active = true;
+   driver.audio          = &test_audio;
+   driver.audio_data     = &sink;
+   sink.size             = 0;
+}
+
+static void deinit(void)
+{
+   rarch_resampler_freep(&g_extern.audio_data.resampler, &g_extern.audio_data.resampler_data);
+   free(g_extern.audio_data.conv_outsamples);
+   free(g_extern.audio_data.sample_buf);
+   free(g_extern.audio_data.data);
+   free(g_extern.audio_data.outsamples);
+}
+
+// Deterministic, and loud enough that every bit of the output matters.
+static void gen_audio(int16_t *samples, size_t count)
+{
+   uint32_t state = 1;
+   for (size_t i = 0; i < count; i++)
+   {
+      state = state * 1664525u + 1013904223u;
+      samples[i] = (int16_t)(state >> 16);
+   }
+}
+
+static bool run(const char *name, bool use_float, size_t chunk_size)
+{
+   size_t frames = TEST_CHUNKS * chunk_size / 2;
+   int16_t *input = (int16_t*)malloc(frames * 2 * sizeof(int16_t));
+   gen_audio(input, frames * 2);
+
+   sink.capacity = (size_t)(frames * 2 * (OUT_RATE / IN_RATE) + 1024) * sizeof(float);
+   uint8_t *batch_out = (uint8_t*)malloc(sink.capacity);
+   sink.data = (uint8_t*)malloc(sink.capacity);
+
+   // Reference: batches are read straight from the core's buffer.
+   init(use_float, chunk_size);
+   for (size_t i = 0; i < frames; i += chunk_size / 2)
+      audio_sample_batch(input + i * 2, chunk_size / 2);
+   size_t batch_size = sink.size;
+   memcpy(batch_out, sink.data, batch_size < sink.capacity ? batch_size : sink.capacity);
+   deinit();
+
+   init(use_float, chunk_size);
+   for (size_t i = 0; i < frames; i++)
+      audio_sample(input[i * 2 + 0], input[i * 2 + 1]);
+   bool ok = g_extern.audio_active && sink.size == batch_size && sink.size <= sink.capacity &&
+      memcmp(sink.data, batch_out, sink.size) == 0;
+   deinit();
+
+   printf("%-22s | %5zu frames in | %6zu bytes out | %s\n", name, frames, batch_size, ok ? "OK" : "FAILED");
+
+   free(input);
+   free(batch_out);
+   free(sink.data);
+   return ok;
+}
+
+static void benchmark(bool use_float)
+{
+   size_t chunk_frames = AUDIO_CHUNK_SIZE_NONBLOCKING / 2;
+   int16_t *input = (int16_t*)malloc(AUDIO_CHUNK_SIZE_NONBLOCKING * sizeof(int16_t));
+   gen_audio(input, AUDIO_CHUNK_SIZE_NONBLOCKING);
+
+   init(use_float, AUDIO_CHUNK_SIZE_NONBLOCKING);
+   test_audio.write = null_write;
+
+   rarch_time_t start = rarch_get_time_usec();
+   for (unsigned i = 0; i < BENCH_CHUNKS; i++)
+      audio_sample_batch(input, chunk_frames);
+   rarch_time_t time = rarch_get_time_usec() - start;
+
+   printf("%s | %u chunks of %zu frames | %.2f us/chunk\n", use_float ? "float" : "s16  ",
+         BENCH_CHUNKS, chunk_frames, (double)time / BENCH_CHUNKS);
+
+   test_audio.write = sink_write;
+   deinit();
+   free(input);
+}
+
+int main(void)
+{
+   bool ok = true;
+
+   ok = run("s16, nonblocking", false, AUDIO_CHUNK_SIZE_NONBLOCKING) && ok;
+   ok = run("s16, blocking", false, AUDIO_CHUNK_SIZE_BLOCKING) && ok;
+   ok = run("float, nonblocking", true, AUDIO_CHUNK_SIZE_NONBLOCKING) && ok;
+
+   benchmark(false);
+   benchmark(true);
+   rarch_perf_log();
+
+   return ok ? 0 : 1;
+}
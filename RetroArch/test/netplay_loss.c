@@ -0,0 +1,556 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Plays netplay between two processes over loopback, through a proxy in this one
+// which delays and drops UDP packets. Both sides run a tiny core at 60 frames per second,
+// and report how long netplay held up their frames, and the state they ended up in.
+// The states have to match, and no frame may be held up for much longer than the round trip.
+
+#include "../netplay_compat.h"
+#include "../netplay.h"
+#include "../general.h"
+#include "../dynamic.h"
+#include "../autosave.h"
+#include "../message.h"
+#include "../performance.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+struct global g_extern;
+struct settings g_settings;
+
+struct scenario
+{
+   const char *name;
+   unsigned frames_ahead;
+   unsigned latency_ms; // One way.
+   unsigned jitter_ms;
+   unsigned loss_percent;
+   unsigned outage_ms; // Nothing gets through for this long, OUTAGE_START_USEC into the game.
+};
+
+static const struct scenario scenarios[] = {
+   { "clean",              2,  5,  0,  0,   0 },
+   { "5% loss, 20 ms",     2, 20,  4,  5,   0 },
+   { "10% loss, 30 ms",    2, 30,  6, 10,   0 },
+   { "20% loss, 50 ms",    8, 50, 10, 20,   0 },
+   { "250 ms outage",      4, 10,  0,  0, 250 },
+   { "600 ms outage",     32, 10,  0,  0, 600 },
+   { "1.5 s outage",      64, 10,  0,  0, 1500 },
+};
+
+#define MEASURED_FRAMES 300
+#define FRAME_USEC 16667
+#define OUTAGE_START_USEC 2000000
+// Frames netplay holds up for longer than this count as stalled.
+#define STALL_USEC 4000
+// Besides outages, no stall may be much longer than a lost packet and its retransmit take.
+#define MAX_STALL_USEC 250000
+#define TIMEOUT_USEC 60000000
+
+struct side_result
+{
+   bool connected;
+   unsigned stalls;
+   rarch_time_t stall_usec;
+   rarch_time_t max_stall_usec;
+   uint32_t hash;
+};
+
+// The core. Its whole state is a hash of all input so far, so any desync shows.
+struct core_state
+{
+   uint32_t frame;
+   uint32_t hash;
+};
+
+static struct core_state core;
+static uint32_t hashes[MEASURED_FRAMES + 128]; // After each frame, rewritten as frames are replayed.
+static uint16_t local_input;
+
+static void core_run(void)
+{
+   input_poll_net();
+
+   uint32_t input = 0;
+   for (unsigned port = 0; port < 2; port++)
+      for (unsigned id = 0; id < 16; id++)
+         if (input_state_net(port, RETRO_DEVICE_JOYPAD, 0, id))
+            input |= 1 << (16 * port + id);
+
+   core.hash = (core.hash ^ input) * 16777619u;
+   core.frame++;
+   if (core.frame < sizeof(hashes) / sizeof(hashes[0]))
+      hashes[core.frame] = core.hash;
+}
+
+static size_t core_serialize_size(void)
+{
+   return sizeof(core);
+}
+
+static bool core_serialize(void *data, size_t size)
+{
+   if (size < sizeof(core))
+      return false;
+   memcpy(data, &core, sizeof(core));
+   return true;
+}
+
+static bool core_unserialize(const void *data, size_t size)
+{
+   if (size < sizeof(core))
+      return false;
+   memcpy(&core, data, sizeof(core));
+   return true;
+}
+
+static unsigned core_api_version(void)
+{
+   return RETRO_API_VERSION;
+}
+
+static void *core_get_memory_data(unsigned id)
+{
+   (void)id;
+   return NULL;
+}
+
+static size_t core_get_memory_size(unsigned id)
+{
+   (void)id;
+   return 0;
+}
+
+static void core_set_video_refresh(retro_video_refresh_t cb)
+{
+   (void)cb;
+}
+
+static void core_set_audio_sample(retro_audio_sample_t cb)
+{
+   (void)cb;
+}
+
+static void core_set_audio_sample_batch(retro_audio_sample_batch_t cb)
+{
+   (void)cb;
+}
+
+static void core_set_input_state(retro_input_state_t cb)
+{
+   (void)cb;
+}
+
+void (*pretro_run)(void) = core_run;
+size_t (*pretro_serialize_size)(void) = core_serialize_size;
+bool (*pretro_serialize)(void*, size_t) = core_serialize;
+bool (*pretro_unserialize)(const void*, size_t) = core_unserialize;
+unsigned (*pretro_api_version)(void) = core_api_version;
+void *(*pretro_get_memory_data)(unsigned) = core_get_memory_data;
+size_t (*pretro_get_memory_size)(unsigned) = core_get_memory_size;
+void (*pretro_set_video_refresh)(retro_video_refresh_t) = core_set_video_refresh;
+void (*pretro_set_audio_sample)(retro_audio_sample_t) = core_set_audio_sample;
+void (*pretro_set_audio_sample_batch)(retro_audio_sample_batch_t) = core_set_audio_sample_batch;
+void (*pretro_set_input_state)(retro_input_state_t) = core_set_input_state;
+
+void lock_autosave(void)
+{}
+
+void unlock_autosave(void)
+{}
+
+static void frame_cb(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   (void)data;
+   (void)width;
+   (void)height;
+   (void)pitch;
+}
+
+static void sample_cb(int16_t left, int16_t right)
+{
+   (void)left;
+   (void)right;
+}
+
+static size_t sample_batch_cb(const int16_t *data, size_t frames)
+{
+   (void)data;
+   return frames;
+}
+
+static int16_t state_cb(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   (void)port;
+   (void)index;
+   return device == RETRO_DEVICE_JOYPAD && id < 16 && (local_input & (1 << id));
+}
+
+// Now and then a button goes down or up. Differs between the two sides.
+static void update_local_input(unsigned *seed)
+{
+   unsigned r = rand_r(seed);
+   if (r % 6 == 0)
+      local_input ^= 1 << ((r >> 8) % 12);
+}
+
+static void run_side(const struct scenario *s, bool host, uint16_t port, int result_fd)
+{
+   g_extern.msg_queue = msg_queue_new(8);
+   g_extern.system.info.library_name = "netplay-loss";
+   g_extern.system.info.library_version = "1";
+   strlcpy(g_settings.input.netplay_predictor, "hold", sizeof(g_settings.input.netplay_predictor));
+
+   struct retro_callbacks cbs = { frame_cb, sample_cb, sample_batch_cb, state_cb };
+   struct side_result result = {0};
+   unsigned seed = host ? 1 : 2;
+
+   g_extern.netplay = netplay_new(host ? NULL : "127.0.0.1", port, s->frames_ahead, &cbs, false,
+         host ? "host" : "client");
+   if (!g_extern.netplay)
+   {
+      if (write(result_fd, &result, sizeof(result)) < 0)
+         _exit(1);
+      _exit(1);
+   }
+   result.connected = true;
+
+   // Late enough that the frame can not be rolled back any more.
+   unsigned report_frame = MEASURED_FRAMES + s->frames_ahead + 2;
+   rarch_time_t next = rarch_get_time_usec();
+
+   // Keeps going after reporting, so the other side is not left waiting, until we are killed.
+   for (unsigned frame = 0; ; frame++)
+   {
+      update_local_input(&seed);
+
+      rarch_time_t start = rarch_get_time_usec();
+      netplay_pre_frame(g_extern.netplay);
+      pretro_run();
+      netplay_post_frame(g_extern.netplay);
+      rarch_time_t time = rarch_get_time_usec() - start;
+
+      if (frame < MEASURED_FRAMES && time > STALL_USEC)
+      {
+         result.stalls++;
+         result.stall_usec += time;
+         if (time > result.max_stall_usec)
+            result.max_stall_usec = time;
+      }
+
+      if (frame == report_frame)
+      {
+         result.hash = hashes[MEASURED_FRAMES];
+         if (write(result_fd, &result, sizeof(result)) < 0)
+            _exit(1);
+      }
+
+      next += FRAME_USEC;
+      rarch_time_t now = rarch_get_time_usec();
+      if (next > now)
+         usleep(next - now);
+      else
+         next = now;
+   }
+}
+
+// Sits between the client and the host. TCP goes through as is, UDP is delayed and dropped.
+struct delayed_packet
+{
+   rarch_time_t when;
+   bool to_host;
+   size_t size;
+   uint8_t data[1024];
+};
+
+#define MAX_DELAYED 256
+
+struct proxy
+{
+   const struct scenario *s;
+   unsigned seed;
+
+   int tcp_listen;
+   int tcp_client;
+   int tcp_host;
+
+   int udp_front; // Where the client sends to.
+   int udp_back; // Sends on to the host.
+   struct sockaddr_storage client_addr;
+   socklen_t client_addr_len;
+
+   rarch_time_t start; // First packet.
+
+   struct delayed_packet packets[MAX_DELAYED];
+   unsigned packet_count;
+   unsigned dropped;
+   unsigned forwarded;
+};
+
+static int loopback_socket(int type, uint16_t port, bool do_bind)
+{
+   int fd = socket(AF_INET, type, 0);
+   if (fd < 0)
+      return -1;
+
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   int yes = 1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+   if (do_bind ? bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 :
+         connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+   {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+static void proxy_queue(struct proxy *p, bool to_host, const uint8_t *data, size_t size)
+{
+   rarch_time_t now = rarch_get_time_usec();
+   if (!p->start)
+      p->start = now;
+
+   bool outage = now >= p->start + OUTAGE_START_USEC &&
+      now < p->start + OUTAGE_START_USEC + p->s->outage_ms * 1000;
+
+   if (outage || (unsigned)(rand_r(&p->seed) % 100) < p->s->loss_percent)
+   {
+      p->dropped++;
+      return;
+   }
+
+   if (p->packet_count >= MAX_DELAYED || size > sizeof(p->packets[0].data))
+   {
+      p->dropped++;
+      return;
+   }
+
+   struct delayed_packet *packet = &p->packets[p->packet_count++];
+   unsigned jitter = p->s->jitter_ms ? rand_r(&p->seed) % (p->s->jitter_ms + 1) : 0;
+   packet->when = now + (p->s->latency_ms + jitter) * 1000;
+   packet->to_host = to_host;
+   packet->size = size;
+   memcpy(packet->data, data, size);
+}
+
+static void proxy_deliver(struct proxy *p)
+{
+   rarch_time_t now = rarch_get_time_usec();
+   for (unsigned i = 0; i < p->packet_count; )
+   {
+      struct delayed_packet *packet = &p->packets[i];
+      if (packet->when > now)
+      {
+         i++;
+         continue;
+      }
+
+      if (packet->to_host)
+         send(p->udp_back, packet->data, packet->size, 0);
+      else
+         sendto(p->udp_front, packet->data, packet->size, 0,
+               (struct sockaddr*)&p->client_addr, p->client_addr_len);
+      p->forwarded++;
+
+      *packet = p->packets[--p->packet_count];
+   }
+}
+
+static bool proxy_relay(int from, int to)
+{
+   uint8_t buf[4096];
+   ssize_t ret = recv(from, buf, sizeof(buf), 0);
+   if (ret <= 0)
+      return false;
+   return send(to, buf, ret, 0) == ret;
+}
+
+static bool proxy_accept(struct proxy *p, uint16_t host_port)
+{
+   p->tcp_client = accept(p->tcp_listen, NULL, NULL);
+   if (p->tcp_client < 0)
+      return false;
+
+   // The host may still be on its way up.
+   for (unsigned i = 0; i < 200 && p->tcp_host < 0; i++)
+   {
+      p->tcp_host = loopback_socket(SOCK_STREAM, host_port, false);
+      if (p->tcp_host < 0)
+         usleep(10000);
+   }
+   return p->tcp_host >= 0;
+}
+
+static bool run_scenario(const struct scenario *s, uint16_t host_port, uint16_t proxy_port)
+{
+   struct proxy *p = (struct proxy*)calloc(1, sizeof(*p));
+   p->s = s;
+   p->seed = 1234;
+   p->tcp_client = -1;
+   p->tcp_host = -1;
+   p->tcp_listen = loopback_socket(SOCK_STREAM, proxy_port, true);
+   p->udp_front = loopback_socket(SOCK_DGRAM, proxy_port, true);
+   p->udp_back = loopback_socket(SOCK_DGRAM, host_port, false);
+   if (p->tcp_listen < 0 || p->udp_front < 0 || p->udp_back < 0 || listen(p->tcp_listen, 1) < 0)
+   {
+      fprintf(stderr, "Failed to set up proxy on port %hu.\n", (unsigned short)proxy_port);
+      return false;
+   }
+
+   int host_pipe[2], client_pipe[2];
+   if (pipe(host_pipe) < 0 || pipe(client_pipe) < 0)
+      return false;
+
+   pid_t host = fork();
+   if (host == 0)
+      run_side(s, true, host_port, host_pipe[1]);
+
+   pid_t client = fork();
+   if (client == 0)
+      run_side(s, false, proxy_port, client_pipe[1]);
+
+   struct side_result results[2];
+   bool got[2] = {false};
+   bool ok = true;
+   rarch_time_t deadline = rarch_get_time_usec() + TIMEOUT_USEC;
+
+   while (!(got[0] && got[1]) && ok)
+   {
+      if (rarch_get_time_usec() > deadline)
+      {
+         fprintf(stderr, "%s: timed out.\n", s->name);
+         ok = false;
+         break;
+      }
+
+      struct pollfd fds[6] = {
+         { host_pipe[0], POLLIN },
+         { client_pipe[0], POLLIN },
+         { p->udp_front, POLLIN },
+         { p->udp_back, POLLIN },
+         { p->tcp_client >= 0 ? p->tcp_client : p->tcp_listen, POLLIN },
+         { p->tcp_host, POLLIN },
+      };
+
+      if (poll(fds, p->tcp_host >= 0 ? 6 : 5, 1) < 0 && errno != EINTR)
+      {
+         ok = false;
+         break;
+      }
+
+      for (unsigned i = 0; i < 2; i++)
+      {
+         if ((fds[i].revents & (POLLIN | POLLHUP)) && !got[i])
+         {
+            if (read(fds[i].fd, &results[i], sizeof(results[i])) != sizeof(results[i]) ||
+                  !results[i].connected)
+            {
+               fprintf(stderr, "%s: %s failed to connect.\n", s->name, i ? "client" : "host");
+               ok = false;
+            }
+            got[i] = true;
+         }
+      }
+
+      uint8_t buf[1024];
+      if (fds[2].revents & POLLIN)
+      {
+         p->client_addr_len = sizeof(p->client_addr);
+         ssize_t ret = recvfrom(p->udp_front, buf, sizeof(buf), 0,
+               (struct sockaddr*)&p->client_addr, &p->client_addr_len);
+         if (ret > 0)
+            proxy_queue(p, true, buf, ret);
+      }
+
+      if (fds[3].revents & POLLIN)
+      {
+         ssize_t ret = recv(p->udp_back, buf, sizeof(buf), 0);
+         if (ret > 0 && p->client_addr_len)
+            proxy_queue(p, false, buf, ret);
+      }
+
+      if (fds[4].revents & POLLIN)
+      {
+         if (p->tcp_client < 0)
+            ok = proxy_accept(p, host_port);
+         else
+            proxy_relay(p->tcp_client, p->tcp_host);
+      }
+
+      if (p->tcp_host >= 0 && (fds[5].revents & POLLIN))
+         proxy_relay(p->tcp_host, p->tcp_client);
+
+      proxy_deliver(p);
+   }
+
+   kill(host, SIGKILL);
+   kill(client, SIGKILL);
+   waitpid(host, NULL, 0);
+   waitpid(client, NULL, 0);
+
+   if (ok)
+   {
+      bool synced = results[0].hash == results[1].hash;
+      rarch_time_t max_stall = s->outage_ms * 1000 + MAX_STALL_USEC;
+      bool stalled = results[0].max_stall_usec > max_stall || results[1].max_stall_usec > max_stall;
+      ok = synced && !stalled;
+
+      printf("%-16s | -F %2u | %3u%% lost | host %3u stalls %7.1f ms, %6.1f ms max | client %3u stalls %7.1f ms, %6.1f ms max | %s\n",
+            s->name, s->frames_ahead, p->forwarded + p->dropped ? 100 * p->dropped / (p->forwarded + p->dropped) : 0,
+            results[0].stalls, results[0].stall_usec / 1000.0, results[0].max_stall_usec / 1000.0,
+            results[1].stalls, results[1].stall_usec / 1000.0, results[1].max_stall_usec / 1000.0,
+            !synced ? "DESYNC" : (stalled ? "STALLED" : "OK"));
+   }
+
+   close(host_pipe[0]);
+   close(host_pipe[1]);
+   close(client_pipe[0]);
+   close(client_pipe[1]);
+   if (p->tcp_client >= 0)
+      close(p->tcp_client);
+   if (p->tcp_host >= 0)
+      close(p->tcp_host);
+   close(p->tcp_listen);
+   close(p->udp_front);
+   close(p->udp_back);
+   free(p);
+   return ok;
+}
+
+int main(void)
+{
+   netplay_init_network();
+
+   bool ok = true;
+   uint16_t port = 20000 + (getpid() % 10000) * 4;
+   for (unsigned i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++, port += 2)
+      ok &= run_scenario(&scenarios[i], port, port + 1);
+
+   printf("%s\n", ok ? "OK" : "FAILED");
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the netplay input predictors over a few minutes of made up, but plausible, input,
+// as netplay would with the other side's input arriving some frames late.
+// Reports how many frames were mispredicted and how many frames had to be replayed per second.
+
+#include "../netplay_predict.h"
+#include "../libretro.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FRAMES (5 * 60 * 60)
+
+// Every button alternates between released and pressed, for a random number of frames within the ranges.
+// Some buttons are pressed in one of two ways, hold_chance percent of the time with the hold range.
+struct button_pattern
+{
+   unsigned id;
+   unsigned gap_min, gap_max;
+   unsigned tap_min, tap_max;
+   unsigned hold_min, hold_max;
+   unsigned hold_chance;
+};
+
+static const struct button_pattern patterns[] = {
+   { RETRO_DEVICE_ID_JOYPAD_RIGHT, 5, 40, 0, 0, 20, 120, 100 }, // Walking.
+   { RETRO_DEVICE_ID_JOYPAD_LEFT, 20, 120, 0, 0, 10, 60, 100 },
+   { RETRO_DEVICE_ID_JOYPAD_DOWN, 30, 200, 2, 6, 0, 0, 0 },
+   { RETRO_DEVICE_ID_JOYPAD_B, 10, 60, 2, 5, 0, 0, 0 },          // Jumping.
+   { RETRO_DEVICE_ID_JOYPAD_A, 8, 40, 2, 4, 0, 0, 0 },           // Mashing.
+   { RETRO_DEVICE_ID_JOYPAD_Y, 15, 60, 2, 4, 40, 90, 30 },       // Tapped, sometimes charged.
+   { RETRO_DEVICE_ID_JOYPAD_START, 600, 1800, 3, 8, 0, 0, 0 },
+};
+
+#define PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+static unsigned rand_range(unsigned min, unsigned max)
+{
+   return min + rand() % (max - min + 1);
+}
+
+static void generate_input(uint16_t *input, unsigned frames)
+{
+   unsigned remaining[PATTERNS] = {0};
+   bool pressed[PATTERNS] = {false};
+
+   for (unsigned f = 0; f < frames; f++)
+   {
+      // Now and then, the player puts the controller down for a bit.
+      bool idle = (f % 1200) >= 1080;
+
+      input[f] = 0;
+      for (unsigned i = 0; i < PATTERNS; i++)
+      {
+         const struct button_pattern *p = &patterns[i];
+         if (!remaining[i])
+         {
+            pressed[i] = !pressed[i];
+            if (!pressed[i])
+               remaining[i] = rand_range(p->gap_min, p->gap_max);
+            else if ((unsigned)(rand() % 100) < p->hold_chance)
+               remaining[i] = rand_range(p->hold_min, p->hold_max);
+            else
+               remaining[i] = rand_range(p->tap_min, p->tap_max);
+         }
+         remaining[i]--;
+
+         if (pressed[i] && !idle)
+            input[f] |= 1 << p->id;
+      }
+   }
+}
+
+struct result
+{
+   unsigned predicted;
+   unsigned mispredicted;
+   unsigned replayed;
+};
+
+// Frame f runs with input confirmed up to f - latency. After each frame, the next confirmed input arrives.
+// If the frame it belongs to was mispredicted, every frame since is replayed with fresh predictions.
+static void run(const netplay_predictor_t *predictor, const uint16_t *input, unsigned frames,
+      unsigned latency, struct result *res)
+{
+   uint16_t *predicted = (uint16_t*)calloc(frames, sizeof(*predicted));
+   struct netplay_input_model model;
+   netplay_input_model_init(&model);
+   memset(res, 0, sizeof(*res));
+
+   int confirmed = -1;
+   for (unsigned f = 0; f < frames; f++)
+   {
+      if ((int)f <= confirmed)
+         predicted[f] = input[f];
+      else
+      {
+         predicted[f] = predictor->predict(&model, f - confirmed);
+         res->predicted++;
+      }
+
+      if ((int)f < (int)latency - 1)
+         continue;
+
+      confirmed++;
+      netplay_input_model_update(&model, input[confirmed]);
+      if (predicted[confirmed] == input[confirmed])
+         continue;
+
+      res->mispredicted++;
+      res->replayed += f - confirmed + 1;
+      for (unsigned g = confirmed + 1; g <= f; g++)
+         predicted[g] = predictor->predict(&model, g - confirmed);
+   }
+
+   free(predicted);
+}
+
+// A few presses with known lengths, to check the model keeps track of them.
+static bool check_model(void)
+{
+   static const uint16_t seq[] = { 0, 1, 1, 1, 0, 0, 1, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 1, 0 };
+   struct netplay_input_model model;
+   netplay_input_model_init(&model);
+
+   for (unsigned i = 0; i < sizeof(seq) / sizeof(seq[0]); i++)
+      netplay_input_model_update(&model, seq[i]);
+
+   if (model.presses[0] != 4 || model.press_lengths[0][2] != 3 || model.press_lengths[0][1] != 1 ||
+         model.age[0] != 1 || model.last)
+   {
+      fprintf(stderr, "Input model didn't keep track of presses.\n");
+      return false;
+   }
+
+   // Presses mostly last 3 frames, so two frames into a new press "hold" expects the release next frame,
+   // and "last" keeps holding.
+   netplay_input_model_update(&model, 1);
+   netplay_input_model_update(&model, 1);
+
+   const netplay_predictor_t *last = netplay_predictor_find("last");
+   const netplay_predictor_t *hold = netplay_predictor_find("hold");
+   if (!last->predict(&model, 2) || !hold->predict(&model, 1) || hold->predict(&model, 2))
+   {
+      fprintf(stderr, "Predictors didn't go by the model.\n");
+      return false;
+   }
+
+   // Once the press outlasts anything seen before, there is nothing to bet on.
+   netplay_input_model_update(&model, 1);
+   netplay_input_model_update(&model, 1);
+   if (!hold->predict(&model, 10))
+   {
+      fprintf(stderr, "Predicted release of an unusually long press.\n");
+      return false;
+   }
+
+   return true;
+}
+
+int main(void)
+{
+   static const unsigned latencies[] = { 2, 4, 8, 16, 32, 64 };
+
+   if (!check_model())
+      return 1;
+
+   uint16_t *input = (uint16_t*)malloc(FRAMES * sizeof(*input));
+   srand(0);
+   generate_input(input, FRAMES);
+
+   bool ok = true;
+   for (unsigned l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++)
+   {
+      struct result last = {0};
+      for (unsigned i = 0; netplay_predictor_get(i); i++)
+      {
+         const netplay_predictor_t *predictor = netplay_predictor_get(i);
+         struct result res;
+         run(predictor, input, FRAMES, latencies[l], &res);
+
+         printf("%2u frames late | %-4s | %5.2f%% mispredicted | %7.1f frames replayed per second\n",
+               latencies[l], predictor->ident,
+               100.0 * res.mispredicted / res.predicted, res.replayed * 60.0 / FRAMES);
+
+         if (i == 0)
+            last = res;
+         else if (res.mispredicted > last.mispredicted)
+         {
+            fprintf(stderr, "\"%s\" mispredicts more than just repeating the last input.\n", predictor->ident);
+            ok = false;
+         }
+      }
+   }
+
+   free(input);
+   return ok ? 0 : 1;
+}
+
@@ -0,0 +1,420 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Hosts netplay in spectate mode at 60 frames per second, while 16 spectators join over loopback at once.
+// One of them stops reading right after joining. Checks that the host's frame time stays flat,
+// that the others follow the game in sync, that the stuck one gets dropped instead of holding up the host,
+// and that the joins did not each cost a serialization.
+
+#include "../netplay_compat.h"
+#include "../netplay.h"
+#include "../general.h"
+#include "../dynamic.h"
+#include "../autosave.h"
+#include "../message.h"
+#include "../performance.h"
+#include "../thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+struct global g_extern;
+struct settings g_settings;
+
+#define SPECTATORS 16
+#define JOIN_FRAME 120
+#define WATCH_FRAMES 300 // Frames the spectators who keep up follow, after joining.
+#define FLOOD_FRAMES 20000 // Run without pacing afterwards, so the stuck spectator falls far behind.
+#define FRAME_USEC 16667
+#define MAX_FRAME_USEC 8000
+#define PORTS 4
+
+// The core. Its whole state is a hash of all input so far, so any desync shows.
+struct core_state
+{
+   uint32_t frame;
+   uint32_t hash;
+};
+
+static struct core_state core;
+static uint32_t hashes[JOIN_FRAME + WATCH_FRAMES + 16];
+static unsigned serializations;
+static uint16_t local_input;
+
+static uint32_t hash_input(uint32_t hash, const uint16_t *input)
+{
+   for (unsigned port = 0; port < PORTS; port++)
+      hash = (hash ^ input[port]) * 16777619u;
+   return hash;
+}
+
+static void core_run(void)
+{
+   uint16_t input[PORTS] = {0};
+   for (unsigned port = 0; port < PORTS; port++)
+      for (unsigned id = 0; id < 16; id++)
+         if (input_state_spectate(port, RETRO_DEVICE_JOYPAD, 0, id))
+            input[port] |= 1 << id;
+
+   core.hash = hash_input(core.hash, input);
+   core.frame++;
+   if (core.frame < sizeof(hashes) / sizeof(hashes[0]))
+      hashes[core.frame] = core.hash;
+}
+
+static size_t core_serialize_size(void)
+{
+   return sizeof(core);
+}
+
+static bool core_serialize(void *data, size_t size)
+{
+   if (size < sizeof(core))
+      return false;
+   memcpy(data, &core, sizeof(core));
+   serializations++;
+   return true;
+}
+
+static bool core_unserialize(const void *data, size_t size)
+{
+   if (size < sizeof(core))
+      return false;
+   memcpy(&core, data, sizeof(core));
+   return true;
+}
+
+static unsigned core_api_version(void)
+{
+   return RETRO_API_VERSION;
+}
+
+static void *core_get_memory_data(unsigned id)
+{
+   (void)id;
+   return NULL;
+}
+
+static size_t core_get_memory_size(unsigned id)
+{
+   (void)id;
+   return 0;
+}
+
+static void core_set_video_refresh(retro_video_refresh_t cb)
+{
+   (void)cb;
+}
+
+static void core_set_audio_sample(retro_audio_sample_t cb)
+{
+   (void)cb;
+}
+
+static void core_set_audio_sample_batch(retro_audio_sample_batch_t cb)
+{
+   (void)cb;
+}
+
+static void core_set_input_state(retro_input_state_t cb)
+{
+   (void)cb;
+}
+
+void (*pretro_run)(void) = core_run;
+size_t (*pretro_serialize_size)(void) = core_serialize_size;
+bool (*pretro_serialize)(void*, size_t) = core_serialize;
+bool (*pretro_unserialize)(const void*, size_t) = core_unserialize;
+unsigned (*pretro_api_version)(void) = core_api_version;
+void *(*pretro_get_memory_data)(unsigned) = core_get_memory_data;
+size_t (*pretro_get_memory_size)(unsigned) = core_get_memory_size;
+void (*pretro_set_video_refresh)(retro_video_refresh_t) = core_set_video_refresh;
+void (*pretro_set_audio_sample)(retro_audio_sample_t) = core_set_audio_sample;
+void (*pretro_set_audio_sample_batch)(retro_audio_sample_batch_t) = core_set_audio_sample_batch;
+void (*pretro_set_input_state)(retro_input_state_t) = core_set_input_state;
+
+void lock_autosave(void)
+{}
+
+void unlock_autosave(void)
+{}
+
+static int16_t state_cb(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   (void)index;
+   return device == RETRO_DEVICE_JOYPAD && (local_input & (1 << ((id + 3 * port) & 15)));
+}
+
+struct spectator
+{
+   sthread_t *thread;
+   uint16_t port;
+   unsigned index;
+   bool stuck; // Stops reading right after joining.
+
+   bool joined;
+   bool in_sync;
+   bool dropped;
+   unsigned frames;
+};
+
+static slock_t *lock;
+static bool drain_stuck;
+
+static bool recv_exact(int fd, void *data_, size_t size)
+{
+   uint8_t *data = (uint8_t*)data_;
+   while (size)
+   {
+      ssize_t ret = recv(fd, data, size, 0);
+      if (ret <= 0)
+         return false;
+      data += ret;
+      size -= ret;
+   }
+   return true;
+}
+
+static int connect_host(uint16_t port)
+{
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   int fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+   {
+      close(fd);
+      fd = -1;
+   }
+   return fd;
+}
+
+// Joins the way a spectating RetroArch would, and then plays along.
+static void spectator_thread(void *data)
+{
+   struct spectator *s = (struct spectator*)data;
+   int fd = connect_host(s->port);
+   if (fd < 0)
+      return;
+
+   char nick[32];
+   snprintf(nick + 1, sizeof(nick) - 1, "spectator%u", s->index);
+   nick[0] = strlen(nick + 1);
+   if (send(fd, nick, nick[0] + 1, 0) != nick[0] + 1)
+      goto end;
+
+   uint8_t host_nick_size;
+   char host_nick[32];
+   uint32_t header[4];
+   struct core_state state;
+   if (!recv_exact(fd, &host_nick_size, 1) || host_nick_size >= sizeof(host_nick) ||
+         !recv_exact(fd, host_nick, host_nick_size) ||
+         !recv_exact(fd, header, sizeof(header)) ||
+         !recv_exact(fd, &state, sizeof(state)))
+      goto end;
+
+   s->joined = true;
+
+   if (s->stuck)
+   {
+      for (;;)
+      {
+         slock_lock(lock);
+         bool drain = drain_stuck;
+         slock_unlock(lock);
+         if (drain)
+            break;
+         rarch_sleep(10);
+      }
+
+      // Whatever the host had queued up for us, and then the connection should end.
+      struct timeval tv = { 2, 0 };
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      uint8_t buf[4096];
+      ssize_t ret;
+      while ((ret = recv(fd, buf, sizeof(buf), 0)) > 0);
+      s->dropped = ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+      goto end;
+   }
+
+   s->in_sync = true;
+   while (state.frame < JOIN_FRAME + WATCH_FRAMES)
+   {
+      int16_t inputs[PORTS * 16];
+      if (!recv_exact(fd, inputs, sizeof(inputs)))
+      {
+         s->in_sync = false;
+         break;
+      }
+
+      uint16_t input[PORTS] = {0};
+      for (unsigned i = 0; i < PORTS * 16; i++)
+         if (swap_if_big16(inputs[i]))
+            input[i / 16] |= 1 << (i % 16);
+
+      state.hash = hash_input(state.hash, input);
+      state.frame++;
+      s->frames++;
+
+      if (hashes[state.frame] != state.hash)
+      {
+         s->in_sync = false;
+         break;
+      }
+   }
+
+end:
+   close(fd);
+}
+
+struct frame_stats
+{
+   unsigned frames;
+   rarch_time_t total_usec;
+   rarch_time_t max_usec;
+};
+
+static void print_stats(const char *name, const struct frame_stats *stats)
+{
+   printf("%-24s | %5u frames | %7.3f ms avg | %7.3f ms max\n", name, stats->frames,
+         stats->frames ? stats->total_usec / (1000.0 * stats->frames) : 0.0, stats->max_usec / 1000.0);
+}
+
+int main(void)
+{
+   netplay_init_network();
+   lock = slock_new();
+
+   g_extern.msg_queue = msg_queue_new(8);
+   g_extern.system.info.library_name = "netplay-spectate";
+   g_extern.system.info.library_version = "1";
+
+   uint16_t port = 20000 + (getpid() % 20000) * 2;
+   struct retro_callbacks cbs = { NULL, NULL, NULL, state_cb };
+   g_extern.netplay = netplay_new(NULL, port, 0, &cbs, true, "host");
+   if (!g_extern.netplay)
+   {
+      fprintf(stderr, "Failed to host on port %hu.\n", (unsigned short)port);
+      return 1;
+   }
+
+   struct spectator spectators[SPECTATORS];
+   memset(spectators, 0, sizeof(spectators));
+
+   struct frame_stats alone = {0}, watched = {0}, flooded = {0};
+   unsigned seed = 1;
+   rarch_time_t next = rarch_get_time_usec();
+   unsigned watch_end = JOIN_FRAME + WATCH_FRAMES + 8;
+
+   for (unsigned frame = 0; frame < watch_end + FLOOD_FRAMES; frame++)
+   {
+      if (frame == JOIN_FRAME)
+      {
+         for (unsigned i = 0; i < SPECTATORS; i++)
+         {
+            spectators[i].port = port;
+            spectators[i].index = i;
+            spectators[i].stuck = i == SPECTATORS - 1;
+            spectators[i].thread = sthread_create(spectator_thread, &spectators[i]);
+         }
+      }
+
+      // Everyone who keeps up is done watching, and leaves.
+      if (frame == watch_end)
+      {
+         for (unsigned i = 0; i < SPECTATORS - 1; i++)
+         {
+            sthread_join(spectators[i].thread);
+            spectators[i].thread = NULL;
+         }
+      }
+
+      unsigned r = rand_r(&seed);
+      if (r % 5 == 0)
+         local_input ^= 1 << ((r >> 8) & 15);
+
+      rarch_time_t start = rarch_get_time_usec();
+      netplay_pre_frame(g_extern.netplay);
+      pretro_run();
+      netplay_post_frame(g_extern.netplay);
+      rarch_time_t time = rarch_get_time_usec() - start;
+
+      struct frame_stats *stats = frame < JOIN_FRAME ? &alone : (frame < watch_end ? &watched : &flooded);
+      stats->frames++;
+      stats->total_usec += time;
+      if (time > stats->max_usec)
+         stats->max_usec = time;
+
+      if (frame < watch_end)
+      {
+         next += FRAME_USEC;
+         rarch_time_t now = rarch_get_time_usec();
+         if (next > now)
+            rarch_sleep((next - now) / 1000);
+         else
+            next = now;
+      }
+   }
+
+   slock_lock(lock);
+   drain_stuck = true;
+   slock_unlock(lock);
+   sthread_join(spectators[SPECTATORS - 1].thread);
+
+   bool ok = true;
+   unsigned joined = 0, synced = 0;
+   for (unsigned i = 0; i < SPECTATORS; i++)
+   {
+      joined += spectators[i].joined;
+      if (!spectators[i].stuck)
+      {
+         synced += spectators[i].in_sync && spectators[i].frames;
+         if (!spectators[i].in_sync)
+            fprintf(stderr, "Spectator #%u desynced after %u frames.\n", i, spectators[i].frames);
+      }
+   }
+
+   print_stats("no spectators", &alone);
+   print_stats("16 spectators", &watched);
+   print_stats("1 stuck spectator, flood", &flooded);
+   printf("%u of %u spectators joined, %u of %u followed in sync, stuck one %s, %u serializations\n",
+         joined, SPECTATORS, synced, SPECTATORS - 1,
+         spectators[SPECTATORS - 1].dropped ? "dropped" : "NOT dropped", serializations);
+
+   if (joined != SPECTATORS || synced != SPECTATORS - 1 || !spectators[SPECTATORS - 1].dropped)
+      ok = false;
+   if (serializations >= SPECTATORS)
+   {
+      fprintf(stderr, "Every join serialized the state.\n");
+      ok = false;
+   }
+   if (watched.max_usec > MAX_FRAME_USEC || flooded.max_usec > MAX_FRAME_USEC)
+   {
+      fprintf(stderr, "Spectators held up the host.\n");
+      ok = false;
+   }
+
+   printf("%s\n", ok ? "OK" : "FAILED");
+
+   netplay_free(g_extern.netplay);
+   msg_queue_free(g_extern.msg_queue);
+   slock_free(lock);
+   return ok ? 0 : 1;
+}
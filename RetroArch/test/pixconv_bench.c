@@ -0,0 +1,239 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs every pixel converter this CPU supports against the C version of the same conversion.
+// Covers all widths up to a few SIMD blocks, padded strides and misaligned rows.
+// Input ends right at an inaccessible page, so reading past the last pixel crashes,
+// and output padding is compared as well, so writing past a row is caught too.
+// Then times each converter on a 1080p frame.
+
+#include "../gfx/scaler/pixconv.h"
+#include "../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_TEST_WIDTH 67
+#define TEST_HEIGHT 3
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_RUNS 64
+
+struct guarded_buffer
+{
+   uint8_t *map;
+   size_t map_size;
+   uint8_t *data; // Ends right before a PROT_NONE page.
+};
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+static unsigned bytes_per_pixel(enum scaler_pix_fmt fmt)
+{
+   switch (fmt)
+   {
+      case SCALER_FMT_ARGB8888:
+      case SCALER_FMT_ABGR8888:
+         return 4;
+      case SCALER_FMT_BGR24:
+         return 3;
+      default:
+         return 2;
+   }
+}
+
+static const char *fmt_name(enum scaler_pix_fmt fmt)
+{
+   switch (fmt)
+   {
+      case SCALER_FMT_ARGB8888:
+         return "ARGB8888";
+      case SCALER_FMT_ABGR8888:
+         return "ABGR8888";
+      case SCALER_FMT_0RGB1555:
+         return "0RGB1555";
+      case SCALER_FMT_RGB565:
+         return "RGB565";
+      case SCALER_FMT_BGR24:
+         return "BGR24";
+      default:
+         return "?";
+   }
+}
+
+static bool guarded_alloc(struct guarded_buffer *buf, size_t size)
+{
+   size_t page = sysconf(_SC_PAGESIZE);
+   size_t pages = (size + page - 1) / page;
+
+   buf->map_size = (pages + 1) * page;
+   buf->map = (uint8_t*)mmap(NULL, buf->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (buf->map == MAP_FAILED)
+      return false;
+
+   if (mprotect(buf->map + pages * page, page, PROT_NONE) < 0)
+      return false;
+
+   buf->data = buf->map + pages * page - size;
+   return true;
+}
+
+static void guarded_free(struct guarded_buffer *buf)
+{
+   munmap(buf->map, buf->map_size);
+}
+
+static scaler_pixconv_t find_c_kernel(const struct pixconv_kernel *kernel)
+{
+   return pixconv_find(kernel->in_fmt, kernel->out_fmt, 0);
+}
+
+// Returns false on mismatch.
+static bool test_kernel(const struct pixconv_kernel *kernel, scaler_pixconv_t reference)
+{
+   unsigned in_bpp  = bytes_per_pixel(kernel->in_fmt);
+   unsigned out_bpp = bytes_per_pixel(kernel->out_fmt);
+
+   // Padding is in whole pixels, and odd, so 16-bit rows alternate between 4 byte and 2 byte alignment.
+   static const unsigned paddings[] = { 0, 1, 3, 17 };
+
+   for (int width = 1; width <= MAX_TEST_WIDTH; width++)
+   {
+      for (unsigned p = 0; p < sizeof(paddings) / sizeof(paddings[0]); p++)
+      {
+         int in_stride  = (width + paddings[p]) * in_bpp;
+         int out_stride = (width + paddings[p] + 1) * out_bpp;
+
+         // The last row is not padded, so it ends exactly at the guard page.
+         size_t in_size  = (size_t)in_stride * (TEST_HEIGHT - 1) + width * in_bpp;
+         size_t out_size = (size_t)out_stride * TEST_HEIGHT;
+
+         struct guarded_buffer in;
+         if (!guarded_alloc(&in, in_size))
+            return false;
+
+         uint8_t *out_ref = (uint8_t*)malloc(out_size);
+         uint8_t *out     = (uint8_t*)malloc(out_size);
+         if (!out_ref || !out)
+            return false;
+
+         for (size_t i = 0; i < in_size; i++)
+            in.data[i] = (uint8_t)rand();
+
+         memset(out_ref, 0xa5, out_size);
+         memset(out, 0xa5, out_size);
+
+         reference(out_ref, in.data, width, TEST_HEIGHT, out_stride, in_stride);
+         kernel->conv(out, in.data, width, TEST_HEIGHT, out_stride, in_stride);
+
+         bool match = memcmp(out, out_ref, out_size) == 0;
+         if (!match)
+         {
+            for (size_t i = 0; i < out_size; i++)
+            {
+               if (out[i] != out_ref[i])
+               {
+                  fprintf(stderr, "%s %s -> %s: width %d, padding %u: byte %lu (row %lu) is 0x%02x, expected 0x%02x.\n",
+                        kernel->ident, fmt_name(kernel->in_fmt), fmt_name(kernel->out_fmt),
+                        width, paddings[p], (unsigned long)i, (unsigned long)(i / out_stride), out[i], out_ref[i]);
+                  break;
+               }
+            }
+         }
+
+         guarded_free(&in);
+         free(out_ref);
+         free(out);
+
+         if (!match)
+            return false;
+      }
+   }
+
+   return true;
+}
+
+static double bench_kernel(scaler_pixconv_t conv, const void *input, void *output,
+      enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt)
+{
+   int in_stride  = BENCH_WIDTH * bytes_per_pixel(in_fmt);
+   int out_stride = BENCH_WIDTH * bytes_per_pixel(out_fmt);
+
+   double start = get_time();
+   for (unsigned i = 0; i < BENCH_RUNS; i++)
+      conv(output, input, BENCH_WIDTH, BENCH_HEIGHT, out_stride, in_stride);
+
+   return (double)BENCH_WIDTH * BENCH_HEIGHT * BENCH_RUNS / (get_time() - start);
+}
+
+int main(void)
+{
+   struct rarch_cpu_features cpu;
+   rarch_get_cpu_features(&cpu);
+
+   unsigned count;
+   const struct pixconv_kernel *kernels = pixconv_get_kernels(&count);
+
+   uint8_t *input  = (uint8_t*)malloc(BENCH_WIDTH * BENCH_HEIGHT * 4);
+   uint8_t *output = (uint8_t*)malloc(BENCH_WIDTH * BENCH_HEIGHT * 4);
+   if (!input || !output)
+      return 1;
+
+   srand(0);
+   for (size_t i = 0; i < BENCH_WIDTH * BENCH_HEIGHT * 4; i++)
+      input[i] = (uint8_t)rand();
+
+   int ret = 0;
+   unsigned tested = 0;
+
+   for (unsigned i = 0; i < count; i++)
+   {
+      const struct pixconv_kernel *kernel = &kernels[i];
+      if ((cpu.simd & kernel->simd) != kernel->simd)
+      {
+         printf("%-8s -> %-8s | %-4s | not supported by this CPU\n",
+               fmt_name(kernel->in_fmt), fmt_name(kernel->out_fmt), kernel->ident);
+         continue;
+      }
+
+      scaler_pixconv_t reference = find_c_kernel(kernel);
+      bool ok = test_kernel(kernel, reference);
+      if (!ok)
+         ret = 1;
+      tested++;
+
+      double speed   = bench_kernel(kernel->conv, input, output, kernel->in_fmt, kernel->out_fmt);
+      double c_speed = bench_kernel(reference, input, output, kernel->in_fmt, kernel->out_fmt);
+
+      printf("%-8s -> %-8s | %-4s | %8.1f Mpix/s | %5.2fx C | %s\n",
+            fmt_name(kernel->in_fmt), fmt_name(kernel->out_fmt), kernel->ident,
+            speed / 1000000.0, speed / c_speed, ok ? "OK" : "MISMATCH");
+   }
+
+   printf("%u converters tested.\n", tested);
+
+   free(input);
+   free(output);
+   return ret;
+}
@@ -0,0 +1,194 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replays frames of libretro-test the way netplay does when it rolls back,
+// once with the core rendering and mixing like on any other frame, and once with it told
+// through RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE that nobody is going to see or hear it.
+// Compares replayed frames per second, and checks that both end up in the same state.
+
+#include "../libretro.h"
+#include "../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ROLLBACKS 4096
+#define ROLLBACK_DISTANCE 8
+
+static bool av_enable_supported;
+static bool replaying;
+static unsigned frame;
+static unsigned video_frames;
+static unsigned audio_frames;
+
+static bool environment(unsigned cmd, void *data)
+{
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+         return *(const enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+
+      case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+         if (!av_enable_supported)
+            return false;
+         *(int*)data = replaying ? 0 : (RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO);
+         return true;
+
+      default:
+         return false;
+   }
+}
+
+// What netplay's callbacks do with replayed frames: look, and throw them away.
+static void video_frame(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   (void)data;
+   (void)width;
+   (void)height;
+   (void)pitch;
+   if (!replaying)
+      video_frames++;
+}
+
+static void audio_sample(int16_t left, int16_t right)
+{
+   (void)left;
+   (void)right;
+   if (!replaying)
+      audio_frames++;
+}
+
+static size_t audio_sample_batch(const int16_t *data, size_t frames)
+{
+   (void)data;
+   if (!replaying)
+      audio_frames += frames;
+   return frames;
+}
+
+static void input_poll(void)
+{}
+
+// Goes round in circles, with some standing still in between.
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   (void)index;
+   if (port || device != RETRO_DEVICE_JOYPAD)
+      return 0;
+
+   unsigned phase = (frame / 20) % 5;
+   switch (id)
+   {
+      case RETRO_DEVICE_ID_JOYPAD_RIGHT:
+         return phase == 0;
+      case RETRO_DEVICE_ID_JOYPAD_DOWN:
+         return phase == 1;
+      case RETRO_DEVICE_ID_JOYPAD_LEFT:
+         return phase == 2;
+      case RETRO_DEVICE_ID_JOYPAD_UP:
+         return phase == 3;
+      default:
+         return 0;
+   }
+}
+
+// Runs ahead one frame at a time, and rolls back ROLLBACK_DISTANCE frames before every one of them.
+// Returns replayed frames per second. state ends up as the last state.
+static double run(bool supported, uint8_t *state, size_t size)
+{
+   av_enable_supported = supported;
+   frame = 0;
+
+   retro_reset();
+   if (!retro_serialize(state, size))
+      return 0.0;
+
+   rarch_time_t replay_time = 0;
+   for (unsigned i = 0; i < ROLLBACKS; i++)
+   {
+      // First frames since the state was saved are replayed, the last one is new.
+      rarch_time_t start = rarch_get_time_usec();
+      replaying = true;
+      unsigned base = frame;
+      retro_unserialize(state, size);
+      for (unsigned j = 0; j < ROLLBACK_DISTANCE; j++, frame++)
+         retro_run();
+      replay_time += rarch_get_time_usec() - start;
+
+      replaying = false;
+      retro_run();
+
+      // Oldest frame is confirmed, and becomes the one we roll back to next time.
+      frame = base + 1;
+      retro_unserialize(state, size);
+      retro_run();
+      retro_serialize(state, size);
+   }
+
+   return (double)ROLLBACKS * ROLLBACK_DISTANCE * 1000000.0 / (replay_time ? replay_time : 1);
+}
+
+int main(void)
+{
+   retro_set_environment(environment);
+   retro_set_video_refresh(video_frame);
+   retro_set_audio_sample(audio_sample);
+   retro_set_audio_sample_batch(audio_sample_batch);
+   retro_set_input_poll(input_poll);
+   retro_set_input_state(input_state);
+   retro_init();
+
+   bool ok = true;
+   if (!retro_load_game(NULL))
+   {
+      fprintf(stderr, "Failed to load game.\n");
+      return 1;
+   }
+
+   size_t size = retro_serialize_size();
+   uint8_t *before_state = (uint8_t*)calloc(1, size);
+   uint8_t *after_state = (uint8_t*)calloc(1, size);
+
+   double before = run(false, before_state, size);
+   unsigned before_video = video_frames;
+   unsigned before_audio = audio_frames;
+   video_frames = audio_frames = 0;
+
+   double after = run(true, after_state, size);
+
+   if (memcmp(before_state, after_state, size))
+   {
+      fprintf(stderr, "Replaying without audio and video ended up in a different state.\n");
+      ok = false;
+   }
+
+   if (video_frames != before_video || audio_frames != before_audio)
+   {
+      fprintf(stderr, "Frames that were not replayed lost output: %u/%u video, %u/%u audio.\n",
+            video_frames, before_video, audio_frames, before_audio);
+      ok = false;
+   }
+
+   printf("Replay, rendering:          %10.0f frames/s\n", before);
+   printf("Replay, output disabled:    %10.0f frames/s (%.1fx)\n", after, after / before);
+   printf("%s\n", ok ? "OK" : "FAILED");
+
+   retro_unload_game();
+   retro_deinit();
+   free(before_state);
+   free(after_state);
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,481 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../rewind.h"
+#include "../general.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+struct global g_extern;
+
+#define FRAMES 64
+#define WRAP_PUSHES (4 * FRAMES)
+
+// Netplay keeps the last few frames around to roll back to when it mispredicted the other side's input.
+#define ROLLBACK_WINDOW 17
+#define ROLLBACK_DISTANCE 8
+#define ROLLBACK_INTERVAL 4
+#define ROLLBACK_FRAMES 256
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+// Roughly mimics a save state: most of it stays put, a few scattered counters
+// and one contiguous region (think VRAM upload) change every frame.
+static void mutate_state(uint32_t *state, size_t words, unsigned frame)
+{
+   for (unsigned i = 0; i < 256; i++)
+      state[(rand() * (size_t)RAND_MAX + rand()) % words] += 1 + (rand() & 0xff);
+
+   size_t span = words / 8;
+   size_t base = (frame * span) % (words - span);
+   for (size_t i = 0; i < span; i++)
+      state[base + i] += frame | 1;
+}
+
+static const char *codec_name(enum state_manager_codec codec)
+{
+   switch (codec)
+   {
+      case STATE_MANAGER_CODEC_RLE:
+         return "rle";
+      case STATE_MANAGER_CODEC_DEFLATE:
+         return "deflate";
+      default:
+         return "none";
+   }
+}
+
+static bool bench_codec(uint32_t **states, size_t state_size, enum state_manager_codec codec)
+{
+   state_manager_t *state = state_manager_new(state_size, state_size * FRAMES * 2, states[0]);
+   if (!state)
+      return false;
+
+   if (!state_manager_set_codec(state, codec))
+   {
+      state_manager_free(state);
+      return true;
+   }
+
+   double start = get_time();
+   for (unsigned i = 1; i < FRAMES; i++)
+      state_manager_push(state, states[i]);
+   double push_time = get_time() - start;
+
+   struct state_manager_stats stats;
+   state_manager_get_stats(state, &stats);
+
+   bool ok = true;
+   start = get_time();
+   for (int i = FRAMES - 1; i >= 0; i--)
+   {
+      void *data;
+      if (!state_manager_pop(state, &data) || memcmp(data, states[i], state_size))
+      {
+         fprintf(stderr, "Mismatch when popping frame %d for %u KiB state.\n", i, (unsigned)(state_size >> 10));
+         ok = false;
+         break;
+      }
+   }
+   double pop_time = get_time() - start;
+
+   double mb = (double)state_size * (FRAMES - 1) / (1024.0 * 1024.0);
+   printf("%8u KiB | %-7s | push: %8.1f MB/s | pop: %8.1f MB/s | %8u bytes/state | ratio %5.2f\n",
+         (unsigned)(state_size >> 10), codec_name(codec), mb / push_time, mb / pop_time,
+         (unsigned)(stats.stored_bytes / stats.entries),
+         (double)stats.raw_bytes / stats.stored_bytes);
+
+   state_manager_free(state);
+
+   // Threaded capture. Only the serialize (here a memcpy) and the handoff stay on the calling thread.
+   // Between pushes, we sleep for twice as long as a synchronous push took to emulate the rest of a frame,
+   // and only count the time spent in the state manager.
+   // Pop right after the last push, so it has to wait for the worker to finish mid-compression.
+   state = state_manager_new(state_size, state_size * FRAMES * 2, states[0]);
+   if (!state)
+      return false;
+   state_manager_set_codec(state, codec);
+
+   double thread_push_time = 0.0;
+   if (state_manager_init_thread(state))
+   {
+      double frame_time = 2.0 * push_time / (FRAMES - 1);
+      for (unsigned i = 1; i < FRAMES; i++)
+      {
+         start = get_time();
+         void *buf = state_manager_capture_buffer(state);
+         memcpy(buf, states[i], state_size);
+         state_manager_push(state, buf);
+         thread_push_time += get_time() - start;
+
+         struct timespec tv = { 0, (long)(frame_time * 1000000000.0) };
+         nanosleep(&tv, NULL);
+      }
+
+      for (int i = FRAMES - 1; ok && i >= 0; i--)
+      {
+         void *data;
+         if (!state_manager_pop(state, &data) || memcmp(data, states[i], state_size))
+         {
+            fprintf(stderr, "Mismatch when popping frame %d from threaded state manager.\n", i);
+            ok = false;
+         }
+      }
+   }
+   state_manager_free(state);
+
+   printf("%8s     | %-7s | threaded push (main thread): %8.1f MB/s\n", "", "",
+         thread_push_time > 0.0 ? mb / thread_push_time : 0.0);
+
+   // Now with a buffer that is too small, so old deltas get overwritten.
+   // Whatever we can still pop must match the pushed states in reverse order.
+   state = state_manager_new(state_size, state_size * 5, states[0]);
+   if (!state)
+      return false;
+   state_manager_set_codec(state, codec);
+
+   for (unsigned i = 1; i < WRAP_PUSHES; i++)
+      state_manager_push(state, states[i % FRAMES]);
+
+   void *data;
+   unsigned popped = 0;
+   for (int i = WRAP_PUSHES - 1; ok && i >= 0 && state_manager_pop(state, &data); i--, popped++)
+   {
+      if (memcmp(data, states[i % FRAMES], state_size))
+      {
+         fprintf(stderr, "Mismatch when popping frame %d from wrapped buffer.\n", i);
+         ok = false;
+      }
+   }
+
+   if (ok && (popped < 2 || popped == WRAP_PUSHES))
+   {
+      fprintf(stderr, "Unexpected number of frames (%u) in wrapped buffer.\n", popped);
+      ok = false;
+   }
+
+   state_manager_free(state);
+   return ok;
+}
+
+// Seeks back by various distances, with and without keyframes, pops once more, then pushes the following states
+// again to make sure the ring is still consistent afterwards.
+static bool bench_seek(uint32_t **states, size_t state_size, enum state_manager_codec codec)
+{
+   static const unsigned distances[] = { 1, 5, 30, 50 };
+
+   for (unsigned interval = 0; interval <= 8; interval += 8)
+   {
+      printf("%8u KiB | %-7s | keyframe interval %u | seek:", (unsigned)(state_size >> 10), codec_name(codec), interval);
+
+      for (unsigned d = 0; d < sizeof(distances) / sizeof(distances[0]); d++)
+      {
+         unsigned frames_back = distances[d];
+         state_manager_t *state = state_manager_new(state_size, state_size * FRAMES * 2, states[0]);
+         if (!state)
+            return false;
+         state_manager_set_codec(state, codec);
+         state_manager_set_keyframe_interval(state, interval);
+
+         for (unsigned i = 1; i < FRAMES; i++)
+            state_manager_push(state, states[i]);
+
+         void *data;
+         unsigned target = FRAMES - 1 - frames_back;
+         double start = get_time();
+         bool ok = state_manager_seek(state, frames_back, &data);
+         double seek_time = get_time() - start;
+
+         if (!ok || memcmp(data, states[target], state_size))
+         {
+            fprintf(stderr, "\nMismatch when seeking back %u frames.\n", frames_back);
+            return false;
+         }
+
+         // Unlike right after a push, the next pop goes back one more instead of handing back the same state.
+         if (!state_manager_pop(state, &data) || memcmp(data, states[target - 1], state_size))
+         {
+            fprintf(stderr, "\nMismatch when popping right after seeking back %u frames.\n", frames_back);
+            return false;
+         }
+
+         for (unsigned i = target; i < FRAMES; i++)
+            state_manager_push(state, states[i]);
+
+         for (int i = FRAMES - 1; i >= 0; i--)
+         {
+            if (!state_manager_pop(state, &data) || memcmp(data, states[i], state_size))
+            {
+               fprintf(stderr, "\nMismatch when popping frame %d after seeking back %u frames.\n", i, frames_back);
+               return false;
+            }
+         }
+
+         state_manager_free(state);
+         printf(" %2u back: %7.1f us |", frames_back, seek_time * 1000000.0);
+      }
+      printf("\n");
+   }
+
+   return true;
+}
+
+// Goes back and forth between runs of states where deltas pay off and runs where most of the state changes,
+// which are stored as key-only blocks. Pops and seeks must cross both kinds of blocks, with and without
+// keyframes and with a ring so small that the oldest block left over can be key-only.
+static bool check_mixed(uint32_t **states, size_t state_size)
+{
+   static const unsigned distances[] = { 1, 5, 20, 40, FRAMES - 1 };
+   size_t words = state_size / sizeof(uint32_t);
+
+   for (unsigned i = 1; i < FRAMES; i++)
+   {
+      memcpy(states[i], states[i - 1], state_size);
+      if ((i / 16) & 1)
+      {
+         for (size_t j = 0; j < words; j += 2)
+            states[i][j] += i;
+      }
+      else
+         mutate_state(states[i], words, i);
+   }
+
+   for (unsigned c = 0; c < 2; c++)
+   {
+      enum state_manager_codec codec = c ? STATE_MANAGER_CODEC_RLE : STATE_MANAGER_CODEC_NONE;
+
+      for (unsigned interval = 0; interval <= 8; interval += 8)
+      {
+         state_manager_t *state = state_manager_new(state_size, state_size * FRAMES * 3, states[0]);
+         if (!state)
+            return false;
+         state_manager_set_codec(state, codec);
+         state_manager_set_keyframe_interval(state, interval);
+
+         void *data;
+         for (unsigned i = 1; i < FRAMES; i++)
+            state_manager_push(state, states[i]);
+
+         for (unsigned d = 0; d < sizeof(distances) / sizeof(distances[0]); d++)
+         {
+            unsigned target = FRAMES - 1 - distances[d];
+            if (!state_manager_seek(state, distances[d], &data) || memcmp(data, states[target], state_size))
+            {
+               fprintf(stderr, "Mismatch when seeking back %u frames through mixed states.\n", distances[d]);
+               return false;
+            }
+
+            for (unsigned i = target + 1; i < FRAMES; i++)
+               state_manager_push(state, states[i]);
+         }
+
+         for (int i = FRAMES - 1; i >= 0; i--)
+         {
+            if (!state_manager_pop(state, &data) || memcmp(data, states[i], state_size))
+            {
+               fprintf(stderr, "Mismatch when popping frame %d from mixed states.\n", i);
+               return false;
+            }
+         }
+         state_manager_free(state);
+
+         state = state_manager_new(state_size, state_size * 5, states[0]);
+         if (!state)
+            return false;
+         state_manager_set_codec(state, codec);
+         state_manager_set_keyframe_interval(state, interval);
+
+         for (unsigned i = 1; i < WRAP_PUSHES; i++)
+            state_manager_push(state, states[i % FRAMES]);
+
+         unsigned popped = 0;
+         for (int i = WRAP_PUSHES - 1; i >= 0 && state_manager_pop(state, &data); i--, popped++)
+         {
+            if (memcmp(data, states[i % FRAMES], state_size))
+            {
+               fprintf(stderr, "Mismatch when popping frame %d of mixed states from wrapped buffer.\n", i);
+               return false;
+            }
+         }
+         state_manager_free(state);
+
+         if (popped < 2)
+         {
+            fprintf(stderr, "Unexpected number of frames (%u) in wrapped buffer.\n", popped);
+            return false;
+         }
+      }
+   }
+
+   printf("%8u KiB | mixed  | pops and seeks across deltas and full states: OK\n", (unsigned)(state_size >> 10));
+   return true;
+}
+
+// Plays ROLLBACK_FRAMES frames, rolling back ROLLBACK_DISTANCE frames and replaying up to the present
+// every ROLLBACK_INTERVAL frames. Compares keeping a full copy of every frame in the window,
+// like netplay used to, against deltas which are only rebuilt when rolling back.
+// The delta ring is set up like netplay's, starting small and growing to keep the whole window.
+static bool bench_rollback(uint32_t **states, size_t state_size, const char *name)
+{
+   uint8_t *ring = (uint8_t*)malloc(state_size * ROLLBACK_WINDOW);
+   uint8_t *restored = (uint8_t*)malloc(state_size);
+   state_manager_t *state = state_manager_new(state_size,
+         (ROLLBACK_WINDOW / 4 + 2) * (state_size + 64), states[0]);
+   if (!ring || !restored || !state)
+      return false;
+   state_manager_set_codec(state, STATE_MANAGER_CODEC_NONE);
+   state_manager_set_min_entries(state, ROLLBACK_WINDOW);
+
+   double copy_time = 0.0, copy_restore_time = 0.0;
+   double push_time = 0.0, seek_time = 0.0;
+   unsigned pushes = 0, rollbacks = 0;
+   bool ok = true;
+
+   for (unsigned f = 1; f < ROLLBACK_FRAMES && ok; f++)
+   {
+      unsigned first = f;
+
+      if (f % ROLLBACK_INTERVAL == 0 && f > ROLLBACK_DISTANCE)
+      {
+         unsigned target = f - 1 - ROLLBACK_DISTANCE;
+
+         double start = get_time();
+         memcpy(restored, ring + (target % ROLLBACK_WINDOW) * state_size, state_size);
+         copy_restore_time += get_time() - start;
+
+         void *data;
+         start = get_time();
+         ok = state_manager_seek(state, ROLLBACK_DISTANCE, &data);
+         seek_time += get_time() - start;
+
+         if (!ok || memcmp(data, states[target % FRAMES], state_size) ||
+               memcmp(restored, states[target % FRAMES], state_size))
+         {
+            fprintf(stderr, "Mismatch when rolling back to frame %u.\n", target);
+            ok = false;
+            break;
+         }
+
+         // Every frame after the one we went back to is stored again as it is replayed.
+         first = target + 1;
+         rollbacks++;
+      }
+
+      for (unsigned i = first; i <= f; i++)
+      {
+         const uint32_t *cur = states[i % FRAMES];
+
+         double start = get_time();
+         memcpy(ring + (i % ROLLBACK_WINDOW) * state_size, cur, state_size);
+         copy_time += get_time() - start;
+
+         start = get_time();
+         state_manager_push(state, cur);
+         push_time += get_time() - start;
+         pushes++;
+      }
+   }
+
+   struct state_manager_stats stats;
+   state_manager_get_stats(state, &stats);
+
+   printf("%8u KiB | %-6s | rollback %u of %u | full copies: %7.1f us/frame, %8u bytes/frame, %6u KiB, restore %7.1f us"
+         " | deltas: %7.1f us/frame, %8u bytes/frame, %6u KiB, restore %7.1f us\n",
+         (unsigned)(state_size >> 10), name, ROLLBACK_DISTANCE, ROLLBACK_WINDOW,
+         copy_time * 1000000.0 / pushes, (unsigned)state_size,
+         (unsigned)((state_size * ROLLBACK_WINDOW) >> 10),
+         copy_restore_time * 1000000.0 / (rollbacks ? rollbacks : 1),
+         push_time * 1000000.0 / pushes, (unsigned)(stats.stored_bytes / stats.entries),
+         (unsigned)(stats.capacity >> 10),
+         seek_time * 1000000.0 / (rollbacks ? rollbacks : 1));
+
+   state_manager_free(state);
+   free(restored);
+   free(ring);
+   return ok;
+}
+
+static bool bench_state_size(size_t state_size)
+{
+   size_t words = state_size / sizeof(uint32_t);
+   uint32_t **states = (uint32_t**)calloc(FRAMES, sizeof(*states));
+   if (!states)
+      return false;
+
+   for (unsigned i = 0; i < FRAMES; i++)
+   {
+      states[i] = (uint32_t*)malloc(state_size);
+      if (!states[i])
+         return false;
+
+      if (i)
+      {
+         memcpy(states[i], states[i - 1], state_size);
+         mutate_state(states[i], words, i);
+      }
+      else
+      {
+         for (size_t j = 0; j < words; j++)
+            states[i][j] = rand();
+      }
+   }
+
+   bool ok = bench_codec(states, state_size, STATE_MANAGER_CODEC_NONE) &&
+      bench_codec(states, state_size, STATE_MANAGER_CODEC_RLE) &&
+      bench_codec(states, state_size, STATE_MANAGER_CODEC_DEFLATE) &&
+      bench_seek(states, state_size, STATE_MANAGER_CODEC_RLE) &&
+      bench_rollback(states, state_size, "usual");
+
+   // Worst case for deltas: every other word changes every frame.
+   for (unsigned i = 1; ok && i < FRAMES; i++)
+   {
+      memcpy(states[i], states[i - 1], state_size);
+      for (size_t j = 0; j < words; j += 2)
+         states[i][j] += i;
+   }
+   ok = ok && bench_rollback(states, state_size, "churn");
+   ok = ok && check_mixed(states, state_size);
+
+   for (unsigned i = 0; i < FRAMES; i++)
+      free(states[i]);
+   free(states);
+   return ok;
+}
+
+int main(int argc, char *argv[])
+{
+   (void)argc;
+   (void)argv;
+
+   static const size_t sizes[] = {
+      16 * 1024, 128 * 1024, 512 * 1024, 2 * 1024 * 1024, 4 * 1024 * 1024,
+   };
+
+   srand(0);
+   for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      if (!bench_state_size(sizes[i]))
+         return 1;
+
+   return 0;
+}
+
@@ -0,0 +1,128 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Encodes a 1080p viewport capture (a scaled up 320x180 game screen with a soft gradient behind it)
+// with every compression level, single threaded and in bands.
+// Every image is decoded again and compared against the input.
+
+#include "../gfx/rpng/rpng.h"
+#include "../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define SCALE 6
+
+static void gen_capture(uint8_t *bgr)
+{
+   static const uint8_t palette[8][3] = {
+      { 0x20, 0x10, 0x08 }, { 0xf8, 0xd8, 0x98 }, { 0x30, 0x90, 0x30 }, { 0xf8, 0xf8, 0xf8 },
+      { 0x80, 0x40, 0xc0 }, { 0x10, 0x60, 0xf8 }, { 0xa0, 0xa0, 0xa0 }, { 0x00, 0x00, 0x00 },
+   };
+
+   srand(0);
+   uint8_t tiles[(180 + 7) / 8][320 / 8];
+   for (unsigned y = 0; y < (180 + 7) / 8; y++)
+      for (unsigned x = 0; x < 320 / 8; x++)
+         tiles[y][x] = (rand() % 5 == 0) ? rand() % 8 : 0xff;
+
+   for (unsigned y = 0; y < HEIGHT; y++)
+   {
+      for (unsigned x = 0; x < WIDTH; x++, bgr += 3)
+      {
+         unsigned sx = x / SCALE, sy = y / SCALE;
+         uint8_t tile = tiles[sy / 8][sx / 8];
+
+         if (tile != 0xff && ((sx ^ sy) & 2))
+         {
+            const uint8_t *col = palette[(tile + ((sx + sy) & 1)) & 7];
+            bgr[0] = col[2];
+            bgr[1] = col[1];
+            bgr[2] = col[0];
+         }
+         else
+         {
+            // Sky gradient, which changes every few lines like it would on a real game.
+            bgr[0] = 0xc0 + (sy >> 2);
+            bgr[1] = 0x60 + (sy >> 1);
+            bgr[2] = 0x20 + (sy >> 3);
+         }
+      }
+   }
+}
+
+static bool check_decode(const char *path, const uint8_t *bgr)
+{
+   uint32_t *data = NULL;
+   unsigned width = 0, height = 0;
+   if (!rpng_load_image_argb(path, &data, &width, &height))
+      return false;
+
+   bool ok = width == WIDTH && height == HEIGHT;
+   for (unsigned i = 0; ok && i < WIDTH * HEIGHT; i++, bgr += 3)
+   {
+      uint32_t expected = 0xff000000u | (bgr[2] << 16) | (bgr[1] << 8) | bgr[0];
+      if (data[i] != expected)
+      {
+         fprintf(stderr, "Pixel %u: got %08x, expected %08x.\n", i, data[i], expected);
+         ok = false;
+      }
+   }
+
+   free(data);
+   return ok;
+}
+
+static bool run(const char *name, const uint8_t *bgr, enum rpng_compression compression, unsigned threads)
+{
+   const char *path = "/tmp/rpng-bench.png";
+
+   rarch_time_t start = rarch_get_time_usec();
+   bool ok = rpng_save_image_bgr24_ex(path, bgr, WIDTH, HEIGHT, WIDTH * 3, compression, threads);
+   rarch_time_t time = rarch_get_time_usec() - start;
+
+   struct stat st = {0};
+   stat(path, &st);
+
+   ok = ok && check_decode(path, bgr);
+   remove(path);
+
+   printf("%-5s %2u threads: %8.2f ms, %8lu bytes, %s\n", name, threads,
+         time / 1000.0, (unsigned long)st.st_size, ok ? "OK" : "FAILED");
+   return ok;
+}
+
+int main(void)
+{
+   uint8_t *bgr = (uint8_t*)malloc(WIDTH * HEIGHT * 3);
+   if (!bgr)
+      return 1;
+   gen_capture(bgr);
+
+   bool ok = true;
+   ok = run("best", bgr, RPNG_COMPRESSION_BEST, 1) && ok;
+   ok = run("best", bgr, RPNG_COMPRESSION_BEST, 4) && ok;
+   ok = run("fast", bgr, RPNG_COMPRESSION_FAST, 1) && ok;
+   ok = run("fast", bgr, RPNG_COMPRESSION_FAST, 4) && ok;
+   // Bands get clamped to the image.
+   ok = run("fast", bgr, RPNG_COMPRESSION_FAST, RPNG_MAX_THREADS + 4) && ok;
+
+   free(bgr);
+   return ok ? 0 : 1;
+}
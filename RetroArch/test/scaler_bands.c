@@ -0,0 +1,543 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Scales random frames with scaler_ctx split into bands on a worker pool,
+// and checks that the output is bit-identical to scaling on a single thread.
+// Single-threaded output is also checked against converting to ARGB8888, scaling, and converting back,
+// which is what the filters reading and writing other formats directly must match.
+// Filter tables are checked to be normalized and in bounds, and tables coming from the filter cache
+// must match freshly generated ones.
+// Also times 1080p upscaling with and without threads, RGB565 -> BGR24 scaling converting in the filters or whole frames,
+// and generating filters with and without the cache.
+
+#include "../gfx/scaler/scaler.h"
+#include "../gfx/scaler/pixconv.h"
+#include "../performance.h"
+#include "../general.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+struct global g_extern;
+
+#define BENCH_FRAMES 32
+
+// Runs which actually got split up. Point scaling and tiny frames stay on one thread.
+static unsigned split_runs;
+
+struct size
+{
+   int in_width, in_height;
+   int out_width, out_height;
+};
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+static unsigned bytes_per_pixel(enum scaler_pix_fmt fmt)
+{
+   switch (fmt)
+   {
+      case SCALER_FMT_ARGB8888:
+      case SCALER_FMT_ABGR8888:
+         return 4;
+      case SCALER_FMT_BGR24:
+         return 3;
+      default:
+         return 2;
+   }
+}
+
+static const char *fmt_name(enum scaler_pix_fmt fmt)
+{
+   switch (fmt)
+   {
+      case SCALER_FMT_ARGB8888:
+         return "ARGB8888";
+      case SCALER_FMT_ABGR8888:
+         return "ABGR8888";
+      case SCALER_FMT_0RGB1555:
+         return "0RGB1555";
+      case SCALER_FMT_RGB565:
+         return "RGB565";
+      case SCALER_FMT_BGR24:
+         return "BGR24";
+      default:
+         return "?";
+   }
+}
+
+static const char *type_name(enum scaler_type type)
+{
+   switch (type)
+   {
+      case SCALER_TYPE_POINT:
+         return "point";
+      case SCALER_TYPE_BILINEAR:
+         return "bilinear";
+      case SCALER_TYPE_SINC:
+         return "sinc";
+      case SCALER_TYPE_LANCZOS2:
+         return "lanczos2";
+      case SCALER_TYPE_LANCZOS3:
+         return "lanczos3";
+      case SCALER_TYPE_AREA:
+         return "area";
+      default:
+         return "?";
+   }
+}
+
+// Scales input into a freshly allocated buffer, padding included so stray writes show up too.
+static uint8_t *scale(const struct size *size, enum scaler_type type,
+      enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt, unsigned threads, bool frame_conv,
+      const void *input, int in_stride, int out_stride, bool *pooled)
+{
+   struct scaler_ctx ctx;
+   memset(&ctx, 0, sizeof(ctx));
+
+   ctx.in_width    = size->in_width;
+   ctx.in_height   = size->in_height;
+   ctx.in_stride   = in_stride;
+   ctx.out_width   = size->out_width;
+   ctx.out_height  = size->out_height;
+   ctx.out_stride  = out_stride;
+   ctx.in_fmt      = in_fmt;
+   ctx.out_fmt     = out_fmt;
+   ctx.scaler_type = type;
+   ctx.threads     = threads;
+   ctx.frame_conv  = frame_conv;
+
+   if (!scaler_ctx_gen_filter(&ctx))
+   {
+      scaler_ctx_gen_reset(&ctx);
+      return NULL;
+   }
+
+   uint8_t *output = (uint8_t*)malloc(out_stride * size->out_height);
+   if (output)
+   {
+      memset(output, 0xa5, out_stride * size->out_height);
+      scaler_ctx_scale(&ctx, output, input);
+   }
+
+   *pooled = ctx.pool != NULL;
+   scaler_ctx_gen_reset(&ctx);
+   return output;
+}
+
+// Converts to ARGB8888 with the C converters, scales ARGB8888 -> ARGB8888, and converts back.
+static uint8_t *scale_two_pass(const struct size *size, enum scaler_type type,
+      enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt,
+      const void *input, int in_stride, int out_stride)
+{
+   int argb_in_stride  = size->in_width * 4;
+   int argb_out_stride = size->out_width * 4;
+   uint8_t *argb_in    = (uint8_t*)malloc(argb_in_stride * size->in_height);
+   uint8_t *output     = (uint8_t*)malloc(out_stride * size->out_height);
+   uint8_t *argb_out   = NULL;
+   bool pooled;
+
+   if (!argb_in || !output)
+      goto error;
+
+   pixconv_find(in_fmt, SCALER_FMT_ARGB8888, 0)(argb_in, input,
+         size->in_width, size->in_height, argb_in_stride, in_stride);
+
+   argb_out = scale(size, type, SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888, 0, false,
+         argb_in, argb_in_stride, argb_out_stride, &pooled);
+   if (!argb_out)
+      goto error;
+
+   memset(output, 0xa5, out_stride * size->out_height);
+   pixconv_find(SCALER_FMT_ARGB8888, out_fmt, 0)(output, argb_out,
+         size->out_width, size->out_height, out_stride, argb_out_stride);
+
+   free(argb_in);
+   free(argb_out);
+   return output;
+
+error:
+   free(argb_in);
+   free(argb_out);
+   free(output);
+   return NULL;
+}
+
+static bool test_case(const struct size *size, enum scaler_type type,
+      enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt)
+{
+   static const unsigned threads[] = { 0, 2, 3, 4, 7 };
+
+   // Odd amount of padding, so rows never line up with the frame width.
+   int in_stride  = (size->in_width * bytes_per_pixel(in_fmt) + 19) & ~3;
+   int out_stride = (size->out_width * bytes_per_pixel(out_fmt) + 23) & ~3;
+
+   uint8_t *input = (uint8_t*)malloc(in_stride * size->in_height);
+   if (!input)
+      return false;
+   for (int i = 0; i < in_stride * size->in_height; i++)
+      input[i] = rand();
+
+   bool pooled = false;
+   uint8_t *reference = scale(size, type, in_fmt, out_fmt, 0, false, input, in_stride, out_stride, &pooled);
+   if (!reference)
+   {
+      fprintf(stderr, "Failed to create scaler for %s -> %s.\n", fmt_name(in_fmt), fmt_name(out_fmt));
+      free(input);
+      return false;
+   }
+
+   bool ok = true;
+   bool unscaled = size->in_width == size->out_width && size->in_height == size->out_height;
+   if (!unscaled)
+   {
+      uint8_t *two_pass = scale_two_pass(size, type, in_fmt, out_fmt, input, in_stride, out_stride);
+      if (!two_pass || memcmp(two_pass, reference, out_stride * size->out_height))
+      {
+         fprintf(stderr, "%dx%d -> %dx%d, %s, %s -> %s: does not match converting around ARGB8888 scaling\n",
+               size->in_width, size->in_height, size->out_width, size->out_height,
+               type_name(type), fmt_name(in_fmt), fmt_name(out_fmt));
+         ok = false;
+      }
+      free(two_pass);
+   }
+
+   // Converting whole frames around the filters must give the same result, split or not.
+   for (unsigned frame_conv = 0; frame_conv < 2; frame_conv++)
+   {
+      for (unsigned t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+      {
+         if (!frame_conv && !threads[t])
+            continue; // That's the reference.
+
+         uint8_t *output = scale(size, type, in_fmt, out_fmt, threads[t], frame_conv,
+               input, in_stride, out_stride, &pooled);
+         bool match = output && memcmp(output, reference, out_stride * size->out_height) == 0;
+         free(output);
+
+         if (pooled)
+            split_runs++;
+
+         if (!match)
+         {
+            fprintf(stderr, "%dx%d -> %dx%d, %s, %s -> %s, %u threads%s%s: MISMATCH\n",
+                  size->in_width, size->in_height, size->out_width, size->out_height,
+                  type_name(type), fmt_name(in_fmt), fmt_name(out_fmt),
+                  threads[t], pooled ? "" : " (not split)", frame_conv ? ", whole frame conversion" : "");
+            ok = false;
+         }
+      }
+   }
+
+   free(reference);
+   free(input);
+   return ok;
+}
+
+static void benchmark(enum scaler_type type)
+{
+   static const struct size size = { 320, 240, 1920, 1080 };
+   int in_stride  = size.in_width * 4;
+   int out_stride = size.out_width * 4;
+
+   uint32_t *input  = (uint32_t*)calloc(size.in_width * size.in_height, sizeof(uint32_t));
+   uint32_t *output = (uint32_t*)calloc(size.out_width * size.out_height, sizeof(uint32_t));
+   if (!input || !output)
+      goto end;
+
+   for (unsigned threads = 1; threads <= 4; threads *= 2)
+   {
+      struct scaler_ctx ctx;
+      memset(&ctx, 0, sizeof(ctx));
+      ctx.in_width    = size.in_width;
+      ctx.in_height   = size.in_height;
+      ctx.in_stride   = in_stride;
+      ctx.out_width   = size.out_width;
+      ctx.out_height  = size.out_height;
+      ctx.out_stride  = out_stride;
+      ctx.in_fmt      = SCALER_FMT_ARGB8888;
+      ctx.out_fmt     = SCALER_FMT_ARGB8888;
+      ctx.scaler_type = type;
+      ctx.threads     = threads;
+
+      if (!scaler_ctx_gen_filter(&ctx))
+         break;
+
+      double start = get_time();
+      for (unsigned i = 0; i < BENCH_FRAMES; i++)
+         scaler_ctx_scale(&ctx, output, input);
+      double time = get_time() - start;
+
+      printf("%-8s | %dx%d -> %dx%d | %u thread(s) | %7.2f ms/frame\n",
+            type_name(type), size.in_width, size.in_height, size.out_width, size.out_height,
+            threads, 1000.0 * time / BENCH_FRAMES);
+
+      scaler_ctx_gen_reset(&ctx);
+   }
+
+end:
+   free(input);
+   free(output);
+}
+
+static bool gen_ctx(struct scaler_ctx *ctx, const struct size *size, enum scaler_type type,
+      enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt, int in_stride, int out_stride)
+{
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->in_width    = size->in_width;
+   ctx->in_height   = size->in_height;
+   ctx->in_stride   = in_stride;
+   ctx->out_width   = size->out_width;
+   ctx->out_height  = size->out_height;
+   ctx->out_stride  = out_stride;
+   ctx->in_fmt      = in_fmt;
+   ctx->out_fmt     = out_fmt;
+   ctx->scaler_type = type;
+   return scaler_ctx_gen_filter(ctx);
+}
+
+static bool check_filter(const struct scaler_filter *filter, int in_len, int out_len, bool normalized)
+{
+   for (int i = 0; i < out_len; i++)
+   {
+      if (filter->filter_pos[i] < 0 || filter->filter_pos[i] + (int)filter->filter_len > in_len)
+         return false;
+
+      int sum = 0;
+      for (unsigned j = 0; j < filter->filter_len; j++)
+         sum += filter->filter[i * filter->filter_stride + j];
+      if (normalized && sum != FILTER_UNITY)
+         return false;
+   }
+
+   return true;
+}
+
+static bool same_filter(const struct scaler_filter *a, const struct scaler_filter *b, int out_len)
+{
+   return a->filter_len == b->filter_len && a->filter_stride == b->filter_stride &&
+      !memcmp(a->filter, b->filter, a->filter_stride * out_len * sizeof(int16_t)) &&
+      !memcmp(a->filter_pos, b->filter_pos, out_len * sizeof(int));
+}
+
+static bool test_filters(const enum scaler_type *types, unsigned num_types)
+{
+   static const struct size sizes[] = {
+      { 256, 224, 640, 480 },
+      { 1920, 1080, 320, 240 },
+      { 320, 240, 173, 97 },
+      // Fewer input pixels than taps. Only the windowed filters handle this.
+      { 3, 2, 1000, 1 },
+      { 1000, 1, 3, 2 },
+   };
+
+   bool ok = true;
+   for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      for (unsigned t = 0; t < num_types; t++)
+      {
+         const struct size *size = &sizes[s];
+         // Point, bilinear and sinc are not normalized near the edges.
+         bool windowed = types[t] >= SCALER_TYPE_LANCZOS2;
+         if (!windowed && s >= 3)
+            continue;
+
+         struct scaler_ctx uncached, cached;
+         struct scaler_filter_cache_stats before, after;
+
+         scaler_filter_cache_clear();
+         bool gen_ok = gen_ctx(&uncached, size, types[t], SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+               size->in_width * 4, size->out_width * 4);
+         scaler_filter_cache_get_stats(&before);
+         gen_ok = gen_ctx(&cached, size, types[t], SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888,
+               size->in_width * 4, size->out_width * 4) && gen_ok;
+         scaler_filter_cache_get_stats(&after);
+
+         const char *error = NULL;
+         if (!gen_ok)
+            error = "failed to generate";
+         else if (before.hits != 0 || before.misses != 2 || after.hits != 2 || after.misses != 2)
+            error = "unexpected cache hits and misses";
+         else if (!same_filter(&uncached.horiz, &cached.horiz, size->out_width) ||
+               !same_filter(&uncached.vert, &cached.vert, size->out_height))
+            error = "cached filter differs";
+         else if (!check_filter(&cached.horiz, size->in_width, size->out_width, windowed) ||
+               !check_filter(&cached.vert, size->in_height, size->out_height, windowed))
+            error = "bad filter";
+
+         if (error)
+         {
+            fprintf(stderr, "%dx%d -> %dx%d, %s: %s.\n",
+                  size->in_width, size->in_height, size->out_width, size->out_height, type_name(types[t]), error);
+            ok = false;
+         }
+
+         scaler_ctx_gen_reset(&uncached);
+         scaler_ctx_gen_reset(&cached);
+      }
+   }
+
+   return ok;
+}
+
+// Regenerating a context, like the recorder does whenever the core changes resolution.
+static void benchmark_gen(enum scaler_type type)
+{
+   static const struct size size = { 1920, 1080, 640, 360 };
+   const unsigned runs = 32;
+   double time[2];
+
+   for (unsigned warm = 0; warm < 2; warm++)
+   {
+      scaler_filter_cache_clear();
+
+      double start = get_time();
+      for (unsigned i = 0; i < runs; i++)
+      {
+         if (!warm)
+            scaler_filter_cache_clear();
+
+         struct scaler_ctx ctx;
+         gen_ctx(&ctx, &size, type, SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888, size.in_width * 4, size.out_width * 4);
+         scaler_ctx_gen_reset(&ctx);
+      }
+      time[warm] = get_time() - start;
+   }
+
+   printf("%-8s | %dx%d -> %dx%d | gen_filter | %7.3f ms uncached, %7.3f ms cached\n",
+         type_name(type), size.in_width, size.in_height, size.out_width, size.out_height,
+         1000.0 * time[0] / runs, 1000.0 * time[1] / runs);
+}
+
+// The recording case: RGB565 core output scaled to BGR24 for the encoder,
+// against converting whole frames to and from ARGB8888 around the scaler with the fastest converters.
+// Scaler timings on a busy machine are noisy, so both ways take turns, and the best run of each counts.
+static void benchmark_formats(enum scaler_type type)
+{
+   static const struct size size = { 320, 240, 640, 480 };
+   const unsigned trials = 16;
+   int in_stride  = size.in_width * 2;
+   int out_stride = size.out_width * 3;
+
+   // ctx[0] converts in the filters, ctx[1] converts whole frames around them.
+   struct scaler_ctx ctx[2];
+   bool ok = gen_ctx(&ctx[0], &size, type, SCALER_FMT_RGB565, SCALER_FMT_BGR24, in_stride, out_stride);
+   ok = gen_ctx(&ctx[1], &size, type, SCALER_FMT_RGB565, SCALER_FMT_BGR24, in_stride, out_stride) && ok;
+   ctx[1].frame_conv = true;
+   ok = scaler_ctx_gen_filter(&ctx[1]) && ok;
+
+   uint16_t *input = (uint16_t*)calloc(size.in_width * size.in_height, sizeof(uint16_t));
+   uint8_t *output = (uint8_t*)calloc(size.out_width * size.out_height, 3);
+
+   if (ok && input && output)
+   {
+      for (int i = 0; i < size.in_width * size.in_height; i++)
+         input[i] = rand();
+
+      double best[2] = { 1e9, 1e9 };
+      for (unsigned trial = 0; trial < trials; trial++)
+      {
+         for (unsigned c = 0; c < 2; c++)
+         {
+            double start = get_time();
+            for (unsigned i = 0; i < BENCH_FRAMES / 4; i++)
+               scaler_ctx_scale(&ctx[c], output, input);
+            double time = (get_time() - start) / (BENCH_FRAMES / 4);
+            if (time < best[c])
+               best[c] = time;
+         }
+      }
+
+      printf("%-8s | %dx%d -> %dx%d | RGB565 -> BGR24 | %7.2f ms/frame converting frames, %7.2f ms/frame in the filters (best of %u)\n",
+            type_name(type), size.in_width, size.in_height, size.out_width, size.out_height,
+            1000.0 * best[1], 1000.0 * best[0], trials);
+   }
+
+   scaler_ctx_gen_reset(&ctx[0]);
+   scaler_ctx_gen_reset(&ctx[1]);
+   free(input);
+   free(output);
+}
+
+int main(void)
+{
+   static const struct size sizes[] = {
+      { 256, 224, 640, 480 },
+      { 320, 240, 173, 97 },
+      { 160, 144, 160, 144 }, // Unscaled, only converts.
+      { 640, 480, 1920, 1080 },
+      { 64, 64, 100, 20 }, // Too short to be split.
+   };
+   static const enum scaler_type types[] = {
+      SCALER_TYPE_POINT, SCALER_TYPE_BILINEAR, SCALER_TYPE_SINC,
+      SCALER_TYPE_LANCZOS2, SCALER_TYPE_LANCZOS3, SCALER_TYPE_AREA,
+   };
+   static const enum scaler_pix_fmt in_fmts[] = {
+      SCALER_FMT_ARGB8888, SCALER_FMT_ABGR8888, SCALER_FMT_0RGB1555, SCALER_FMT_RGB565, SCALER_FMT_BGR24,
+   };
+   static const enum scaler_pix_fmt out_fmts[] = {
+      SCALER_FMT_ARGB8888, SCALER_FMT_ABGR8888, SCALER_FMT_0RGB1555, SCALER_FMT_RGB565, SCALER_FMT_BGR24,
+   };
+
+   srand(0);
+   scaler_filter_cache_init();
+
+   bool ok = true;
+   unsigned cases = 0;
+   for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      bool unscaled = sizes[s].in_width == sizes[s].out_width && sizes[s].in_height == sizes[s].out_height;
+
+      for (unsigned t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+      {
+         for (unsigned i = 0; i < sizeof(in_fmts) / sizeof(in_fmts[0]); i++)
+         {
+            for (unsigned o = 0; o < sizeof(out_fmts) / sizeof(out_fmts[0]); o++)
+            {
+               // Unscaled conversion only exists for some pairs, and doesn't care about filter type.
+               if (unscaled && (t > 0 || !pixconv_find(in_fmts[i], out_fmts[o], 0)))
+                  continue;
+
+               ok = test_case(&sizes[s], types[t], in_fmts[i], out_fmts[o]) && ok;
+               cases++;
+            }
+         }
+      }
+   }
+
+   printf("Band scaling: %u cases, %u threaded runs split into bands, %s.\n",
+         cases, split_runs, ok ? "all bit-identical" : "FAILED");
+
+   bool filters_ok = test_filters(types, sizeof(types) / sizeof(types[0]));
+   printf("Filter tables: %s.\n", filters_ok ? "in bounds, normalized, cached copies identical" : "FAILED");
+   ok = filters_ok && ok;
+
+   benchmark(SCALER_TYPE_BILINEAR);
+   benchmark(SCALER_TYPE_SINC);
+   benchmark_formats(SCALER_TYPE_BILINEAR);
+   benchmark_formats(SCALER_TYPE_SINC);
+   benchmark_gen(SCALER_TYPE_LANCZOS3);
+   benchmark_gen(SCALER_TYPE_AREA);
+
+   scaler_filter_cache_deinit();
+   return ok ? 0 : 1;
+}
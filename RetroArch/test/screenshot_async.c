@@ -0,0 +1,158 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Takes screenshots of a 1080p frame as fast as possible, like someone holding down the hotkey.
+// Compares how long the caller is blocked against encoding synchronously,
+// checks that a full queue drops screenshots instead of waiting,
+// and that every accepted screenshot ends up as its own file and is reported through msg_queue.
+
+#include "../screenshot.h"
+#include "../general.h"
+#include "../message.h"
+#include "../file.h"
+#include "../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+struct global g_extern;
+struct settings g_settings;
+
+#define FRAME_WIDTH 1920
+#define FRAME_HEIGHT 1080
+#define SHOTS 16
+
+static unsigned count_files(const char *dir)
+{
+   struct string_list *list = dir_list_new(dir, "png", false);
+   if (!list)
+      return 0;
+   unsigned count = list->size;
+   dir_list_free(list);
+   return count;
+}
+
+static void remove_files(const char *dir)
+{
+   struct string_list *list = dir_list_new(dir, NULL, false);
+   if (!list)
+      return;
+   for (size_t i = 0; i < list->size; i++)
+      remove(list->elems[i].data);
+   dir_list_free(list);
+}
+
+int main(void)
+{
+   char dir[] = "/tmp/rarch-screenshot-XXXXXX";
+   if (!mkdtemp(dir))
+   {
+      fprintf(stderr, "Failed to create temporary directory.\n");
+      return 1;
+   }
+
+   g_extern.msg_queue = msg_queue_new(8);
+   g_extern.system.pix_fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+
+   // Something deflate has to work a bit for.
+   uint32_t *frame = (uint32_t*)malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t));
+   srand(0);
+   for (unsigned i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++)
+      frame[i] = ((i % FRAME_WIDTH) * 0x010203) ^ ((rand() & 7) * 0x010101);
+
+   const uint8_t *bottom = (const uint8_t*)(frame + (FRAME_HEIGHT - 1) * FRAME_WIDTH);
+   int pitch = -(int)(FRAME_WIDTH * sizeof(uint32_t));
+   bool ok = true;
+
+   rarch_time_t start = rarch_get_time_usec();
+   if (!screenshot_dump(dir, bottom, FRAME_WIDTH, FRAME_HEIGHT, pitch, false))
+   {
+      fprintf(stderr, "Synchronous screenshot failed.\n");
+      ok = false;
+   }
+   rarch_time_t sync_time = rarch_get_time_usec() - start;
+   remove_files(dir);
+
+   unsigned accepted = 0;
+   rarch_time_t async_max = 0;
+   rarch_time_t async_total = 0;
+   for (unsigned i = 0; i < SHOTS; i++)
+   {
+      start = rarch_get_time_usec();
+      if (screenshot_dump_async(dir, bottom, FRAME_WIDTH, FRAME_HEIGHT, pitch, false))
+         accepted++;
+      rarch_time_t time = rarch_get_time_usec() - start;
+
+      async_total += time;
+      if (time > async_max)
+         async_max = time;
+   }
+
+   if (accepted == SHOTS)
+   {
+      fprintf(stderr, "Queue took all %u screenshots, it should be bounded.\n", SHOTS);
+      ok = false;
+   }
+
+   unsigned reported = 0;
+   for (unsigned i = 0; i < 30000 && !reported; i++)
+   {
+      if (screenshot_async_poll())
+      {
+         const char *msg = msg_queue_pull(g_extern.msg_queue);
+         if (msg && strstr(msg, "Saved screenshot"))
+            reported++;
+      }
+      else
+         rarch_sleep(1);
+   }
+
+   // Queue has room again once results are collected.
+   if (!screenshot_dump_async(dir, bottom, FRAME_WIDTH, FRAME_HEIGHT, pitch, false))
+   {
+      fprintf(stderr, "Queue didn't free up after polling.\n");
+      ok = false;
+   }
+   else
+      accepted++;
+
+   screenshot_async_deinit();
+
+   unsigned files = count_files(dir);
+   if (files != accepted)
+   {
+      fprintf(stderr, "%u screenshots accepted, but %u files written.\n", accepted, files);
+      ok = false;
+   }
+
+   if (!reported)
+   {
+      fprintf(stderr, "Finished screenshots were never reported.\n");
+      ok = false;
+   }
+
+   printf("screenshot_dump():       %8.2f ms\n", sync_time / 1000.0);
+   printf("screenshot_dump_async(): %8.2f ms avg, %8.2f ms max, %u of %u accepted\n",
+         async_total / (1000.0 * SHOTS), async_max / 1000.0, accepted - 1, SHOTS);
+   printf("%s\n", ok ? "OK" : "FAILED");
+
+   remove_files(dir);
+   rmdir(dir);
+   free(frame);
+   msg_queue_free(g_extern.msg_queue);
+   return ok ? 0 : 1;
+}
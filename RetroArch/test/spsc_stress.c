@@ -0,0 +1,210 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Streams a known byte sequence through spsc_buffer_t from one thread to another in random chunk sizes,
+// and checks that every byte arrives in order. The same is done with fifo_buffer_t behind a lock for comparison.
+
+#include "../spsc_buffer.h"
+#include "../fifo_buffer.h"
+#include "../thread.h"
+#include "../boolean.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#define TOTAL_BYTES (64 * 1024 * 1024)
+#define MAX_CHUNK 4096
+
+// Not a power of two, so the ring has to cap the storage it rounded up to.
+#define BUFFER_SIZE 48000
+
+struct stress
+{
+   spsc_buffer_t *spsc;
+   fifo_buffer_t *fifo;
+   slock_t *lock;
+
+   volatile bool failed;
+};
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+static inline uint8_t stream_byte(size_t pos)
+{
+   return (uint8_t)(pos ^ (pos >> 8) ^ (pos >> 16));
+}
+
+static size_t write_avail(struct stress *s)
+{
+   if (s->spsc)
+      return spsc_write_avail(s->spsc);
+
+   slock_lock(s->lock);
+   size_t avail = fifo_write_avail(s->fifo);
+   slock_unlock(s->lock);
+   return avail;
+}
+
+static size_t read_avail(struct stress *s)
+{
+   if (s->spsc)
+      return spsc_read_avail(s->spsc);
+
+   slock_lock(s->lock);
+   size_t avail = fifo_read_avail(s->fifo);
+   slock_unlock(s->lock);
+   return avail;
+}
+
+static void producer_thread(void *data)
+{
+   struct stress *s = (struct stress*)data;
+   uint8_t chunk[MAX_CHUNK];
+   unsigned seed = 1;
+
+   size_t pos = 0;
+   while (pos < TOTAL_BYTES && !s->failed)
+   {
+      size_t size = 1 + rand_r(&seed) % MAX_CHUNK;
+      if (size > TOTAL_BYTES - pos)
+         size = TOTAL_BYTES - pos;
+
+      size_t avail = write_avail(s);
+      if (avail == 0)
+      {
+         sched_yield();
+         continue;
+      }
+      if (size > avail)
+         size = avail;
+
+      for (size_t i = 0; i < size; i++)
+         chunk[i] = stream_byte(pos + i);
+
+      if (s->spsc)
+         spsc_write(s->spsc, chunk, size);
+      else
+      {
+         slock_lock(s->lock);
+         fifo_write(s->fifo, chunk, size);
+         slock_unlock(s->lock);
+      }
+
+      pos += size;
+   }
+}
+
+static bool consume(struct stress *s)
+{
+   uint8_t chunk[MAX_CHUNK];
+   unsigned seed = 2;
+
+   size_t pos = 0;
+   while (pos < TOTAL_BYTES)
+   {
+      size_t size = 1 + rand_r(&seed) % MAX_CHUNK;
+      size_t avail = read_avail(s);
+      if (avail == 0)
+      {
+         sched_yield();
+         continue;
+      }
+      if (size > avail)
+         size = avail;
+
+      if (s->spsc)
+         spsc_read(s->spsc, chunk, size);
+      else
+      {
+         slock_lock(s->lock);
+         fifo_read(s->fifo, chunk, size);
+         slock_unlock(s->lock);
+      }
+
+      for (size_t i = 0; i < size; i++)
+      {
+         if (chunk[i] != stream_byte(pos + i))
+         {
+            fprintf(stderr, "Byte %lu is out of order.\n", (unsigned long)(pos + i));
+            s->failed = true;
+            return false;
+         }
+      }
+
+      pos += size;
+   }
+
+   return true;
+}
+
+static bool run(struct stress *s, const char *name)
+{
+   double start = get_time();
+   sthread_t *thread = sthread_create(producer_thread, s);
+   if (!thread)
+      return false;
+
+   bool ok = consume(s);
+   sthread_join(thread);
+   double time = get_time() - start;
+
+   if (ok && read_avail(s) != 0)
+   {
+      fprintf(stderr, "Data left over in buffer.\n");
+      ok = false;
+   }
+
+   printf("%-12s | %8.1f MB/s | %s\n", name, TOTAL_BYTES / (time * 1024.0 * 1024.0), ok ? "OK" : "FAILED");
+   return ok;
+}
+
+int main(void)
+{
+   struct stress s;
+   memset(&s, 0, sizeof(s));
+
+   s.spsc = spsc_new(BUFFER_SIZE);
+   if (!s.spsc)
+      return 1;
+
+   if (spsc_write_avail(s.spsc) != BUFFER_SIZE)
+   {
+      fprintf(stderr, "Expected %u bytes free, got %lu.\n", BUFFER_SIZE, (unsigned long)spsc_write_avail(s.spsc));
+      return 1;
+   }
+
+   bool ok = run(&s, "spsc");
+   spsc_free(s.spsc);
+   s.spsc = NULL;
+
+   s.fifo = fifo_new(BUFFER_SIZE);
+   s.lock = slock_new();
+   if (!s.fifo || !s.lock)
+      return 1;
+
+   ok = run(&s, "fifo + lock") && ok;
+   fifo_free(s.fifo);
+   slock_free(s.lock);
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2013 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Pushes numbered frames through the threaded video wrapper into the null video driver.
+// Every pixel of a frame holds its number, so the driver can check that it never sees a torn frame,
+// and that frames only ever move forward. Checks the dropped, duplicated and rendered counters add up,
+// and that the newest frame always makes it to the screen.
+// Also times thread_frame() against a driver that is much slower than the core,
+// and with the core rendering straight into the wrapper's buffer.
+
+#include "../gfx/thread_wrapper.h"
+#include "../general.h"
+#include "../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+struct global g_extern;
+
+#define FRAME_WIDTH 256
+#define FRAME_HEIGHT 224
+
+extern const video_driver_t video_null;
+
+// Only touched by the video thread, read once it is drained.
+static struct
+{
+   unsigned render_delay_ms;
+   uint32_t last_id;
+   unsigned frames;
+   unsigned dupes;
+   bool torn;
+   bool backwards;
+} seen;
+
+static bool test_frame(void *data, const void *frame,
+      unsigned width, unsigned height, unsigned pitch, const char *msg)
+{
+   if (frame)
+   {
+      const uint32_t *pixels = (const uint32_t*)frame;
+      uint32_t id = pixels[0];
+
+      for (unsigned y = 0; y < height; y++)
+         for (unsigned x = 0; x < width; x++)
+            if (pixels[y * (pitch >> 2) + x] != id)
+               seen.torn = true;
+
+      if (id <= seen.last_id)
+         seen.backwards = true;
+      seen.last_id = id;
+      seen.frames++;
+   }
+   else
+      seen.dupes++;
+
+   if (seen.render_delay_ms)
+      rarch_sleep(seen.render_delay_ms);
+
+   return video_null.frame(data, frame, width, height, pitch, msg);
+}
+
+static const video_poke_interface_t test_poke;
+
+static void test_poke_interface(void *data, const video_poke_interface_t **iface)
+{
+   *iface = &test_poke;
+}
+
+static void wait_drained(void *thr, struct rarch_threaded_video_stats *stats)
+{
+   for (unsigned i = 0; i < 2000; i++)
+   {
+      rarch_threaded_video_get_stats(thr, stats);
+      if (stats->rendered + stats->dropped == stats->frames)
+         return;
+      rarch_sleep(1);
+   }
+}
+
+static bool check_stats(const char *name, const struct rarch_threaded_video_stats *stats,
+      unsigned dupes_sent, uint32_t last_id)
+{
+   bool ok = true;
+
+   if (stats->rendered + stats->dropped != stats->frames)
+   {
+      fprintf(stderr, "%s: %llu rendered and %llu dropped out of %llu frames.\n", name,
+            (unsigned long long)stats->rendered, (unsigned long long)stats->dropped,
+            (unsigned long long)stats->frames);
+      ok = false;
+   }
+
+   if (stats->duplicated != seen.dupes || stats->rendered != seen.frames + seen.dupes || seen.dupes > dupes_sent)
+   {
+      fprintf(stderr, "%s: counters don't match what the driver got.\n", name);
+      ok = false;
+   }
+
+   if (seen.torn || seen.backwards)
+   {
+      fprintf(stderr, "%s: driver got %s.\n", name, seen.torn ? "a torn frame" : "an older frame after a newer one");
+      ok = false;
+   }
+
+   if (seen.last_id != last_id)
+   {
+      fprintf(stderr, "%s: last frame shown is %u, expected %u.\n", name, seen.last_id, last_id);
+      ok = false;
+   }
+
+   printf("%-12s | %5llu frames | %5llu rendered | %5llu dropped | %3llu duplicated | %6.2f ms avg latency, %6.2f ms max | %s\n",
+         name, (unsigned long long)stats->frames, (unsigned long long)stats->rendered,
+         (unsigned long long)stats->dropped, (unsigned long long)stats->duplicated,
+         stats->rendered ? stats->latency_total_usec / (1000.0 * stats->rendered) : 0.0,
+         stats->latency_max_usec / 1000.0, ok ? "OK" : "FAILED");
+
+   return ok;
+}
+
+// Sends frames frames, every dupe_interval-th one as a dupe, sleeping core_delay_ms in between.
+// With zero_copy, frames are rendered into the buffer the wrapper hands out instead.
+static bool run(const char *name, unsigned frames, unsigned dupe_interval,
+      unsigned core_delay_ms, unsigned render_delay_ms, bool zero_copy)
+{
+   video_driver_t driver = video_null;
+   driver.frame = test_frame;
+   driver.poke_interface = test_poke_interface;
+
+   memset(&seen, 0, sizeof(seen));
+   seen.render_delay_ms = render_delay_ms;
+
+   video_info_t info = {0};
+   info.width       = FRAME_WIDTH;
+   info.height      = FRAME_HEIGHT;
+   info.rgb32       = true;
+   info.input_scale = 1;
+
+   const video_driver_t *thread_driver = NULL;
+   void *thr = NULL;
+   const input_driver_t *input = NULL;
+   void *input_data = NULL;
+
+   if (!rarch_threaded_video_init(&thread_driver, &thr, &input, &input_data, &driver, &info, false))
+   {
+      fprintf(stderr, "%s: failed to start threaded video.\n", name);
+      return false;
+   }
+
+   const video_poke_interface_t *poke = NULL;
+   thread_driver->poke_interface(thr, &poke);
+
+   uint32_t *frame = (uint32_t*)malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t));
+   bool ok = true;
+   uint32_t last_id = 0;
+   unsigned dupes_sent = 0;
+   rarch_time_t frame_total = 0;
+   rarch_time_t frame_max = 0;
+
+   for (unsigned i = 1; i <= frames; i++)
+   {
+      bool dupe = dupe_interval && i % dupe_interval == 0;
+      uint32_t *pixels = frame;
+      size_t pitch = FRAME_WIDTH * sizeof(uint32_t);
+
+      if (zero_copy && !dupe)
+      {
+         struct retro_framebuffer fb = {0};
+         fb.width = FRAME_WIDTH;
+         fb.height = FRAME_HEIGHT;
+         fb.access_flags = RETRO_MEMORY_ACCESS_WRITE;
+         if (!poke || !poke->get_current_software_framebuffer(thr, &fb) ||
+               fb.format != RETRO_PIXEL_FORMAT_XRGB8888 || fb.pitch != pitch)
+         {
+            fprintf(stderr, "%s: didn't get a framebuffer.\n", name);
+            ok = false;
+            break;
+         }
+         pixels = (uint32_t*)fb.data;
+      }
+
+      if (!dupe)
+      {
+         for (unsigned p = 0; p < FRAME_WIDTH * FRAME_HEIGHT; p++)
+            pixels[p] = i;
+         last_id = i;
+      }
+      else
+         dupes_sent++;
+
+      rarch_time_t start = rarch_get_time_usec();
+      thread_driver->frame(thr, dupe ? NULL : pixels, FRAME_WIDTH, FRAME_HEIGHT, pitch, NULL);
+      rarch_time_t time = rarch_get_time_usec() - start;
+
+      frame_total += time;
+      if (time > frame_max)
+         frame_max = time;
+
+      if (core_delay_ms)
+         rarch_sleep(core_delay_ms);
+   }
+
+   struct rarch_threaded_video_stats stats;
+   wait_drained(thr, &stats);
+   ok = check_stats(name, &stats, dupes_sent, last_id) && ok;
+
+   printf("%-12s | thread_frame(): %.3f ms avg, %.3f ms max\n", name,
+         frame_total / (1000.0 * frames), frame_max / 1000.0);
+
+   thread_driver->free(thr);
+   free(frame);
+   return ok;
+}
+
+int main(void)
+{
+   bool ok = true;
+
+   // Core much faster than the display. Most frames get dropped, but the core never waits.
+   ok = run("slow display", 300, 0, 1, 4, false) && ok;
+   // Display keeps up, so there should be (almost) nothing to drop.
+   ok = run("fast display", 200, 0, 2, 0, false) && ok;
+   // Core sends dupes, which are only rendered when they don't hide a newer frame.
+   ok = run("dupes", 200, 3, 2, 0, false) && ok;
+   ok = run("dupes, slow", 300, 2, 1, 3, false) && ok;
+   // Both sides as fast as they can go, to shake out races.
+   ok = run("flood", 3000, 7, 0, 0, false) && ok;
+   // Core renders into the wrapper's buffer, so thread_frame() has nothing to copy.
+   ok = run("zero copy", 3000, 7, 0, 0, true) && ok;
+
+   return ok ? 0 : 1;
+}